@@ -580,6 +580,18 @@ ssize_t ArmArchVmAspace<paf>::UnmapPageTable(vaddr_t vaddr, vaddr_t vaddr_rel, s
 
     pte = page_table[index];
 
+    if (index_shift > page_size_shift &&
+        (pte & MMU_PTE_DESCRIPTOR_MASK) == MMU_PTE_L012_DESCRIPTOR_BLOCK &&
+        chunk_size != block_size) {
+      // Split the block so that the rest of it stays mapped. If the split
+      // fails the whole block is unmapped below, and a subsequent page fault
+      // maps the rest again.
+      if (likely(SplitLargePage(vaddr, index_shift, page_size_shift, index, page_table) ==
+                 ZX_OK)) {
+        pte = page_table[index];
+      }
+    }
+
     if (index_shift > page_size_shift &&
         (pte & MMU_PTE_DESCRIPTOR_MASK) == MMU_PTE_L012_DESCRIPTOR_TABLE) {
       page_table_paddr = pte & MMU_PTE_OUTPUT_ADDR_MASK;
@@ -98,6 +98,9 @@ class X86ArchVmAspace final : public ArchVmAspaceInterface {
   zx_status_t Protect(vaddr_t vaddr, size_t count, uint mmu_flags) override;
   zx_status_t Query(vaddr_t vaddr, paddr_t* paddr, uint* mmu_flags) override;
 
+  void DeferInvalidations() override { pt_->DeferInvalidations(); }
+  void FlushDeferredInvalidations() override { pt_->FlushDeferredInvalidations(); }
+
   vaddr_t PickSpot(vaddr_t base, uint prev_region_mmu_flags, vaddr_t end,
                    uint next_region_mmu_flags, vaddr_t align, size_t size, uint mmu_flags) override;
 
@@ -107,6 +110,13 @@ class X86ArchVmAspace final : public ArchVmAspaceInterface {
 
   int active_cpus() { return active_cpus_.load(); }
 
+  // Identifies this aspace in the per-cpu PCID caches, or 0 if it does not use PCIDs.
+  uint64_t pcid_id() const { return pcid_id_; }
+  // CPUs which switched to this aspace since the last TLB invalidation which left them out.
+  ktl::atomic<int>& pcid_cpus() { return pcid_cpus_; }
+  // Number of TLB invalidations of this aspace, if it uses PCIDs.
+  ktl::atomic<uint64_t>& tlb_generation() { return tlb_generation_; }
+
   IoBitmap& io_bitmap() { return io_bitmap_; }
 
   static void ContextSwitch(X86ArchVmAspace* from, X86ArchVmAspace* to);
@@ -137,6 +147,19 @@ class X86ArchVmAspace final : public ArchVmAspaceInterface {
   // CPUs that are currently executing in this aspace.
   // Actually an mp_cpu_mask_t, but header dependencies.
   ktl::atomic<int> active_cpus_{0};
+
+  // Unique across all aspaces for the life of the system, so that a PCID cached for a destroyed
+  // aspace is never mistaken for one assigned to a new aspace.
+  uint64_t pcid_id_ = 0;
+
+  // Actually an mp_cpu_mask_t, like |active_cpus_|. A superset of |active_cpus_|: a cpu is added
+  // when it switches to this aspace and removed when a TLB invalidation leaves it to catch up on
+  // its next switch instead of interrupting it. Only used to count those invalidations.
+  ktl::atomic<int> pcid_cpus_{0};
+
+  // A cpu which finds this moved on since it last switched to this aspace, or last caught up
+  // with an invalidation of it, flushes the entries tagged with its PCID.
+  ktl::atomic<uint64_t> tlb_generation_{0};
 };
 
 using ArchVmAspace = X86ArchVmAspace<pmm_alloc_page>;
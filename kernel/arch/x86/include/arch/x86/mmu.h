@@ -71,6 +71,9 @@
 
 #define X86_PAGING_LEVELS 4
 
+/* bits of CR3 holding the PCID of the active address space when CR4.PCIDE is set */
+#define X86_CR3_PCID_MASK 0xfffUL
+
 #define MMU_GUEST_SIZE_SHIFT 48
 
 /* page fault error code flags */
@@ -20,7 +20,9 @@
 #include <arch/x86/descriptor.h>
 #include <arch/x86/feature.h>
 #include <arch/x86/mmu_mem_types.h>
+#include <kernel/align.h>
 #include <kernel/mp.h>
+#include <ktl/atomic.h>
 #include <lib/cmdline.h>
 #include <vm/arch_vm_aspace.h>
 #include <vm/physmap.h>
@@ -38,6 +40,13 @@ KCOUNTER(tlb_invalidations_received, "mmu.tlb_invalidation_batches_received")
 KCOUNTER(tlb_invalidations_full_global_received, "mmu.tlb_invalidation_full_global_received")
 // Count of the number of TLB invalidation requests for all non-global entries on each CPU
 KCOUNTER(tlb_invalidations_full_nonglobal_received, "mmu.tlb_invalidation_full_nonglobal_received")
+// Count of the number of CPUs left out of batches of TLB invalidations for a user aspace they
+// were not running, which catch up with it the next time they switch to it instead
+KCOUNTER(tlb_invalidation_ipis_deferred, "mmu.tlb_invalidation_ipis_deferred")
+// Count of the number of switches to a user aspace which kept its TLB entries from a cached PCID
+KCOUNTER(context_switch_pcid_kept, "mmu.context_switch_pcid_kept")
+// Count of the number of switches to a user aspace which flushed its TLB entries
+KCOUNTER(context_switch_pcid_flushed, "mmu.context_switch_pcid_flushed")
 
 /* Default address width including virtual/physical address.
  * newer versions fetched below */
@@ -50,6 +59,9 @@ int g_enable_isolation = -1;
 /* True if the system supports 1GB pages */
 static bool supports_huge_pages = false;
 
+/* True if user address spaces are tagged with PCIDs */
+static bool use_pcid = false;
+
 /* top level kernel page tables, initialized in start.S */
 volatile pt_entry_t pml4[NO_OF_PT_ENTRIES] __ALIGNED(PAGE_SIZE);
 volatile pt_entry_t pdp[NO_OF_PT_ENTRIES] __ALIGNED(PAGE_SIZE); /* temporary */
@@ -139,8 +151,10 @@ bool x86_mmu_check_paddr(paddr_t paddr) {
 static void x86_tlb_global_invalidate() {
   /* See Intel 3A section 4.10.4.1 */
   ulong cr4 = x86_get_cr4();
-  if (likely(cr4 & X86_CR4_PGE)) {
-    x86_set_cr4(cr4 & ~X86_CR4_PGE);
+  if (likely(cr4 & (X86_CR4_PGE | X86_CR4_PCIDE))) {
+    /* Toggling PGE invalidates the entries of every PCID, whereas reloading CR3 would only
+     * invalidate those of the current one. */
+    x86_set_cr4(cr4 ^ X86_CR4_PGE);
     x86_set_cr4(cr4);
   } else {
     x86_set_cr3(x86_get_cr3());
@@ -152,9 +166,99 @@ static void x86_tlb_global_invalidate() {
  */
 static void x86_tlb_nonglobal_invalidate() { x86_set_cr3(x86_get_cr3()); }
 
+/* PCIDs 1 through kPcidCount are assigned to user address spaces by each CPU, least recently
+ * assigned first. PCID 0 is used by the kernel address space. A CPU only assigns, looks up and
+ * updates PCIDs in its own cache, with interrupts disabled.
+ *
+ * Along with each PCID, a CPU records the TLB generation of the aspace up to which the entries
+ * tagged with it are current. TLB invalidations for an aspace only interrupt the CPUs it is
+ * active on; the others find that its generation moved on when they next switch to it, and
+ * flush its entries then. */
+static constexpr uint kPcidCount = 8;
+static_assert(kPcidCount < (1u << X86_PCID_BITS), "");
+
+/* A generation no aspace reaches, marking the entries tagged with a PCID stale. */
+static constexpr uint64_t kPcidStaleGeneration = UINT64_MAX;
+
+struct PcidCache {
+  /* pcid_id() of the aspace whose entries are tagged with PCID i + 1, or 0 */
+  uint64_t aspace_ids[kPcidCount];
+  /* tlb_generation() of that aspace up to which those entries are current */
+  uint64_t generations[kPcidCount];
+  /* index of the next PCID to assign */
+  uint next;
+  /* true if the entries tagged with the kernel's PCID 0 must be flushed on the next switch */
+  bool kernel_stale;
+} __CPU_ALIGN;
+
+static PcidCache pcid_caches[SMP_MAX_CPUS];
+
+/* Source of X86ArchVmAspace::pcid_id() values. */
+static ktl::atomic<uint64_t> next_pcid_aspace_id{1};
+
+/* Returns the PCID of the aspace |id| on the current CPU, assigning one if needed, and marks
+ * its entries current up to |generation|. Sets |*flush| if the entries tagged with it must be
+ * invalidated first, because it was just assigned, or because the aspace's generation moved on
+ * since. */
+static ulong x86_pcid_get(uint64_t id, uint64_t generation, bool* flush) {
+  DEBUG_ASSERT(arch_ints_disabled());
+  PcidCache& cache = pcid_caches[arch_curr_cpu_num()];
+  for (uint i = 0; i < kPcidCount; i++) {
+    if (cache.aspace_ids[i] == id) {
+      *flush = cache.generations[i] != generation;
+      cache.generations[i] = generation;
+      return i + 1;
+    }
+  }
+  uint i = cache.next;
+  cache.next = (i + 1) % kPcidCount;
+  cache.aspace_ids[i] = id;
+  cache.generations[i] = generation;
+  *flush = true;
+  return i + 1;
+}
+
+/* Marks the entries of the aspace |id| on the current CPU current up to |generation|, if it has
+ * a PCID here. */
+static void x86_pcid_sync(uint64_t id, uint64_t generation) {
+  DEBUG_ASSERT(arch_ints_disabled());
+  PcidCache& cache = pcid_caches[arch_curr_cpu_num()];
+  for (uint i = 0; i < kPcidCount; i++) {
+    if (cache.aspace_ids[i] == id) {
+      cache.generations[i] = generation;
+    }
+  }
+}
+
+/* Marks the entries tagged with every PCID on the current CPU stale, so that they are flushed
+ * when next switched to.  Invalidating kernel pages with invlpg only removes the paging-structure
+ * cache entries of the current PCID, and those of the other PCIDs may still walk through kernel
+ * page tables that were freed. */
+static void x86_pcid_mark_all_stale() {
+  DEBUG_ASSERT(arch_ints_disabled());
+  PcidCache& cache = pcid_caches[arch_curr_cpu_num()];
+  for (uint i = 0; i < kPcidCount; i++) {
+    cache.generations[i] = kPcidStaleGeneration;
+  }
+  cache.kernel_stale = true;
+}
+
+/* Returns whether the entries of the kernel's PCID 0 on the current CPU must be flushed on a
+ * switch to it, and marks them current. */
+static bool x86_pcid_kernel_flush() {
+  DEBUG_ASSERT(arch_ints_disabled());
+  PcidCache& cache = pcid_caches[arch_curr_cpu_num()];
+  bool flush = cache.kernel_stale;
+  cache.kernel_stale = false;
+  return flush;
+}
+
 /* Task used for invalidating a TLB entry on each CPU */
 struct TlbInvalidatePage_context {
   ulong target_cr3;
+  /* PCID of the target aspace, if it uses PCIDs, and its TLB generation after this invalidation */
+  uint64_t pcid_id;
+  uint64_t tlb_generation;
   const PendingTlbInvalidation* pending;
 };
 static void TlbInvalidatePage_task(void* raw_context) {
@@ -163,10 +267,17 @@ static void TlbInvalidatePage_task(void* raw_context) {
 
   kcounter_add(tlb_invalidations_received, 1);
 
-  ulong cr3 = x86_get_cr3();
-  if (context->target_cr3 != cr3 && !context->pending->contains_global) {
-    /* This invalidation doesn't apply to this CPU, ignore it */
-    return;
+  ulong cr3 = x86_get_cr3() & ~X86_CR3_PCID_MASK;
+  if (context->target_cr3 != cr3) {
+    if (!context->pending->contains_global) {
+      /* This invalidation doesn't apply to this CPU, ignore it.  If the target aspace has
+       * entries tagged with a PCID here, the next switch to it flushes them. */
+      return;
+    }
+  } else if (context->pcid_id != 0) {
+    /* Invalidations sent before this one were done here while the target aspace was active,
+     * so its entries are current once this one is done. */
+    x86_pcid_sync(context->pcid_id, context->tlb_generation);
   }
 
   if (context->pending->full_shootdown) {
@@ -192,6 +303,10 @@ static void TlbInvalidatePage_task(void* raw_context) {
         break;
     }
   }
+
+  if (context->pending->contains_global && use_pcid) {
+    x86_pcid_mark_all_stale();
+  }
 }
 
 /**
@@ -203,30 +318,44 @@ static void TlbInvalidatePage_task(void* raw_context) {
 template <page_alloc_fn_t paf>
 static void x86_tlb_invalidate_page(const X86PageTableBase<paf>* pt,
                                     PendingTlbInvalidation* pending) {
-  if (pending->count == 0) {
+  if (pending->count == 0 && !pending->full_shootdown) {
     return;
   }
 
   kcounter_add(tlb_invalidations_sent, 1);
 
-  ulong cr3 = pt ? pt->phys() : x86_get_cr3();
+  ulong cr3 = pt ? pt->phys() : (x86_get_cr3() & ~X86_CR3_PCID_MASK);
+  X86ArchVmAspace<paf>* aspace =
+      pt ? static_cast<X86ArchVmAspace<paf>*>(pt->ctx()) : nullptr;
+  uint64_t pcid_id = aspace ? aspace->pcid_id() : 0;
+  /* Invalidations of a page table are serialized by its lock, so each generation is
+   * only done once the previous one is done on every CPU it was sent to. */
+  uint64_t tlb_generation = pcid_id ? aspace->tlb_generation().fetch_add(1) + 1 : 0;
   struct TlbInvalidatePage_context task_context = {
       .target_cr3 = cr3,
+      .pcid_id = pcid_id,
+      .tlb_generation = tlb_generation,
       .pending = pending,
   };
 
   /* Target only CPUs this aspace is active on.  It may be the case that some
    * other CPU will become active in it after this load, or will have left it
    * just before this load.  In the former case, it is becoming active after
-   * the write to the page table, so it will see the change.  In the latter
-   * case, it will get a spurious request to flush. */
+   * the write to the page table and the new generation, and flushes.  In the
+   * latter case, it will get a spurious request to flush.  CPUs which still
+   * hold entries tagged with a PCID of this aspace flush them when they next
+   * switch to it, as they find its generation moved on. */
   mp_ipi_target_t target;
   cpu_mask_t target_mask = 0;
   if (pending->contains_global || pt == nullptr) {
     target = MP_IPI_TARGET_ALL;
   } else {
     target = MP_IPI_TARGET_MASK;
-    target_mask = static_cast<X86ArchVmAspace<paf>*>(pt->ctx())->active_cpus();
+    target_mask = aspace->active_cpus();
+    if (pcid_id) {
+      cpu_mask_t deferred = aspace->pcid_cpus().fetch_and(target_mask) & ~target_mask;
+      kcounter_add(tlb_invalidation_ipis_deferred, __builtin_popcount(deferred));
+    }
   }
 
   mp_sync_exec(target, target_mask, TlbInvalidatePage_task, &task_context);
@@ -549,6 +678,17 @@ void x86_mmu_init(void) {
                        ((pti_enable == 2) && g_has_meltdown);
   printf("Kernel PTI %s\n", g_enable_isolation ? "enabled" : "disabled");
 
+  // Tag user address spaces with PCIDs only while kernel mappings are global, so that changing
+  // a kernel mapping never needs to invalidate it for every PCID. All other CPUs will do this in
+  // x86_mmu_percpu_init.
+  if (!g_enable_isolation) {
+    spin_lock_saved_state_t state;
+    arch_interrupt_save(&state, 0);
+    use_pcid = x86_enable_pcid();
+    arch_interrupt_restore(state, 0);
+  }
+  printf("PCID %s\n", use_pcid ? "enabled" : "disabled");
+
   // TODO(crbug.com/fuchsia/31415): Currently KPTI disables Global pages; we might be able to do
   // better, to use global pages for all user-pages, to avoid implicit TLB entry invalidations
   // on user<->kernel transitions.
@@ -660,6 +800,10 @@ zx_status_t X86ArchVmAspace<paf>::Init(vaddr_t base, size_t size, uint mmu_flags
       return status;
     }
 
+    if (use_pcid) {
+      pcid_id_ = next_pcid_aspace_id.fetch_add(1);
+    }
+
     LTRACEF("user aspace: pt phys %#" PRIxPTR ", virt %p\n", pt_->phys(), pt_->virt());
   }
   ktl::atomic_init(&active_cpus_, 0);
@@ -721,15 +865,33 @@ void X86ArchVmAspace<paf>::ContextSwitch(X86ArchVmAspace* old_aspace, X86ArchVmA
     aspace->canary_.Assert();
     paddr_t phys = aspace->pt_phys();
     LTRACEF_LEVEL(3, "switching to aspace %p, pt %#" PRIXPTR "\n", aspace, phys);
-    x86_set_cr3(phys);
+    ulong cr3 = phys;
+    // Become active before loading the TLB generation: an invalidation which does not see this
+    // CPU active advanced the generation first, so the load sees it and the entries are flushed.
+    aspace->active_cpus_.fetch_or(cpu_bit);
+    if (aspace->pcid_id_ != 0) {
+      aspace->pcid_cpus_.fetch_or(cpu_bit);
+      bool flush;
+      cr3 |= x86_pcid_get(aspace->pcid_id_, aspace->tlb_generation_.load(), &flush);
+      if (flush) {
+        kcounter_add(context_switch_pcid_flushed, 1);
+      } else {
+        kcounter_add(context_switch_pcid_kept, 1);
+        cr3 |= 1UL << X86_PCID_CR3_SAVE_ENTRIES;
+      }
+    }
+    x86_set_cr3(cr3);
 
     if (old_aspace != nullptr) {
       old_aspace->active_cpus_.fetch_and(~cpu_bit);
     }
-    aspace->active_cpus_.fetch_or(cpu_bit);
   } else {
     LTRACEF_LEVEL(3, "switching to kernel aspace, pt %#" PRIxPTR "\n", kernel_pt_phys);
-    x86_set_cr3(kernel_pt_phys);
+    // The kernel aspace's PCID 0 only holds global entries, which are never flushed by CR3 loads,
+    // but its paging-structure caches are flushed after kernel page invalidations.
+    x86_set_cr3(use_pcid && !x86_pcid_kernel_flush()
+                    ? (kernel_pt_phys | (1UL << X86_PCID_CR3_SAVE_ENTRIES))
+                    : kernel_pt_phys);
     if (old_aspace != nullptr) {
       old_aspace->active_cpus_.fetch_and(~cpu_bit);
     }
@@ -778,6 +940,11 @@ void x86_mmu_percpu_init(void) {
   if (g_enable_isolation == 1) {
     disable_global_pages();
   }
+
+  // Likewise, this is only set on CPU 0 after this runs there.
+  if (use_pcid) {
+    x86_enable_pcid();
+  }
 }
 
 template <page_alloc_fn_t paf>
@@ -139,6 +139,16 @@ void x86_pat_sync(cpu_mask_t targets) {
   }
 }
 
+/* Flush the TLB entries of every PCID, with the PGE flag clear.  Reloading CR3
+ * would only flush those of the current PCID, whereas any change to the PGE
+ * flag flushes them all. */
+static void x86_pat_flush_tlb() {
+  ulong cr4 = x86_get_cr4();
+  DEBUG_ASSERT(!(cr4 & X86_CR4_PGE));
+  x86_set_cr4(cr4 | X86_CR4_PGE);
+  x86_set_cr4(cr4);
+}
+
 static void x86_pat_sync_task(void* raw_context) {
   /* Step 2: Disable interrupts */
   DEBUG_ASSERT(arch_ints_disabled());
@@ -169,9 +179,9 @@ static void x86_pat_sync_task(void* raw_context) {
   cr4 &= ~X86_CR4_PGE;
   x86_set_cr4(cr4);
 
-  /* Step 7: If the PGE flag wasn't set, flush the TLB via CR3 */
+  /* Step 7: If the PGE flag wasn't set, flush the TLB */
   if (!pge_was_set) {
-    x86_set_cr3(x86_get_cr3());
+    x86_pat_flush_tlb();
   }
 
   /* Step 8: Disable MTRRs */
@@ -216,7 +226,7 @@ static void x86_pat_sync_task(void* raw_context) {
 
   /* Step 11: Flush all cache and the TLB again */
   __asm volatile("wbinvd" ::: "memory");
-  x86_set_cr3(x86_get_cr3());
+  x86_pat_flush_tlb();
 
   /* Step 12: Enter the normal cache mode */
   cr0 = x86_get_cr0();
@@ -10,6 +10,7 @@
 #include <fbl/canary.h>
 #include <fbl/mutex.h>
 #include <hwreg/bitfields.h>
+#include <list.h>
 // Needed for ARCH_MMU_FLAG_*
 #include <vm/arch_vm_aspace.h>
 
@@ -55,6 +56,9 @@ struct PendingTlbInvalidation {
   // Clear the list of pending invalidations
   void clear();
 
+  // Add the invalidations pending in |other| to this one, and clear |other|.
+  void merge(PendingTlbInvalidation* other);
+
   ~PendingTlbInvalidation();
 };
 
@@ -92,6 +96,12 @@ class X86PageTableBase {
 
   zx_status_t QueryVaddr(vaddr_t vaddr, paddr_t* paddr, uint* mmu_flags);
 
+  // Hold back the TLB invalidations of the calling thread's changes to the page tables, and the
+  // freeing of page tables they release, until FlushDeferredInvalidations(). Changes made by any
+  // other thread in the meantime send the held back invalidations along with their own.
+  void DeferInvalidations();
+  void FlushDeferredInvalidations();
+
  protected:
   // Initialize an empty page table, assigning this given context to it.
   zx_status_t Init(void* ctx);
@@ -181,6 +191,12 @@ class X86PageTableBase {
 
   // low lock to protect the mmu code
   DECLARE_MUTEX(X86PageTableBase) lock_;
+
+  // Thread holding back invalidations with DeferInvalidations(), or nullptr.
+  const struct thread_t* deferring_thread_ TA_GUARDED(lock_) = nullptr;
+  // Invalidations held back, and the page tables to free once they are done.
+  PendingTlbInvalidation deferred_tlb_ TA_GUARDED(lock_);
+  list_node deferred_free_ TA_GUARDED(lock_) = LIST_INITIAL_VALUE(deferred_free_);
 };
 
 #endif  // ZIRCON_KERNEL_ARCH_X86_PAGE_TABLES_INCLUDE_ARCH_X86_PAGE_TABLES_PAGE_TABLES_H_
@@ -5,6 +5,7 @@
 // https://opensource.org/licenses/MIT
 
 #include <assert.h>
+#include <lib/counters.h>
 #include <trace.h>
 
 #include <arch/x86/feature.h>
@@ -12,11 +13,15 @@
 #include <arch/x86/page_tables/page_tables.h>
 #include <fbl/algorithm.h>
 #include <fbl/auto_call.h>
+#include <kernel/thread.h>
 #include <vm/physmap.h>
 #include <vm/pmm.h>
 
 #define LOCAL_TRACE 0
 
+// Count of the number of batches of TLB invalidations held back to be sent with a later batch
+KCOUNTER(tlb_invalidations_deferred, "mmu.tlb_invalidation_batches_deferred")
+
 namespace {
 
 // Return the page size for this level
@@ -110,6 +115,21 @@ void PendingTlbInvalidation::clear() {
   contains_global = false;
 }
 
+void PendingTlbInvalidation::merge(PendingTlbInvalidation* other) {
+  if (other->contains_global) {
+    contains_global = true;
+  }
+
+  if (other->full_shootdown || count + other->count > fbl::count_of(item)) {
+    full_shootdown = true;
+  } else if (!full_shootdown) {
+    for (uint i = 0; i < other->count; ++i) {
+      item[count++] = other->item[i];
+    }
+  }
+  other->clear();
+}
+
 PendingTlbInvalidation::~PendingTlbInvalidation() { DEBUG_ASSERT(count == 0); }
 
 // Utility for coalescing cache line flushes when modifying page tables.  This
@@ -213,6 +233,7 @@ X86PageTableBase<paf>::ConsistencyManager::~ConsistencyManager() {
 template <page_alloc_fn_t paf>
 void X86PageTableBase<paf>::ConsistencyManager::Finish() {
   DEBUG_ASSERT(pt_->lock_.lock().IsHeld());
+  AssertHeld(pt_->lock_);
 
   clf_.ForceFlush();
   if (pt_->needs_cache_flushes()) {
@@ -221,6 +242,23 @@ void X86PageTableBase<paf>::ConsistencyManager::Finish() {
     // invalidations.
     mb();
   }
+
+  if (pt_->deferring_thread_ == get_current_thread()) {
+    // Hold the invalidations back, along with the page tables which must not
+    // be freed before they are done.
+    if (tlb_.count != 0 || tlb_.full_shootdown) {
+      kcounter_add(tlb_invalidations_deferred, 1);
+    }
+    pt_->deferred_tlb_.merge(&tlb_);
+    list_splice_after(&to_free_, &pt_->deferred_free_);
+    pt_ = nullptr;
+    return;
+  }
+
+  // Send any invalidations held back so far along with ours, so that no entry
+  // changed before now may still be cached once we return.
+  tlb_.merge(&pt_->deferred_tlb_);
+  list_splice_after(&pt_->deferred_free_, &to_free_);
   pt_->TlbInvalidate(&tlb_);
   pt_ = nullptr;
 }
@@ -1051,9 +1089,32 @@ zx_status_t X86PageTableBase<paf>::QueryVaddr(vaddr_t vaddr, paddr_t* paddr, uin
   return ZX_OK;
 }
 
+template <page_alloc_fn_t paf>
+void X86PageTableBase<paf>::DeferInvalidations() {
+  canary_.Assert();
+
+  Guard<Mutex> a{&lock_};
+  DEBUG_ASSERT(deferring_thread_ == nullptr);
+  deferring_thread_ = get_current_thread();
+}
+
+template <page_alloc_fn_t paf>
+void X86PageTableBase<paf>::FlushDeferredInvalidations() {
+  canary_.Assert();
+
+  ConsistencyManager cm(this);
+  {
+    Guard<Mutex> a{&lock_};
+    DEBUG_ASSERT(deferring_thread_ == get_current_thread());
+    deferring_thread_ = nullptr;
+    cm.Finish();
+  }
+}
+
 template <page_alloc_fn_t paf>
 void X86PageTableBase<paf>::Destroy(vaddr_t base, size_t size) {
   canary_.Assert();
+  DEBUG_ASSERT(deferring_thread_ == nullptr);
 
 #if LK_DEBUGLEVEL > 1
   PageTableLevel top = top_level();
@@ -17,21 +17,33 @@
 
 #include <kernel/thread.h>
 #include <kernel/timer.h>
+#include <ktl/atomic.h>
 
 #define EVENT_MAGIC (0x65766E74)  // "evnt"
 
+// |state| holds EVENT_STATE_SIGNALED along with the number of threads blocking or blocked on the
+// event, in units of EVENT_STATE_WAITER. Since it is only changed with atomic operations,
+// signaling an event which no thread waits for, and waiting for an event which is already
+// signaled, do not take the thread lock. A thread registers as a waiter before checking the
+// signal, so a signaler either sees the waiter and takes the thread lock to wake it, or the waiter
+// sees the signal.
 typedef struct event {
   int magic;
-  bool signaled;
+  ktl::atomic<uint32_t> state;
   uint flags;
   wait_queue_t wait;
 } event_t;
 
+#define EVENT_STATE_SIGNALED 1u
+#define EVENT_STATE_WAITER 2u
+
 #define EVENT_FLAG_AUTOUNSIGNAL 1
 
 #define EVENT_INITIAL_VALUE(e, initial, _flags)                 \
   {                                                             \
-    .magic = EVENT_MAGIC, .signaled = initial, .flags = _flags, \
+    .magic = EVENT_MAGIC,                                       \
+    .state = (initial) ? EVENT_STATE_SIGNALED : 0u,             \
+    .flags = _flags,                                            \
     .wait = WAIT_QUEUE_INITIAL_VALUE((e).wait),                 \
   }
 
@@ -51,7 +63,10 @@ typedef struct event {
 //     event_unsignal() is called.
 
 static inline void event_init(event_t* e, bool initial, uint flags) {
-  *e = (event_t)EVENT_INITIAL_VALUE(*e, initial, flags);
+  e->magic = EVENT_MAGIC;
+  e->state.store(initial ? EVENT_STATE_SIGNALED : 0u, ktl::memory_order_relaxed);
+  e->flags = flags;
+  wait_queue_init(&e->wait);
 }
 void event_destroy(event_t*);
 
@@ -79,7 +94,9 @@ zx_status_t event_unsignal(event_t*);
 
 static inline bool event_initialized(const event_t* e) { return e->magic == EVENT_MAGIC; }
 
-static inline bool event_signaled(const event_t* e) { return e->signaled; }
+static inline bool event_signaled(const event_t* e) {
+  return e->state.load() & EVENT_STATE_SIGNALED;
+}
 
 // C++ wrapper. This should be waited on from only a single thread, but may be
 // signaled from many threads (Signal() is thread-safe).
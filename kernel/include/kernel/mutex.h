@@ -58,11 +58,21 @@ class TA_CAP("mutex") Mutex {
 
   static constexpr uint32_t MAGIC = 0x6D757478;  // 'mutx'
   static constexpr uintptr_t STATE_FREE = 0u;
+  // Set by a contending thread while it holds |wait_|'s queue lock, and
+  // cleared by a releasing thread while it holds the thread lock.
   static constexpr uintptr_t STATE_FLAG_CONTESTED = 1u;
 
   template <ThreadLockState TLS>
   void ReleaseInternal(const bool allow_reschedule) TA_REL() __TA_NO_THREAD_SAFETY_ANALYSIS;
 
+  // Slow path helper for Acquire, called with the wait queue's lock held.
+  // Sets the contested flag, unless the mutex turns out to be free, in which
+  // case it is acquired by storing |new_mutex_state|.  Returns true if the
+  // mutex was acquired.  Otherwise returns false and reports the state the
+  // contested flag was set on, and therefore the holder to block behind, in
+  // |old_mutex_state|.
+  bool AcquireOrMarkContested(uintptr_t new_mutex_state, uintptr_t* old_mutex_state);
+
   // Accessors to extract the holder pointer from the val member
   uintptr_t val() const { return val_.load(ktl::memory_order_relaxed); }
 
@@ -10,6 +10,7 @@
 #include <fbl/canary.h>
 #include <fbl/intrusive_double_list.h>
 #include <fbl/macros.h>
+#include <kernel/spinlock.h>
 #include <kernel/thread.h>
 #include <kernel/thread_lock.h>
 #include <kernel/wait.h>
@@ -117,6 +118,17 @@ class OwnedWaitQueue : public WaitQueue, public fbl::DoublyLinkedListable<OwnedW
   // const accessor for the owner member.
   thread_t* owner() const TA_REQ(thread_lock) { return owner_; }
 
+  // The lock of this wait queue.
+  //
+  // Users of the queue may hold it, before taking the thread lock, to
+  // serialize the threads which are about to block on or wake the queue.
+  // This keeps a pile-up of threads contending for one queue from turning
+  // into a pile-up on the global thread lock: at most one of them at a time
+  // goes on to compete for the thread lock.  It must never be acquired while
+  // the thread lock is held, and must be dropped before blocking.  The queue
+  // and ownership bookkeeping themselves remain guarded by the thread lock.
+  SpinLock& queue_lock() TA_RET_CAP(queue_lock_) { return queue_lock_; }
+
   // Debug Assert wrapper which skips the thread analysis checks just to
   // assert that a specific queue is unowned.  Used by FutexContext
   void AssertNotOwned() const TA_NO_THREAD_SAFETY_ANALYSIS { DEBUG_ASSERT(owner_ == nullptr); }
@@ -326,6 +338,7 @@ class OwnedWaitQueue : public WaitQueue, public fbl::DoublyLinkedListable<OwnedW
       TA_REQ(thread_lock) __WARN_UNUSED_RESULT;
 
   thread_t* owner_ TA_GUARDED(thread_lock) = nullptr;
+  SpinLock queue_lock_;
 };
 
 #endif  // ZIRCON_KERNEL_INCLUDE_KERNEL_OWNED_WAIT_QUEUE_H_
@@ -40,6 +40,9 @@ class Scheduler {
 
   static_assert(kDefaultPeakLatency >= kDefaultTargetLatency);
 
+  // Default period of the load balance check triggered from the timer tick.
+  static constexpr SchedDuration kDefaultBalancePeriod = SchedMs(8);
+
   Scheduler() = default;
   ~Scheduler() = default;
 
@@ -119,6 +122,21 @@ class Scheduler {
   // Returns a CPU to run the given thread on.
   static cpu_num_t FindTargetCpu(thread_t* thread) TA_REQ(thread_lock);
 
+  // Builds the list of CPUs searched by FindTargetCpu, in order of increasing
+  // cache distance from this CPU. Called once the system topology and all of
+  // the percpu instances are available.
+  void InitializeSearchSet() TA_EXCL(thread_lock);
+
+  // Attempts to move a thread waiting in the run queue of a more heavily
+  // loaded CPU to this CPU's run queue, respecting the thread's hard and soft
+  // affinity. Peers are searched in order of increasing cache distance.
+  // Returns true if a thread was moved.
+  bool StealThread(SchedTime now) TA_REQ(thread_lock);
+
+  // Returns the cache distance from this CPU to the given CPU, or UINT32_MAX
+  // if the distance is not known.
+  uint32_t CacheDistance(cpu_num_t cpu) const TA_REQ(thread_lock);
+
   // Updates the system load metrics.
   void UpdateCounters(SchedDuration queue_time_ns) TA_REQ(thread_lock);
 
@@ -177,6 +195,12 @@ class Scheduler {
     static auto& node_state(thread_t& thread) { return thread.scheduler_state.run_queue_node_; }
   };
 
+  // Entry in the list of CPUs to search when selecting a target CPU.
+  struct SearchEntry {
+    cpu_num_t cpu;
+    uint32_t distance;
+  };
+
   // Alias of the WAVLTree type for the runqueue.
   using RunQueue = fbl::WAVLTree<SchedTime, thread_t*, TaskTraits, TaskTraits>;
 
@@ -246,6 +270,22 @@ class Scheduler {
   TA_GUARDED(thread_lock)
   SchedDuration peak_latency_ns_{kDefaultPeakLatency};
 
+  // The other CPUs in the system in order of increasing cache distance from
+  // this CPU. Empty until InitializeSearchSet() is called, in which case
+  // FindTargetCpu falls back to a linear search of the available CPUs.
+  TA_GUARDED(thread_lock)
+  SearchEntry search_set_[SMP_MAX_CPUS];
+
+  // The number of valid entries in |search_set_|.
+  TA_GUARDED(thread_lock)
+  size_t search_set_count_{0};
+
+  // The time of the next periodic load balance check and whether the check
+  // is due at the next reschedule. These are only accessed by the CPU this
+  // instance is associated with, with interrupts disabled.
+  SchedTime next_balance_time_ns_{0};
+  bool balance_pending_{false};
+
   // The CPU this scheduler instance is associated with.
   // NOTE: This member is not initialized to prevent clobbering the value set
   // by sched_early_init(), which is called before the global ctors that
@@ -13,6 +13,9 @@
 #include <zircon/compiler.h>
 #include <zircon/types.h>
 
+#include <utility>
+
+#include <fbl/intrusive_wavl_tree.h>
 #include <kernel/deadline.h>
 #include <kernel/spinlock.h>
 
@@ -27,7 +30,7 @@ typedef void (*timer_callback)(struct timer*, zx_time_t now, void* arg);
 
 typedef struct timer {
   int magic;
-  struct list_node node;
+  fbl::WAVLTreeNodeState<struct timer*> node;
 
   zx_time_t scheduled_time;
   zx_duration_t slack;  // Stores the applied slack adjustment from
@@ -35,14 +38,20 @@ typedef struct timer {
   timer_callback callback;
   void* arg;
 
+  uint64_t generation;  // Orders timers with the same scheduled_time.
+  uint queue_cpu;       // cpu whose timer queue holds the timer, if any
+
   volatile int active_cpu;  // <0 if inactive
   volatile bool cancel;     // true if cancel is pending
+
+  // The key of the timer in its timer queue.
+  std::pair<zx_time_t, uint64_t> key() const { return {scheduled_time, generation}; }
 } timer_t;
 
-#define TIMER_INITIAL_VALUE(t)                                                                 \
-  {                                                                                            \
-    .magic = TIMER_MAGIC, .node = LIST_INITIAL_CLEARED_VALUE, .scheduled_time = 0, .slack = 0, \
-    .callback = NULL, .arg = NULL, .active_cpu = -1, .cancel = false,                          \
+#define TIMER_INITIAL_VALUE(t)                                                             \
+  {                                                                                        \
+    .magic = TIMER_MAGIC, .node = {}, .scheduled_time = 0, .slack = 0, .callback = NULL,   \
+    .arg = NULL, .generation = 0, .queue_cpu = 0, .active_cpu = -1, .cancel = false,       \
   }
 
 // Rules for Timers:
@@ -124,4 +133,16 @@ zx_status_t timer_trylock_or_cancel(timer_t* t, spin_lock_t* lock) TA_TRY_ACQ(fa
 
 __END_CDECLS
 
+// Per-cpu queue of pending timers, ordered by scheduled_time. Timers with the same
+// scheduled_time are ordered by generation, which increases with each timer_set().
+struct TimerQueueTraits {
+  using KeyType = std::pair<zx_time_t, uint64_t>;
+  static KeyType GetKey(const timer_t& timer) { return timer.key(); }
+  static bool LessThan(KeyType a, KeyType b) { return a < b; }
+  static bool EqualTo(KeyType a, KeyType b) { return a == b; }
+  static auto& node_state(timer_t& timer) { return timer.node; }
+};
+using TimerQueue =
+    fbl::WAVLTree<TimerQueueTraits::KeyType, timer_t*, TimerQueueTraits, TimerQueueTraits>;
+
 #endif  // ZIRCON_KERNEL_INCLUDE_KERNEL_TIMER_H_
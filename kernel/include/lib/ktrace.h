@@ -50,10 +50,11 @@ static inline uint64_t ktrace_timestamp() { return current_ticks(); }
 #define KTRACE_STRING_REF_CAT(a, b) a##b
 #define KTRACE_STRING_REF(string) KTRACE_STRING_REF_CAT(string, _stringref)
 
-// Allocates a new trace record in the trace buffer. Returns a pointer to the
-// start of the record or nullptr if tracing is disabled or the end of the
-// buffer is reached.
-void* ktrace_open(uint32_t tag, uint64_t ts = ktrace_timestamp());
+// Writes a trace record to the current cpu's trace buffer, with the
+// KTRACE_LEN(|tag|) - KTRACE_HDRSIZE bytes at |payload| following the header.
+// Returns false if tracing is disabled or the record was dropped because the
+// buffer is full.
+bool ktrace_write(uint32_t tag, const void* payload, uint64_t ts = ktrace_timestamp());
 
 // Emits a tiny trace record.
 void ktrace_tiny(uint32_t tag, uint32_t arg);
@@ -66,12 +67,8 @@ inline void ktrace(TraceEnabled<enabled>, TraceContext context, uint32_t tag, ui
   if constexpr (enabled) {
     const uint32_t effective_tag =
         KTRACE_TAG_FLAGS(tag, context == TraceContext::Thread ? 0 : KTRACE_FLAGS_CPU);
-    if (uint32_t* data = static_cast<uint32_t*>(ktrace_open(effective_tag, explicit_ts))) {
-      data[0] = a;
-      data[1] = b;
-      data[2] = c;
-      data[3] = d;
-    }
+    const uint32_t args[4] = {a, b, c, d};
+    ktrace_write(effective_tag, args, explicit_ts);
   } else {
     (void)context;
     (void)tag;
@@ -105,7 +102,7 @@ inline void ktrace_probe(TraceEnabled<enabled>, TraceContext context, StringRef*
     const uint32_t effective_tag =
         KTRACE_TAG_FLAGS(tag, context == TraceContext::Thread ? 0 : KTRACE_FLAGS_CPU);
 
-    ktrace_open(effective_tag);
+    ktrace_write(effective_tag, nullptr);
   } else {
     (void)context;
     (void)string_ref;
@@ -120,12 +117,8 @@ inline void ktrace_probe(TraceEnabled<enabled>, TraceContext context, StringRef*
     const uint32_t effective_tag =
         KTRACE_TAG_FLAGS(tag, context == TraceContext::Thread ? 0 : KTRACE_FLAGS_CPU);
 
-    void* const payload = ktrace_open(effective_tag);
-    uint32_t* const args = static_cast<uint32_t*>(payload);
-    if (args) {
-      args[0] = a;
-      args[1] = b;
-    }
+    const uint32_t args[2] = {a, b};
+    ktrace_write(effective_tag, args);
   } else {
     (void)context;
     (void)string_ref;
@@ -142,11 +135,7 @@ inline void ktrace_probe(TraceEnabled<enabled>, TraceContext context, StringRef*
     const uint32_t effective_tag =
         KTRACE_TAG_FLAGS(tag, context == TraceContext::Thread ? 0 : KTRACE_FLAGS_CPU);
 
-    void* const payload = ktrace_open(effective_tag);
-    uint64_t* const args = static_cast<uint64_t*>(payload);
-    if (args) {
-      args[0] = a;
-    }
+    ktrace_write(effective_tag, &a);
   } else {
     (void)context;
     (void)string_ref;
@@ -162,12 +151,8 @@ inline void ktrace_probe(TraceEnabled<enabled>, TraceContext context, StringRef*
     const uint32_t effective_tag =
         KTRACE_TAG_FLAGS(tag, context == TraceContext::Thread ? 0 : KTRACE_FLAGS_CPU);
 
-    void* const payload = ktrace_open(effective_tag);
-    uint64_t* const args = static_cast<uint64_t*>(payload);
-    if (args) {
-      args[0] = a;
-      args[1] = b;
-    }
+    const uint64_t args[2] = {a, b};
+    ktrace_write(effective_tag, args);
   } else {
     (void)context;
     (void)string_ref;
@@ -184,7 +169,7 @@ inline void ktrace_begin_duration(TraceEnabled<enabled>, TraceContext context, u
     const uint32_t effective_tag =
         KTRACE_TAG_FLAGS(tag, context == TraceContext::Thread ? 0 : KTRACE_FLAGS_CPU);
 
-    ktrace_open(effective_tag);
+    ktrace_write(effective_tag, nullptr);
   } else {
     (void)context;
     (void)group;
@@ -200,7 +185,7 @@ inline void ktrace_end_duration(TraceEnabled<enabled>, TraceContext context, uin
     const uint32_t effective_tag =
         KTRACE_TAG_FLAGS(tag, context == TraceContext::Thread ? 0 : KTRACE_FLAGS_CPU);
 
-    ktrace_open(effective_tag);
+    ktrace_write(effective_tag, nullptr);
   } else {
     (void)context;
     (void)group;
@@ -216,12 +201,8 @@ inline void ktrace_begin_duration(TraceEnabled<enabled>, TraceContext context, u
     const uint32_t effective_tag =
         KTRACE_TAG_FLAGS(tag, context == TraceContext::Thread ? 0 : KTRACE_FLAGS_CPU);
 
-    void* const payload = ktrace_open(effective_tag);
-    uint64_t* const args = static_cast<uint64_t*>(payload);
-    if (args) {
-      args[0] = a;
-      args[1] = b;
-    }
+    const uint64_t args[2] = {a, b};
+    ktrace_write(effective_tag, args);
   } else {
     (void)context;
     (void)group;
@@ -239,12 +220,8 @@ inline void ktrace_end_duration(TraceEnabled<enabled>, TraceContext context, uin
     const uint32_t effective_tag =
         KTRACE_TAG_FLAGS(tag, context == TraceContext::Thread ? 0 : KTRACE_FLAGS_CPU);
 
-    void* const payload = ktrace_open(effective_tag);
-    uint64_t* const args = static_cast<uint64_t*>(payload);
-    if (args) {
-      args[0] = a;
-      args[1] = b;
-    }
+    const uint64_t args[2] = {a, b};
+    ktrace_write(effective_tag, args);
   } else {
     (void)context;
     (void)group;
@@ -262,11 +239,7 @@ inline void ktrace_flow_begin(TraceEnabled<enabled>, TraceContext context, uint3
     const uint32_t effective_tag =
         KTRACE_TAG_FLAGS(tag, context == TraceContext::Thread ? 0 : KTRACE_FLAGS_CPU);
 
-    void* const payload = ktrace_open(effective_tag);
-    uint64_t* const args = static_cast<uint64_t*>(payload);
-    if (args) {
-      args[0] = flow_id;
-    }
+    ktrace_write(effective_tag, &flow_id);
   } else {
     (void)context;
     (void)group;
@@ -283,11 +256,7 @@ inline void ktrace_flow_end(TraceEnabled<enabled>, TraceContext context, uint32_
     const uint32_t effective_tag =
         KTRACE_TAG_FLAGS(tag, context == TraceContext::Thread ? 0 : KTRACE_FLAGS_CPU);
 
-    void* const payload = ktrace_open(effective_tag);
-    uint64_t* const args = static_cast<uint64_t*>(payload);
-    if (args) {
-      args[0] = flow_id;
-    }
+    ktrace_write(effective_tag, &flow_id);
   } else {
     (void)context;
     (void)group;
@@ -302,6 +271,10 @@ static inline void ktrace_name(uint32_t tag, uint32_t id, uint32_t arg, const ch
   ktrace_name_etc(tag, id, arg, name, false);
 }
 
+// Copies up to |len| bytes of the trace, starting |off| bytes in, to |ptr|, or
+// returns the size of the trace if |ptr| is null. In streaming mode |off| is
+// ignored and the records read are removed from the buffers. In circular mode
+// the buffers are only consistent while tracing is stopped.
 ssize_t ktrace_read_user(void* ptr, uint32_t off, size_t len);
 zx_status_t ktrace_control(uint32_t action, uint32_t options, void* ptr);
 
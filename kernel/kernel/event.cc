@@ -48,12 +48,29 @@
 void event_destroy(event_t* e) {
   DEBUG_ASSERT(e->magic == EVENT_MAGIC);
 
+  DEBUG_ASSERT(e->state.load() < EVENT_STATE_WAITER);
+
   e->magic = 0;
-  e->signaled = false;
+  e->state.store(0, ktl::memory_order_relaxed);
   e->flags = 0;
   wait_queue_destroy(&e->wait);
 }
 
+// Consumes the signal of |e| if it is signaled: clears it if |e| is EVENT_FLAG_AUTOUNSIGNAL, so
+// that only one thread falls through. Returns true if the signal was consumed.
+static bool event_try_consume(event_t* e) {
+  uint32_t state = e->state.load();
+  if (!(e->flags & EVENT_FLAG_AUTOUNSIGNAL)) {
+    return state & EVENT_STATE_SIGNALED;
+  }
+  while (state & EVENT_STATE_SIGNALED) {
+    if (e->state.compare_exchange_weak(state, state & ~EVENT_STATE_SIGNALED)) {
+      return true;
+    }
+  }
+  return false;
+}
+
 static zx_status_t event_wait_worker(event_t* e, const Deadline& deadline, bool interruptable,
                                      uint signal_mask) {
   thread_t* current_thread = get_current_thread();
@@ -62,20 +79,25 @@ static zx_status_t event_wait_worker(event_t* e, const Deadline& deadline, bool
   DEBUG_ASSERT(e->magic == EVENT_MAGIC);
   DEBUG_ASSERT(!arch_blocking_disallowed());
 
+  /* signaled, we're going to fall through without taking the thread lock */
+  if (event_try_consume(e)) {
+    return ZX_OK;
+  }
+
   Guard<spin_lock_t, IrqSave> guard{ThreadLock::Get()};
 
   current_thread->interruptable = interruptable;
 
-  if (e->signaled) {
-    /* signaled, we're going to fall through */
-    if (e->flags & EVENT_FLAG_AUTOUNSIGNAL) {
-      /* autounsignal flag lets one thread fall through before unsignaling */
-      e->signaled = false;
-    }
-  } else {
+  /*
+   * register as a waiter before checking the signal again, so that a signaler
+   * which does not see us has set the signal before we check it
+   */
+  e->state.fetch_add(EVENT_STATE_WAITER);
+  if (!event_try_consume(e)) {
     /* unsignaled, block here */
     ret = wait_queue_block_etc(&e->wait, deadline, signal_mask, ResourceOwnership::Normal);
   }
+  e->state.fetch_sub(EVENT_STATE_WAITER);
 
   current_thread->interruptable = false;
 
@@ -142,14 +164,14 @@ zx_status_t event_wait_with_mask(event_t* e, uint signal_mask) {
   return event_wait_worker(e, Deadline::infinite(), true, signal_mask);
 }
 
-static int event_signal_internal(event_t* e, bool reschedule, zx_status_t wait_result)
+static int event_signal_locked(event_t* e, bool reschedule, zx_status_t wait_result)
     TA_REQ(thread_lock) {
   DEBUG_ASSERT(e->magic == EVENT_MAGIC);
 
   int wake_count = 0;
 
-  if (!e->signaled) {
-    if (e->flags & EVENT_FLAG_AUTOUNSIGNAL) {
+  if (e->flags & EVENT_FLAG_AUTOUNSIGNAL) {
+    if (!(e->state.load() & EVENT_STATE_SIGNALED)) {
       /* try to release one thread and leave unsignaled if successful */
       if ((wake_count = wait_queue_wake_one(&e->wait, reschedule, wait_result)) <= 0) {
         /*
@@ -157,18 +179,39 @@ static int event_signal_internal(event_t* e, bool reschedule, zx_status_t wait_r
          * signaled state and let the next call to event_wait
          * unsignal the event.
          */
-        e->signaled = true;
+        e->state.fetch_or(EVENT_STATE_SIGNALED);
       }
-    } else {
-      /* release all threads and remain signaled */
-      e->signaled = true;
-      wake_count = wait_queue_wake_all(&e->wait, reschedule, wait_result);
     }
+  } else if (!(e->state.fetch_or(EVENT_STATE_SIGNALED) & EVENT_STATE_SIGNALED)) {
+    /* release all threads and remain signaled */
+    wake_count = wait_queue_wake_all(&e->wait, reschedule, wait_result);
   }
 
   return wake_count;
 }
 
+static int event_signal_internal(event_t* e, bool reschedule, zx_status_t wait_result) {
+  DEBUG_ASSERT(e->magic == EVENT_MAGIC);
+
+  /*
+   * if no thread is waiting, set the signal without taking the thread lock;
+   * a thread which starts waiting concurrently either sees the signal or
+   * makes the compare-exchange fail
+   */
+  uint32_t state = e->state.load();
+  while (state < EVENT_STATE_WAITER) {
+    if (state & EVENT_STATE_SIGNALED) {
+      return 0;
+    }
+    if (e->state.compare_exchange_weak(state, state | EVENT_STATE_SIGNALED)) {
+      return 0;
+    }
+  }
+
+  Guard<spin_lock_t, IrqSave> guard{ThreadLock::Get()};
+  return event_signal_locked(e, reschedule, wait_result);
+}
+
 /**
  * @brief  Signal an event
  *
@@ -189,7 +232,6 @@ static int event_signal_internal(event_t* e, bool reschedule, zx_status_t wait_r
  * @return  Returns the number of threads that have been unblocked.
  */
 int event_signal_etc(event_t* e, bool reschedule, zx_status_t wait_result) {
-  Guard<spin_lock_t, IrqSave> guard{ThreadLock::Get()};
   return event_signal_internal(e, reschedule, wait_result);
 }
 
@@ -211,7 +253,6 @@ int event_signal_etc(event_t* e, bool reschedule, zx_status_t wait_result) {
  * @return  Returns the number of threads that have been unblocked.
  */
 int event_signal(event_t* e, bool reschedule) {
-  Guard<spin_lock_t, IrqSave> guard{ThreadLock::Get()};
   return event_signal_internal(e, reschedule, ZX_OK);
 }
 
@@ -220,7 +261,7 @@ int event_signal_thread_locked(event_t* e) {
   DEBUG_ASSERT(arch_ints_disabled());
   DEBUG_ASSERT(spin_lock_held(&thread_lock));
 
-  return event_signal_internal(e, false, ZX_OK);
+  return event_signal_locked(e, false, ZX_OK);
 }
 
 /**
@@ -238,7 +279,7 @@ int event_signal_thread_locked(event_t* e) {
 zx_status_t event_unsignal(event_t* e) {
   DEBUG_ASSERT(e->magic == EVENT_MAGIC);
 
-  e->signaled = false;
+  e->state.fetch_and(~EVENT_STATE_SIGNALED);
 
   return ZX_OK;
 }
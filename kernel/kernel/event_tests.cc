@@ -0,0 +1,132 @@
+// Copyright 2019 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <lib/unittest/unittest.h>
+#include <platform.h>
+
+#include <kernel/event.h>
+#include <kernel/thread.h>
+#include <kernel/thread_lock.h>
+#include <lockdep/lockdep.h>
+
+using lockdep::Guard;
+
+static bool smoke_test() {
+  BEGIN_TEST;
+
+  const Deadline past = Deadline::no_slack(current_time());
+
+  {
+    event_t e = EVENT_INITIAL_VALUE(e, false, 0);
+    ASSERT_EQ(ZX_ERR_TIMED_OUT, event_wait_interruptable(&e, past));
+    ASSERT_EQ(0, event_signal(&e, false));
+    ASSERT_TRUE(event_signaled(&e));
+    ASSERT_EQ(ZX_OK, event_wait_interruptable(&e, past));
+    ASSERT_EQ(ZX_OK, event_wait_interruptable(&e, past));
+    ASSERT_EQ(ZX_OK, event_unsignal(&e));
+    ASSERT_EQ(ZX_ERR_TIMED_OUT, event_wait_interruptable(&e, past));
+    event_destroy(&e);
+  }
+
+  {
+    event_t e = EVENT_INITIAL_VALUE(e, false, EVENT_FLAG_AUTOUNSIGNAL);
+    ASSERT_EQ(0, event_signal(&e, false));
+    ASSERT_EQ(0, event_signal(&e, false));
+    ASSERT_EQ(ZX_OK, event_wait_interruptable(&e, past));
+    ASSERT_FALSE(event_signaled(&e));
+    ASSERT_EQ(ZX_ERR_TIMED_OUT, event_wait_interruptable(&e, past));
+    event_destroy(&e);
+  }
+
+  END_TEST;
+}
+
+static int wait_event_thread(void* arg) {
+  auto e = reinterpret_cast<event_t*>(arg);
+  return static_cast<int>(event_wait_interruptable(e, Deadline::infinite()));
+}
+
+static bool thread_is_blocked(const thread_t* t) {
+  Guard<spin_lock_t, IrqSave> guard{ThreadLock::Get()};
+  return (t->state == THREAD_BLOCKED);
+}
+
+// Signaling an event which a thread is blocked on wakes the thread, and leaves the event
+// signaled unless it is EVENT_FLAG_AUTOUNSIGNAL.
+template <uint flags>
+static bool wake_blocked_test() {
+  BEGIN_TEST;
+
+  event_t e = EVENT_INITIAL_VALUE(e, false, flags);
+  thread_t* thread = thread_create("test event", wait_event_thread, &e, DEFAULT_PRIORITY);
+  ASSERT_NONNULL(thread);
+  thread_resume(thread);
+
+  while (!thread_is_blocked(thread)) {
+    thread_sleep_relative(ZX_MSEC(1));
+  }
+
+  ASSERT_EQ(1, event_signal(&e, true));
+  int retcode = ZX_ERR_INTERNAL;
+  thread_join(thread, &retcode, ZX_TIME_INFINITE);
+  ASSERT_EQ(ZX_OK, retcode);
+  ASSERT_EQ(!(flags & EVENT_FLAG_AUTOUNSIGNAL), event_signaled(&e));
+  event_destroy(&e);
+
+  END_TEST;
+}
+
+struct PingPong {
+  static constexpr int kRounds = 10000;
+
+  event_t ping = EVENT_INITIAL_VALUE(ping, false, EVENT_FLAG_AUTOUNSIGNAL);
+  event_t pong = EVENT_INITIAL_VALUE(pong, false, EVENT_FLAG_AUTOUNSIGNAL);
+};
+
+static int pong_thread(void* arg) {
+  auto pp = reinterpret_cast<PingPong*>(arg);
+  for (int i = 0; i < PingPong::kRounds; i++) {
+    zx_status_t status =
+        event_wait_interruptable(&pp->ping, Deadline::no_slack(current_time() + ZX_SEC(10)));
+    if (status != ZX_OK) {
+      return status;
+    }
+    event_signal(&pp->pong, false);
+  }
+  return ZX_OK;
+}
+
+// Bouncing between two threads races signals against threads about to block, which must never
+// lose a wakeup.
+static bool ping_pong_test() {
+  BEGIN_TEST;
+
+  PingPong pp;
+  thread_t* thread = thread_create("test event pong", pong_thread, &pp, DEFAULT_PRIORITY);
+  ASSERT_NONNULL(thread);
+  thread_resume(thread);
+
+  for (int i = 0; i < PingPong::kRounds; i++) {
+    event_signal(&pp.ping, false);
+    ASSERT_EQ(ZX_OK, event_wait_interruptable(
+                         &pp.pong, Deadline::no_slack(current_time() + ZX_SEC(10))));
+  }
+
+  int retcode = ZX_ERR_INTERNAL;
+  thread_join(thread, &retcode, ZX_TIME_INFINITE);
+  ASSERT_EQ(ZX_OK, retcode);
+  event_destroy(&pp.ping);
+  event_destroy(&pp.pong);
+
+  END_TEST;
+}
+
+UNITTEST_START_TESTCASE(event_tests)
+UNITTEST("smoke_test", smoke_test)
+UNITTEST("wake_blocked_test", wake_blocked_test<0>)
+UNITTEST("wake_blocked_autounsignal_test", wake_blocked_test<EVENT_FLAG_AUTOUNSIGNAL>)
+UNITTEST("ping_pong_test", ping_pong_test)
+UNITTEST_END_TESTCASE(event_tests, "event", "Event tests");
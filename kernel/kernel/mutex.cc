@@ -172,28 +172,36 @@ void Mutex::Acquire(zx_duration_t spin_max_duration) {
   }
 
   {
-    // we contended with someone else, will probably need to block
-    Guard<spin_lock_t, IrqSave> guard{ThreadLock::Get()};
-
-    // Check if the queued flag is currently set. The contested flag can only be changed
-    // whilst the thread lock is held so we know we aren't racing with anyone here. This
-    // is just an optimization and allows us to avoid redundantly doing the atomic OR.
-    old_mutex_state = val();
-
-    if (unlikely(!(old_mutex_state & STATE_FLAG_CONTESTED))) {
-      // Set the queued flag to indicate that we're blocking.
-      old_mutex_state = val_.fetch_or(STATE_FLAG_CONTESTED, ktl::memory_order_seq_cst);
-      // We may have raced with the holder as they dropped the mutex.
-      if (unlikely(old_mutex_state == STATE_FREE)) {
-        // Since we set the contested flag we know that there are no
-        // waiters and no one is able to perform fast path acquisition.
-        // Therefore we can just take the mutex, and remove the queued
-        // flag.
-        val_.store(new_mutex_state, ktl::memory_order_seq_cst);
-        return;
-      }
+    // we contended with someone else, will probably need to block.  Take the
+    // lock of our wait queue before the thread lock so that, no matter how
+    // many threads pile up on this mutex, at most one of them at a time
+    // competes for the global thread lock.
+    spin_lock_saved_state_t irq_state;
+    wait_.queue_lock().AcquireIrqSave(irq_state);
+
+    // The holder may have dropped the mutex while we were spinning.  If so,
+    // we can take it without ever touching the thread lock.
+    if (AcquireOrMarkContested(new_mutex_state, &old_mutex_state)) {
+      wait_.queue_lock().ReleaseIrqRestore(irq_state);
+      return;
+    }
+
+    spin_lock(&thread_lock);
+
+    // A holder releasing with ReleaseThreadLocked does not take the queue
+    // lock, so it may have dropped the mutex (clearing the contested flag)
+    // while we were waiting for the thread lock.  Check again; from here on
+    // the holder cannot release without the thread lock, which we hold.
+    if (unlikely(AcquireOrMarkContested(new_mutex_state, &old_mutex_state))) {
+      spin_unlock(&thread_lock);
+      wait_.queue_lock().ReleaseIrqRestore(irq_state);
+      return;
     }
 
+    // Let the next contending thread through while we block.  It cannot
+    // get anywhere until we have been queued and the thread lock dropped.
+    wait_.queue_lock().Release();
+
     // extract the current holder of the mutex from oldval, no need to
     // re-read from the mutex as it cannot change if the queued flag is set
     // without holding the thread lock (which we currently hold).  We need
@@ -213,7 +221,35 @@ void Mutex::Acquire(zx_duration_t spin_max_duration) {
 
     // someone must have woken us up, we should own the mutex now
     DEBUG_ASSERT(ct == holder());
+
+    spin_unlock_irqrestore(&thread_lock, irq_state);
+  }
+}
+
+bool Mutex::AcquireOrMarkContested(uintptr_t new_mutex_state, uintptr_t* old_mutex_state) {
+  // Check if the contested flag is currently set.  It is only ever set by a
+  // thread holding our wait queue's lock, and only ever cleared by a thread
+  // holding the thread lock, so once the caller holds both no one can change
+  // it (before then, Acquire checks again).  This is just an optimization and
+  // allows us to avoid redundantly doing the atomic OR.
+  *old_mutex_state = val();
+  if (likely(*old_mutex_state & STATE_FLAG_CONTESTED)) {
+    return false;
+  }
+
+  // Set the contested flag to indicate that we're blocking.
+  *old_mutex_state = val_.fetch_or(STATE_FLAG_CONTESTED, ktl::memory_order_seq_cst);
+
+  // We may have raced with the holder as they dropped the mutex.
+  if (unlikely(*old_mutex_state == STATE_FREE)) {
+    // Since we set the contested flag we know that no one is able to
+    // perform fast path acquisition, and a free mutex has no waiters.
+    // Therefore we can just take the mutex, and remove the contested flag.
+    val_.store(new_mutex_state, ktl::memory_order_seq_cst);
+    return true;
   }
+
+  return false;
 }
 
 // Shared implementation of release
@@ -248,12 +284,18 @@ void Mutex::ReleaseInternal(const bool allow_reschedule) {
     }
   }
 
-  // compile-time conditionally acquire/release the thread lock
+  // compile-time conditionally acquire/release the queue lock and the thread
+  // lock.  Holding the queue lock keeps contending threads from setting the
+  // contested flag behind our back.  When the caller already holds the thread
+  // lock we must not take the queue lock (it is ordered before the thread
+  // lock); Acquire copes with that by re-checking the mutex state once it
+  // holds the thread lock.
   // NOTE: using the manual spinlock grab/release instead of THREAD_LOCK because
   // the state variable needs to exit in either path.
   __UNUSED spin_lock_saved_state_t irq_state;
   if constexpr (TLS == ThreadLockState::NotHeld) {
-    spin_lock_irqsave(&thread_lock, irq_state);
+    wait_.queue_lock().AcquireIrqSave(irq_state);
+    spin_lock(&thread_lock);
   }
 
   // Attempt to release a thread. If there are still waiters in the queue
@@ -309,6 +351,12 @@ void Mutex::ReleaseInternal(const bool allow_reschedule) {
           reinterpret_cast<uintptr_t>(ct) | STATE_FLAG_CONTESTED, old_mutex_state, this, ct);
   }
 
+  // The queue lock must not be held across a context switch, so drop it
+  // before we (potentially) reschedule.
+  if constexpr (TLS == ThreadLockState::NotHeld) {
+    wait_.queue_lock().Release();
+  }
+
   if (allow_reschedule && need_reschedule) {
     sched_reschedule();
   }
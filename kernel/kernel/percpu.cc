@@ -24,7 +24,6 @@ percpu** percpu::processor_index_{percpu::boot_index_};
 size_t percpu::processor_count_{1};
 
 percpu::percpu(cpu_num_t cpu_num) {
-  list_initialize(&timer_queue);
   for (unsigned int i = 0; i < NUM_PRIORITIES; i++) {
     list_initialize(&run_queue[i]);
   }
@@ -69,6 +68,14 @@ void percpu::InitializeSecondary(uint32_t /*init_level*/) {
     processor_index_[i] = &secondary_processors_[i - 1];
     new (&secondary_processors_[i - 1]) percpu{i};
   }
+
+#if WITH_FAIR_SCHEDULER
+  // Now that every percpu instance exists, order each CPU's target search by
+  // cache distance.
+  for (cpu_num_t i = 0; i < processor_count_; i++) {
+    processor_index_[i]->scheduler.InitializeSearchSet();
+  }
+#endif
 }
 
 // Allocate secondary percpu instances before booting other processors, after
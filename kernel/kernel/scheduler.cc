@@ -12,6 +12,7 @@
 #include <inttypes.h>
 #include <lib/counters.h>
 #include <lib/ktrace.h>
+#include <lib/system-topology.h>
 #include <list.h>
 #include <platform.h>
 #include <printf.h>
@@ -67,6 +68,16 @@ KCOUNTER(latency_counter, "thread.latency_accum")
 KCOUNTER(runnable_counter, "thread.runnable_accum")
 KCOUNTER(samples_counter, "thread.samples_accum")
 
+// Counters to track the cache distance of migrations made by target selection.
+KCOUNTER(migrate_smt_counter, "thread.migrate.smt")
+KCOUNTER(migrate_cache_counter, "thread.migrate.cache")
+KCOUNTER(migrate_remote_counter, "thread.migrate.remote")
+KCOUNTER(search_early_exit_counter, "thread.find_target.early_exit")
+
+// Counters to track threads pulled from busier CPUs.
+KCOUNTER(steal_idle_counter, "thread.steal.idle")
+KCOUNTER(steal_balance_counter, "thread.steal.balance")
+
 namespace {
 
 // Conversion table entry. Scales the integer argument to a fixed-point weight
@@ -94,6 +105,19 @@ constexpr SchedWeight PriorityToWeight(int priority) { return kPriorityToWeightT
 constexpr SchedWeight kMinWeight = PriorityToWeight(LOWEST_PRIORITY);
 constexpr SchedWeight kReciprocalMinWeight = 1 / kMinWeight;
 
+// Target CPU searches stop before moving to a more distant cache level when
+// the best candidate found so far has a total weight at or below this value.
+constexpr SchedWeight kSearchTerminationThreshold = kMinWeight;
+
+// Cache distances reported by the system topology. See
+// system_topology::Graph::ProcessorDistance.
+constexpr uint32_t kSmtDistance = 1;
+constexpr uint32_t kSharedCacheDistance = 2;
+
+// Maximum number of queued threads examined on a peer CPU when looking for a
+// thread to steal.
+constexpr int kMaxStealCandidates = 8;
+
 // Utility operator to make expressions more succinct that update thread times
 // and durations of basic types using the fixed-point counterparts.
 constexpr zx_time_t& operator+=(zx_time_t& value, SchedDuration delta) {
@@ -251,10 +275,76 @@ thread_t* Scheduler::EvaluateNextThread(SchedTime now, thread_t* current_thread,
   // Select another thread to run.
   if (likely(!run_queue_.is_empty())) {
     return DequeueThread();
-  } else {
-    const cpu_num_t current_cpu = arch_curr_cpu_num();
-    return &percpu::Get(current_cpu).idle_thread;
   }
+
+  // This CPU is about to go idle. Try to pull a waiting thread from a busier
+  // CPU instead.
+  if (StealThread(now)) {
+    steal_idle_counter.Add(1);
+    return DequeueThread();
+  }
+
+  return &percpu::Get(current_cpu).idle_thread;
+}
+
+bool Scheduler::StealThread(SchedTime now) {
+  LocalTraceDuration trace{"steal_thread: cpu,count"_stringref};
+
+  const cpu_mask_t this_cpu_mask = cpu_num_to_mask(this_cpu());
+  const cpu_mask_t active_mask = mp_get_active_mask();
+
+  // Do not pull threads onto a CPU that is going offline.
+  if ((active_mask & this_cpu_mask) == 0) {
+    return false;
+  }
+
+  // Find the most loaded peer with a queued thread that is allowed to run on
+  // this CPU. Moving a thread is only worthwhile if the peer would still have
+  // at least as many runnable threads as this CPU afterwards. Ties go to the
+  // nearer peer.
+  Scheduler* busiest = nullptr;
+  thread_t* candidate = nullptr;
+  const size_t peer_count = percpu::processor_count() - 1;
+  for (size_t i = 0; i < peer_count; i++) {
+    const cpu_num_t cpu = search_set_count_ != 0
+                              ? search_set_[i].cpu
+                              : static_cast<cpu_num_t>((this_cpu() + 1 + i) % (peer_count + 1));
+    if ((active_mask & cpu_num_to_mask(cpu)) == 0) {
+      continue;
+    }
+
+    Scheduler* const peer = Get(cpu);
+    if (peer->run_queue_.is_empty() ||
+        peer->runnable_task_count_ < runnable_task_count_ + 2 ||
+        (busiest != nullptr && peer->weight_total_ <= busiest->weight_total_)) {
+      continue;
+    }
+
+    // Examine the threads furthest from running first, since moving them
+    // saves the most queue time.
+    int examined = 0;
+    for (auto iter = --peer->run_queue_.end(); iter.IsValid() && examined < kMaxStealCandidates;
+         --iter, examined++) {
+      if (GetAllowedCpusMask(active_mask, &*iter) & this_cpu_mask) {
+        busiest = peer;
+        candidate = &*iter;
+        break;
+      }
+    }
+  }
+
+  if (candidate == nullptr) {
+    return false;
+  }
+
+  SCHED_LTRACEF("thread=%s from=%u\n", candidate->name, busiest->this_cpu());
+
+  busiest->run_queue_.erase(*candidate);
+  busiest->Remove(candidate);
+  Insert(now, candidate);
+
+  trace.End(busiest->this_cpu(), busiest->runnable_task_count_);
+  return true;
 }
 
 cpu_num_t Scheduler::FindTargetCpu(thread_t* thread) {
@@ -292,22 +382,67 @@ cpu_num_t Scheduler::FindTargetCpu(thread_t* thread) {
 
   target_queue = Get(target_cpu);
 
-  // See if there is a better target in the set of available CPUs.
-  // TODO(eieio): Replace this with a search in order of increasing cache
-  // distance from the initial target cpu when topology information is available.
-  // TODO(eieio): Add some sort of threshold to terminate search when a sufficiently
-  // unloaded target is found.
+  // See if there is a better target in the set of available CPUs, searching
+  // in order of increasing cache distance from the initial target. The search
+  // terminates as soon as an idle CPU is found, or before moving on to a more
+  // distant cache level if the best candidate so far is sufficiently unloaded.
+  const Scheduler* const initial_queue = target_queue;
   cpu_mask_t remaining_mask = available_mask & ~cpu_num_to_mask(target_cpu);
-  while (remaining_mask != 0 && target_queue->weight_total_ > SchedWeight{0}) {
-    const cpu_num_t candidate_cpu = lowest_cpu_set(remaining_mask);
-    Scheduler* const candidate_queue = Get(candidate_cpu);
+  if (initial_queue->search_set_count_ != 0) {
+    uint32_t current_distance = 0;
+    for (size_t i = 0; i < initial_queue->search_set_count_; i++) {
+      if (remaining_mask == 0 || target_queue->weight_total_ == SchedWeight{0}) {
+        break;
+      }
+
+      const SearchEntry& entry = initial_queue->search_set_[i];
+      const cpu_mask_t candidate_mask = cpu_num_to_mask(entry.cpu);
+      if ((remaining_mask & candidate_mask) == 0) {
+        continue;
+      }
+
+      // Always search the nearest cache level. Stay within it if it yielded a
+      // sufficiently unloaded target.
+      if (entry.distance != current_distance) {
+        if (current_distance != 0 && target_queue->weight_total_ <= kSearchTerminationThreshold) {
+          search_early_exit_counter.Add(1);
+          break;
+        }
+        current_distance = entry.distance;
+      }
+
+      Scheduler* const candidate_queue = Get(entry.cpu);
+      if (candidate_queue->weight_total_ < target_queue->weight_total_) {
+        target_cpu = entry.cpu;
+        target_queue = candidate_queue;
+      }
 
-    if (candidate_queue->weight_total_ < target_queue->weight_total_) {
-      target_cpu = candidate_cpu;
-      target_queue = candidate_queue;
+      remaining_mask &= ~candidate_mask;
     }
+  } else {
+    while (remaining_mask != 0 && target_queue->weight_total_ > SchedWeight{0}) {
+      const cpu_num_t candidate_cpu = lowest_cpu_set(remaining_mask);
+      Scheduler* const candidate_queue = Get(candidate_cpu);
+
+      if (candidate_queue->weight_total_ < target_queue->weight_total_) {
+        target_cpu = candidate_cpu;
+        target_queue = candidate_queue;
+      }
 
-    remaining_mask &= ~cpu_num_to_mask(candidate_cpu);
+      remaining_mask &= ~cpu_num_to_mask(candidate_cpu);
+    }
+  }
+
+  // Track the cache distance of the migration, if any.
+  if (thread->last_cpu != INVALID_CPU && thread->last_cpu != target_cpu) {
+    const uint32_t distance = Get(thread->last_cpu)->CacheDistance(target_cpu);
+    if (distance == kSmtDistance) {
+      migrate_smt_counter.Add(1);
+    } else if (distance == kSharedCacheDistance) {
+      migrate_cache_counter.Add(1);
+    } else if (distance != UINT32_MAX) {
+      migrate_remote_counter.Add(1);
+    }
   }
 
   SCHED_LTRACEF("thread=%s target_cpu=%u\n", thread->name, target_cpu);
@@ -315,6 +450,51 @@ cpu_num_t Scheduler::FindTargetCpu(thread_t* thread) {
   return target_cpu;
 }
 
+void Scheduler::InitializeSearchSet() {
+  const system_topology::Graph& topology = system_topology::GetSystemTopology();
+  const cpu_num_t cpu_count = static_cast<cpu_num_t>(percpu::processor_count());
+  DEBUG_ASSERT(cpu_count <= SMP_MAX_CPUS);
+
+  // Build the list outside of the thread lock. Candidates at the same distance
+  // are ordered starting after this CPU so that CPUs sharing a cache level do
+  // not all converge on the same candidate first.
+  SearchEntry entries[SMP_MAX_CPUS];
+  size_t count = 0;
+  for (cpu_num_t i = 1; i < cpu_count; i++) {
+    const cpu_num_t cpu = (this_cpu_ + i) % cpu_count;
+
+    uint32_t distance;
+    if (topology.ProcessorDistance(this_cpu_, cpu, &distance) != ZX_OK) {
+      distance = UINT32_MAX;
+    }
+
+    // Stable insertion sort by distance.
+    size_t j = count++;
+    for (; j > 0 && entries[j - 1].distance > distance; j--) {
+      entries[j] = entries[j - 1];
+    }
+    entries[j] = SearchEntry{cpu, distance};
+  }
+
+  Guard<spin_lock_t, IrqSave> guard{ThreadLock::Get()};
+  for (size_t i = 0; i < count; i++) {
+    search_set_[i] = entries[i];
+  }
+  search_set_count_ = count;
+}
+
+uint32_t Scheduler::CacheDistance(cpu_num_t cpu) const {
+  if (cpu == this_cpu_) {
+    return 0;
+  }
+  for (size_t i = 0; i < search_set_count_; i++) {
+    if (search_set_[i].cpu == cpu) {
+      return search_set_[i].distance;
+    }
+  }
+  return UINT32_MAX;
+}
+
 void Scheduler::UpdateTimeline(SchedTime now) {
   LocalTraceDuration trace{"update_vtime"_stringref};
 
@@ -379,6 +559,14 @@ void Scheduler::RescheduleCommon(SchedTime now, void* outer_trace) {
 
   const bool timeslice_expired = total_runtime_ns >= current_state->time_slice_ns_;
 
+  // Correct load imbalance with other CPUs if the periodic check is due.
+  if (balance_pending_) {
+    balance_pending_ = false;
+    if (StealThread(now)) {
+      steal_balance_counter.Add(1);
+    }
+  }
+
   // Select a thread to run.
   thread_t* const next_thread = EvaluateNextThread(now, current_thread, timeslice_expired);
   DEBUG_ASSERT(next_thread != nullptr);
@@ -1028,6 +1216,15 @@ void Scheduler::InheritWeight(thread_t* thread, int priority, cpu_mask_t* cpus_t
 
 void Scheduler::TimerTick(SchedTime now) {
   LocalTraceDuration trace{"sched_timer_tick"_stringref};
+
+  // Schedule a load balance check for the upcoming reschedule if the
+  // balance period elapsed.
+  Scheduler* const current = Get();
+  if (now >= current->next_balance_time_ns_) {
+    current->next_balance_time_ns_ = now + kDefaultBalancePeriod;
+    current->balance_pending_ = true;
+  }
+
   thread_preempt_set_pending();
 }
 
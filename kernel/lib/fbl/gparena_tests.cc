@@ -9,6 +9,10 @@
 
 #include <fbl/alloc_checker.h>
 #include <fbl/gparena.h>
+#include <kernel/cpu.h>
+#include <kernel/mp.h>
+#include <kernel/thread.h>
+#include <ktl/unique_ptr.h>
 
 using fbl::GPArena;
 
@@ -271,6 +275,101 @@ static bool parallel_grow_memory() {
   END_TEST;
 }
 
+static bool per_cpu_cache() {
+  BEGIN_TEST;
+
+  constexpr int preserve = 8;
+  constexpr char magic[preserve + 1] = "preserve";
+  constexpr int count = 32;
+
+  // Too large for the stack with all the per-cpu caches.
+  fbl::AllocChecker ac;
+  auto arena = ktl::make_unique<fbl::PerCpuGPArena<preserve, 16, 8>>(&ac);
+  ASSERT_TRUE(ac.check());
+  ASSERT_EQ(arena->Init("test", count), ZX_OK);
+
+  void* allocs[count];
+  for (int i = 0; i < count; i++) {
+    allocs[i] = arena->Alloc();
+    ASSERT_NONNULL(allocs[i]);
+    memcpy(allocs[i], magic, preserve);
+  }
+  EXPECT_EQ(static_cast<size_t>(count), arena->DiagnosticCount());
+
+  // Freed objects either sit in a cache or go back to the arena, and either way stop being counted
+  // and keep their preserved data.
+  for (int i = 0; i < count; i++) {
+    arena->Free(allocs[i]);
+  }
+  EXPECT_EQ(0u, arena->DiagnosticCount());
+  for (int i = 0; i < count; i++) {
+    EXPECT_EQ(memcmp(allocs[i], magic, preserve), 0);
+  }
+
+  // Every object can be allocated again, whether it was cached or not.
+  for (int i = 0; i < count; i++) {
+    allocs[i] = arena->Alloc();
+    ASSERT_NONNULL(allocs[i]);
+    EXPECT_EQ(memcmp(allocs[i], magic, preserve), 0);
+  }
+  EXPECT_EQ(static_cast<size_t>(count), arena->DiagnosticCount());
+
+  // Cleanup. The destructor drains the caches.
+  for (int i = 0; i < count; i++) {
+    arena->Free(allocs[i]);
+  }
+
+  END_TEST;
+}
+
+// Objects cached on one cpu must still be allocatable from another once the arena runs out.
+static bool per_cpu_cache_other_cpu() {
+  BEGIN_TEST;
+
+  const cpu_mask_t online = mp_get_online_mask();
+  const cpu_num_t first_cpu = lowest_cpu_set(online);
+  const cpu_num_t last_cpu = highest_cpu_set(online);
+  if (first_cpu == last_cpu) {
+    unittest_printf("only one cpu online, skipping\n");
+    END_TEST;
+  }
+
+  constexpr int count = 32;
+  fbl::AllocChecker ac;
+  auto arena = ktl::make_unique<fbl::PerCpuGPArena<0, 16, 8>>(&ac);
+  ASSERT_TRUE(ac.check());
+  ASSERT_EQ(arena->Init("test", count), ZX_OK);
+
+  thread_t* const self = get_current_thread();
+  const cpu_mask_t old_affinity = thread_get_cpu_affinity(self);
+
+  // Allocate everything and free it on the first cpu, leaving some objects in its cache.
+  thread_set_cpu_affinity(self, cpu_num_to_mask(first_cpu));
+  void* allocs[count];
+  for (int i = 0; i < count; i++) {
+    allocs[i] = arena->Alloc();
+    EXPECT_NONNULL(allocs[i]);
+  }
+  for (int i = 0; i < count; i++) {
+    arena->Free(allocs[i]);
+  }
+
+  // The last of these can only come from the first cpu's cache.
+  thread_set_cpu_affinity(self, cpu_num_to_mask(last_cpu));
+  for (int i = 0; i < count; i++) {
+    allocs[i] = arena->Alloc();
+    EXPECT_NONNULL(allocs[i]);
+  }
+  EXPECT_NULL(arena->Alloc());
+
+  thread_set_cpu_affinity(self, old_affinity);
+  for (int i = 0; i < count; i++) {
+    arena->Free(allocs[i]);
+  }
+
+  END_TEST;
+}
+
 #define GPARENA_UNITTEST(fname) UNITTEST(#fname, fname)
 
 UNITTEST_START_TESTCASE(gparena_tests)
@@ -281,4 +380,6 @@ GPARENA_UNITTEST(does_preserve)
 GPARENA_UNITTEST(committed_monotonic)
 GPARENA_UNITTEST(parallel_alloc)
 GPARENA_UNITTEST(parallel_grow_memory)
+GPARENA_UNITTEST(per_cpu_cache)
+GPARENA_UNITTEST(per_cpu_cache_other_cpu)
 UNITTEST_END_TESTCASE(gparena_tests, "gparena_tests", "GPArena test");
@@ -7,8 +7,13 @@
 #ifndef ZIRCON_KERNEL_LIB_FBL_INCLUDE_FBL_GPARENA_H_
 #define ZIRCON_KERNEL_LIB_FBL_INCLUDE_FBL_GPARENA_H_
 
+#include <string.h>
+
+#include <arch/ops.h>
 #include <fbl/auto_call.h>
 #include <fbl/mutex.h>
+#include <kernel/align.h>
+#include <kernel/spinlock.h>
 #include <vm/vm_aspace.h>
 #include <vm/vm_object_paged.h>
 
@@ -261,6 +266,126 @@ class GPArena {
 #endif
 };
 
+// PerCpuGPArena puts a small per-cpu cache of free objects in front of a GPArena. Objects freed on
+// a cpu are handed back out by the next Alloc on that cpu without touching the shared free list,
+// so allocation heavy paths don't bounce its cache line between cpus. Once the arena is exhausted,
+// Alloc takes objects from the caches of other cpus, so all |max_count| objects can still be
+// allocated.
+//
+// Cached objects are only referenced by pointer and never written to, so the guarantees of
+// GPArena about the first PersistSize bytes of an object still hold.
+template <size_t PersistSize, size_t ObjectSize, size_t CacheDepth = 16>
+class PerCpuGPArena {
+ public:
+  PerCpuGPArena() = default;
+  ~PerCpuGPArena() { Drain(); }
+
+  zx_status_t Init(const char* name, size_t max_count) { return arena_.Init(name, max_count); }
+
+  void* Alloc() {
+    // The cpu may change under us, which only means we use another cpu's cache.
+    Cache& cache = caches_[arch_curr_cpu_num()];
+    {
+      Guard<SpinLock, IrqSave> guard{&cache.lock};
+      const size_t count = cache.count.load(ktl::memory_order_relaxed);
+      if (count > 0) {
+        cache.count.store(count - 1, ktl::memory_order_relaxed);
+        return cache.objects[count - 1];
+      }
+    }
+    void* node = arena_.Alloc();
+    if (unlikely(node == nullptr)) {
+      node = AllocFromAnyCache();
+    }
+    return node;
+  }
+
+  void Free(void* node) {
+    Cache& cache = caches_[arch_curr_cpu_num()];
+    Guard<SpinLock, IrqSave> guard{&cache.lock};
+    size_t count = cache.count.load(ktl::memory_order_relaxed);
+    if (count == CacheDepth) {
+      // Return the oldest half to the arena. GPArena::Free never blocks, so this is safe with the
+      // spinlock held.
+      for (size_t i = 0; i < kFlushCount; i++) {
+        arena_.Free(cache.objects[i]);
+      }
+      memmove(cache.objects, cache.objects + kFlushCount,
+              (count - kFlushCount) * sizeof(cache.objects[0]));
+      count -= kFlushCount;
+    }
+    cache.objects[count] = node;
+    cache.count.store(count + 1, ktl::memory_order_relaxed);
+  }
+
+  // Returns every cached object to the arena.
+  void Drain() {
+    for (Cache& cache : caches_) {
+      Guard<SpinLock, IrqSave> guard{&cache.lock};
+      const size_t count = cache.count.load(ktl::memory_order_relaxed);
+      for (size_t i = 0; i < count; i++) {
+        arena_.Free(cache.objects[i]);
+      }
+      cache.count.store(0, ktl::memory_order_relaxed);
+    }
+  }
+
+  // Number of objects that are allocated and not sitting in a cache. This is a racy sum over all
+  // the caches and is only meant for diagnostics.
+  size_t DiagnosticCount() const {
+    size_t cached = 0;
+    for (const Cache& cache : caches_) {
+      cached += cache.count.load(ktl::memory_order_relaxed);
+    }
+    const size_t count = arena_.DiagnosticCount();
+    return count > cached ? count - cached : 0;
+  }
+
+  // Number of objects handed out by the underlying arena, including those sitting in a cache. This
+  // is a single load rather than a sum over every cpu, and overestimates DiagnosticCount by at
+  // most CacheDepth objects per cpu.
+  size_t DiagnosticCountUpperBound() const { return arena_.DiagnosticCount(); }
+
+  bool Committed(void* node) const { return arena_.Committed(node); }
+
+  void* Base() const { return arena_.Base(); }
+
+  void Dump() {
+    arena_.Dump();
+    printf(" per-cpu cached %zu\n", arena_.DiagnosticCount() - DiagnosticCount());
+  }
+
+ private:
+  DISALLOW_COPY_ASSIGN_AND_MOVE(PerCpuGPArena);
+
+  static_assert(CacheDepth >= 2, "CacheDepth must allow a partial flush");
+  static constexpr size_t kFlushCount = CacheDepth / 2;
+
+  // Takes an object from the first cpu's cache that has one, or returns nullptr if they are all
+  // empty. Only used once the arena is exhausted, so walking every cpu is fine.
+  void* AllocFromAnyCache() {
+    for (Cache& cache : caches_) {
+      Guard<SpinLock, IrqSave> guard{&cache.lock};
+      const size_t count = cache.count.load(ktl::memory_order_relaxed);
+      if (count > 0) {
+        cache.count.store(count - 1, ktl::memory_order_relaxed);
+        return cache.objects[count - 1];
+      }
+    }
+    return nullptr;
+  }
+
+  struct Cache {
+    DECLARE_SPINLOCK(PerCpuGPArena) lock;
+    // Written only with |lock| held, but read without it by DiagnosticCount.
+    ktl::atomic<size_t> count{0};
+    void* objects[CacheDepth] TA_GUARDED(lock);
+  } __CPU_ALIGN;
+
+  GPArena<PersistSize, ObjectSize> arena_;
+  Cache caches_[SMP_MAX_CPUS];
+};
+
 }  // namespace fbl
 
 #endif  // ZIRCON_KERNEL_LIB_FBL_INCLUDE_FBL_GPARENA_H_
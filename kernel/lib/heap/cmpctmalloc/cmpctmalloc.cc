@@ -18,9 +18,15 @@
 #include <string.h>
 #include <trace.h>
 
+#include <new>
+
+#include <arch/ops.h>
+#include <kernel/align.h>
 #include <kernel/mutex.h>
 #include <kernel/spinlock.h>
 #include <kernel/thread.h>
+#include <ktl/atomic.h>
+#include <lk/init.h>
 #include <vm/vm.h>
 
 // Malloc implementation tuned for space.
@@ -29,6 +35,9 @@
 // kept in linked lists with 8 different sizes per binary order of magnitude
 // and the header size is two words with eager coalescing on free.
 //
+// When built with CMPCT_PERCPU_CACHE, small allocations and frees are served
+// from per-cpu caches in front of the global mutex. See percpu_cache.
+//
 // ## Concepts ##
 //
 // OS allocation:
@@ -115,6 +124,10 @@
 
 #define LOCAL_TRACE 0
 
+#ifndef CMPCT_PERCPU_CACHE
+#define CMPCT_PERCPU_CACHE 0
+#endif
+
 // Use HEAP_ENABLE_TESTS to enable internal testing. The tests are not useful
 // when the target system is up. By that time we have done hundreds of allocations
 // already.
@@ -770,28 +783,10 @@ static void cmpct_test_return_to_os(void) TA_EXCL(TheHeapLock::Get()) {
 }
 #endif  // HEAP_ENABLE_TESTS
 
-/****************************************************
- *
- * Public API
- *
- ****************************************************/
-
-void* cmpct_alloc(size_t size) {
-  if (size == 0u) {
-    return NULL;
-  }
-
-  // Large allocations are no longer allowed. See ZX-1318 for details.
-  if (size > (HEAP_LARGE_ALLOC_BYTES - sizeof(header_t))) {
-    return NULL;
-  }
-
-  size_t rounded_up;
-  int start_bucket = size_to_index_allocating(size, &rounded_up);
-
-  rounded_up += sizeof(header_t);
-
-  Guard<Mutex> guard(TheHeapLock::Get());
+// Allocates an area from bucket |start_bucket| or above, growing the heap if needed.
+// |rounded_up| is the size of the area including its header.
+static void* alloc_locked(size_t size, int start_bucket, size_t rounded_up)
+    TA_REQ(TheHeapLock::Get()) {
   int bucket = find_nonempty_bucket(start_bucket);
   if (bucket == -1) {
     // Grow heap by at least 12% if we can.
@@ -833,30 +828,8 @@ void* cmpct_alloc(size_t size) {
   return result;
 }
 
-void* cmpct_realloc(void* payload, size_t size) {
-  if (payload == NULL) {
-    return cmpct_alloc(size);
-  }
-  header_t* header = (header_t*)payload - 1;
-  size_t old_size = header->size - sizeof(header_t);
-
-  void* new_payload = cmpct_alloc(size);
-  if (new_payload == NULL) {
-    return NULL;
-  }
-
-  memcpy(new_payload, payload, MIN(size, old_size));
-  cmpct_free(payload);
-  return new_payload;
-}
-
-void cmpct_free(void* payload) {
-  if (payload == NULL) {
-    return;
-  }
-
-  Guard<Mutex> guard(TheHeapLock::Get());
-
+// Returns an allocated area to the free buckets, coalescing it with its neighbors.
+static void free_locked(void* payload) TA_REQ(TheHeapLock::Get()) {
   header_t* header = (header_t*)payload - 1;
   DEBUG_ASSERT(!is_tagged_as_free(header));  // Double free!
   size_t size = header->size;
@@ -891,6 +864,315 @@ void cmpct_free(void* payload) {
   }
 }
 
+#if CMPCT_PERCPU_CACHE
+// Per-cpu caches of small areas.
+//
+// Each cpu keeps a magazine of areas for each of the smallest buckets. Areas
+// in a magazine are still marked as allocated in the heap, so they are never
+// coalesced, and cmpct_alloc() can hand them straight back out without taking
+// TheHeapLock. An empty magazine is refilled with a batch of areas from the
+// heap and a full one returns half of its areas to the heap, so the lock is
+// taken at most once per batch.
+//
+// Areas are cached by the bucket their size rounds down to, so every area in
+// the magazine for a bucket is large enough for any allocation that rounds up
+// to that bucket.
+
+// Buckets 0 to 23 hold areas of up to 256 bytes.
+#define CACHED_BUCKETS 24
+#define MAGAZINE_SIZE 16
+#define MAGAZINE_BATCH (MAGAZINE_SIZE / 2)
+
+struct magazine {
+  size_t count;
+  void* areas[MAGAZINE_SIZE];
+};
+
+struct percpu_cache {
+  DECLARE_SPINLOCK(percpu_cache) lock;
+  magazine magazines[CACHED_BUCKETS] TA_GUARDED(lock);
+  // Total size of the areas in |magazines|, headers included.
+  size_t bytes TA_GUARDED(lock);
+} __CPU_ALIGN;
+
+// One cache per cpu, allocated by cache_init() once the number of cpus is
+// known. The count is published after the array.
+static percpu_cache* caches;
+static ktl::atomic<uint> cache_cpus{0};
+
+// Set once the caches exist, and cleared while the heap tests run, since they
+// check the exact state of the free buckets.
+static ktl::atomic<bool> caches_enabled{false};
+
+static inline size_t area_size(const void* payload) { return ((const header_t*)payload - 1)->size; }
+
+// Areas in a magazine are still allocated as far as the heap is concerned, so
+// free_locked() cannot catch a second free of one. Instead the first two words
+// of a cached area's payload, which every area has, are tagged while it sits in
+// a magazine.
+#define CACHED_TAG ((uintptr_t)0xcac4edc0ffee0000ull)
+static_assert(sizeof(free_t) - sizeof(header_t) >= 2 * sizeof(uintptr_t), "");
+
+static inline void tag_as_cached(void* payload) {
+  uintptr_t* words = (uintptr_t*)payload;
+  words[0] = CACHED_TAG;
+  words[1] = (uintptr_t)payload;
+}
+
+static inline void untag_cached(void* payload) { ((uintptr_t*)payload)[0] = 0; }
+
+static inline bool is_tagged_as_cached(const void* payload) {
+  const uintptr_t* words = (const uintptr_t*)payload;
+  return words[0] == CACHED_TAG && words[1] == (uintptr_t)payload;
+}
+
+// Returns a batch of areas taken out of a magazine to the heap.
+static void cache_release(void** batch, size_t count) TA_EXCL(TheHeapLock::Get()) {
+  for (size_t i = 0; i < count; i++) {
+    untag_cached(batch[i]);
+  }
+  Guard<Mutex> guard(TheHeapLock::Get());
+  for (size_t i = 0; i < count; i++) {
+    free_locked(batch[i]);
+  }
+}
+
+static void* cache_alloc(int bucket, size_t rounded_up) TA_EXCL(TheHeapLock::Get()) {
+  if (!caches_enabled.load(ktl::memory_order_acquire)) {
+    return NULL;
+  }
+
+  // The cpu may change under us, which only means we use another cpu's cache.
+  percpu_cache& cache = caches[arch_curr_cpu_num()];
+  {
+    Guard<SpinLock, IrqSave> guard{&cache.lock};
+    magazine& m = cache.magazines[bucket];
+    if (m.count > 0) {
+      void* area = m.areas[--m.count];
+      cache.bytes -= area_size(area);
+      untag_cached(area);
+      return area;
+    }
+  }
+
+  // Refill from the heap. Take one area for this allocation and cache the rest.
+  void* batch[MAGAZINE_BATCH];
+  size_t count = 0;
+  {
+    Guard<Mutex> guard(TheHeapLock::Get());
+    while (count < MAGAZINE_BATCH) {
+      void* area = alloc_locked(rounded_up - sizeof(header_t), bucket, rounded_up);
+      if (area == NULL) {
+        break;
+      }
+      batch[count++] = area;
+    }
+  }
+  if (count == 0) {
+    return NULL;
+  }
+
+  {
+    Guard<SpinLock, IrqSave> guard{&cache.lock};
+    magazine& m = cache.magazines[bucket];
+    while (count > 1 && m.count < MAGAZINE_SIZE) {
+      void* area = batch[--count];
+      tag_as_cached(area);
+      cache.bytes += area_size(area);
+      m.areas[m.count++] = area;
+    }
+  }
+  // Someone else filled the magazine while we were refilling it.
+  if (count > 1) {
+    Guard<Mutex> guard(TheHeapLock::Get());
+    while (count > 1) {
+      free_locked(batch[--count]);
+    }
+  }
+  return batch[0];
+}
+
+static bool cache_free(void* payload) TA_EXCL(TheHeapLock::Get()) {
+  if (!caches_enabled.load(ktl::memory_order_acquire)) {
+    return false;
+  }
+
+  // The header of an allocated area belongs to its owner, so it can be read
+  // without the heap lock. Only the owner sets its free bit, so the unlocked
+  // check below is stable unless the area is being freed twice.
+  header_t* header = (header_t*)payload - 1;
+  DEBUG_ASSERT(((uintptr_t)header->left & FREE_BIT) == 0);  // Double free!
+  DEBUG_ASSERT(!is_tagged_as_cached(payload));              // Double free!
+  int bucket = size_to_index_freeing(header->size - sizeof(header_t));
+  if (bucket >= CACHED_BUCKETS) {
+    return false;
+  }
+
+#ifdef CMPCT_DEBUG
+  memset(payload, FREE_FILL, header->size - sizeof(header_t));
+#endif
+  tag_as_cached(payload);
+
+  void* batch[MAGAZINE_BATCH];
+  size_t count = 0;
+  percpu_cache& cache = caches[arch_curr_cpu_num()];
+  {
+    Guard<SpinLock, IrqSave> guard{&cache.lock};
+    magazine& m = cache.magazines[bucket];
+    if (m.count == MAGAZINE_SIZE) {
+      // Return the oldest half to the heap.
+      count = MAGAZINE_BATCH;
+      memcpy(batch, m.areas, count * sizeof(void*));
+      memmove(m.areas, m.areas + count, (m.count - count) * sizeof(void*));
+      m.count -= count;
+      for (size_t i = 0; i < count; i++) {
+        cache.bytes -= area_size(batch[i]);
+      }
+    }
+    m.areas[m.count++] = payload;
+    cache.bytes += header->size;
+  }
+
+  if (count > 0) {
+    cache_release(batch, count);
+  }
+  return true;
+}
+
+// Returns every cached area on every cpu to the heap.
+static void cache_drain() TA_EXCL(TheHeapLock::Get()) {
+  const uint cpus = cache_cpus.load(ktl::memory_order_acquire);
+  for (uint cpu = 0; cpu < cpus; cpu++) {
+    percpu_cache& cache = caches[cpu];
+    for (int bucket = 0; bucket < CACHED_BUCKETS; bucket++) {
+      void* batch[MAGAZINE_SIZE];
+      size_t count;
+      {
+        Guard<SpinLock, IrqSave> guard{&cache.lock};
+        magazine& m = cache.magazines[bucket];
+        count = m.count;
+        memcpy(batch, m.areas, count * sizeof(void*));
+        m.count = 0;
+        for (size_t i = 0; i < count; i++) {
+          cache.bytes -= area_size(batch[i]);
+        }
+      }
+      if (count > 0) {
+        cache_release(batch, count);
+      }
+    }
+  }
+}
+
+// Number and total size of the areas currently held by the per-cpu caches.
+// Racy, for stats only.
+static void cache_totals(size_t* areas, size_t* bytes) {
+  *areas = 0;
+  *bytes = 0;
+  const uint cpus = cache_cpus.load(ktl::memory_order_acquire);
+  for (uint cpu = 0; cpu < cpus; cpu++) {
+    percpu_cache& cache = caches[cpu];
+    Guard<SpinLock, IrqSave> guard{&cache.lock};
+    for (const magazine& m : cache.magazines) {
+      *areas += m.count;
+    }
+    *bytes += cache.bytes;
+  }
+}
+
+// The caches are sized for the cpus actually present, so they are only
+// allocated once those are known.
+static void cache_init(uint level) {
+  static_assert((MAX_CACHE_LINE % alignof(percpu_cache)) == 0, "");
+
+  const uint count = arch_max_num_cpus();
+  auto* array =
+      static_cast<percpu_cache*>(cmpct_memalign(sizeof(percpu_cache) * count, MAX_CACHE_LINE));
+  if (array == NULL) {
+    printf("cmpctmalloc: could not allocate per-cpu caches\n");
+    return;
+  }
+  for (uint cpu = 0; cpu < count; cpu++) {
+    new (&array[cpu]) percpu_cache{};
+  }
+
+  caches = array;
+  cache_cpus.store(count, ktl::memory_order_release);
+  caches_enabled.store(true, ktl::memory_order_release);
+}
+
+LK_INIT_HOOK(cmpct_percpu_cache, cache_init, LK_INIT_LEVEL_THREADING)
+#endif  // CMPCT_PERCPU_CACHE
+
+/****************************************************
+ *
+ * Public API
+ *
+ ****************************************************/
+
+void* cmpct_alloc(size_t size) {
+  if (size == 0u) {
+    return NULL;
+  }
+
+  // Large allocations are no longer allowed. See ZX-1318 for details.
+  if (size > (HEAP_LARGE_ALLOC_BYTES - sizeof(header_t))) {
+    return NULL;
+  }
+
+  size_t rounded_up;
+  int start_bucket = size_to_index_allocating(size, &rounded_up);
+
+  rounded_up += sizeof(header_t);
+
+#if CMPCT_PERCPU_CACHE
+  if (start_bucket < CACHED_BUCKETS) {
+    void* result = cache_alloc(start_bucket, rounded_up);
+    if (result != NULL) {
+#ifdef CMPCT_DEBUG
+      memset(result, ALLOC_FILL, size);
+#endif
+      return result;
+    }
+  }
+#endif
+
+  Guard<Mutex> guard(TheHeapLock::Get());
+  return alloc_locked(size, start_bucket, rounded_up);
+}
+
+void* cmpct_realloc(void* payload, size_t size) {
+  if (payload == NULL) {
+    return cmpct_alloc(size);
+  }
+  header_t* header = (header_t*)payload - 1;
+  size_t old_size = header->size - sizeof(header_t);
+
+  void* new_payload = cmpct_alloc(size);
+  if (new_payload == NULL) {
+    return NULL;
+  }
+
+  memcpy(new_payload, payload, MIN(size, old_size));
+  cmpct_free(payload);
+  return new_payload;
+}
+
+void cmpct_free(void* payload) {
+  if (payload == NULL) {
+    return;
+  }
+
+#if CMPCT_PERCPU_CACHE
+  if (cache_free(payload)) {
+    return;
+  }
+#endif
+
+  Guard<Mutex> guard(TheHeapLock::Get());
+  free_locked(payload);
+}
+
 void* cmpct_memalign(size_t size, size_t alignment) {
   if (alignment < 8) {
     return cmpct_alloc(size);
@@ -948,19 +1230,40 @@ void cmpct_dump(bool panic_time) {
     // If we are panic'ing, just skip the lock.  All bets are off anyway.
     ([]() TA_NO_THREAD_SAFETY_ANALYSIS { cmpct_dump_locked(); })();
   } else {
-    Guard<Mutex> guard(TheHeapLock::Get());
-    cmpct_dump_locked();
+    {
+      Guard<Mutex> guard(TheHeapLock::Get());
+      cmpct_dump_locked();
+    }
+#if CMPCT_PERCPU_CACHE
+    size_t areas, bytes;
+    cache_totals(&areas, &bytes);
+    dprintf(INFO, "\tper-cpu cached areas %zu, %zu bytes\n", areas, bytes);
+#endif
   }
 }
 
 void cmpct_get_info(size_t* size_bytes, size_t* free_bytes) {
+#if CMPCT_PERCPU_CACHE
+  // Areas in the per-cpu caches are allocated as far as the heap is concerned,
+  // but are as free as anything in the buckets.
+  size_t cached_areas, cached_bytes;
+  cache_totals(&cached_areas, &cached_bytes);
+#endif
   Guard<Mutex> guard(TheHeapLock::Get());
   *size_bytes = theheap.size;
   *free_bytes = theheap.remaining;
+#if CMPCT_PERCPU_CACHE
+  *free_bytes += cached_bytes;
+#endif
 }
 
 #ifdef HEAP_ENABLE_TESTS
 void cmpct_test(void) {
+#if CMPCT_PERCPU_CACHE
+  // The tests check the exact state of the free buckets.
+  const bool caches_were_enabled = caches_enabled.exchange(false);
+  cache_drain();
+#endif
   cmpct_test_buckets();
   cmpct_test_get_back_newly_freed();
   cmpct_test_return_to_os();
@@ -1019,6 +1322,9 @@ void cmpct_test(void) {
   }
 
   cmpct_dump(false);
+#if CMPCT_PERCPU_CACHE
+  caches_enabled.store(caches_were_enabled);
+#endif
 }
 
 #else
@@ -1029,6 +1335,10 @@ void cmpct_trim(void) {
   // Look at free list entries that are at least as large as one page plus a
   // header. They might be at the start or the end of a block, so we can trim
   // them and free the page(s).
+#if CMPCT_PERCPU_CACHE
+  // Cached areas pin their OS allocations, so give them back first.
+  cache_drain();
+#endif
   Guard<Mutex> guard(TheHeapLock::Get());
   for (int bucket = size_to_index_freeing(PAGE_SIZE); bucket < NUMBER_OF_BUCKETS; bucket++) {
     free_t* next;
@@ -11,12 +11,19 @@
 #include <lib/ktrace/string_ref.h>
 #include <lib/zircon-internal/thread_annotations.h>
 #include <platform.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <arch/ops.h>
 #include <arch/user_copy.h>
+#include <fbl/algorithm.h>
 #include <fbl/alloc_checker.h>
 #include <hypervisor/ktrace.h>
+#include <kernel/align.h>
+#include <kernel/mp.h>
+#include <kernel/mutex.h>
+#include <kernel/spinlock.h>
+#include <ktl/atomic.h>
 #include <lk/init.h>
 #include <object/thread_dispatcher.h>
 #include <vm/vm_aspace.h>
@@ -60,91 +67,361 @@ static void ktrace_report_probes(void) {
   }
 }
 
+// A trace buffer owned by one cpu. Only that cpu adds records, with interrupts disabled, so
+// recording an event takes no locks and writes no cache lines shared with other cpus.
+//
+// Positions count the bytes recorded since the last rewind; the record at a position is at
+// the position modulo |size| in |data|. A record never wraps around the end of |data|: the
+// space left there is filled with a TAG_PAD record instead.
+struct ktrace_cpu_buffer {
+  uint8_t* data;
+  uint32_t size;
+
+  // Position just after the newest record. Written only by the owning cpu.
+  ktl::atomic<uint64_t> head;
+
+  // Position of the oldest record. Advanced by the owning cpu in circular mode, as it
+  // overwrites old records, and by the reader in streaming mode, as it drains them.
+  ktl::atomic<uint64_t> tail;
+
+  // Records dropped because the buffer was full. Written only by the owning cpu.
+  ktl::atomic<uint32_t> dropped;
+
+  // Value of |dropped| when the reader last drained this buffer.
+  uint32_t dropped_drained;
+} __CPU_ALIGN;
+
 typedef struct ktrace_state {
-  // where the next record will be written
+  // where the next metadata record will be written
   int offset;
 
   // mask of groups we allow, 0 == tracing disabled
   int grpmask;
 
-  // total size of the trace buffer
+  // KTRACE_MODE_* of the per-cpu buffers
+  int mode;
+
+  // total size of the metadata buffer
   uint32_t bufsize;
 
-  // offset where tracing was stopped, 0 if tracing active
-  uint32_t marker;
+  // offset of the first metadata record not yet drained in streaming mode
+  uint32_t drained;
 
-  // raw trace buffer
+  // metadata buffer: names and other records without timestamps
   uint8_t* buffer;
+
+  // buffers for the records of each cpu
+  uint32_t num_cpus;
+  ktrace_cpu_buffer cpus[SMP_MAX_CPUS];
 } ktrace_state_t;
 
 static ktrace_state_t KTRACE_STATE;
 
-ssize_t ktrace_read_user(void* ptr, uint32_t off, size_t len) {
-  ktrace_state_t* ks = &KTRACE_STATE;
+namespace {
+// Serializes readers and control operations.
+DECLARE_SINGLETON_MUTEX(KtraceLock);
+}  // namespace
+
+static ktrace_header_t* ktrace_cpu_record(ktrace_cpu_buffer* cb, uint64_t pos) {
+  return reinterpret_cast<ktrace_header_t*>(cb->data + pos % cb->size);
+}
+
+// Writes a whole record to the current cpu's buffer: the header, then the payload of
+// KTRACE_LEN(|tag|) - KTRACE_HDRSIZE bytes at |payload|. The record is published to
+// readers only once it is complete, and nothing touches it after interrupts are enabled
+// again, since the space may then be reused at any time. Returns false if the record was
+// dropped.
+static bool ktrace_write_record(ktrace_state_t* ks, uint32_t tag, uint32_t tid, uint64_t ts,
+                                const void* payload) {
+  DEBUG_ASSERT(arch_ints_disabled());
+  ktrace_cpu_buffer* cb = &ks->cpus[arch_curr_cpu_num()];
+  const uint32_t len = KTRACE_LEN(tag);
+
+  const uint64_t head = cb->head.load(ktl::memory_order_relaxed);
+  const uint32_t room = cb->size - static_cast<uint32_t>(head % cb->size);
+  const uint32_t pad = room < len ? room : 0;
+  const uint64_t end = head + pad + len;
+
+  uint64_t tail = cb->tail.load(ktl::memory_order_acquire);
+  if (end - tail > cb->size) {
+    const int mode = atomic_load(&ks->mode);
+    if (mode != KTRACE_MODE_CIRCULAR) {
+      cb->dropped.store(cb->dropped.load(ktl::memory_order_relaxed) + 1,
+                        ktl::memory_order_relaxed);
+      if (mode == KTRACE_MODE_ONESHOT) {
+        // if we arrive at the end, stop
+        atomic_store(&ks->grpmask, 0);
+      }
+      return false;
+    }
+    // make room by discarding the oldest records
+    while (end - tail > cb->size) {
+      const uint32_t n = KTRACE_LEN(ktrace_cpu_record(cb, tail)->tag);
+      DEBUG_ASSERT(n != 0);
+      tail += n;
+    }
+    cb->tail.store(tail, ktl::memory_order_release);
+  }
+
+  if (pad) {
+    ktrace_cpu_record(cb, head)->tag = (TAG_PAD & 0xFFFFFFF0) | (pad >> 3);
+  }
+  ktrace_header_t* hdr = ktrace_cpu_record(cb, head + pad);
+  hdr->tag = tag;
+  hdr->tid = tid;
+  hdr->ts = ts;
+  if (len > KTRACE_HDRSIZE) {
+    memcpy(hdr + 1, payload, len - KTRACE_HDRSIZE);
+  }
+  cb->head.store(end, ktl::memory_order_release);
+  return true;
+}
+
+static void ktrace_rewind_cpu(void*) {
+  ktrace_cpu_buffer* cb = &KTRACE_STATE.cpus[arch_curr_cpu_num()];
+  cb->head.store(0, ktl::memory_order_relaxed);
+  cb->tail.store(0, ktl::memory_order_relaxed);
+  cb->dropped.store(0, ktl::memory_order_relaxed);
+}
+
+// Empties every cpu's buffer. Each online cpu empties its own, so that this cannot race
+// with it adding a record.
+static void ktrace_rewind_cpus(ktrace_state_t* ks) TA_REQ(KtraceLock::Get()) {
+  mp_sync_exec(MP_IPI_TARGET_ALL, 0, ktrace_rewind_cpu, nullptr);
+  for (uint32_t cpu = 0; cpu < ks->num_cpus; cpu++) {
+    ktrace_cpu_buffer* cb = &ks->cpus[cpu];
+    if (!mp_is_cpu_online(cpu)) {
+      cb->head.store(0, ktl::memory_order_relaxed);
+      cb->tail.store(0, ktl::memory_order_relaxed);
+      cb->dropped.store(0, ktl::memory_order_relaxed);
+    }
+    cb->dropped_drained = 0;
+  }
+}
+
+static void ktrace_sync_cpu(void*) {}
+
+namespace {
+
+// Copies a trace assembled from several pieces to userspace, starting |offset| bytes
+// into the trace. With a null |ptr| this only adds up the size of the trace.
+class TraceCopier {
+ public:
+  TraceCopier(void* ptr, uint32_t offset, size_t len) : ptr_(ptr), offset_(offset), len_(len) {}
+
+  // Appends |size| bytes at |src| to the trace.
+  zx_status_t Append(const void* src, size_t size) {
+    total_ += size;
+    if (ptr_ == nullptr) {
+      return ZX_OK;
+    }
+    const size_t skip = fbl::min<size_t>(offset_, size);
+    offset_ -= skip;
+    const size_t n = fbl::min(size - skip, len_ - copied_);
+    if (n == 0) {
+      return ZX_OK;
+    }
+    if (arch_copy_to_user(static_cast<uint8_t*>(ptr_) + copied_,
+                          static_cast<const uint8_t*>(src) + skip, n) != ZX_OK) {
+      return ZX_ERR_INVALID_ARGS;
+    }
+    copied_ += n;
+    return ZX_OK;
+  }
+
+  // Appends the records of |cb| from position |start| up to position |end|.
+  zx_status_t AppendCpu(ktrace_cpu_buffer* cb, uint64_t start, uint64_t end) {
+    while (start != end) {
+      const uint32_t off = static_cast<uint32_t>(start % cb->size);
+      const size_t n = fbl::min<uint64_t>(end - start, cb->size - off);
+      zx_status_t status = Append(cb->data + off, n);
+      if (status != ZX_OK) {
+        return status;
+      }
+      start += n;
+    }
+    return ZX_OK;
+  }
+
+  // Bytes left to fill in the caller's buffer.
+  size_t remaining() const { return len_ - copied_; }
+
+  // The size of the trace for a null |ptr|, otherwise the bytes copied.
+  ssize_t result() const { return ptr_ == nullptr ? total_ : copied_; }
+
+ private:
+  void* const ptr_;
+  size_t offset_;
+  const size_t len_;
+  size_t copied_ = 0;
+  size_t total_ = 0;
+};
+
+}  // namespace
+
+static ktrace_rec_32b_t ktrace_cpu_buffer_record(uint32_t cpu, uint64_t bytes, uint32_t dropped) {
+  ktrace_rec_32b_t rec = {};
+  rec.tag = TAG_CPU_BUFFER;
+  rec.tid = cpu;
+  rec.a = static_cast<uint32_t>(bytes);
+  rec.b = dropped;
+  return rec;
+}
+
+// Reads the whole trace: the metadata, then the records of each cpu.
+static ssize_t ktrace_read_snapshot(ktrace_state_t* ks, void* ptr, uint32_t off, size_t len)
+    TA_REQ(KtraceLock::Get()) {
+  TraceCopier copier(ptr, off, len);
 
-  // Buffer size is limited by the marker if set,
-  // otherwise limited by offset (last written point).
   // Offset can end up pointing past the end, so clip
   // it to the actual buffer size to be safe.
-  uint32_t max;
-  if (ks->marker) {
-    max = ks->marker;
-  } else {
-    max = ks->offset;
-    if (max > ks->bufsize) {
-      max = ks->bufsize;
+  uint32_t max = atomic_load(&ks->offset);
+  if (max > ks->bufsize) {
+    max = ks->bufsize;
+  }
+  zx_status_t status = copier.Append(ks->buffer, max);
+
+  for (uint32_t cpu = 0; cpu < ks->num_cpus && status == ZX_OK; cpu++) {
+    ktrace_cpu_buffer* cb = &ks->cpus[cpu];
+    const uint64_t head = cb->head.load(ktl::memory_order_acquire);
+    const uint64_t tail = cb->tail.load(ktl::memory_order_acquire);
+    const uint32_t dropped = cb->dropped.load(ktl::memory_order_relaxed);
+    if (head == tail && dropped == 0) {
+      continue;
     }
+    const ktrace_rec_32b_t rec = ktrace_cpu_buffer_record(cpu, head - tail, dropped);
+    status = copier.Append(&rec, sizeof(rec));
+    if (status == ZX_OK) {
+      status = copier.AppendCpu(cb, tail, head);
+    }
+  }
+  if (status != ZX_OK) {
+    return status;
   }
+  return copier.result();
+}
 
-  // null read is a query for trace buffer size
+// Reads and discards as many whole records as fit in |len| bytes: the metadata not yet
+// drained, then the records of each cpu.
+static ssize_t ktrace_drain(ktrace_state_t* ks, void* ptr, size_t len) TA_REQ(KtraceLock::Get()) {
+  // null read is a query for the records waiting to be drained
   if (ptr == nullptr) {
-    return max;
+    return ktrace_read_snapshot(ks, nullptr, 0, 0) - ks->drained;
   }
 
-  // constrain read to available buffer
-  if (off >= max) {
-    return 0;
+  TraceCopier copier(ptr, 0, len);
+
+  uint32_t max = atomic_load(&ks->offset);
+  if (max > ks->bufsize) {
+    max = ks->bufsize;
   }
-  if (len > (max - off)) {
-    len = max - off;
+  uint32_t end = ks->drained;
+  while (end < max) {
+    const uint32_t n = KTRACE_LEN(reinterpret_cast<ktrace_header_t*>(ks->buffer + end)->tag);
+    if (n == 0 || end - ks->drained + n > copier.remaining()) {
+      break;
+    }
+    end += n;
   }
+  zx_status_t status = copier.Append(ks->buffer + ks->drained, end - ks->drained);
+  if (status != ZX_OK) {
+    return status;
+  }
+  ks->drained = end;
+
+  for (uint32_t cpu = 0; cpu < ks->num_cpus; cpu++) {
+    if (copier.remaining() < sizeof(ktrace_rec_32b_t)) {
+      break;
+    }
+    ktrace_cpu_buffer* cb = &ks->cpus[cpu];
+    const uint64_t head = cb->head.load(ktl::memory_order_acquire);
+    const uint64_t tail = cb->tail.load(ktl::memory_order_relaxed);
+    const uint32_t dropped = cb->dropped.load(ktl::memory_order_relaxed);
+
+    const size_t room = copier.remaining() - sizeof(ktrace_rec_32b_t);
+    uint64_t end = tail;
+    while (end != head) {
+      const uint32_t n = KTRACE_LEN(ktrace_cpu_record(cb, end)->tag);
+      if (end - tail + n > room) {
+        break;
+      }
+      end += n;
+    }
+    if (end == tail && dropped == cb->dropped_drained) {
+      continue;
+    }
+
+    const ktrace_rec_32b_t rec =
+        ktrace_cpu_buffer_record(cpu, end - tail, dropped - cb->dropped_drained);
+    status = copier.Append(&rec, sizeof(rec));
+    if (status == ZX_OK) {
+      status = copier.AppendCpu(cb, tail, end);
+    }
+    if (status != ZX_OK) {
+      return status;
+    }
+    cb->dropped_drained = dropped;
+    // hand the space back to the cpu only once the records are copied out
+    cb->tail.store(end, ktl::memory_order_release);
+  }
+  return copier.result();
+}
 
-  if (arch_copy_to_user(ptr, ks->buffer + off, len) != ZX_OK) {
-    return ZX_ERR_INVALID_ARGS;
+ssize_t ktrace_read_user(void* ptr, uint32_t off, size_t len) {
+  ktrace_state_t* ks = &KTRACE_STATE;
+  Guard<Mutex> guard(KtraceLock::Get());
+
+  if (atomic_load(&ks->mode) == KTRACE_MODE_STREAMING) {
+    return ktrace_drain(ks, ptr, len);
   }
-  return len;
+  return ktrace_read_snapshot(ks, ptr, off, len);
 }
 
 zx_status_t ktrace_control(uint32_t action, uint32_t options, void* ptr) {
   ktrace_state_t* ks = &KTRACE_STATE;
 
   switch (action) {
-    case KTRACE_ACTION_START:
+    case KTRACE_ACTION_START: {
+      Guard<Mutex> guard(KtraceLock::Get());
       options = KTRACE_GRP_TO_MASK(options);
-      ks->marker = 0;
       atomic_store(&ks->grpmask, options ? options : KTRACE_GRP_TO_MASK(KTRACE_GRP_ALL));
       ktrace_report_live_processes();
       ktrace_report_live_threads();
       break;
+    }
 
     case KTRACE_ACTION_STOP: {
+      Guard<Mutex> guard(KtraceLock::Get());
       atomic_store(&ks->grpmask, 0);
-      uint32_t n = ks->offset;
-      if (n > ks->bufsize) {
-        ks->marker = ks->bufsize;
-      } else {
-        ks->marker = n;
-      }
+      // Records are added with interrupts disabled, so once every cpu has run this no
+      // record is still being added.
+      mp_sync_exec(MP_IPI_TARGET_ALL, 0, ktrace_sync_cpu, nullptr);
       break;
     }
 
-    case KTRACE_ACTION_REWIND:
+    case KTRACE_ACTION_REWIND: {
+      Guard<Mutex> guard(KtraceLock::Get());
       // roll back to just after the metadata
       atomic_store(&ks->offset, KTRACE_RECSIZE * 2);
+      ks->drained = 0;
+      ktrace_rewind_cpus(ks);
       ktrace_report_syscalls(kt_syscall_info);
       ktrace_report_probes();
       ktrace_report_vcpu_meta();
       break;
+    }
+
+    case KTRACE_ACTION_SET_MODE: {
+      Guard<Mutex> guard(KtraceLock::Get());
+      if (options > KTRACE_MODE_STREAMING) {
+        return ZX_ERR_INVALID_ARGS;
+      }
+      if (atomic_load(&ks->grpmask) != 0) {
+        return ZX_ERR_BAD_STATE;
+      }
+      atomic_store(&ks->mode, static_cast<int>(options));
+      break;
+    }
 
     case KTRACE_ACTION_NEW_PROBE: {
       const char* const string_in = static_cast<const char*>(ptr);
@@ -203,11 +480,21 @@ void ktrace_init(unsigned level) {
     return;
   }
 
+  // Names are much rarer than events, so the metadata gets a sixteenth of the
+  // buffer and the cpus share the rest.
+  const uint32_t metasize = ROUNDDOWN(mb / 16, KTRACE_RECSIZE);
+  ks->num_cpus = arch_max_num_cpus();
+  const uint32_t cpusize = ROUNDDOWN((mb - metasize) / ks->num_cpus, KTRACE_RECSIZE);
+  for (uint32_t cpu = 0; cpu < ks->num_cpus; cpu++) {
+    ks->cpus[cpu].data = ks->buffer + metasize + cpu * cpusize;
+    ks->cpus[cpu].size = cpusize;
+  }
+
   // The last packet written can overhang the end of the buffer,
   // so we reduce the reported size by the max size of a record
-  ks->bufsize = mb - 256;
+  ks->bufsize = metasize - 256;
 
-  dprintf(INFO, "ktrace: buffer at %p (%u bytes)\n", ks->buffer, mb);
+  dprintf(INFO, "ktrace: buffer at %p (%u bytes, %u per cpu)\n", ks->buffer, mb, cpusize);
 
   // write metadata to the first two event slots
   uint64_t n = ktrace_ticks_per_ms();
@@ -241,39 +528,27 @@ void ktrace_tiny(uint32_t tag, uint32_t arg) {
   ktrace_state_t* ks = &KTRACE_STATE;
   if (tag & atomic_load(&ks->grpmask)) {
     tag = (tag & 0xFFFFFFF0) | 2;
-    int off;
-    if ((off = atomic_add(&ks->offset, KTRACE_HDRSIZE)) >= static_cast<int>(ks->bufsize)) {
-      // if we arrive at the end, stop
-      atomic_store(&ks->grpmask, 0);
-    } else {
-      ktrace_header_t* hdr = reinterpret_cast<ktrace_header_t*>(ks->buffer + off);
-      hdr->ts = ktrace_timestamp();
-      hdr->tag = tag;
-      hdr->tid = arg;
-    }
+    spin_lock_saved_state_t state;
+    arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+    ktrace_write_record(ks, tag, arg, ktrace_timestamp(), nullptr);
+    arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
   }
 }
 
-void* ktrace_open(uint32_t tag, uint64_t ts) {
+bool ktrace_write(uint32_t tag, const void* payload, uint64_t ts) {
   ktrace_state_t* ks = &KTRACE_STATE;
   if (!(tag & atomic_load(&ks->grpmask))) {
-    return nullptr;
+    return false;
   }
 
-  int off;
-  if ((off = atomic_add(&ks->offset, KTRACE_LEN(tag))) >= static_cast<int>(ks->bufsize)) {
-    // if we arrive at the end, stop
-    atomic_store(&ks->grpmask, 0);
-    return nullptr;
-  }
-
-  ktrace_header_t* hdr = reinterpret_cast<ktrace_header_t*>(ks->buffer + off);
-  hdr->ts = ts;
-  hdr->tag = tag;
-  hdr->tid = KTRACE_FLAGS(tag) & KTRACE_FLAGS_CPU
-                 ? arch_curr_cpu_num()
-                 : static_cast<uint32_t>(get_current_thread()->user_tid);
-  return hdr + 1;
+  spin_lock_saved_state_t state;
+  arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+  const uint32_t tid = KTRACE_FLAGS(tag) & KTRACE_FLAGS_CPU
+                           ? arch_curr_cpu_num()
+                           : static_cast<uint32_t>(get_current_thread()->user_tid);
+  const bool written = ktrace_write_record(ks, tag, tid, ts, payload);
+  arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
+  return written;
 }
 
 void ktrace_name_etc(uint32_t tag, uint32_t id, uint32_t arg, const char* name, bool always) {
@@ -284,11 +559,10 @@ void ktrace_name_etc(uint32_t tag, uint32_t id, uint32_t arg, const char* name,
     // set size to: sizeof(hdr) + len + 1, round up to multiple of 8
     tag = (tag & 0xFFFFFFF0) | ((KTRACE_NAMESIZE + len + 1 + 7) >> 3);
 
+    // Names go to the metadata buffer, and are dropped once it is full without
+    // stopping the tracing of events.
     int off;
-    if ((off = atomic_add(&ks->offset, KTRACE_LEN(tag))) >= static_cast<int>(ks->bufsize)) {
-      // if we arrive at the end, stop
-      atomic_store(&ks->grpmask, 0);
-    } else {
+    if ((off = atomic_add(&ks->offset, KTRACE_LEN(tag))) < static_cast<int>(ks->bufsize)) {
       ktrace_rec_name_t* rec = reinterpret_cast<ktrace_rec_name_t*>(ks->buffer + off);
       rec->tag = tag;
       rec->id = id;
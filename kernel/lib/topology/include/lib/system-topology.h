@@ -107,6 +107,16 @@ class Graph {
     return ZX_OK;
   }
 
+  // Computes the cache distance between the logical processors |a| and |b|.
+  // The distance is zero when |a| and |b| are the same logical processor, one
+  // when they are SMT siblings on the same physical processor, and otherwise
+  // one plus the number of levels above the processor node of |a| to the
+  // nearest node shared with |b|. Processors with no common ancestor are one
+  // level further than the root of |a|.
+  //
+  // Returns ZX_ERR_NOT_FOUND if either logical id is not in the graph.
+  zx_status_t ProcessorDistance(cpu_num_t a, cpu_num_t b, uint32_t* distance) const;
+
   // Returns an immutable reference to the system topology graph. This may be
   // called after the graph is initialized by Graph::InitializeSystemTopology.
   static const Graph& GetSystemTopology() { return system_topology_.Get(); }
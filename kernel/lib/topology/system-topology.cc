@@ -116,6 +116,41 @@ zx_status_t Graph::InitializeSystemTopology(const zbi_topology_node_t* nodes, si
   return ZX_OK;
 }
 
+zx_status_t Graph::ProcessorDistance(cpu_num_t a, cpu_num_t b, uint32_t* distance) const {
+  if (a >= processors_by_logical_id_.size() || b >= processors_by_logical_id_.size()) {
+    return ZX_ERR_NOT_FOUND;
+  }
+
+  const Node* processor_a = processors_by_logical_id_[a];
+  const Node* processor_b = processors_by_logical_id_[b];
+  if (processor_a == nullptr || processor_b == nullptr) {
+    return ZX_ERR_NOT_FOUND;
+  }
+
+  if (a == b) {
+    *distance = 0;
+    return ZX_OK;
+  }
+
+  // Walk up from |a|, checking each ancestor for membership in the ancestry
+  // of |b|. The graph is shallow (see kMaxTopologyDepth) so the quadratic walk
+  // is cheap.
+  uint32_t levels = 0;
+  for (const Node* ancestor_a = processor_a; ancestor_a != nullptr;
+       ancestor_a = ancestor_a->parent, levels++) {
+    for (const Node* ancestor_b = processor_b; ancestor_b != nullptr;
+         ancestor_b = ancestor_b->parent) {
+      if (ancestor_a == ancestor_b) {
+        *distance = levels + 1;
+        return ZX_OK;
+      }
+    }
+  }
+
+  *distance = levels + 1;
+  return ZX_OK;
+}
+
 bool Graph::Validate(const zbi_topology_node_t* nodes, size_t count) {
   DEBUG_ASSERT(nodes != nullptr);
   DEBUG_ASSERT(count > 0);
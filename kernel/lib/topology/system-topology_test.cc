@@ -87,6 +87,44 @@ bool test_flat_to_heap_walk_result() {
   END_TEST;
 }
 
+bool test_processor_distance() {
+  BEGIN_TEST;
+  FlatTopo topo = ComplexTopology();
+
+  Graph graph;
+  ASSERT_EQ(ZX_OK, Graph::Initialize(&graph, topo.nodes, topo.node_count));
+
+  uint32_t distance = 0;
+
+  // Same logical processor.
+  ASSERT_EQ(ZX_OK, graph.ProcessorDistance(0, 0, &distance));
+  EXPECT_EQ(0u, distance);
+
+  // SMT siblings on the same processor.
+  ASSERT_EQ(ZX_OK, graph.ProcessorDistance(0, 1, &distance));
+  EXPECT_EQ(1u, distance);
+
+  // Processors sharing a cache in the same CCX.
+  ASSERT_EQ(ZX_OK, graph.ProcessorDistance(0, 2, &distance));
+  EXPECT_EQ(2u, distance);
+  ASSERT_EQ(ZX_OK, graph.ProcessorDistance(7, 0, &distance));
+  EXPECT_EQ(2u, distance);
+
+  // Processors in different CCXs on the same die.
+  ASSERT_EQ(ZX_OK, graph.ProcessorDistance(0, 8, &distance));
+  EXPECT_EQ(4u, distance);
+
+  // Processors on different NUMA regions share no ancestor.
+  ASSERT_EQ(ZX_OK, graph.ProcessorDistance(0, 16, &distance));
+  EXPECT_EQ(6u, distance);
+
+  // Unknown logical ids.
+  EXPECT_EQ(ZX_ERR_NOT_FOUND, graph.ProcessorDistance(0, 64, &distance));
+  EXPECT_EQ(ZX_ERR_NOT_FOUND, graph.ProcessorDistance(64, 0, &distance));
+
+  END_TEST;
+}
+
 bool test_validate_processor_not_leaf() {
   BEGIN_TEST;
   FlatTopo topo = ComplexTopology();
@@ -162,6 +200,7 @@ UNITTEST_START_TESTCASE(system_topology_tests)
 UNITTEST("Parse flat topology, simple.", test_flat_to_heap_simple)
 UNITTEST("Parse flat topology, complex.", test_flat_to_heap_complex)
 UNITTEST("Parse complex then walk result.", test_flat_to_heap_walk_result)
+UNITTEST("Processor cache distance.", test_processor_distance)
 UNITTEST("Fail validation if processor is not a leaf.", test_validate_processor_not_leaf)
 UNITTEST("Fail validation if leaf is not processor.", test_validate_leaf_not_processor)
 UNITTEST("Fail validation if there is a cycle.", test_validate_cycle)
@@ -6,6 +6,135 @@
 
 #include "object/buffer_chain.h"
 
+#include <lib/counters.h>
+#include <stdio.h>
+
+#include <fbl/gparena.h>
+
+namespace {
+
+KCOUNTER(buffer_chain_slab_allocs, "buffer_chain.alloc.slab")
+KCOUNTER(buffer_chain_page_allocs, "buffer_chain.alloc.pages")
+
+// Upper bounds on the number of small and medium chains alive at once. Once a slab is full, chains
+// of its size come from the PMM like larger ones.
+constexpr size_t kMaxSmallBuffers = 64 * 1024u;
+constexpr size_t kMaxMediumBuffers = 16 * 1024u;
+
+// Nothing in a free slab buffer needs to survive until it is reused.
+fbl::PerCpuGPArena<0, BufferChain::kSizeOfSmallBuffer> small_buffers;
+fbl::PerCpuGPArena<0, BufferChain::kSizeOfMediumBuffer> medium_buffers;
+
+// Set once the slabs are ready to use.
+bool slabs_initialized = false;
+
+}  // namespace
+
+void BufferChain::Init() {
+  if (small_buffers.Init("buffer_chain:small", kMaxSmallBuffers) != ZX_OK ||
+      medium_buffers.Init("buffer_chain:medium", kMaxMediumBuffers) != ZX_OK) {
+    printf("WARNING: BufferChain slabs unavailable, every message will use a page\n");
+    return;
+  }
+  slabs_initialized = true;
+}
+
+// Allocates a chain of a single slab buffer that can hold |size| bytes, which includes the
+// BufferChain itself.
+//
+// Returns nullptr if |size| is too large for the slabs or they are exhausted.
+BufferChain* BufferChain::AllocFromSlab(size_t size) {
+  if (!slabs_initialized) {
+    return nullptr;
+  }
+
+  void* va = nullptr;
+  size_t buffer_size = 0;
+  if (size <= kSizeOfSmallBuffer - kSizeOfBufferFields) {
+    buffer_size = kSizeOfSmallBuffer;
+    va = small_buffers.Alloc();
+  }
+  if (va == nullptr && size <= kSizeOfMediumBuffer - kSizeOfBufferFields) {
+    buffer_size = kSizeOfMediumBuffer;
+    va = medium_buffers.Alloc();
+  }
+  if (va == nullptr) {
+    return nullptr;
+  }
+
+  BufferChain::BufferList temp;
+  temp.push_front(new (va) BufferChain::Buffer(buffer_size));
+
+  list_node pages = LIST_INITIAL_VALUE(pages);
+  BufferChain* chain = new (temp.front().data()) BufferChain(&temp, &pages);
+  kcounter_add(buffer_chain_slab_allocs, 1);
+  return chain;
+}
+
+BufferChain* BufferChain::Alloc(size_t size) {
+  size += sizeof(BufferChain);
+
+  // Small chains fit in a single buffer from one of the slabs.
+  BufferChain* chain = AllocFromSlab(size);
+  if (chain != nullptr) {
+    return chain;
+  }
+
+  const size_t num_buffers = (size + kRawDataSize - 1) / kRawDataSize;
+
+  // Allocate a list of pages.
+  list_node pages = LIST_INITIAL_VALUE(pages);
+  zx_status_t status = pmm_alloc_pages(num_buffers, 0, &pages);
+  if (unlikely(status != ZX_OK)) {
+    return nullptr;
+  }
+
+  // Construct a Buffer in each page and add them to a temporary list.
+  BufferChain::BufferList temp;
+  vm_page_t* page;
+  list_for_every_entry (&pages, page, vm_page_t, queue_node) {
+    DEBUG_ASSERT(page->state() == VM_PAGE_STATE_ALLOC);
+    page->set_state(VM_PAGE_STATE_IPC);
+    void* va = paddr_to_physmap(page->paddr());
+    temp.push_front(new (va) BufferChain::Buffer);
+  }
+
+  // We now have a list of buffers and a list of pages.  Construct a chain inside the first
+  // buffer and give the buffers and pages to the chain.
+  chain = new (temp.front().data()) BufferChain(&temp, &pages);
+  DEBUG_ASSERT(list_is_empty(&pages));
+  kcounter_add(buffer_chain_page_allocs, 1);
+
+  return chain;
+}
+
+void BufferChain::Free(BufferChain* chain) {
+  // Remove the buffers and vm_page_t's from the chain *before* destroying it.
+  BufferChain::BufferList buffers(ktl::move(*chain->buffers()));
+  list_node pages = LIST_INITIAL_VALUE(pages);
+  list_move(&chain->pages_, &pages);
+
+  chain->~BufferChain();
+
+  while (!buffers.is_empty()) {
+    BufferChain::Buffer* buf = buffers.pop_front();
+    const size_t buffer_size = buf->buffer_size();
+    buf->Buffer::~Buffer();
+
+    // Buffers that don't fill a page came from a slab.
+    if (buffer_size == kSizeOfSmallBuffer) {
+      small_buffers.Free(buf);
+    } else if (buffer_size == kSizeOfMediumBuffer) {
+      medium_buffers.Free(buf);
+    } else {
+      DEBUG_ASSERT(buffer_size == kSizeOfBuffer);
+    }
+  }
+  if (!list_is_empty(&pages)) {
+    pmm_free(&pages);
+  }
+}
+
 // Makes a const void* look like a user_in_ptr<const void>.
 //
 // Sometimes we need to copy data from kernel space. KernelPtrAdapter allows us to implement the
@@ -138,9 +138,78 @@ static bool copy_in_copy_out() {
   END_TEST;
 }
 
+static bool alloc_free_slab() {
+  BEGIN_TEST;
+
+  constexpr size_t kSmall = BufferChain::kSizeOfSmallBuffer;
+  constexpr size_t kMedium = BufferChain::kSizeOfMediumBuffer;
+  constexpr size_t kMaxSmall = kSmall - BufferChain::kSizeOfBufferFields - sizeof(BufferChain);
+  constexpr size_t kMaxMedium = kMedium - BufferChain::kSizeOfBufferFields - sizeof(BufferChain);
+
+  // Each size should get a single buffer from the smallest slab that fits it.
+  const struct {
+    size_t size;
+    size_t buffer_size;
+  } cases[] = {
+      {0, kSmall},
+      {kMaxSmall, kSmall},
+      {kMaxSmall + 1, kMedium},
+      {kMaxMedium, kMedium},
+      {kMaxMedium + 1, BufferChain::kSizeOfBuffer},
+  };
+  for (const auto& c : cases) {
+    BufferChain* bc = BufferChain::Alloc(c.size);
+    ASSERT_NE(bc, nullptr);
+    ASSERT_EQ(bc->buffers()->size_slow(), 1u);
+    auto& buffer = bc->buffers()->front();
+    EXPECT_EQ(buffer.buffer_size(), c.buffer_size);
+    EXPECT_GE(buffer.size(), c.size);
+
+    // The whole buffer should be usable.
+    memset(buffer.data(), 'A', buffer.size());
+    BufferChain::Free(bc);
+  }
+
+  END_TEST;
+}
+
+static bool copy_in_copy_out_slab() {
+  BEGIN_TEST;
+
+  constexpr size_t kSize = 100;
+  char buf[kSize];
+  ktl::unique_ptr<UserMemory> mem = UserMemory::Create(kSize);
+  auto mem_in = make_user_in_ptr(mem->in());
+  auto mem_out = make_user_out_ptr(mem->out());
+
+  BufferChain* bc = BufferChain::Alloc(kSize);
+  ASSERT_NE(nullptr, bc);
+  ASSERT_EQ(BufferChain::kSizeOfSmallBuffer, bc->buffers()->front().buffer_size());
+
+  for (size_t i = 0; i < kSize; ++i) {
+    buf[i] = static_cast<char>(i);
+  }
+  ASSERT_EQ(ZX_OK, mem_out.copy_array_to_user(buf, kSize));
+  ASSERT_EQ(ZX_OK, bc->CopyIn(mem_in, 0, kSize));
+
+  memset(buf, 0, kSize);
+  ASSERT_EQ(ZX_OK, mem_out.copy_array_to_user(buf, kSize));
+  ASSERT_EQ(ZX_OK, bc->CopyOut(mem_out, 0, kSize));
+  ASSERT_EQ(ZX_OK, mem_in.copy_array_from_user(buf, kSize));
+  for (size_t i = 0; i < kSize; ++i) {
+    ASSERT_EQ(static_cast<char>(i), buf[i]);
+  }
+
+  BufferChain::Free(bc);
+
+  END_TEST;
+}
+
 }  // namespace
 
 UNITTEST_START_TESTCASE(buffer_chain_tests)
 UNITTEST("alloc_free_basic", alloc_free_basic)
 UNITTEST("copy_in_copy_out", copy_in_copy_out)
+UNITTEST("alloc_free_slab", alloc_free_slab)
+UNITTEST("copy_in_copy_out_slab", copy_in_copy_out_slab)
 UNITTEST_END_TESTCASE(buffer_chain_tests, "buffer_chain", "BufferChain tests");
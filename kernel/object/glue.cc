@@ -16,6 +16,7 @@
 #include <zircon/types.h>
 
 #include <lk/init.h>
+#include <object/buffer_chain.h>
 #include <object/diagnostics.h>
 #include <object/event_dispatcher.h>
 #include <object/excp_port.h>
@@ -102,6 +103,7 @@ static int oom_thread(void* unused) {
 
 static void object_glue_init(uint level) TA_NO_THREAD_SAFETY_ANALYSIS {
   Handle::Init();
+  BufferChain::Init();
   root_job = JobDispatcher::CreateRootJob();
   PortDispatcher::Init();
 
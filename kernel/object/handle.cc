@@ -9,6 +9,7 @@
 #include <lib/counters.h>
 #include <pow2.h>
 
+#include <ktl/atomic.h>
 #include <object/dispatcher.h>
 
 namespace {
@@ -16,9 +17,13 @@ namespace {
 // The number of outstanding (live) handles in the arena.
 constexpr size_t kMaxHandleCount = 256 * 1024u;
 
-// Warning level: high_handle_count() is called when
-// there are this many outstanding handles.
+// Warning level: a warning is printed when there are this many
+// outstanding handles, and again for every kHighHandleCountStep more.
 constexpr size_t kHighHandleCount = (kMaxHandleCount * 7) / 8;
+constexpr size_t kHighHandleCountStep = 1024u;
+
+// Outstanding handle count above which the next warning is printed.
+ktl::atomic<size_t> next_high_handle_warning{kHighHandleCount};
 
 KCOUNTER(handle_count_made, "handles.made")
 KCOUNTER(handle_count_duped, "handles.duped")
@@ -54,7 +59,7 @@ static_assert((kHandleReservedBitsMask | kHandleGenerationMask | kHandleIndexMas
 
 }  // namespace
 
-fbl::GPArena<Handle::PreserveSize, sizeof(Handle)> HandleTableArena::arena_;
+fbl::PerCpuGPArena<Handle::PreserveSize, sizeof(Handle)> HandleTableArena::arena_;
 
 void Handle::Init() { HandleTableArena::arena_.Init("handles", kMaxHandleCount); }
 
@@ -88,29 +93,31 @@ uint32_t Handle::GetNewBaseValue(void* addr) {
 // says whether this is allocation or duplication, for the error message.
 void* Handle::Alloc(const fbl::RefPtr<Dispatcher>& dispatcher, const char* what,
                     uint32_t* base_value) {
-  size_t outstanding_handles;
-  {
-    void* addr = HandleTableArena::arena_.Alloc();
-    outstanding_handles = HandleTableArena::arena_.DiagnosticCount();
-    if (likely(addr)) {
-      if (outstanding_handles > kHighHandleCount) {
-        // TODO: Avoid calling this for every handle after
-        // kHighHandleCount; printfs are slow and we're
-        // holding the lock.
-        printf("WARNING: High handle count: %zu handles\n", outstanding_handles);
-      }
-      dispatcher->increment_handle_count();
-      // checking the process_id_ and dispatcher is really about trying to catch cases where this
-      // Handle might somehow already be in use.
-      DEBUG_ASSERT(reinterpret_cast<Handle*>(addr)->process_id_ == ZX_KOID_INVALID);
-      DEBUG_ASSERT(reinterpret_cast<Handle*>(addr)->dispatcher_ == nullptr);
-      *base_value = GetNewBaseValue(addr);
-      return addr;
-    }
+  void* addr = HandleTableArena::arena_.Alloc();
+  if (unlikely(!addr)) {
+    printf("WARNING: Could not allocate %s handle (%zu outstanding)\n", what,
+           HandleTableArena::arena_.DiagnosticCount());
+    return nullptr;
+  }
+
+  // The upper bound also counts the handles cached per cpu, which is close enough for a warning
+  // and avoids summing all the caches on every allocation.
+  const size_t outstanding_handles = HandleTableArena::arena_.DiagnosticCountUpperBound();
+  size_t next_warning = next_high_handle_warning.load(ktl::memory_order_relaxed);
+  if (unlikely(outstanding_handles > next_warning) &&
+      next_high_handle_warning.compare_exchange_strong(
+          next_warning, outstanding_handles + kHighHandleCountStep, ktl::memory_order_relaxed,
+          ktl::memory_order_relaxed)) {
+    printf("WARNING: High handle count: %zu handles\n", outstanding_handles);
   }
 
-  printf("WARNING: Could not allocate %s handle (%zu outstanding)\n", what, outstanding_handles);
-  return nullptr;
+  dispatcher->increment_handle_count();
+  // checking the process_id_ and dispatcher is really about trying to catch cases where this
+  // Handle might somehow already be in use.
+  DEBUG_ASSERT(reinterpret_cast<Handle*>(addr)->process_id_ == ZX_KOID_INVALID);
+  DEBUG_ASSERT(reinterpret_cast<Handle*>(addr)->dispatcher_ == nullptr);
+  *base_value = GetNewBaseValue(addr);
+  return addr;
 }
 
 HandleOwner Handle::Make(fbl::RefPtr<Dispatcher> dispatcher, zx_rights_t rights) {
@@ -240,6 +240,32 @@ bool KernelHandleUpgrade() {
   END_TEST;
 }
 
+bool HandleReuseChangesBaseValue() {
+  BEGIN_TEST;
+
+  KernelHandle<EventPairDispatcher> eventpair[2];
+  zx_rights_t rights;
+  ASSERT_EQ(EventPairDispatcher::Create(&eventpair[0], &eventpair[1], &rights), ZX_OK);
+  HandleOwner handle = Handle::Make(ktl::move(eventpair[0]), rights);
+  ASSERT_TRUE(handle);
+
+  // Freed handles are cached per cpu, so a Dup right after closing another usually gets the same
+  // slot back. Whichever slot it gets, the new handle must not match the closed one's value.
+  for (int i = 0; i < 16; i++) {
+    HandleOwner dup = Handle::Dup(handle.get(), rights);
+    ASSERT_TRUE(dup);
+    const uint32_t old_value = dup->base_value();
+    dup.reset(nullptr);
+
+    dup = Handle::Dup(handle.get(), rights);
+    ASSERT_TRUE(dup);
+    EXPECT_NE(dup->base_value(), old_value);
+    EXPECT_NE(Handle::FromU32(old_value), dup.get());
+  }
+
+  END_TEST;
+}
+
 }  // namespace
 
 UNITTEST_START_TESTCASE(handle_tests)
@@ -254,4 +280,5 @@ UNITTEST("KernelHandleMoveConstructorUpcast", KernelHandleMoveConstructorUpcast)
 UNITTEST("KernelHandleMoveAssignment", KernelHandleMoveAssignment)
 UNITTEST("KernelHandleMoveAssignmentUpcast", KernelHandleMoveAssignmentUpcast)
 UNITTEST("KernelHandleUpgrade", KernelHandleUpgrade)
+UNITTEST("HandleReuseChangesBaseValue", HandleReuseChangesBaseValue)
 UNITTEST_END_TESTCASE(handle_tests, "handle", "Handle test");
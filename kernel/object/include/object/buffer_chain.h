@@ -27,6 +27,10 @@
 // It's designed for use with channel messages.  Pages backing a BufferChain are marked as
 // VM_PAGE_STATE_IPC.
 //
+// Chains small enough to fit in a single kSizeOfSmallBuffer or kSizeOfMediumBuffer byte buffer are
+// instead carved from a per-cpu cached slab, so that small messages don't take a whole page from
+// the PMM.  Such a chain has exactly one, shorter, Buffer and no pages.
+//
 // The BufferChain object itself lives *inside* its first buffer.  Here's what it looks like:
 //
 //   +--------------------------------+     +--------------------------------+
@@ -62,6 +66,10 @@ class BufferChain {
   // kContig is the number of bytes guaranteed to be stored contiguously in any buffer
   constexpr static size_t kContig = kRawDataSize - kSizeOfBufferChain;
 
+  // Sizes of the slab allocated buffers used for chains that fit in a single small buffer.
+  constexpr static size_t kSizeOfSmallBuffer = 256;
+  constexpr static size_t kSizeOfMediumBuffer = 1024;
+
   // Copies |size| bytes from this chain starting at offset |src_offset| to |dst|.
   //
   // |src_offset| must be in the range [0, kContig).
@@ -89,50 +97,14 @@ class BufferChain {
   // It is the caller's responsibility to free the chain with BufferChain::Free.
   //
   // Returns nullptr on error.
-  static BufferChain* Alloc(size_t size) {
-    size += sizeof(BufferChain);
-    const size_t num_buffers = (size + kRawDataSize - 1) / kRawDataSize;
-
-    // Allocate a list of pages.
-    list_node pages = LIST_INITIAL_VALUE(pages);
-    zx_status_t status = pmm_alloc_pages(num_buffers, 0, &pages);
-    if (unlikely(status != ZX_OK)) {
-      return nullptr;
-    }
-
-    // Construct a Buffer in each page and add them to a temporary list.
-    BufferChain::BufferList temp;
-    vm_page_t* page;
-    list_for_every_entry (&pages, page, vm_page_t, queue_node) {
-      DEBUG_ASSERT(page->state() == VM_PAGE_STATE_ALLOC);
-      page->set_state(VM_PAGE_STATE_IPC);
-      void* va = paddr_to_physmap(page->paddr());
-      temp.push_front(new (va) BufferChain::Buffer);
-    }
-
-    // We now have a list of buffers and a list of pages.  Construct a chain inside the first
-    // buffer and give the buffers and pages to the chain.
-    BufferChain* chain = new (temp.front().data()) BufferChain(&temp, &pages);
-    DEBUG_ASSERT(list_is_empty(&pages));
-
-    return chain;
-  }
+  static BufferChain* Alloc(size_t size);
 
   // Frees |chain| and its buffers.
-  static void Free(BufferChain* chain) {
-    // Remove the buffers and vm_page_t's from the chain *before* destroying it.
-    BufferChain::BufferList buffers(ktl::move(*chain->buffers()));
-    list_node pages = LIST_INITIAL_VALUE(pages);
-    list_move(&chain->pages_, &pages);
+  static void Free(BufferChain* chain);
 
-    chain->~BufferChain();
-
-    while (!buffers.is_empty()) {
-      BufferChain::Buffer* buf = buffers.pop_front();
-      buf->Buffer::~Buffer();
-    }
-    pmm_free(&pages);
-  }
+  // Sets up the slabs used for small chains.  Until this is called every chain is allocated from
+  // the PMM.
+  static void Init();
 
   // Copies |size| bytes from |src| to this chain starting at offset |dst_offset|.
   //
@@ -149,24 +121,36 @@ class BufferChain {
     Buffer() = default;
     ~Buffer() = default;
 
+    // Constructs a Buffer at the start of a block of only |buffer_size| bytes.  Just the first
+    // |buffer_size| - kSizeOfBufferFields bytes of raw_data_ are backed by that block.
+    explicit Buffer(size_t buffer_size)
+        : raw_size_(static_cast<uint16_t>(buffer_size - kSizeOfBufferFields)) {
+      DEBUG_ASSERT(buffer_size > kSizeOfBufferFields && buffer_size <= kSizeOfBuffer);
+    }
+
     char* data() {
       canary_.Assert();
       return raw_data_ + reserved_;
     }
 
-    size_t size() const { return sizeof(raw_data_) - reserved_; }
+    size_t size() const { return raw_size_ - reserved_; }
+
+    // Size of the block this Buffer was constructed in.
+    size_t buffer_size() const { return raw_size_ + kSizeOfBufferFields; }
 
     void set_reserved(uint32_t reserved) {
-      DEBUG_ASSERT(reserved < sizeof(raw_data_));
-      reserved_ = reserved;
+      DEBUG_ASSERT(reserved < raw_size_);
+      reserved_ = static_cast<uint16_t>(reserved);
     }
 
    private:
     fbl::Canary<fbl::magic("BUFC")> canary_;
-    uint32_t reserved_ = 0;
+    uint16_t reserved_ = 0;
+    uint16_t raw_size_ = kRawDataSize;
     char raw_data_[kRawDataSize];
   };
   static_assert(sizeof(BufferChain::Buffer) == BufferChain::kSizeOfBuffer, "");
+  static_assert(BufferChain::kRawDataSize <= UINT16_MAX, "");
 
   BufferList* buffers() { return &buffers_; }
 
@@ -181,6 +165,8 @@ class BufferChain {
 
   ~BufferChain() { DEBUG_ASSERT(list_is_empty(&pages_)); }
 
+  static BufferChain* AllocFromSlab(size_t size);
+
   // |PTR_IN| is a user_in_ptr-like type.
   template <typename PTR_IN>
   zx_status_t CopyInCommon(PTR_IN src, size_t dst_offset, size_t size) {
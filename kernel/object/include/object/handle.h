@@ -188,7 +188,10 @@ class HandleTableArena {
                 Handle::PreserveSize);
   static_assert(offsetof(Handle, dispatcher_) + sizeof(Handle::dispatcher_) <=
                 Handle::PreserveSize);
-  static fbl::GPArena<Handle::PreserveSize, sizeof(Handle)> arena_;
+  // Handles are allocated and freed on every channel write that carries them, so freed slots are
+  // cached per cpu. The cache never writes to a free slot, so the preserved base_value_ that
+  // Handle::GetNewBaseValue relies on is kept.
+  static fbl::PerCpuGPArena<Handle::PreserveSize, sizeof(Handle)> arena_;
   // Give the Handle access to its arena.
   friend Handle;
 };
@@ -19,7 +19,7 @@
 //
 // To reduce heap fragmentation, MessagePackets are stored in a lists of fixed size buffers
 // (BufferChains) rather than a contiguous blocks of memory.  These lists and buffers are allocated
-// from the PMM.
+// from the PMM, except for small messages which get a single buffer from a slab.
 //
 // The first buffer in a MessagePacket's BufferChain contains the MessagePacket object, followed by
 // its handles (if any), and finally its payload data (if any).
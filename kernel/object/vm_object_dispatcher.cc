@@ -29,6 +29,10 @@ zx_status_t VmObjectDispatcher::parse_create_syscall_flags(uint32_t flags, uint3
     res |= VmObjectPaged::kResizable;
     flags &= ~ZX_VMO_RESIZABLE;
   }
+  if (flags & ZX_VMO_LARGE_PAGES) {
+    res |= VmObjectPaged::kLargePages;
+    flags &= ~ZX_VMO_LARGE_PAGES;
+  }
 
   if (flags) {
     return ZX_ERR_INVALID_ARGS;
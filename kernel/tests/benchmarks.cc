@@ -16,13 +16,18 @@
 #include <trace.h>
 
 #include <arch/ops.h>
+#include <fbl/algorithm.h>
 #include <kernel/brwlock.h>
 #include <kernel/mp.h>
 #include <kernel/mutex.h>
 #include <kernel/spinlock.h>
 #include <kernel/thread.h>
+#include <kernel/timer.h>
+#include <ktl/atomic.h>
 #include <ktl/type_traits.h>
+#include <vm/pmm.h>
 
+#include "run_on_cpus.h"
 #include "tests.h"
 
 const size_t BUFSIZE = (3 * 1024 * 1024);  // must be smaller than max allowed heap allocation
@@ -316,6 +321,124 @@ __NO_INLINE static void bench_rwlock() {
          c, ktl::is_same_v<LockType, BrwLockPi>, count, c / count);
 }
 
+static const uint kPmmBenchCount = 1024 * 1024;
+
+// Allocates and frees single pages from an increasing number of cpus at once.
+__NO_INLINE static void bench_pmm_alloc_free() {
+  for (uint num_threads = 1; num_threads <= arch_max_num_cpus(); num_threads *= 2) {
+    ktl::atomic<bool> failed{false};
+    uint created;
+    zx_duration_t t = RunOnCpus(num_threads, &created, [&failed](uint) {
+      for (size_t i = 0; i < kPmmBenchCount; i++) {
+        vm_page_t* page;
+        paddr_t pa;
+        if (pmm_alloc_page(0, &page, &pa) != ZX_OK) {
+          failed.store(true);
+          return;
+        }
+        pmm_free_page(page);
+      }
+    });
+
+    if (failed.load()) {
+      printf("pmm alloc/free on %u cpus failed\n", created);
+      return;
+    }
+    printf("%" PRIi64 " ns to alloc/free a page %u times on each of %u cpus (%" PRIi64
+           " ns per)\n",
+           t, kPmmBenchCount, created, t / kPmmBenchCount);
+    if (created < num_threads) {
+      break;
+    }
+  }
+}
+
+static const size_t kHeapBenchIterations = 16 * 1024;
+
+// Mallocs and frees small blocks, a few live at once, from an increasing number
+// of cpus at once.
+__NO_INLINE static void bench_heap_parallel() {
+  for (uint num_threads = 1; num_threads <= arch_max_num_cpus(); num_threads *= 2) {
+    ktl::atomic<bool> failed{false};
+    uint created;
+    zx_duration_t t = RunOnCpus(num_threads, &created, [&failed](uint) {
+      void* ptrs[8];
+      for (size_t i = 0; i < kHeapBenchIterations; i++) {
+        // Small sizes typical of kernel objects.
+        for (size_t j = 0; j < fbl::count_of(ptrs); j++) {
+          ptrs[j] = malloc(16 << (j % 5));
+          if (ptrs[j] == nullptr) {
+            failed.store(true);
+          }
+        }
+        for (size_t j = 0; j < fbl::count_of(ptrs); j++) {
+          free(ptrs[j]);
+        }
+      }
+    });
+
+    if (failed.load()) {
+      printf("heap malloc/free on %u cpus failed\n", created);
+      return;
+    }
+    const uint64_t pairs = kHeapBenchIterations * 8;
+    printf("%" PRIi64 " ns to malloc/free %" PRIu64 " blocks on each of %u cpus (%" PRIu64
+           " ns per)\n",
+           t, pairs, created, static_cast<uint64_t>(t) / pairs);
+    if (created < num_threads) {
+      break;
+    }
+  }
+}
+
+// Records that a timer fired; none are due before bench_timer_queue() cancels them.
+static void timer_queue_noop_cb(timer_t*, zx_time_t, void* arg) {
+  static_cast<ktl::atomic<bool>*>(arg)->store(true);
+}
+
+// Sets and then cancels queues of pending timers of increasing size.
+__NO_INLINE static void bench_timer_queue() {
+  static const size_t kCounts[] = {10000, 100000, 1000000};
+  for (size_t count : kCounts) {
+    timer_t* timers = static_cast<timer_t*>(malloc(sizeof(timer_t) * count));
+    if (timers == nullptr) {
+      printf("skipping %zu timers, not enough memory\n", count);
+      continue;
+    }
+
+    // Spread the deadlines an hour from now, far enough that none fire during the benchmark.
+    const zx_time_t base = current_time() + ZX_HOUR(1);
+    const TimerSlack slack{ZX_USEC(1), TIMER_SLACK_CENTER};
+    ktl::atomic<bool> fired{false};
+
+    zx_time_t start = current_time();
+    for (size_t i = 0; i < count; i++) {
+      timer_init(&timers[i]);
+      const Deadline deadline(base + zx_duration_mul_int64(ZX_MSEC(100), rand()) / RAND_MAX,
+                              slack);
+      timer_set(&timers[i], deadline, timer_queue_noop_cb, &fired);
+    }
+    const zx_duration_t set_time = zx_time_sub_time(current_time(), start);
+
+    // Cancel in a different order than the timers were set.
+    bool all_canceled = true;
+    start = current_time();
+    for (size_t i = 0; i < count; i++) {
+      all_canceled &= timer_cancel(&timers[(i * 7919) % count]);
+    }
+    const zx_duration_t cancel_time = zx_time_sub_time(current_time(), start);
+
+    free(timers);
+    if (!all_canceled || fired.load()) {
+      printf("%zu timers: a timer fired before it was canceled\n", count);
+      return;
+    }
+    printf("%zu timers: set %" PRIi64 " ns/timer, cancel %" PRIi64 " ns/timer\n", count,
+           set_time / static_cast<zx_duration_t>(count),
+           cancel_time / static_cast<zx_duration_t>(count));
+  }
+}
+
 int benchmarks(int, const cmd_args*, uint32_t) {
   bench_set_overhead();
   bench_memcpy();
@@ -335,5 +458,10 @@ int benchmarks(int, const cmd_args*, uint32_t) {
   bench_rwlock<BrwLockPi>();
   bench_rwlock<BrwLockNoPi>();
 
+  bench_pmm_alloc_free();
+  bench_heap_parallel();
+
+  bench_timer_queue();
+
   return 0;
 }
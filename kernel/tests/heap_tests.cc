@@ -0,0 +1,204 @@
+// Copyright 2019 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <lib/unittest/unittest.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <arch/ops.h>
+#include <fbl/algorithm.h>
+
+#include "run_on_cpus.h"
+#include "tests.h"
+
+namespace {
+
+// Sizes that are served from the per-cpu caches when they are enabled, and a
+// few that are not.
+constexpr size_t kSizes[] = {1, 8, 16, 24, 48, 64, 100, 128, 200, 256, 300, 1024, 4096};
+
+constexpr uint8_t Pattern(size_t size, size_t index) {
+  return static_cast<uint8_t>(size * 31 + index);
+}
+
+bool Fill(void* ptr, size_t size, size_t index) {
+  if (ptr == nullptr) {
+    return false;
+  }
+  memset(ptr, Pattern(size, index), size);
+  return true;
+}
+
+bool Check(const void* ptr, size_t size, size_t index) {
+  const uint8_t* bytes = static_cast<const uint8_t*>(ptr);
+  for (size_t i = 0; i < size; i++) {
+    if (bytes[i] != Pattern(size, index)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Allocates blocks of many sizes, frees them in an interleaved order and makes
+// sure no two live blocks overlap.
+bool heap_alloc_free_test() {
+  BEGIN_TEST;
+
+  constexpr size_t kPerSize = 64;
+  constexpr size_t kCount = fbl::count_of(kSizes) * kPerSize;
+  void** ptrs = static_cast<void**>(calloc(kCount, sizeof(void*)));
+  ASSERT_NONNULL(ptrs);
+
+  for (size_t i = 0; i < kCount; i++) {
+    const size_t size = kSizes[i % fbl::count_of(kSizes)];
+    ptrs[i] = malloc(size);
+    EXPECT_TRUE(Fill(ptrs[i], size, i));
+  }
+
+  // Free every other block and allocate again, which recycles freed blocks.
+  for (size_t i = 0; i < kCount; i += 2) {
+    const size_t size = kSizes[i % fbl::count_of(kSizes)];
+    EXPECT_TRUE(Check(ptrs[i], size, i));
+    free(ptrs[i]);
+    ptrs[i] = malloc(size);
+    EXPECT_TRUE(Fill(ptrs[i], size, i));
+  }
+
+  for (size_t i = 0; i < kCount; i++) {
+    const size_t size = kSizes[i % fbl::count_of(kSizes)];
+    EXPECT_TRUE(Check(ptrs[i], size, i));
+    free(ptrs[i]);
+  }
+
+  free(ptrs);
+  END_TEST;
+}
+
+struct HeapThreadArgs {
+  void** ptrs;
+  size_t count;
+  size_t iterations;
+  bool ok;
+};
+
+// Runs |worker| on each of up to |max_threads| cpus, each with its own entry
+// of |args|, and returns the time they took. |ok| is set to whether every
+// worker succeeded.
+zx_duration_t RunWorkersOnCpus(void (*worker)(HeapThreadArgs*), HeapThreadArgs* args,
+                               uint max_threads, uint* num_threads, bool* ok) {
+  for (uint i = 0; i < max_threads; i++) {
+    args[i].ok = true;
+  }
+  zx_duration_t duration =
+      RunOnCpus(max_threads, num_threads, [worker, args](uint i) { worker(&args[i]); });
+
+  *ok = true;
+  for (uint i = 0; i < *num_threads; i++) {
+    *ok &= args[i].ok;
+  }
+  return duration;
+}
+
+// Frees the blocks handed over by another cpu and replaces them with new ones,
+// so blocks are regularly freed on a different cpu than they were allocated on.
+void CrossCpuWorker(HeapThreadArgs* args) {
+  for (size_t i = 0; i < args->count; i++) {
+    const size_t size = kSizes[i % fbl::count_of(kSizes)];
+    if (!Check(args->ptrs[i], size, i)) {
+      args->ok = false;
+    }
+    free(args->ptrs[i]);
+    args->ptrs[i] = malloc(size);
+    if (!Fill(args->ptrs[i], size, i)) {
+      args->ok = false;
+    }
+  }
+}
+
+bool heap_cross_cpu_free_test() {
+  BEGIN_TEST;
+
+  constexpr size_t kPerThread = 256;
+  HeapThreadArgs args[SMP_MAX_CPUS] = {};
+  const uint max_threads = arch_max_num_cpus();
+  for (uint i = 0; i < max_threads; i++) {
+    args[i].count = kPerThread;
+    args[i].ptrs = static_cast<void**>(calloc(kPerThread, sizeof(void*)));
+    ASSERT_NONNULL(args[i].ptrs);
+    for (size_t j = 0; j < kPerThread; j++) {
+      const size_t size = kSizes[j % fbl::count_of(kSizes)];
+      args[i].ptrs[j] = malloc(size);
+      EXPECT_TRUE(Fill(args[i].ptrs[j], size, j));
+    }
+  }
+
+  // Each round rotates the block arrays by one thread, so blocks allocated on
+  // one cpu get freed on the next.
+  for (int round = 0; round < 4; round++) {
+    uint num_threads;
+    bool ok;
+    RunWorkersOnCpus(CrossCpuWorker, args, max_threads, &num_threads, &ok);
+    EXPECT_TRUE(ok);
+
+    void** first = args[0].ptrs;
+    for (uint i = 0; i + 1 < max_threads; i++) {
+      args[i].ptrs = args[i + 1].ptrs;
+    }
+    args[max_threads - 1].ptrs = first;
+  }
+
+  for (uint i = 0; i < max_threads; i++) {
+    for (size_t j = 0; j < kPerThread; j++) {
+      EXPECT_TRUE(Check(args[i].ptrs[j], kSizes[j % fbl::count_of(kSizes)], j));
+      free(args[i].ptrs[j]);
+    }
+    free(args[i].ptrs);
+  }
+
+  END_TEST;
+}
+
+void ChurnWorker(HeapThreadArgs* args) {
+  void* ptrs[8];
+  for (size_t i = 0; i < args->iterations; i++) {
+    // Small sizes typical of kernel objects, with a few blocks live at once.
+    for (size_t j = 0; j < fbl::count_of(ptrs); j++) {
+      ptrs[j] = malloc(16 << (j % 5));
+      if (ptrs[j] == nullptr) {
+        args->ok = false;
+      }
+    }
+    for (size_t j = 0; j < fbl::count_of(ptrs); j++) {
+      free(ptrs[j]);
+    }
+  }
+}
+
+// Runs malloc/free churn on every cpu at once. bench_heap_parallel() in
+// benchmarks.cc times the same pattern.
+bool heap_parallel_alloc_free_test() {
+  BEGIN_TEST;
+
+  HeapThreadArgs args[SMP_MAX_CPUS] = {};
+  for (auto& a : args) {
+    a.iterations = 1024;
+  }
+
+  uint num_threads;
+  bool ok;
+  RunWorkersOnCpus(ChurnWorker, args, arch_max_num_cpus(), &num_threads, &ok);
+  EXPECT_TRUE(ok);
+
+  END_TEST;
+}
+
+}  // namespace
+
+UNITTEST_START_TESTCASE(heap_tests)
+UNITTEST("alloc and free", heap_alloc_free_test)
+UNITTEST("free on another cpu", heap_cross_cpu_free_test)
+UNITTEST("parallel alloc and free", heap_parallel_alloc_free_test)
+UNITTEST_END_TESTCASE(heap_tests, "heap", "Kernel heap tests");
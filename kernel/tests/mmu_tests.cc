@@ -12,6 +12,7 @@
 #include <arch/aspace.h>
 #include <arch/mmu.h>
 #include <fbl/auto_call.h>
+#include <kernel/thread.h>
 #include <vm/arch_vm_aspace.h>
 #include <vm/pmm.h>
 
@@ -257,10 +258,70 @@ static bool test_mapping_oom() {
   END_TEST;
 }
 
+static bool test_deferred_invalidations() {
+  BEGIN_TEST;
+
+  struct Context {
+    ArchVmAspace aspace;
+    // Pages in different page tables, so that unmapping one of them frees page tables.
+    const vaddr_t va1 = 1UL << PGTABLE_L1_SHIFT;
+    const vaddr_t va2 = 2UL << PGTABLE_L1_SHIFT;
+  } context;
+  ArchVmAspace& aspace = context.aspace;
+  vaddr_t base = 1UL << 20;
+  size_t size = (1UL << 47) - base - (1UL << 20);
+  zx_status_t err = aspace.Init(base, size, 0);
+  ASSERT_EQ(err, ZX_OK, "init aspace");
+
+  const uint arch_rw_flags = ARCH_MMU_FLAG_PERM_READ | ARCH_MMU_FLAG_PERM_WRITE;
+
+  size_t mapped;
+  err = aspace.MapContiguous(context.va1, 0, 1, arch_rw_flags, &mapped);
+  EXPECT_EQ(err, ZX_OK, "map first page");
+  err = aspace.MapContiguous(context.va2, 0, 1, arch_rw_flags, &mapped);
+  EXPECT_EQ(err, ZX_OK, "map second page");
+
+  // Changes made while invalidations are held back are visible in the page tables right away.
+  aspace.DeferInvalidations();
+  err = aspace.Protect(context.va1, 1, ARCH_MMU_FLAG_PERM_READ);
+  EXPECT_EQ(err, ZX_OK, "protect first page");
+  err = aspace.Unmap(context.va2, 1, nullptr);
+  EXPECT_EQ(err, ZX_OK, "unmap second page");
+
+  paddr_t pa;
+  uint flags;
+  EXPECT_EQ(ZX_OK, aspace.Query(context.va1, &pa, &flags));
+  EXPECT_EQ(ARCH_MMU_FLAG_PERM_READ, flags);
+  EXPECT_EQ(ZX_ERR_NOT_FOUND, aspace.Query(context.va2, &pa, &flags));
+
+  // Another thread changing the page tables meanwhile sends the held back invalidations, and
+  // frees the page tables released by the unmap.
+  auto unmap = [](void* arg) -> int {
+    auto context = static_cast<Context*>(arg);
+    return context->aspace.Unmap(context->va1, 1, nullptr);
+  };
+  thread_t* thread = thread_create("test unmap", unmap, &context, DEFAULT_PRIORITY);
+  ASSERT_NONNULL(thread);
+  thread_resume(thread);
+  int retcode = ZX_ERR_INTERNAL;
+  thread_join(thread, &retcode, ZX_TIME_INFINITE);
+  EXPECT_EQ(ZX_OK, retcode, "unmap first page from another thread");
+  EXPECT_EQ(ZX_ERR_NOT_FOUND, aspace.Query(context.va1, &pa, &flags));
+
+  aspace.FlushDeferredInvalidations();
+
+  // Destroying the aspace verifies that nothing is left mapped.
+  err = aspace.Destroy();
+  EXPECT_EQ(err, ZX_OK, "destroy aspace");
+
+  END_TEST;
+}
+
 UNITTEST_START_TESTCASE(mmu_tests)
 UNITTEST("create large unaligned region and ensure it can be unmapped", test_large_unaligned_region)
 UNITTEST("create large unaligned region without mapping and ensure it can be unmapped",
          test_large_unaligned_region_without_map)
 UNITTEST("creating large vm region, and change permissions", test_large_region_protect)
 UNITTEST("trigger oom failures when creating a mapping", test_mapping_oom)
+UNITTEST("hold back tlb invalidations while changing mappings", test_deferred_invalidations)
 UNITTEST_END_TESTCASE(mmu_tests, "mmu", "mmu tests");
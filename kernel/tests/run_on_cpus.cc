@@ -0,0 +1,79 @@
+// Copyright 2019 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include "run_on_cpus.h"
+
+#include <platform.h>
+
+#include <arch/ops.h>
+#include <kernel/mp.h>
+#include <kernel/thread.h>
+#include <ktl/atomic.h>
+
+namespace {
+
+struct RunOnCpusState {
+  RunOnCpusFn fn;
+  void* ctx;
+  ktl::atomic<uint32_t> ready{0};
+  ktl::atomic<bool> go{false};
+};
+
+struct RunOnCpusThread {
+  RunOnCpusState* state;
+  uint index;
+};
+
+int RunOnCpusEntry(void* arg) {
+  auto* thread = static_cast<RunOnCpusThread*>(arg);
+  RunOnCpusState* state = thread->state;
+
+  state->ready.fetch_add(1);
+  while (!state->go.load()) {
+    arch_spinloop_pause();
+  }
+
+  state->fn(thread->index, state->ctx);
+  return 0;
+}
+
+}  // namespace
+
+zx_duration_t RunOnCpus(uint max_threads, RunOnCpusFn fn, void* ctx, uint* num_threads) {
+  RunOnCpusState state;
+  state.fn = fn;
+  state.ctx = ctx;
+  RunOnCpusThread args[SMP_MAX_CPUS];
+  thread_t* threads[SMP_MAX_CPUS];
+  uint created = 0;
+
+  const cpu_mask_t online = mp_get_online_mask();
+  for (cpu_num_t cpu = 0; cpu < arch_max_num_cpus() && created < max_threads; cpu++) {
+    if (!(online & cpu_num_to_mask(cpu))) {
+      continue;
+    }
+    args[created] = {&state, created};
+    thread_t* t = thread_create("run on cpus", RunOnCpusEntry, &args[created], DEFAULT_PRIORITY);
+    if (t == nullptr) {
+      break;
+    }
+    thread_set_cpu_affinity(t, cpu_num_to_mask(cpu));
+    thread_resume(t);
+    threads[created++] = t;
+  }
+
+  while (state.ready.load() != created) {
+    thread_yield();
+  }
+  zx_time_t start = current_time();
+  state.go.store(true);
+
+  for (uint i = 0; i < created; i++) {
+    thread_join(threads[i], nullptr, ZX_TIME_INFINITE);
+  }
+  *num_threads = created;
+  return current_time() - start;
+}
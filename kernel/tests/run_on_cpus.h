@@ -0,0 +1,29 @@
+// Copyright 2019 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#ifndef ZIRCON_KERNEL_TESTS_RUN_ON_CPUS_H_
+#define ZIRCON_KERNEL_TESTS_RUN_ON_CPUS_H_
+
+#include <sys/types.h>
+#include <zircon/types.h>
+
+// Runs one thread pinned to each online cpu, up to |max_threads| of them. Once
+// every thread has started, they are released together and thread |i| calls
+// |fn(i, ctx)|. Returns the time from releasing the threads until the last one
+// finished, and the number of threads run in |num_threads|, which is less than
+// |max_threads| when there are fewer online cpus.
+using RunOnCpusFn = void (*)(uint index, void* ctx);
+zx_duration_t RunOnCpus(uint max_threads, RunOnCpusFn fn, void* ctx, uint* num_threads);
+
+// As above, with thread |i| calling |body(i)|.
+template <typename Body>
+zx_duration_t RunOnCpus(uint max_threads, uint* num_threads, const Body& body) {
+  return RunOnCpus(
+      max_threads, [](uint index, void* ctx) { (*static_cast<const Body*>(ctx))(index); },
+      const_cast<Body*>(&body), num_threads);
+}
+
+#endif  // ZIRCON_KERNEL_TESTS_RUN_ON_CPUS_H_
@@ -16,6 +16,7 @@
 #include <zircon/types.h>
 
 #include <fbl/algorithm.h>
+#include <fbl/alloc_checker.h>
 #include <kernel/auto_lock.h>
 #include <kernel/event.h>
 #include <kernel/mp.h>
@@ -23,6 +24,7 @@
 #include <kernel/thread.h>
 #include <kernel/timer.h>
 #include <ktl/atomic.h>
+#include <ktl/unique_ptr.h>
 
 #include "tests.h"
 
@@ -485,6 +487,119 @@ static bool trylock_or_cancel_get_lock() {
   END_TEST;
 }
 
+// Measures setting and canceling many pending timers, which only touch the timer queue. Larger
+// queues are measured by bench_timer_queue() in benchmarks.cc, outside the always-run tests.
+// Records the order in which the timers of queue_fires_in_order fire.
+struct ordered_timer_args {
+  ktl::atomic<size_t> fired;
+  size_t count;
+  size_t* order;
+  event_t done;
+};
+
+struct ordered_timer {
+  timer_t timer;
+  size_t index;
+  ordered_timer_args* args;
+};
+
+static void ordered_timer_cb(timer_t*, zx_time_t, void* arg) {
+  ordered_timer* t = static_cast<ordered_timer*>(arg);
+  ordered_timer_args* args = t->args;
+  const size_t n = args->fired.fetch_add(1);
+  args->order[n] = t->index;
+  if (n + 1 == args->count) {
+    event_signal(&args->done, false);
+  }
+}
+
+// Timers set on one cpu fire in order of deadline, and timers with the same deadline fire in the
+// order they were set.
+static bool queue_fires_in_order() {
+  BEGIN_TEST;
+
+  constexpr size_t count = 64;
+  fbl::AllocChecker ac;
+  ktl::unique_ptr<ordered_timer[]> timers(new (&ac) ordered_timer[count]);
+  ASSERT_TRUE(ac.check());
+  size_t order[count] = {};
+  ordered_timer_args args;
+  args.fired.store(0);
+  args.count = count;
+  args.order = order;
+  event_init(&args.done, false, 0);
+
+  // Keep all the timers in one cpu's queue.
+  thread_t* const self = get_current_thread();
+  const cpu_mask_t old_affinity = thread_get_cpu_affinity(self);
+  thread_set_cpu_affinity(self, cpu_num_to_mask(arch_curr_cpu_num()));
+
+  // Set the timers in a scrambled order of deadlines, two to each deadline.
+  const zx_time_t base = current_time() + ZX_MSEC(5);
+  auto deadline_of = [base](size_t index) {
+    return base + ZX_USEC(50) * static_cast<zx_duration_t>(((index * 37) % count) / 2);
+  };
+  for (size_t i = 0; i < count; i++) {
+    timers[i].index = i;
+    timers[i].args = &args;
+    timer_init(&timers[i].timer);
+    timer_set(&timers[i].timer, Deadline::no_slack(deadline_of(i)), ordered_timer_cb, &timers[i]);
+  }
+
+  event_wait(&args.done);
+  thread_set_cpu_affinity(self, old_affinity);
+  event_destroy(&args.done);
+
+  ASSERT_EQ(count, args.fired.load());
+  for (size_t i = 1; i < count; i++) {
+    const size_t prev = order[i - 1];
+    const size_t next = order[i];
+    EXPECT_TRUE(deadline_of(prev) < deadline_of(next) ||
+                    (deadline_of(prev) == deadline_of(next) && prev < next),
+                "timers fired out of order");
+  }
+
+  END_TEST;
+}
+
+// Many pending timers can all be canceled, in any order, leaving none of them queued.
+// bench_timer_queue() in benchmarks.cc times the same thing.
+static bool queue_cancel_many() {
+  BEGIN_TEST;
+
+  const size_t count = 10000;
+  timer_t* timers = static_cast<timer_t*>(malloc(sizeof(timer_t) * count));
+  ASSERT_NONNULL(timers);
+
+  // Spread the deadlines an hour from now, far enough that none fire during the test.
+  const zx_time_t base = current_time() + ZX_HOUR(1);
+  const TimerSlack slack{ZX_USEC(1), TIMER_SLACK_CENTER};
+  timer_args arg{};
+
+  for (size_t i = 0; i < count; i++) {
+    timer_init(&timers[i]);
+    const Deadline deadline(base + rand_duration(ZX_MSEC(100)), slack);
+    timer_set(&timers[i], deadline, timer_cb, &arg);
+  }
+
+  // Cancel in a different order than the timers were set.
+  bool all_canceled = true;
+  for (size_t i = 0; i < count; i++) {
+    all_canceled &= timer_cancel(&timers[(i * 7919) % count]);
+  }
+  bool none_queued = true;
+  for (size_t i = 0; i < count; i++) {
+    none_queued &= !timers[i].node.InContainer();
+  }
+
+  free(timers);
+  EXPECT_TRUE(all_canceled);
+  EXPECT_TRUE(none_queued);
+  EXPECT_FALSE(atomic_load(&arg.timer_fired));
+
+  END_TEST;
+}
+
 UNITTEST_START_TESTCASE(timer_tests)
 UNITTEST("cancel_before_deadline", cancel_before_deadline)
 UNITTEST("cancel_after_fired", cancel_after_fired)
@@ -492,4 +607,6 @@ UNITTEST("cancel_from_callback", cancel_from_callback)
 UNITTEST("set_from_callback", set_from_callback)
 UNITTEST("trylock_or_cancel_canceled", trylock_or_cancel_canceled)
 UNITTEST("trylock_or_cancel_get_lock", trylock_or_cancel_get_lock)
+UNITTEST("queue_fires_in_order", queue_fires_in_order)
+UNITTEST("queue_cancel_many", queue_cancel_many)
 UNITTEST_END_TESTCASE(timer_tests, "timer", "timer tests");
@@ -73,6 +73,16 @@ class ArchVmAspaceInterface {
 
   virtual zx_status_t Query(vaddr_t vaddr, paddr_t* paddr, uint* mmu_flags) = 0;
 
+  // Hold back the TLB invalidations needed by the calling thread's Unmap and Protect calls until
+  // FlushDeferredInvalidations, so that an operation spanning many of them interrupts other CPUs
+  // once. Calls made by other threads in the meantime do the held back invalidations along with
+  // their own. Pages unmapped in the meantime may still be accessed through the TLB, so the
+  // caller must not free them before the flush.
+  //
+  // Architectures whose invalidations do not interrupt other CPUs need not implement these.
+  virtual void DeferInvalidations() {}
+  virtual void FlushDeferredInvalidations() {}
+
   virtual vaddr_t PickSpot(vaddr_t base, uint prev_region_mmu_flags, vaddr_t end,
                            uint next_region_mmu_flags, vaddr_t align, size_t size,
                            uint mmu_flags) = 0;
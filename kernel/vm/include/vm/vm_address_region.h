@@ -258,6 +258,12 @@ class VmAddressRegion : public VmAddressRegionOrMapping {
   explicit VmAddressRegion(VmAspace& kernel_aspace);
   // Count the allocated pages, caller must be holding the aspace lock
   size_t AllocatedPagesLocked() const override;
+
+  // Finds the mapping covering |va| and checks that a fault with |pf_flags| is allowed on it.
+  // On success returns the mapped vmo and the offset of |va| within it, so that the caller can
+  // resolve the page in the vmo after dropping the aspace lock.
+  zx_status_t FaultTargetLocked(vaddr_t va, uint pf_flags, fbl::RefPtr<VmObject>* vmo,
+                                uint64_t* vmo_offset);
   // Used to implement VmAspace::EnumerateChildren.
   // |aspace_->lock()| must be held.
   virtual bool EnumerateChildrenLocked(VmEnumerator* ve, uint depth);
@@ -471,6 +477,13 @@ class VmMapping final : public VmAddressRegionOrMapping,
   // Implementation for Protect().  This does not acquire the aspace lock.
   zx_status_t ProtectLocked(vaddr_t base, size_t size, uint new_arch_mmu_flags);
 
+  // Checks the fault flags against the permissions of this mapping.
+  zx_status_t CheckFaultPermissions(uint pf_flags) const;
+
+  // See VmAddressRegion::FaultTargetLocked.
+  zx_status_t FaultTargetLocked(vaddr_t va, uint pf_flags, fbl::RefPtr<VmObject>* vmo,
+                                uint64_t* vmo_offset) const;
+
   // Version of AllocatedPages() that does not acquire the aspace lock
   size_t AllocatedPagesLocked() const override;
 
@@ -487,6 +500,18 @@ class VmMapping final : public VmAddressRegionOrMapping,
   bool ObjectRangeToVaddrRange(uint64_t offset, uint64_t len, vaddr_t* base,
                                uint64_t* virtual_len) const TA_REQ(object_->lock());
 
+  // Maps the pages of the fault-around window containing |va| that are already resident in
+  // the vmo and not yet mapped. Pages are always mapped without write permission so that a
+  // write still faults and goes through the usual copy-on-write path. Failures are ignored,
+  // since the faulting page itself has already been mapped.
+  void FaultAroundLocked(vaddr_t va) TA_REQ(object_->lock());
+
+  // Maps the whole large page containing |va| if the vmo has it committed as a suitably aligned
+  // contiguous run, replacing any small pages already mapped there. |pa| is the page found for
+  // |va|. Returns false if the large page was not mapped, in which case the caller maps the single
+  // page as usual.
+  bool MapLargePageLocked(vaddr_t va, paddr_t pa, uint pf_flags) TA_REQ(object_->lock());
+
   // pointer and region of the object we are mapping
   fbl::RefPtr<VmObject> object_;
   uint64_t object_offset_ = 0;
@@ -494,8 +519,11 @@ class VmMapping final : public VmAddressRegionOrMapping,
   // cached mapping flags (read/write/user/etc)
   uint arch_mmu_flags_;
 
-  // used to detect recursions through the vmo fault path
+  // used to detect recursions through the vmo fault path, along with the range of addresses the
+  // fault in progress maps itself
   bool currently_faulting_ = false;
+  vaddr_t faulting_base_ = 0;
+  size_t faulting_len_ = 0;
 };
 
 #endif  // ZIRCON_KERNEL_VM_INCLUDE_VM_VM_ADDRESS_REGION_H_
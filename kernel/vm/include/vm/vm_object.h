@@ -230,6 +230,15 @@ class VmObject : public fbl::RefCounted<VmObject>,
     return ZX_ERR_NOT_SUPPORTED;
   }
 
+  // Checks whether the |len| bytes at |offset|, which must be aligned to |len|, are all committed
+  // to pages that are private to this vmo, physically contiguous and aligned to |len| in physical
+  // memory. If so, returns the physical address of the first page, and the run may be mapped as
+  // a single large page.
+  virtual zx_status_t LookupLargePageLocked(uint64_t offset, uint64_t len, paddr_t* pa)
+      TA_REQ(lock_) {
+    return ZX_ERR_NOT_SUPPORTED;
+  }
+
   Lock<Mutex>* lock() TA_RET_CAP(lock_) { return &lock_; }
   Lock<Mutex>& lock_ref() TA_RET_CAP(lock_) { return lock_; }
 
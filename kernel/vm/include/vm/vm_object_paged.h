@@ -36,6 +36,8 @@ class VmObjectPaged final : public VmObject {
   static constexpr uint32_t kContiguous = (1u << 1);
   static constexpr uint32_t kHidden = (1u << 2);
   static constexpr uint32_t kSlice = (1u << 3);
+  // Commit faulted pages in physically contiguous, large page sized runs where possible.
+  static constexpr uint32_t kLargePages = (1u << 4);
 
   static zx_status_t Create(uint32_t pmm_alloc_flags, uint32_t options, uint64_t size,
                             fbl::RefPtr<VmObject>* vmo);
@@ -127,6 +129,9 @@ class VmObjectPaged final : public VmObject {
       // Calls a Locked method of the parent, which confuses analysis.
       TA_NO_THREAD_SAFETY_ANALYSIS;
 
+  zx_status_t LookupLargePageLocked(uint64_t offset, uint64_t len, paddr_t* pa) override
+      TA_REQ(lock_);
+
   zx_status_t CreateClone(Resizability resizable, CloneType type, uint64_t offset, uint64_t size,
                           bool copy_name, fbl::RefPtr<VmObject>* child_vmo) override
       // This function reaches into the created child, which confuses analysis.
@@ -195,6 +200,21 @@ class VmObjectPaged final : public VmObject {
   zx_status_t AddPageLocked(vm_page_t* p, uint64_t offset, bool do_range_update = true)
       TA_REQ(lock_);
 
+  // Commits the whole large page sized run containing |offset| from a single physically
+  // contiguous allocation of zeroed pages, if none of the run is committed yet. Returns false
+  // if the whole run could not be committed this way, in which case part of it may still have
+  // been.
+  bool CommitLargePageLocked(uint64_t offset) TA_REQ(lock_);
+
+  // Whether CommitLargePageLocked() could lay out the run starting at the large page aligned
+  // |start|: the vmo owns all its pages outright, the run fits, and none of it is committed.
+  bool LargePageRunFreeLocked(uint64_t start) TA_REQ(lock_);
+
+  // Commits the run starting at |start|, which LargePageRunFreeLocked() must allow, from the
+  // VM_LARGE_PAGE_SIZE / PAGE_SIZE physically contiguous pages at the head of |pages|. Returns
+  // false if only part of the run could be added, in which case the rest of its pages are freed.
+  bool InstallLargePageLocked(uint64_t start, list_node* pages) TA_REQ(lock_);
+
   // internal page list routine
   void AddPageToArray(size_t index, vm_page_t* p);
 
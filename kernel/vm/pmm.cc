@@ -113,7 +113,10 @@ static void pmm_dump_timer(struct timer* t, zx_time_t now, void*) {
   pmm_node.DumpFree();
 }
 
-static void init_request_thread(unsigned int level) { pmm_node.InitRequestThread(); }
+static void init_request_thread(unsigned int level) {
+  pmm_node.InitRequestThread();
+  pmm_node.InitPageCaches();
+}
 
 LK_INIT_HOOK(pmm, init_request_thread, LK_INIT_LEVEL_THREADING)
 
@@ -7,10 +7,12 @@
 
 #include <inttypes.h>
 #include <lib/counters.h>
+#include <stdlib.h>
 #include <trace.h>
 
 #include <new>
 
+#include <fbl/auto_call.h>
 #include <kernel/mp.h>
 #include <kernel/thread.h>
 #include <pretty/sizes.h>
@@ -24,6 +26,10 @@
 #define LOCAL_TRACE MAX(VM_GLOBAL_TRACE, 0)
 
 KCOUNTER(pmm_alloc_async, "vm.pmm.alloc.async")
+KCOUNTER(pmm_cache_alloc, "vm.pmm.cache.alloc")
+KCOUNTER(pmm_cache_free, "vm.pmm.cache.free")
+KCOUNTER(pmm_cache_refill, "vm.pmm.cache.refill")
+KCOUNTER(pmm_cache_trim, "vm.pmm.cache.trim")
 
 namespace {
 
@@ -47,6 +53,11 @@ PmmNode::~PmmNode() {
     thread_join(request_thread_, &res, ZX_TIME_INFINITE);
     DEBUG_ASSERT(res == 0);
   }
+
+  for (size_t i = 0; i < page_cache_count_; i++) {
+    page_caches_[i].~PageCache();
+  }
+  free(page_caches_);
 }
 
 // We disable thread safety analysis here, since this function is only called
@@ -123,24 +134,41 @@ static void alloc_page_helper(vm_page* page) {
 }
 
 zx_status_t PmmNode::AllocPage(uint alloc_flags, vm_page_t** page_out, paddr_t* pa_out) {
-  Guard<fbl::Mutex> guard{&lock_};
+  vm_page* page = nullptr;
 
-  if (unlikely(InOomStateLocked())) {
-    if (alloc_flags & PMM_ALLOC_DELAY_OK) {
-      // TODO(stevensd): Differentiate 'cannot allocate now' from 'can never allocate'
-      return ZX_ERR_NO_MEMORY;
-    }
+  // An allocation which may be delayed has to check for the OOM state, under
+  // |lock_|, before it takes any page, so only the others use the caches.
+  if (!(alloc_flags & PMM_ALLOC_DELAY_OK)) {
+    page = AllocPageFromCache();
   }
 
-  vm_page* page = list_remove_head_type(&free_list_, vm_page, queue_node);
   if (!page) {
-    return ZX_ERR_NO_MEMORY;
+    Guard<fbl::Mutex> guard{&lock_};
+
+    if (unlikely(InOomStateLocked())) {
+      if (alloc_flags & PMM_ALLOC_DELAY_OK) {
+        // TODO(stevensd): Differentiate 'cannot allocate now' from 'can never allocate'
+        return ZX_ERR_NO_MEMORY;
+      }
+    }
+
+    page = RefillPageCacheLocked(arch_curr_cpu_num());
+    if (!page) {
+      if (unlikely(list_is_empty(&free_list_)) && DrainPageCachesLocked() > 0) {
+        UpdateMemAvailStateLocked();
+      }
+
+      page = list_remove_head_type(&free_list_, vm_page, queue_node);
+      if (!page) {
+        return ZX_ERR_NO_MEMORY;
+      }
+
+      DecrementFreeCountLocked(1);
+    }
   }
 
   alloc_page_helper(page);
 
-  DecrementFreeCountLocked(1);
-
   if (pa_out) {
     *pa_out = page->paddr();
   }
@@ -172,7 +200,13 @@ zx_status_t PmmNode::AllocPages(size_t count, uint alloc_flags, list_node* list)
   Guard<fbl::Mutex> guard{&lock_};
 
   if (unlikely(count > free_count_)) {
-    return ZX_ERR_NO_MEMORY;
+    // Pull back any pages held in the per-CPU caches before giving up.
+    if (DrainPageCachesLocked() > 0) {
+      UpdateMemAvailStateLocked();
+    }
+    if (count > free_count_) {
+      return ZX_ERR_NO_MEMORY;
+    }
   }
 
   DecrementFreeCountLocked(count);
@@ -218,6 +252,13 @@ zx_status_t PmmNode::AllocRange(paddr_t address, size_t count, list_node* list)
 
   Guard<fbl::Mutex> guard{&lock_};
 
+  // Free pages must be on |free_list_| to be removed below. Keep the caches
+  // empty until the range is allocated.
+  DisablePageCachesLocked();
+  auto enable_caches = fbl::MakeAutoCall([this]() TA_NO_THREAD_SAFETY_ANALYSIS {
+    EnablePageCachesLocked();
+  });
+
   // walk through the arenas, looking to see if the physical page belongs to it
   for (auto& a : arena_list_) {
     while (allocated < count && a.address_in_arena(address)) {
@@ -272,6 +313,13 @@ zx_status_t PmmNode::AllocContiguous(const size_t count, uint alloc_flags, uint8
 
   Guard<fbl::Mutex> guard{&lock_};
 
+  // Free pages must be on |free_list_| to be removed below. Keep the caches
+  // empty until the run is allocated.
+  DisablePageCachesLocked();
+  auto enable_caches = fbl::MakeAutoCall([this]() TA_NO_THREAD_SAFETY_ANALYSIS {
+    EnablePageCachesLocked();
+  });
+
   for (auto& a : arena_list_) {
     vm_page_t* p = a.FindFreeContiguous(count, alignment_log2);
     if (!p) {
@@ -304,7 +352,7 @@ zx_status_t PmmNode::AllocContiguous(const size_t count, uint alloc_flags, uint8
   return ZX_ERR_NOT_FOUND;
 }
 
-void PmmNode::FreePageHelperLocked(vm_page* page) {
+void PmmNode::FreePageHelper(vm_page* page) {
   LTRACEF("page %p state %u paddr %#" PRIxPTR "\n", page, page->state(), page->paddr());
 
   DEBUG_ASSERT(page->state() != VM_PAGE_STATE_OBJECT || page->object.pin_count == 0);
@@ -319,12 +367,16 @@ void PmmNode::FreePageHelperLocked(vm_page* page) {
 }
 
 void PmmNode::FreePage(vm_page* page) {
-  Guard<fbl::Mutex> guard{&lock_};
-
   // pages freed individually shouldn't be in a queue
   DEBUG_ASSERT(!list_in_list(&page->queue_node));
 
-  FreePageHelperLocked(page);
+  if (FreePageToCache(page)) {
+    return;
+  }
+
+  Guard<fbl::Mutex> guard{&lock_};
+
+  FreePageHelper(page);
 
   // add it to the free queue
   list_add_head(&free_list_, &page->queue_node);
@@ -339,7 +391,7 @@ void PmmNode::FreeListLocked(list_node* list) {
   uint64_t count = 0;
   for (vm_page* page = list_peek_tail_type(list, vm_page, queue_node); page != nullptr;
        page = list_prev_type(list, &page->queue_node, vm_page, queue_node)) {
-    FreePageHelperLocked(page);
+    FreePageHelper(page);
     count++;
   }
 
@@ -355,6 +407,160 @@ void PmmNode::FreeList(list_node* list) {
   FreeListLocked(list);
 }
 
+vm_page* PmmNode::AllocPageFromCache() {
+  if (!PageCachesEnabled()) {
+    return nullptr;
+  }
+
+  PageCache& cache = page_caches_[arch_curr_cpu_num()];
+  Guard<SpinLock, IrqSave> guard{&cache.lock};
+
+  // Recheck under the cache lock, which orders this with a concurrent drain.
+  if (!PageCachesEnabled()) {
+    return nullptr;
+  }
+
+  vm_page* page = list_remove_head_type(&cache.free_list, vm_page, queue_node);
+  if (page) {
+    cache.count--;
+    cached_count_.fetch_sub(1);
+    kcounter_add(pmm_cache_alloc, 1);
+  }
+  return page;
+}
+
+bool PmmNode::FreePageToCache(vm_page* page) {
+  if (!PageCachesEnabled()) {
+    return false;
+  }
+
+  const size_t cpu = arch_curr_cpu_num();
+  PageCache& cache = page_caches_[cpu];
+  bool trim;
+  {
+    Guard<SpinLock, IrqSave> guard{&cache.lock};
+
+    // Recheck under the cache lock, which orders this with a concurrent drain.
+    if (!PageCachesEnabled()) {
+      return false;
+    }
+
+    FreePageHelper(page);
+    list_add_head(&cache.free_list, &page->queue_node);
+    cache.count++;
+    cached_count_.fetch_add(1);
+    trim = cache.count > kPageCacheLimit;
+  }
+  kcounter_add(pmm_cache_free, 1);
+
+  if (unlikely(trim)) {
+    Guard<fbl::Mutex> guard{&lock_};
+    TrimPageCacheLocked(cpu);
+  }
+  return true;
+}
+
+vm_page* PmmNode::RefillPageCacheLocked(size_t cpu) {
+  // Never let a refill push the node across its lower watermark bound; the
+  // allocation falls back to |free_list_| instead, which performs the state
+  // transition.
+  if (!PageCachesEnabled() || free_count_ <= mem_avail_state_lower_bound_ + kPageCacheBatch) {
+    return nullptr;
+  }
+
+  vm_page* page = list_remove_head_type(&free_list_, vm_page, queue_node);
+  DEBUG_ASSERT(page);
+
+  {
+    PageCache& cache = page_caches_[cpu];
+    Guard<SpinLock, IrqSave> guard{&cache.lock};
+    for (uint64_t i = 1; i < kPageCacheBatch; i++) {
+      list_add_tail(&cache.free_list, list_remove_head(&free_list_));
+    }
+    cache.count += kPageCacheBatch - 1;
+    cached_count_.fetch_add(kPageCacheBatch - 1);
+  }
+
+  // Account for the whole batch, including the page returned to the caller.
+  DecrementFreeCountLocked(kPageCacheBatch);
+  kcounter_add(pmm_cache_refill, 1);
+  return page;
+}
+
+void PmmNode::TrimPageCacheLocked(size_t cpu) {
+  PageCache& cache = page_caches_[cpu];
+  uint64_t count = 0;
+  {
+    Guard<SpinLock, IrqSave> guard{&cache.lock};
+
+    // Return the coldest pages, leaving a batch behind for future allocations.
+    while (cache.count > kPageCacheBatch) {
+      list_add_head(&free_list_, list_remove_tail(&cache.free_list));
+      cache.count--;
+      count++;
+    }
+    cached_count_.fetch_sub(count);
+  }
+
+  if (count > 0) {
+    kcounter_add(pmm_cache_trim, 1);
+    IncrementFreeCountLocked(count);
+  }
+}
+
+uint64_t PmmNode::DrainPageCachesLocked() {
+  uint64_t total = 0;
+  for (size_t i = 0; i < page_cache_count_; i++) {
+    PageCache& cache = page_caches_[i];
+    Guard<SpinLock, IrqSave> guard{&cache.lock};
+    if (cache.count == 0) {
+      continue;
+    }
+
+    list_splice_after(&cache.free_list, &free_list_);
+    cached_count_.fetch_sub(cache.count);
+    total += cache.count;
+    cache.count = 0;
+  }
+
+  free_count_ += total;
+  return total;
+}
+
+void PmmNode::DisablePageCachesLocked() {
+  // Disable before draining so that no page can be added to a cache after it
+  // has been drained.
+  page_cache_disables_.fetch_add(1);
+  if (DrainPageCachesLocked() > 0 && free_count_ >= mem_avail_state_upper_bound_) {
+    UpdateMemAvailStateLocked();
+  }
+}
+
+void PmmNode::EnablePageCachesLocked() {
+  DEBUG_ASSERT(page_cache_disables_.load() > 0);
+  page_cache_disables_.fetch_sub(1);
+}
+
+void PmmNode::InitPageCaches() {
+  static_assert((MAX_CACHE_LINE % alignof(PageCache)) == 0);
+
+  const size_t count = arch_max_num_cpus();
+  auto* caches = static_cast<PageCache*>(memalign(MAX_CACHE_LINE, sizeof(PageCache) * count));
+  if (!caches) {
+    printf("PMM: could not allocate per-CPU page caches\n");
+    return;
+  }
+  for (size_t i = 0; i < count; i++) {
+    new (&caches[i]) PageCache{};
+  }
+
+  Guard<fbl::Mutex> guard{&lock_};
+  DEBUG_ASSERT(page_caches_ == nullptr);
+  page_caches_ = caches;
+  page_cache_count_ = count;
+  EnablePageCachesLocked();
+}
+
 void PmmNode::AllocPages(uint alloc_flags, page_request_t* req) {
   kcounter_add(pmm_alloc_async, 1);
 
@@ -460,7 +666,9 @@ void PmmNode::ProcessPendingRequests() {
   }
 }
 
-uint64_t PmmNode::CountFreePages() const TA_NO_THREAD_SAFETY_ANALYSIS { return free_count_; }
+uint64_t PmmNode::CountFreePages() const TA_NO_THREAD_SAFETY_ANALYSIS {
+  return free_count_ + cached_count_.load();
+}
 
 uint64_t PmmNode::CountTotalBytes() const TA_NO_THREAD_SAFETY_ANALYSIS {
   return arena_cumulative_size_;
@@ -474,8 +682,8 @@ void PmmNode::DumpFree() const TA_NO_THREAD_SAFETY_ANALYSIS {
 void PmmNode::Dump(bool is_panic) const {
   // No lock analysis here, as we want to just go for it in the panic case without the lock.
   auto dump = [this]() TA_NO_THREAD_SAFETY_ANALYSIS {
-    printf("pmm node %p: free_count %zu (%zu bytes), total size %zu\n", this, free_count_,
-           free_count_ * PAGE_SIZE, arena_cumulative_size_);
+    printf("pmm node %p: free_count %zu (%zu bytes), cached %zu, total size %zu\n", this,
+           free_count_, free_count_ * PAGE_SIZE, cached_count_.load(), arena_cumulative_size_);
     for (auto& a : arena_list_) {
       a.Dump(false, false);
     }
@@ -538,13 +746,36 @@ zx_status_t PmmNode::InitReclamation(const uint64_t* watermarks, uint8_t waterma
 
 void PmmNode::UpdateMemAvailStateLocked() {
   // Find the smallest watermark which is greater than the number of free pages.
-  uint8_t target = mem_avail_state_watermark_count_;
-  for (uint8_t i = 0; i < mem_avail_state_watermark_count_; i++) {
-    if (mem_avail_state_watermarks_[i] > free_count_) {
-      target = i;
-      break;
+  auto find_target = [this]() TA_REQ(lock_) {
+    uint8_t target = mem_avail_state_watermark_count_;
+    for (uint8_t i = 0; i < mem_avail_state_watermark_count_; i++) {
+      if (mem_avail_state_watermarks_[i] > free_count_) {
+        target = i;
+        break;
+      }
     }
+    return target;
+  };
+  uint8_t target = find_target();
+
+  // The per-CPU page caches are only used in the highest state, and never in
+  // the oom state. Pull back the cached pages before entering a lower state,
+  // so that the remaining transitions see every free page.
+  auto is_highest = [this](uint8_t target) TA_REQ(lock_) {
+    return target == mem_avail_state_watermark_count_ && target != 0;
+  };
+  if (!is_highest(target) && !page_caches_pressure_disabled_) {
+    page_caches_pressure_disabled_ = true;
+    page_cache_disables_.fetch_add(1);
+    if (DrainPageCachesLocked() > 0) {
+      target = find_target();
+    }
+  }
+  if (is_highest(target) && page_caches_pressure_disabled_) {
+    page_caches_pressure_disabled_ = false;
+    EnablePageCachesLocked();
   }
+
   SetMemAvailStateLocked(target);
 }
 
@@ -9,8 +9,11 @@
 #include <fbl/canary.h>
 #include <fbl/intrusive_double_list.h>
 #include <fbl/mutex.h>
+#include <kernel/align.h>
 #include <kernel/event.h>
 #include <kernel/lockdep.h>
+#include <kernel/spinlock.h>
+#include <ktl/atomic.h>
 #include <vm/pmm.h>
 
 #include "pmm_arena.h"
@@ -49,6 +52,10 @@ class PmmNode {
   int RequestThreadLoop();
   void InitRequestThread();
 
+  // Allocates and enables the per-CPU page caches. Called once threading is
+  // available. If the caches cannot be allocated they stay disabled.
+  void InitPageCaches();
+
   uint64_t CountFreePages() const;
   uint64_t CountTotalBytes() const;
 
@@ -71,9 +78,32 @@ class PmmNode {
   void AddFreePages(list_node* list);
 
  private:
-  void FreePageHelperLocked(vm_page* page) TA_REQ(lock_);
+  void FreePageHelper(vm_page* page);
   void FreeListLocked(list_node* list) TA_REQ(lock_);
 
+  // Per-CPU page cache routines. Each returns false (or nullptr) when the
+  // caches are disabled, in which case the caller falls back to |free_list_|.
+  vm_page* AllocPageFromCache();
+  bool FreePageToCache(vm_page* page);
+
+  // Moves a batch of pages from |free_list_| to |cache| and returns one of
+  // them, or returns nullptr if doing so would cross a watermark.
+  vm_page* RefillPageCacheLocked(size_t cpu) TA_REQ(lock_);
+
+  // Returns pages above the cache limit from the given cache to |free_list_|.
+  void TrimPageCacheLocked(size_t cpu) TA_REQ(lock_);
+
+  // Returns every cached page to |free_list_| and adds them to |free_count_|
+  // without evaluating the watermarks. Returns the number of pages moved.
+  uint64_t DrainPageCachesLocked() TA_REQ(lock_);
+
+  // Disables the per-CPU caches and drains them. Each call must be balanced by
+  // a call to EnablePageCachesLocked.
+  void DisablePageCachesLocked() TA_REQ(lock_);
+  void EnablePageCachesLocked() TA_REQ(lock_);
+
+  bool PageCachesEnabled() const { return page_cache_disables_.load() == 0; }
+
   void ProcessPendingRequests();
 
   void UpdateMemAvailStateLocked() TA_REQ(lock_);
@@ -130,6 +160,42 @@ class PmmNode {
   uint64_t mem_avail_state_lower_bound_ TA_GUARDED(lock_);
   mem_avail_state_updated_callback_t mem_avail_state_callback_ TA_GUARDED(lock_);
 
+  // Per-CPU cache of free pages in front of |free_list_|, which lets single
+  // page allocations and frees avoid |lock_|. Pages in a cache are in the free
+  // state but are not counted in |free_count_|, so the watermarks see slightly
+  // less free memory than actually exists while the caches are in use. The
+  // caches are only used in the highest memory availability state and are
+  // drained as soon as the node drops below it.
+  //
+  // A cache lock may be acquired while holding |lock_|, but not the reverse.
+  struct PageCache {
+    DECLARE_SPINLOCK(PageCache) lock;
+    list_node free_list TA_GUARDED(lock) = LIST_INITIAL_VALUE(free_list);
+    uint64_t count TA_GUARDED(lock) = 0;
+  } __CPU_ALIGN;
+
+  // Number of pages moved between |free_list_| and a cache at a time, and the
+  // number of pages above which a cache is trimmed.
+  static constexpr uint64_t kPageCacheBatch = 32;
+  static constexpr uint64_t kPageCacheLimit = 2 * kPageCacheBatch;
+
+  // One cache per CPU, allocated by InitPageCaches() rather than embedded, so
+  // that a node is small enough to live on the stack in tests. Only touched
+  // while the caches are enabled, or under |lock_|.
+  PageCache* page_caches_ = nullptr;
+  size_t page_cache_count_ = 0;
+
+  // Total number of pages held in the page caches.
+  ktl::atomic<uint64_t> cached_count_ = 0;
+
+  // The caches are used only when this is zero. Starts with one reference
+  // released by InitPageCaches(). Only modified while holding |lock_|.
+  ktl::atomic<uint32_t> page_cache_disables_ = 1;
+
+  // Whether a disable reference is held because the node is below its
+  // highest memory availability state.
+  bool page_caches_pressure_disabled_ TA_GUARDED(lock_) = false;
+
   thread_t* request_thread_ = nullptr;
   ktl::atomic<bool> request_thread_live_ = true;
 
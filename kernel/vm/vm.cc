@@ -10,8 +10,10 @@
 #include <debug.h>
 #include <err.h>
 #include <inttypes.h>
+#include <lib/cmdline.h>
 #include <lib/console.h>
 #include <lib/crypto/global_prng.h>
+#include <pow2.h>
 #include <string.h>
 #include <trace.h>
 #include <zircon/types.h>
@@ -33,6 +35,12 @@
 vm_page_t* zero_page;
 paddr_t zero_page_paddr;
 
+// number of pages mapped around a faulting address, see vm_fault_around_pages()
+uint32_t fault_around_pages;
+
+// whether large pages may be used, see vm_large_pages_enabled()
+bool large_pages_enabled;
+
 // set early in arch code to record the start address of the kernel
 paddr_t kernel_base_phys;
 
@@ -118,6 +126,14 @@ void vm_init() {
 
   VmAspace* aspace = VmAspace::kernel_aspace();
 
+  // size the fault-around window, rounding down to a power of two so windows stay aligned
+  uint32_t window = gCmdline.GetUInt32("kernel.vm.fault-around-pages", 16);
+  window = MIN(window, VM_FAULT_AROUND_MAX_PAGES);
+  fault_around_pages = (window > 1) ? (1u << log2_uint_floor(window)) : 0;
+  dprintf(INFO, "VM: fault-around window %u pages\n", fault_around_pages);
+
+  large_pages_enabled = gCmdline.GetBool("kernel.vm.large-pages", true);
+
   // we expect the kernel to be in a temporary mapping, define permanent
   // regions for those now
   struct temp_region {
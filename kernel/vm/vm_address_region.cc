@@ -14,6 +14,7 @@
 #include <zircon/types.h>
 
 #include <fbl/alloc_checker.h>
+#include <fbl/auto_call.h>
 #include <vm/vm.h>
 #include <vm/vm_aspace.h>
 #include <vm/vm_object.h>
@@ -382,6 +383,22 @@ zx_status_t VmAddressRegion::PageFault(vaddr_t va, uint pf_flags, PageRequest* p
   return ZX_ERR_NOT_FOUND;
 }
 
+zx_status_t VmAddressRegion::FaultTargetLocked(vaddr_t va, uint pf_flags,
+                                               fbl::RefPtr<VmObject>* vmo, uint64_t* vmo_offset) {
+  canary_.Assert();
+  DEBUG_ASSERT(aspace_->lock()->lock().IsHeld());
+
+  auto vmar = WrapRefPtr(this);
+  while (auto next = vmar->FindRegionLocked(va)) {
+    if (next->is_mapping()) {
+      return next->as_vm_mapping()->FaultTargetLocked(va, pf_flags, vmo, vmo_offset);
+    }
+    vmar = next->as_vm_address_region();
+  }
+
+  return ZX_ERR_NOT_FOUND;
+}
+
 bool VmAddressRegion::IsRangeAvailableLocked(vaddr_t base, size_t size) {
   DEBUG_ASSERT(aspace_->lock()->lock().IsHeld());
   DEBUG_ASSERT(size > 0);
@@ -807,6 +824,11 @@ zx_status_t VmAddressRegion::Protect(vaddr_t base, size_t size, uint new_arch_mm
     return ZX_ERR_NOT_FOUND;
   }
 
+  // Protecting the mappings frees no pages, so the TLB invalidations for all of them can be done
+  // at once when we are done.
+  aspace_->arch_aspace().DeferInvalidations();
+  auto flush = fbl::MakeAutoCall([this]() { aspace_->arch_aspace().FlushDeferredInvalidations(); });
+
   for (auto itr = begin; itr != end;) {
     DEBUG_ASSERT(itr->is_mapping());
 
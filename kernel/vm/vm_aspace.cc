@@ -552,10 +552,27 @@ zx_status_t VmAspace::PageFault(vaddr_t va, uint flags) {
   zx_status_t status = ZX_OK;
   PageRequest page_request;
   do {
+    // Resolve the page in the vmo first, holding the aspace lock only to find the mapping. This
+    // keeps page allocation, zeroing and copy-on-write copies off the aspace lock, so that
+    // threads faulting on different mappings or ranges don't serialize behind each other.
+    fbl::RefPtr<VmObject> vmo;
+    uint64_t vmo_offset;
     {
-      // for now, hold the aspace lock across the page fault operation,
-      // which stops any other operations on the address space from moving
-      // the region out from underneath it
+      Guard<fbl::Mutex> guard{&lock_};
+      status = root_vmar_->FaultTargetLocked(va, flags, &vmo, &vmo_offset);
+    }
+    if (status != ZX_OK) {
+      return status;
+    }
+    status = vmo->GetPage(vmo_offset, flags, nullptr, &page_request, nullptr, nullptr);
+    vmo.reset();
+
+    // Unless we have to wait for a pager, finish with the regular fault path. The page is now
+    // normally present in the vmo so this only looks it up and maps it, and any failure is
+    // reported against the current state of the mapping. The aspace lock is held for this
+    // part, which stops any other operations on the address space from moving the region out
+    // from underneath it.
+    if (status != ZX_ERR_SHOULD_WAIT) {
       Guard<fbl::Mutex> guard{&lock_};
 
       status = root_vmar_->PageFault(va, flags, &page_request);
@@ -6,9 +6,11 @@
 #include <assert.h>
 #include <err.h>
 #include <inttypes.h>
+#include <lib/counters.h>
 #include <trace.h>
 #include <zircon/types.h>
 
+#include <fbl/algorithm.h>
 #include <fbl/alloc_checker.h>
 #include <fbl/auto_call.h>
 #include <ktl/move.h>
@@ -22,6 +24,11 @@
 
 #define LOCAL_TRACE MAX(VM_GLOBAL_TRACE, 0)
 
+KCOUNTER(vm_fault_count, "vm.fault.count")
+KCOUNTER(vm_fault_around_windows, "vm.fault.around.windows")
+KCOUNTER(vm_fault_around_mapped, "vm.fault.around.mapped")
+KCOUNTER(vm_large_page_map, "vm.large_page.map")
+
 VmMapping::VmMapping(VmAddressRegion& parent, vaddr_t base, size_t size, uint32_t vmar_flags,
                      fbl::RefPtr<VmObject> vmo, uint64_t vmo_offset, uint arch_mmu_flags)
     : VmAddressRegionOrMapping(base, size, vmar_flags, parent.aspace_.get(), &parent),
@@ -370,16 +377,6 @@ zx_status_t VmMapping::UnmapVmoRangeLocked(uint64_t offset, uint64_t len) const
   DEBUG_ASSERT(object_);
   DEBUG_ASSERT(object_->lock()->lock().IsHeld());
 
-  // If we're currently faulting and are responsible for the vmo code to be calling
-  // back to us, detect the recursion and abort here.
-  // The specific path we're avoiding is if the VMO calls back into us during vmo->GetPageLocked()
-  // via UnmapVmoRangeLocked(). If we set this flag we're short circuiting the unmap operation
-  // so that we don't do extra work.
-  if (likely(currently_faulting_)) {
-    LTRACEF("recursing to ourself, abort\n");
-    return ZX_OK;
-  }
-
   // See if there's an intersect.
   vaddr_t base;
   uint64_t new_len;
@@ -387,6 +384,30 @@ zx_status_t VmMapping::UnmapVmoRangeLocked(uint64_t offset, uint64_t len) const
     return ZX_OK;
   }
 
+  // If we're currently faulting and are responsible for the vmo code to be calling
+  // back to us, detect the recursion here.
+  // The specific path we're avoiding is if the VMO calls back into us during vmo->GetPageLocked()
+  // via UnmapVmoRangeLocked(). The fault maps the pages it is for itself, so skip those to avoid
+  // extra work, but the vmo may have changed pages around them as well (a large page vmo commits
+  // the whole run around the faulting page), and those still have to be unmapped.
+  if (likely(currently_faulting_)) {
+    LTRACEF("recursing to ourself, skipping the faulting range\n");
+    const vaddr_t end = base + new_len;
+    const vaddr_t faulting_end = faulting_base_ + faulting_len_;
+    if (base < faulting_base_) {
+      zx_status_t status = aspace_->arch_aspace().Unmap(
+          base, (fbl::min(end, faulting_base_) - base) / PAGE_SIZE, nullptr);
+      if (status != ZX_OK) {
+        return status;
+      }
+    }
+    if (end > faulting_end) {
+      const vaddr_t start = fbl::max(base, faulting_end);
+      return aspace_->arch_aspace().Unmap(start, (end - start) / PAGE_SIZE, nullptr);
+    }
+    return ZX_OK;
+  }
+
   return aspace_->arch_aspace().Unmap(base, new_len / PAGE_SIZE, nullptr);
 }
 
@@ -532,6 +553,8 @@ zx_status_t VmMapping::MapRange(size_t offset, size_t len, bool commit) {
   // set the currently faulting flag for any recursive calls the vmo may make back into us.
   DEBUG_ASSERT(!currently_faulting_);
   currently_faulting_ = true;
+  faulting_base_ = base_ + offset;
+  faulting_len_ = len;
   auto ac = fbl::MakeAutoCall([&]() { currently_faulting_ = false; });
 
   // iterate through the range, grabbing a page from the underlying object and
@@ -632,20 +655,7 @@ zx_status_t VmMapping::DestroyLocked() {
   return ZX_OK;
 }
 
-zx_status_t VmMapping::PageFault(vaddr_t va, const uint pf_flags, PageRequest* page_request) {
-  canary_.Assert();
-  DEBUG_ASSERT(aspace_->lock()->lock().IsHeld());
-
-  DEBUG_ASSERT(va >= base_ && va <= base_ + size_ - 1);
-
-  va = ROUNDDOWN(va, PAGE_SIZE);
-  uint64_t vmo_offset = va - base_ + object_offset_;
-
-  __UNUSED char pf_string[5];
-  LTRACEF("%p va %#" PRIxPTR " vmo_offset %#" PRIx64 ", pf_flags %#x (%s)\n", this, va, vmo_offset,
-          pf_flags, vmm_pf_flags_to_string(pf_flags, pf_string));
-
-  // make sure we have permission to continue
+zx_status_t VmMapping::CheckFaultPermissions(uint pf_flags) const {
   if ((pf_flags & VMM_PF_FLAG_USER) && !(arch_mmu_flags_ & ARCH_MMU_FLAG_PERM_USER)) {
     // user page fault on non user mapped region
     LTRACEF("permission failure: user fault on non user region\n");
@@ -666,6 +676,48 @@ zx_status_t VmMapping::PageFault(vaddr_t va, const uint pf_flags, PageRequest* p
     LTRACEF("permission failure: execute fault on no execute region\n");
     return ZX_ERR_ACCESS_DENIED;
   }
+  return ZX_OK;
+}
+
+zx_status_t VmMapping::FaultTargetLocked(vaddr_t va, uint pf_flags, fbl::RefPtr<VmObject>* vmo,
+                                         uint64_t* vmo_offset) const {
+  canary_.Assert();
+  DEBUG_ASSERT(aspace_->lock()->lock().IsHeld());
+  DEBUG_ASSERT(va >= base_ && va <= base_ + size_ - 1);
+
+  if (state_ != LifeCycleState::ALIVE) {
+    return ZX_ERR_BAD_STATE;
+  }
+  zx_status_t status = CheckFaultPermissions(pf_flags);
+  if (status != ZX_OK) {
+    return status;
+  }
+
+  *vmo = object_;
+  *vmo_offset = ROUNDDOWN(va, PAGE_SIZE) - base_ + object_offset_;
+  return ZX_OK;
+}
+
+zx_status_t VmMapping::PageFault(vaddr_t va, const uint pf_flags, PageRequest* page_request) {
+  canary_.Assert();
+  DEBUG_ASSERT(aspace_->lock()->lock().IsHeld());
+
+  DEBUG_ASSERT(va >= base_ && va <= base_ + size_ - 1);
+
+  kcounter_add(vm_fault_count, 1);
+
+  va = ROUNDDOWN(va, PAGE_SIZE);
+  uint64_t vmo_offset = va - base_ + object_offset_;
+
+  __UNUSED char pf_string[5];
+  LTRACEF("%p va %#" PRIxPTR " vmo_offset %#" PRIx64 ", pf_flags %#x (%s)\n", this, va, vmo_offset,
+          pf_flags, vmm_pf_flags_to_string(pf_flags, pf_string));
+
+  // make sure we have permission to continue
+  zx_status_t status = CheckFaultPermissions(pf_flags);
+  if (status != ZX_OK) {
+    return status;
+  }
 
   // grab the lock for the vmo
   Guard<fbl::Mutex> guard{object_->lock()};
@@ -673,16 +725,17 @@ zx_status_t VmMapping::PageFault(vaddr_t va, const uint pf_flags, PageRequest* p
   // set the currently faulting flag for any recursive calls the vmo may make back into us
   // The specific path we're avoiding is if the VMO calls back into us during vmo->GetPageLocked()
   // via UnmapVmoRangeLocked(). Since we're responsible for that page, signal to ourself to skip
-  // the unmap operation.
+  // unmapping it.
   DEBUG_ASSERT(!currently_faulting_);
   currently_faulting_ = true;
+  faulting_base_ = va;
+  faulting_len_ = PAGE_SIZE;
   auto ac = fbl::MakeAutoCall([&]() { currently_faulting_ = false; });
 
   // fault in or grab an existing page
   paddr_t new_pa;
   vm_page_t* page;
-  zx_status_t status =
-      object_->GetPageLocked(vmo_offset, pf_flags, nullptr, page_request, &page, &new_pa);
+  status = object_->GetPageLocked(vmo_offset, pf_flags, nullptr, page_request, &page, &new_pa);
   if (status != ZX_OK) {
     // TODO(cpu): This trace was originally TRACEF() always on, but it fires if the
     // VMO was resized, rather than just when the system is running out of memory.
@@ -758,6 +811,11 @@ zx_status_t VmMapping::PageFault(vaddr_t va, const uint pf_flags, PageRequest* p
     // assert that we're not accidentally mapping the zero page writable
     DEBUG_ASSERT((new_pa != vm_get_zero_page_paddr()) || !(mmu_flags & ARCH_MMU_FLAG_PERM_WRITE));
 
+    // if the page is part of a run the vmo has laid out as a large page, map all of it at once
+    if (MapLargePageLocked(va, new_pa, pf_flags)) {
+      return ZX_OK;
+    }
+
     size_t mapped;
     status = aspace_->arch_aspace().MapContiguous(va, new_pa, 1, mmu_flags, &mapped);
     if (status != ZX_OK) {
@@ -775,9 +833,121 @@ zx_status_t VmMapping::PageFault(vaddr_t va, const uint pf_flags, PageRequest* p
     arch_sync_cache_range(va, PAGE_SIZE);
   }
 #endif
+
+  // while we hold the vmo lock, map in any neighbours that are already resident so that
+  // touching them does not take another fault
+  if (vm_fault_around_pages() != 0 && aspace_->is_user() && !(pf_flags & VMM_PF_FLAG_GUEST)) {
+    FaultAroundLocked(va);
+  }
   return ZX_OK;
 }
 
+bool VmMapping::MapLargePageLocked(vaddr_t va, paddr_t pa, uint pf_flags) {
+  canary_.Assert();
+
+  if (!vm_large_pages_enabled()) {
+    return false;
+  }
+
+  // the large page has to fit in the mapping, with the vmo offset aligned the same as the address
+  const vaddr_t block = ROUNDDOWN(va, VM_LARGE_PAGE_SIZE);
+  if (block < base_ || block - base_ + VM_LARGE_PAGE_SIZE > size_) {
+    return false;
+  }
+  const uint64_t block_offset = block - base_ + object_offset_;
+  if (!IS_ALIGNED(block_offset, VM_LARGE_PAGE_SIZE)) {
+    return false;
+  }
+
+  // cheap check before walking the vmo: the faulting page must sit at the matching spot of an
+  // aligned physical run
+  if (!IS_ALIGNED(pa - (va - block), VM_LARGE_PAGE_SIZE)) {
+    return false;
+  }
+  paddr_t block_pa;
+  if (object_->LookupLargePageLocked(block_offset, VM_LARGE_PAGE_SIZE, &block_pa) != ZX_OK) {
+    return false;
+  }
+
+  // The run is private to the vmo, so unlike a single read faulted page it never needs a write
+  // fault to copy it and can be mapped with the full permissions of the mapping. Any small pages
+  // of the run that are already mapped are replaced. Later partial unmaps or protects split the
+  // large page in the arch layer.
+  zx_status_t status =
+      aspace_->arch_aspace().Unmap(block, VM_LARGE_PAGE_SIZE / PAGE_SIZE, nullptr);
+  if (status != ZX_OK) {
+    return false;
+  }
+  size_t mapped;
+  status = aspace_->arch_aspace().MapContiguous(block, block_pa, VM_LARGE_PAGE_SIZE / PAGE_SIZE,
+                                                arch_mmu_flags_, &mapped);
+  if (status != ZX_OK) {
+    LTRACEF("failed to map large page at va %#" PRIxPTR "\n", block);
+    return false;
+  }
+  DEBUG_ASSERT(mapped == VM_LARGE_PAGE_SIZE / PAGE_SIZE);
+  kcounter_add(vm_large_page_map, 1);
+
+#if ARCH_ARM64
+  if (!(pf_flags & VMM_PF_FLAG_GUEST) && (arch_mmu_flags_ & ARCH_MMU_FLAG_PERM_EXECUTE)) {
+    arch_sync_cache_range(block, VM_LARGE_PAGE_SIZE);
+  }
+#endif
+  return true;
+}
+
+void VmMapping::FaultAroundLocked(vaddr_t va) {
+  canary_.Assert();
+
+  const size_t window_size = vm_fault_around_pages() * PAGE_SIZE;
+  const vaddr_t start = MAX(ROUNDDOWN(va, window_size), base_);
+  const vaddr_t end = MIN(ROUNDDOWN(va, window_size) + window_size, base_ + size_);
+  const uint mmu_flags = arch_mmu_flags_ & ~ARCH_MMU_FLAG_PERM_WRITE;
+
+  kcounter_add(vm_fault_around_windows, 1);
+
+  // collect runs of resident but unmapped pages and map each run in one call
+  paddr_t pas[VM_FAULT_AROUND_MAX_PAGES];
+  size_t count = 0;
+  vaddr_t run_start = start;
+  auto map_run = [&]() {
+    if (count == 0) {
+      return;
+    }
+    size_t mapped;
+    zx_status_t status = aspace_->arch_aspace().Map(run_start, pas, count, mmu_flags, &mapped);
+    if (status != ZX_OK) {
+      LTRACEF("failed to map %zu pages around va %#" PRIxPTR "\n", count, va);
+    } else {
+      kcounter_add(vm_fault_around_mapped, mapped);
+#if ARCH_ARM64
+      if (arch_mmu_flags_ & ARCH_MMU_FLAG_PERM_EXECUTE) {
+        arch_sync_cache_range(run_start, count * PAGE_SIZE);
+      }
+#endif
+    }
+    count = 0;
+  };
+
+  for (vaddr_t cur = start; cur < end; cur += PAGE_SIZE) {
+    paddr_t pa;
+    bool resident = false;
+    if (cur != va && aspace_->arch_aspace().Query(cur, nullptr, nullptr) != ZX_OK) {
+      // a lookup without fault flags never allocates or forks, it only reports a page that is
+      // already present in this vmo or visible through its parent chain
+      resident = object_->GetPageLocked(cur - base_ + object_offset_, 0, nullptr, nullptr,
+                                        nullptr, &pa) == ZX_OK;
+    }
+    if (!resident) {
+      map_run();
+      run_start = cur + PAGE_SIZE;
+      continue;
+    }
+    pas[count++] = pa;
+  }
+  map_run();
+}
+
 void VmMapping::ActivateLocked() {
   DEBUG_ASSERT(state_ == LifeCycleState::NOT_READY);
   DEBUG_ASSERT(aspace_->lock()->lock().IsHeld());
@@ -9,6 +9,7 @@
 #include <err.h>
 #include <inttypes.h>
 #include <lib/console.h>
+#include <lib/counters.h>
 #include <stdlib.h>
 #include <string.h>
 #include <trace.h>
@@ -29,6 +30,9 @@
 
 #define LOCAL_TRACE MAX(VM_GLOBAL_TRACE, 0)
 
+KCOUNTER(vm_large_page_commit, "vm.large_page.commit")
+KCOUNTER(vm_large_page_commit_failed, "vm.large_page.commit_failed")
+
 namespace {
 
 void ZeroPage(paddr_t pa) {
@@ -1566,6 +1570,27 @@ zx_status_t VmObjectPaged::GetPageLocked(uint64_t offset, uint pf_flags, list_no
     return ZX_OK;
   }
 
+  // A write to a page with no content anywhere in a large page vmo commits the whole large page
+  // run around it, after which the page is simply present. A run that could only be partly
+  // committed may still have covered this page, so check for it whether or not the commit
+  // succeeded. Callers that preallocated pages, like CommitRange(), have already laid out the
+  // runs they want and get their pages from |free_list|.
+  if ((options_ & kLargePages) && page_owner == this && p == vm_get_zero_page() &&
+      (free_list == nullptr || list_is_empty(free_list))) {
+    CommitLargePageLocked(offset);
+    vm_page_t* committed = page_list_.GetPage(offset);
+    if (committed) {
+      p = committed;
+      if (page_out) {
+        *page_out = p;
+      }
+      if (pa_out) {
+        *pa_out = p->paddr();
+      }
+      return ZX_OK;
+    }
+  }
+
   vm_page_t* res_page;
   if (!page_owner->is_hidden() || p == vm_get_zero_page()) {
     // If the vmo isn't hidden, we can't move the page. If the page is the zero
@@ -1610,6 +1635,129 @@ zx_status_t VmObjectPaged::GetPageLocked(uint64_t offset, uint pf_flags, list_no
   return ZX_OK;
 }
 
+bool VmObjectPaged::LargePageRunFreeLocked(uint64_t start) {
+  canary_.Assert();
+  DEBUG_ASSERT(lock_.lock().IsHeld());
+  DEBUG_ASSERT(IS_ALIGNED(start, VM_LARGE_PAGE_SIZE));
+
+  if (!vm_large_pages_enabled() || parent_ || page_source_) {
+    return false;
+  }
+  if (start >= size_ || VM_LARGE_PAGE_SIZE > size_ - start) {
+    return false;
+  }
+
+  bool empty = true;
+  page_list_.ForEveryPageInRange(
+      [&empty](const auto p, uint64_t off) {
+        empty = false;
+        return ZX_ERR_STOP;
+      },
+      start, start + VM_LARGE_PAGE_SIZE);
+  return empty;
+}
+
+bool VmObjectPaged::CommitLargePageLocked(uint64_t offset) {
+  canary_.Assert();
+  DEBUG_ASSERT(lock_.lock().IsHeld());
+
+  const uint64_t start = ROUNDDOWN(offset, VM_LARGE_PAGE_SIZE);
+  if (!LargePageRunFreeLocked(start)) {
+    return false;
+  }
+
+  list_node list = LIST_INITIAL_VALUE(list);
+  paddr_t pa;
+  zx_status_t status = pmm_alloc_contiguous(VM_LARGE_PAGE_SIZE / PAGE_SIZE, pmm_alloc_flags_,
+                                            VM_LARGE_PAGE_SHIFT, &pa, &list);
+  if (status != ZX_OK) {
+    kcounter_add(vm_large_page_commit_failed, 1);
+    return false;
+  }
+  return InstallLargePageLocked(start, &list);
+}
+
+bool VmObjectPaged::InstallLargePageLocked(uint64_t start, list_node* pages) {
+  canary_.Assert();
+  DEBUG_ASSERT(lock_.lock().IsHeld());
+  DEBUG_ASSERT(LargePageRunFreeLocked(start));
+
+  // The pages come in physical address order, so adding them in order lays the run out
+  // contiguously in the vmo.
+  const uint64_t end = start + VM_LARGE_PAGE_SIZE;
+  const paddr_t pa = list_peek_head_type(pages, vm_page_t, queue_node)->paddr();
+  uint64_t cur = start;
+  while (cur < end) {
+    vm_page_t* p = list_remove_head_type(pages, vm_page_t, queue_node);
+    DEBUG_ASSERT(p);
+    InitializeVmPage(p);
+    ZeroPage(p);
+    zx_status_t status = AddPageLocked(p, cur, false);
+    if (status != ZX_OK) {
+      // AddPageLocked failing for any other reason is a programming error. Keep the pages that
+      // were added, they are just regular committed pages now.
+      DEBUG_ASSERT_MSG(status == ZX_ERR_NO_MEMORY, "status=%d\n", status);
+      pmm_free_page(p);
+      for (uint64_t rest = cur + PAGE_SIZE; rest < end; rest += PAGE_SIZE) {
+        pmm_free_page(list_remove_head_type(pages, vm_page_t, queue_node));
+      }
+      break;
+    }
+    cur += PAGE_SIZE;
+  }
+
+#if ARCH_ARM64
+  if (cache_policy_ != ARCH_MMU_FLAG_CACHED) {
+    arch_clean_invalidate_cache_range((addr_t)paddr_to_physmap(pa), cur - start);
+  }
+#endif
+
+  // Other mappings may have had the zero page mapped anywhere in the run.
+  if (cur != start) {
+    RangeChangeUpdateLocked(start, cur - start, RangeChangeOp::Unmap);
+  }
+  kcounter_add(vm_large_page_commit, 1);
+  return cur == end;
+}
+
+zx_status_t VmObjectPaged::LookupLargePageLocked(uint64_t offset, uint64_t len, paddr_t* pa_out) {
+  canary_.Assert();
+  DEBUG_ASSERT(lock_.lock().IsHeld());
+  DEBUG_ASSERT(IS_ALIGNED(offset, len));
+
+  // Pages reachable through a parent or supplied by a page source may be shared or replaced
+  // behind our back, so only runs of pages this vmo owns outright qualify.
+  if (!vm_large_pages_enabled() || parent_ || page_source_ || is_hidden()) {
+    return ZX_ERR_NOT_SUPPORTED;
+  }
+  if (offset >= size_ || len > size_ - offset) {
+    return ZX_ERR_OUT_OF_RANGE;
+  }
+
+  paddr_t base = 0;
+  uint64_t expected = offset;
+  page_list_.ForEveryPageInRange(
+      [&base, &expected, offset](const auto p, uint64_t off) {
+        if (off != expected) {
+          return ZX_ERR_STOP;
+        }
+        if (off == offset) {
+          base = p->paddr();
+        } else if (p->paddr() != base + (off - offset)) {
+          return ZX_ERR_STOP;
+        }
+        expected += PAGE_SIZE;
+        return ZX_ERR_NEXT;
+      },
+      offset, offset + len);
+
+  if (expected != offset + len || !IS_ALIGNED(base, len)) {
+    return ZX_ERR_NOT_FOUND;
+  }
+  *pa_out = base;
+  return ZX_OK;
+}
+
 zx_status_t VmObjectPaged::CommitRange(uint64_t offset, uint64_t len) {
   canary_.Assert();
   LTRACEF("offset %#" PRIx64 ", len %#" PRIx64 "\n", offset, len);
@@ -1654,10 +1802,47 @@ zx_status_t VmObjectPaged::CommitRange(uint64_t offset, uint64_t len) {
       return ZX_OK;
     }
 
-    zx_status_t status = pmm_alloc_pages(count, pmm_alloc_flags_, &page_list);
-    if (status != ZX_OK) {
-      return status;
+    // Large page vmos first take a physically contiguous allocation for each large page run the
+    // range covers completely. Nothing is installed until the remaining pages have been allocated
+    // as well, so that the commit still either completes or leaves the vmo untouched.
+    list_node large_pages = LIST_INITIAL_VALUE(large_pages);
+    uint64_t large_runs = 0;
+    if (options_ & kLargePages) {
+      for (uint64_t run = ROUNDUP(offset, VM_LARGE_PAGE_SIZE);
+           run < end && VM_LARGE_PAGE_SIZE <= end - run; run += VM_LARGE_PAGE_SIZE) {
+        if (!LargePageRunFreeLocked(run)) {
+          continue;
+        }
+        paddr_t pa;
+        if (pmm_alloc_contiguous(VM_LARGE_PAGE_SIZE / PAGE_SIZE, pmm_alloc_flags_,
+                                 VM_LARGE_PAGE_SHIFT, &pa, &large_pages) != ZX_OK) {
+          // Memory too fragmented for this run will be for the following ones too.
+          kcounter_add(vm_large_page_commit_failed, 1);
+          break;
+        }
+        large_runs++;
+        count -= VM_LARGE_PAGE_SIZE / PAGE_SIZE;
+      }
+    }
+
+    if (count > 0) {
+      zx_status_t status = pmm_alloc_pages(count, pmm_alloc_flags_, &page_list);
+      if (status != ZX_OK) {
+        pmm_free(&large_pages);
+        return status;
+      }
+    }
+
+    // The allocated runs belong to the first |large_runs| free runs in the range, in order.
+    for (uint64_t run = ROUNDUP(offset, VM_LARGE_PAGE_SIZE); large_runs > 0;
+         run += VM_LARGE_PAGE_SIZE) {
+      if (LargePageRunFreeLocked(run)) {
+        // Should the run only be partly added, the rest of it is committed page by page below.
+        InstallLargePageLocked(run, &large_pages);
+        large_runs--;
+      }
     }
+    DEBUG_ASSERT(list_is_empty(&large_pages));
   }
 
   auto list_cleanup = fbl::MakeAutoCall([&page_list]() {
@@ -31,4 +31,27 @@ static inline paddr_t vm_get_zero_page_paddr(void) {
   return zero_page_paddr;
 }
 
+// size of the large pages that vmos commit and mappings map as a single unit
+#define VM_LARGE_PAGE_SHIFT 21u
+#define VM_LARGE_PAGE_SIZE (1ul << VM_LARGE_PAGE_SHIFT)
+
+// return true if vmos and mappings may use large pages
+static inline bool vm_large_pages_enabled(void) {
+  extern bool large_pages_enabled;
+
+  return large_pages_enabled;
+}
+
+// Upper bound on the number of pages around a faulting address that a VmMapping will map
+// speculatively.
+#define VM_FAULT_AROUND_MAX_PAGES 32u
+
+// return the number of pages in the fault-around window, or 0 if fault-around is disabled.
+// always a power of two no larger than VM_FAULT_AROUND_MAX_PAGES.
+static inline uint32_t vm_fault_around_pages(void) {
+  extern uint32_t fault_around_pages;
+
+  return fault_around_pages;
+}
+
 #endif  // ZIRCON_KERNEL_VM_VM_PRIV_H_
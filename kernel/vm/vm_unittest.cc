@@ -13,6 +13,7 @@
 #include <fbl/alloc_checker.h>
 #include <fbl/array.h>
 #include <kernel/semaphore.h>
+#include <kernel/thread.h>
 #include <ktl/move.h>
 #include <vm/physmap.h>
 #include <vm/vm.h>
@@ -23,6 +24,7 @@
 #include <vm/vm_object_physical.h>
 
 #include "pmm_node.h"
+#include "vm_priv.h"
 
 static const uint kArchRwFlags = ARCH_MMU_FLAG_PERM_READ | ARCH_MMU_FLAG_PERM_WRITE;
 
@@ -394,6 +396,44 @@ static bool pmm_node_oom_sync_alloc_failure_test() {
   END_TEST;
 }
 
+// Checks that pages held in the per-cpu page caches are still counted as free and that
+// the caches are drained once the node leaves the highest memory state.
+static bool pmm_node_page_cache_test() {
+  BEGIN_TEST;
+  ManagedPmmNode node;
+  node.node().InitPageCaches();
+  list_node list = LIST_INITIAL_VALUE(list);
+
+  // Allocate every page one at a time. The first allocation fills a cache, later ones
+  // are served from it until the node runs low and the caches are drained.
+  uint64_t allocated = 0;
+  vm_page_t* page;
+  while (node.node().AllocPage(0, &page, nullptr) == ZX_OK) {
+    list_add_tail(&list, &page->queue_node);
+    allocated++;
+    EXPECT_EQ(ManagedPmmNode::kNumPages - allocated, node.node().CountFreePages());
+  }
+  EXPECT_EQ(ManagedPmmNode::kNumPages, allocated);
+  EXPECT_EQ(node.cur_level(), 0);
+
+  // Free them again. Once the node is back in the highest state the frees are absorbed
+  // by the caches, which must not change the free count.
+  while (!list_is_empty(&list)) {
+    node.node().FreePage(list_remove_head_type(&list, vm_page_t, queue_node));
+    allocated--;
+    EXPECT_EQ(ManagedPmmNode::kNumPages - allocated, node.node().CountFreePages());
+  }
+  EXPECT_EQ(node.cur_level(), 1);
+
+  // A multi-page allocation of everything has to pull the cached pages back.
+  zx_status_t status = node.node().AllocPages(ManagedPmmNode::kNumPages, 0, &list);
+  EXPECT_EQ(ZX_OK, status);
+  EXPECT_EQ(0u, node.node().CountFreePages());
+  node.node().FreeList(&list);
+
+  END_TEST;
+}
+
 // Checks async allocation queued while the node is in a low-memory state.
 static bool pmm_node_delayed_alloc_test() {
   BEGIN_TEST;
@@ -808,6 +848,71 @@ static bool vmaspace_alloc_smoke_test() {
   END_TEST;
 }
 
+// Faults on disjoint ranges of a single user aspace from several threads at once and checks
+// that every page ended up committed and mapped writable.
+static bool vmaspace_concurrent_fault_test() {
+  BEGIN_TEST;
+  static const size_t kNumThreads = 8;
+  static const size_t kPagesPerThread = 64;
+  static const size_t alloc_size = kNumThreads * kPagesPerThread * PAGE_SIZE;
+
+  fbl::RefPtr<VmObject> vmo;
+  zx_status_t status = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, 0u, alloc_size, &vmo);
+  ASSERT_EQ(status, ZX_OK, "vmobject creation\n");
+
+  auto aspace = VmAspace::Create(VmAspace::TYPE_USER, "test aspace");
+  ASSERT_NONNULL(aspace, "VmAspace::Create pointer");
+
+  void* ptr;
+  status = aspace->MapObjectInternal(vmo, "test", 0, alloc_size, &ptr, 0, 0,
+                                     kArchRwFlags | ARCH_MMU_FLAG_PERM_USER);
+  ASSERT_EQ(status, ZX_OK, "mapping object");
+
+  struct FaultArgs {
+    VmAspace* aspace;
+    vaddr_t base;
+  } args[kNumThreads];
+  thread_t* threads[kNumThreads];
+  for (size_t i = 0; i < kNumThreads; i++) {
+    args[i] = {aspace.get(), reinterpret_cast<vaddr_t>(ptr) + i * kPagesPerThread * PAGE_SIZE};
+    threads[i] = thread_create(
+        "fault test",
+        [](void* arg) -> int {
+          auto* args = static_cast<FaultArgs*>(arg);
+          for (size_t j = 0; j < kPagesPerThread; j++) {
+            zx_status_t status = args->aspace->PageFault(
+                args->base + j * PAGE_SIZE, VMM_PF_FLAG_USER | VMM_PF_FLAG_WRITE);
+            if (status != ZX_OK) {
+              return status;
+            }
+          }
+          return ZX_OK;
+        },
+        &args[i], DEFAULT_PRIORITY);
+    ASSERT_NONNULL(threads[i], "thread_create");
+    thread_resume(threads[i]);
+  }
+
+  for (size_t i = 0; i < kNumThreads; i++) {
+    int ret;
+    thread_join(threads[i], &ret, ZX_TIME_INFINITE);
+    EXPECT_EQ(ZX_OK, ret, "page fault");
+  }
+
+  EXPECT_EQ(kNumThreads * kPagesPerThread, vmo->AttributedPagesInRange(0, alloc_size));
+  for (size_t i = 0; i < alloc_size / PAGE_SIZE; i++) {
+    uint flags;
+    status = aspace->arch_aspace().Query(reinterpret_cast<vaddr_t>(ptr) + i * PAGE_SIZE, nullptr,
+                                         &flags);
+    EXPECT_EQ(ZX_OK, status, "page mapped");
+    EXPECT_TRUE(flags & ARCH_MMU_FLAG_PERM_WRITE, "page mapped writable");
+  }
+
+  status = aspace->Destroy();
+  EXPECT_EQ(ZX_OK, status, "VmAspace::Destroy");
+  END_TEST;
+}
+
 // Doesn't do anything, just prints all aspaces.
 // Should be run after all other tests so that people can manually comb
 // through the output for leaked test aspaces.
@@ -1117,6 +1222,170 @@ static bool vmo_demand_paged_map_test() {
   END_TEST;
 }
 
+// Faults on a single page of a committed vmo and checks that the rest of the fault-around
+// window is mapped without write permission and nothing outside of it is.
+static bool vmo_fault_around_test() {
+  BEGIN_TEST;
+  static const size_t alloc_size = PAGE_SIZE * 16;
+  fbl::RefPtr<VmObject> vmo;
+  zx_status_t status = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, 0u, alloc_size, &vmo);
+  ASSERT_EQ(status, ZX_OK, "vmobject creation\n");
+  status = vmo->CommitRange(0, alloc_size);
+  ASSERT_EQ(status, ZX_OK, "committing vmo\n");
+
+  auto aspace = VmAspace::Create(VmAspace::TYPE_USER, "test aspace");
+  ASSERT_NONNULL(aspace, "VmAspace::Create pointer");
+
+  void* ptr;
+  status = aspace->MapObjectInternal(vmo, "test", 0, alloc_size, &ptr, 0, 0,
+                                     kArchRwFlags | ARCH_MMU_FLAG_PERM_USER);
+  ASSERT_EQ(status, ZX_OK, "mapping object");
+
+  const vaddr_t fault_va = reinterpret_cast<vaddr_t>(ptr) + 4 * PAGE_SIZE;
+  status = aspace->PageFault(fault_va, VMM_PF_FLAG_USER);
+  EXPECT_EQ(status, ZX_OK, "page fault");
+
+  const size_t window_size = MAX(vm_fault_around_pages(), 1u) * PAGE_SIZE;
+  for (size_t i = 0; i < alloc_size / PAGE_SIZE; i++) {
+    const vaddr_t va = reinterpret_cast<vaddr_t>(ptr) + i * PAGE_SIZE;
+    const bool in_window = ROUNDDOWN(va, window_size) == ROUNDDOWN(fault_va, window_size);
+    uint flags;
+    status = aspace->arch_aspace().Query(va, nullptr, &flags);
+    EXPECT_EQ(in_window, status == ZX_OK, "mapped state");
+    if (status == ZX_OK) {
+      EXPECT_FALSE(flags & ARCH_MMU_FLAG_PERM_WRITE, "mapped without write");
+    }
+  }
+
+  status = aspace->Destroy();
+  EXPECT_EQ(ZX_OK, status, "VmAspace::Destroy");
+  END_TEST;
+}
+
+// Writes to a large page vmo and checks that the whole large page around the fault is committed
+// contiguously and mapped, and that decommitting part of it leaves the rest mapped.
+static bool vmo_large_page_test() {
+  BEGIN_TEST;
+  if (!vm_large_pages_enabled()) {
+    unittest_printf("large pages disabled, skipping\n");
+    END_TEST;
+  }
+
+  static const size_t alloc_size = VM_LARGE_PAGE_SIZE * 2;
+  fbl::RefPtr<VmObject> vmo;
+  zx_status_t status =
+      VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, VmObjectPaged::kLargePages, alloc_size, &vmo);
+  ASSERT_EQ(status, ZX_OK, "vmobject creation\n");
+
+  auto aspace = VmAspace::Create(VmAspace::TYPE_USER, "test aspace");
+  ASSERT_NONNULL(aspace, "VmAspace::Create pointer");
+
+  void* ptr;
+  status = aspace->MapObjectInternal(vmo, "test", 0, alloc_size, &ptr, VM_LARGE_PAGE_SHIFT, 0,
+                                     kArchRwFlags | ARCH_MMU_FLAG_PERM_USER);
+  ASSERT_EQ(status, ZX_OK, "mapping object");
+  const vaddr_t base = reinterpret_cast<vaddr_t>(ptr);
+
+  status = aspace->PageFault(base + PAGE_SIZE, VMM_PF_FLAG_USER | VMM_PF_FLAG_WRITE);
+  ASSERT_EQ(status, ZX_OK, "page fault");
+
+  // If physical memory is too fragmented for a contiguous run the vmo falls back to single pages.
+  if (vmo->AttributedPagesInRange(0, alloc_size) == 1) {
+    unittest_printf("no contiguous run available, skipping\n");
+  } else {
+    EXPECT_EQ(VM_LARGE_PAGE_SIZE / PAGE_SIZE, vmo->AttributedPagesInRange(0, alloc_size));
+
+    paddr_t first;
+    status = aspace->arch_aspace().Query(base, &first, nullptr);
+    EXPECT_EQ(ZX_OK, status, "first page mapped");
+    EXPECT_TRUE(IS_ALIGNED(first, VM_LARGE_PAGE_SIZE), "run is aligned");
+    for (size_t i = 1; i < VM_LARGE_PAGE_SIZE / PAGE_SIZE; i++) {
+      paddr_t pa;
+      status = aspace->arch_aspace().Query(base + i * PAGE_SIZE, &pa, nullptr);
+      EXPECT_EQ(ZX_OK, status, "page mapped");
+      EXPECT_EQ(first + i * PAGE_SIZE, pa, "page contiguous");
+    }
+    status = aspace->arch_aspace().Query(base + VM_LARGE_PAGE_SIZE, nullptr, nullptr);
+    EXPECT_EQ(ZX_ERR_NOT_FOUND, status, "next large page untouched");
+
+    // Decommitting a single page has to split the large page rather than unmap all of it.
+    status = vmo->DecommitRange(PAGE_SIZE, PAGE_SIZE);
+    EXPECT_EQ(ZX_OK, status, "decommit");
+    status = aspace->arch_aspace().Query(base + PAGE_SIZE, nullptr, nullptr);
+    EXPECT_EQ(ZX_ERR_NOT_FOUND, status, "decommitted page unmapped");
+    paddr_t pa;
+    status = aspace->arch_aspace().Query(base + 2 * PAGE_SIZE, &pa, nullptr);
+    EXPECT_EQ(ZX_OK, status, "neighbour still mapped");
+    EXPECT_EQ(first + 2 * PAGE_SIZE, pa, "neighbour unchanged");
+  }
+
+  status = aspace->Destroy();
+  EXPECT_EQ(ZX_OK, status, "VmAspace::Destroy");
+  END_TEST;
+}
+
+// Maps the zero page at the start of a large page vmo, then commits the run through a neighbour
+// while the mapping is faulting, and checks that the mapping sees the vmo's pages afterwards rather
+// than keeping the zero page.
+static bool vmo_large_page_fault_neighbour_test() {
+  BEGIN_TEST;
+  if (!vm_large_pages_enabled()) {
+    unittest_printf("large pages disabled, skipping\n");
+    END_TEST;
+  }
+
+  static const size_t alloc_size = VM_LARGE_PAGE_SIZE;
+  fbl::RefPtr<VmObject> vmo;
+  zx_status_t status =
+      VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, VmObjectPaged::kLargePages, alloc_size, &vmo);
+  ASSERT_EQ(status, ZX_OK, "vmobject creation\n");
+
+  auto aspace = VmAspace::Create(VmAspace::TYPE_USER, "test aspace");
+  ASSERT_NONNULL(aspace, "VmAspace::Create pointer");
+
+  fbl::RefPtr<VmMapping> mapping;
+  status = aspace->RootVmar()->CreateVmMapping(0, alloc_size, VM_LARGE_PAGE_SHIFT,
+                                               VMAR_CAN_RWX_FLAGS, vmo, 0,
+                                               kArchRwFlags | ARCH_MMU_FLAG_PERM_USER, "test",
+                                               &mapping);
+  ASSERT_EQ(status, ZX_OK, "mapping object");
+  const vaddr_t base = mapping->base();
+
+  // A read fault maps the shared zero page.
+  status = aspace->PageFault(base, VMM_PF_FLAG_USER);
+  ASSERT_EQ(ZX_OK, status, "read fault");
+  paddr_t pa;
+  status = aspace->arch_aspace().Query(base, &pa, nullptr);
+  ASSERT_EQ(ZX_OK, status, "zero page mapped");
+  EXPECT_EQ(vm_get_zero_page_paddr(), pa, "zero page mapped");
+
+  // Committing the second page through the mapping lays out the whole run.
+  status = mapping->MapRange(PAGE_SIZE, PAGE_SIZE, true);
+  ASSERT_EQ(ZX_OK, status, "commit neighbour");
+
+  if (vmo->AttributedPagesInRange(0, alloc_size) == 1) {
+    unittest_printf("no contiguous run available, skipping\n");
+  } else {
+    const uint64_t value = 0x5a5a5a5a5a5a5a5a;
+    status = vmo->Write(&value, 0, sizeof(value));
+    ASSERT_EQ(ZX_OK, status, "write through vmo");
+
+    // The first page may simply have been unmapped, in which case fault it back in.
+    if (aspace->arch_aspace().Query(base, &pa, nullptr) != ZX_OK) {
+      status = aspace->PageFault(base, VMM_PF_FLAG_USER);
+      ASSERT_EQ(ZX_OK, status, "read fault");
+      status = aspace->arch_aspace().Query(base, &pa, nullptr);
+      ASSERT_EQ(ZX_OK, status, "page mapped");
+    }
+    EXPECT_NE(vm_get_zero_page_paddr(), pa, "zero page replaced");
+    EXPECT_EQ(value, *static_cast<uint64_t*>(paddr_to_physmap(pa)), "write visible in mapping");
+  }
+
+  status = aspace->Destroy();
+  EXPECT_EQ(ZX_OK, status, "VmAspace::Destroy");
+  END_TEST;
+}
+
 // Creates a vm object, maps it, drops ref before unmapping.
 static bool vmo_dropped_ref_test() {
   BEGIN_TEST;
@@ -2178,6 +2447,7 @@ VM_UNITTEST(vmm_alloc_contiguous_missing_flag_commit_fails)
 VM_UNITTEST(vmm_alloc_contiguous_zero_size_fails)
 VM_UNITTEST(vmaspace_create_smoke_test)
 VM_UNITTEST(vmaspace_alloc_smoke_test)
+VM_UNITTEST(vmaspace_concurrent_fault_test)
 VM_UNITTEST(vmo_create_test)
 VM_UNITTEST(vmo_create_maximum_size)
 VM_UNITTEST(vmo_pin_test)
@@ -2189,6 +2459,9 @@ VM_UNITTEST(vmo_create_contiguous_test)
 VM_UNITTEST(vmo_contiguous_decommit_test)
 VM_UNITTEST(vmo_precommitted_map_test)
 VM_UNITTEST(vmo_demand_paged_map_test)
+VM_UNITTEST(vmo_fault_around_test)
+VM_UNITTEST(vmo_large_page_test)
+VM_UNITTEST(vmo_large_page_fault_neighbour_test)
 VM_UNITTEST(vmo_dropped_ref_test)
 VM_UNITTEST(vmo_remap_test)
 VM_UNITTEST(vmo_double_remap_test)
@@ -2212,6 +2485,7 @@ VM_UNITTEST(pmm_node_watermark_level_test)
 VM_UNITTEST(pmm_node_multi_watermark_level_test)
 VM_UNITTEST(pmm_node_multi_watermark_level_test2)
 VM_UNITTEST(pmm_node_oom_sync_alloc_failure_test)
+VM_UNITTEST(pmm_node_page_cache_test)
 VM_UNITTEST(pmm_node_delayed_alloc_test)
 VM_UNITTEST(pmm_node_delayed_alloc_no_lowmem_test)
 VM_UNITTEST(pmm_node_delayed_alloc_swap_early_test)
@@ -348,6 +348,19 @@ zx_status_t VPartitionManager::Load() {
     pslice_allocated_count_++;
   }
 
+  // Publish the slice maps before I/O can be queued to the VPartitions.
+  for (size_t i = 1; i < fvm::kMaxVPartitions; i++) {
+    if (vpartitions[i] == nullptr) {
+      continue;
+    }
+    fbl::AutoLock vp_lock(&vpartitions[i]->lock_);
+    fbl::unique_ptr<SliceMapSnapshot> map;
+    if ((status = vpartitions[i]->AllocateSliceMapLocked(0, &map)) != ZX_OK) {
+      return status;
+    }
+    vpartitions[i]->PublishSliceMapLocked(std::move(map));
+  }
+
   lock.release();
 
   // Iterate through 'valid' VPartitions, and create their devices.
@@ -429,12 +442,20 @@ zx_status_t VPartitionManager::AllocateSlicesLocked(VPartition* vp, size_t vslic
 
   zx_status_t status = ZX_OK;
   size_t hint = 0;
+  fbl::unique_ptr<SliceMapSnapshot> previous_map;
 
   {
     fbl::AutoLock lock(&vp->lock_);
     if (vp->IsKilledLocked()) {
       return ZX_ERR_BAD_STATE;
     }
+    // Each allocated slice adds at most one run to the slice map, and no more slices can be
+    // allocated than are free.
+    fbl::unique_ptr<SliceMapSnapshot> map;
+    const size_t free_slices = format_info_.slice_count() - pslice_allocated_count_;
+    if ((status = vp->AllocateSliceMapLocked(fbl::min(count, free_slices), &map)) != ZX_OK) {
+      return status;
+    }
     for (size_t i = 0; i < count; i++) {
       size_t pslice;
       auto vslice = vslice_start + i;
@@ -464,11 +485,13 @@ zx_status_t VPartitionManager::AllocateSlicesLocked(VPartition* vp, size_t vslic
       AllocatePhysicalSlice(vp, pslice, vslice);
       hint = pslice + 1;
     }
+    previous_map = vp->PublishSliceMapLocked(std::move(map));
   }
 
   if ((status = WriteFvmLocked()) != ZX_OK) {
     // Undo allocation in the event of failure; avoid holding VPartition
-    // lock while writing to fvm.
+    // lock while writing to fvm. The previous snapshot of the slice map
+    // matches it again once the allocation is undone.
     fbl::AutoLock lock(&vp->lock_);
     for (int j = static_cast<int>(count - 1); j >= 0; j--) {
       auto vslice = vslice_start + j;
@@ -479,6 +502,10 @@ zx_status_t VPartitionManager::AllocateSlicesLocked(VPartition* vp, size_t vslic
         vp->SliceFreeLocked(vslice);
       }
     }
+    // A VPartition which is still being created has no previous snapshot, and no I/O.
+    if (previous_map != nullptr) {
+      vp->PublishSliceMapLocked(std::move(previous_map));
+    }
   }
 
   return status;
@@ -533,6 +560,16 @@ zx_status_t VPartitionManager::FreeSlicesLocked(VPartition* vp, uint64_t vslice_
     if (vp->IsKilledLocked())
       return ZX_ERR_BAD_STATE;
 
+    // Freeing a slice from the middle of a run splits it in two, so each freed slice adds at
+    // most one run to the slice map. Freeing the entire VPartition leaves no runs.
+    fbl::unique_ptr<SliceMapSnapshot> map;
+    const size_t mapped_slices = GetVPartEntryLocked(vp->GetEntryIndex())->slices;
+    const size_t added_runs = (vslice_start == 0) ? 0 : fbl::min(count, mapped_slices);
+    zx_status_t status = vp->AllocateSliceMapLocked(added_runs, &map);
+    if (status != ZX_OK) {
+      return status;
+    }
+
     if (vslice_start == 0) {
       // Special case: Freeing entire VPartition
       for (auto extent = vp->ExtentBegin(); extent.IsValid(); extent = vp->ExtentBegin()) {
@@ -562,6 +599,7 @@ zx_status_t VPartitionManager::FreeSlicesLocked(VPartition* vp, uint64_t vslice_
         }
       }
     }
+    vp->PublishSliceMapLocked(std::move(map));
   }
 
   if (!valid_range) {
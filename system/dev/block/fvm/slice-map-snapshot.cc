@@ -0,0 +1,100 @@
+// Copyright 2019 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "slice-map-snapshot.h"
+
+#include <utility>
+
+#include <fbl/alloc_checker.h>
+#include <zircon/assert.h>
+
+namespace fvm {
+
+zx_status_t SliceMapSnapshot::Create(const SliceMap& slice_map,
+                                     fbl::unique_ptr<SliceMapSnapshot>* out) {
+  // Count the runs first so that they can be allocated at once.
+  fbl::unique_ptr<SliceMapSnapshot> snapshot;
+  zx_status_t status = Allocate(CountRuns(slice_map), &snapshot);
+  if (status != ZX_OK) {
+    return status;
+  }
+  snapshot->Assign(slice_map);
+
+  *out = std::move(snapshot);
+  return ZX_OK;
+}
+
+zx_status_t SliceMapSnapshot::Allocate(size_t capacity, fbl::unique_ptr<SliceMapSnapshot>* out) {
+  fbl::AllocChecker ac;
+  fbl::unique_ptr<SliceMapSnapshot> snapshot(new (&ac) SliceMapSnapshot());
+  if (!ac.check()) {
+    return ZX_ERR_NO_MEMORY;
+  }
+  snapshot->runs_.reset(new (&ac) Run[capacity], capacity);
+  if (!ac.check()) {
+    return ZX_ERR_NO_MEMORY;
+  }
+
+  *out = std::move(snapshot);
+  return ZX_OK;
+}
+
+size_t SliceMapSnapshot::CountRuns(const SliceMap& slice_map) {
+  size_t count = 0;
+  bool have_previous = false;
+  uint64_t next_vslice = 0;
+  uint64_t next_pslice = 0;
+  for (const SliceExtent& extent : slice_map) {
+    for (uint64_t vslice = extent.start(); vslice < extent.end(); vslice++) {
+      uint64_t pslice = extent.at(vslice);
+      if (!have_previous || vslice != next_vslice || pslice != next_pslice) {
+        count++;
+      }
+      have_previous = true;
+      next_vslice = vslice + 1;
+      next_pslice = pslice + 1;
+    }
+  }
+  return count;
+}
+
+void SliceMapSnapshot::Assign(const SliceMap& slice_map) {
+  size_t index = 0;
+  for (const SliceExtent& extent : slice_map) {
+    for (uint64_t vslice = extent.start(); vslice < extent.end(); vslice++) {
+      uint64_t pslice = extent.at(vslice);
+      if (index > 0) {
+        Run& last = runs_[index - 1];
+        if (vslice == last.vslice_end() && pslice == last.pslice_start + last.count) {
+          last.count++;
+          continue;
+        }
+      }
+      ZX_ASSERT(index < runs_.size());
+      runs_[index++] = {vslice, pslice, 1};
+    }
+  }
+  run_count_ = index;
+}
+
+size_t SliceMapSnapshot::Find(uint64_t vslice) const {
+  // Find the first run which starts after |vslice|; the run before it is the only one which may
+  // contain |vslice|.
+  size_t low = 0;
+  size_t high = run_count_;
+  while (low < high) {
+    size_t mid = low + (high - low) / 2;
+    if (runs_[mid].vslice_start <= vslice) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  if (low == 0 || runs_[low - 1].vslice_end() <= vslice) {
+    return run_count_;
+  }
+  return low - 1;
+}
+
+}  // namespace fvm
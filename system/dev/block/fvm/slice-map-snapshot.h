@@ -0,0 +1,65 @@
+// Copyright 2019 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <stdint.h>
+#include <zircon/types.h>
+
+#include <fbl/array.h>
+#include <fbl/intrusive_wavl_tree.h>
+#include <fbl/macros.h>
+#include <fbl/unique_ptr.h>
+
+#include "slice-extent.h"
+
+namespace fvm {
+
+// An immutable copy of the slice map of a partition, used to translate I/O without holding the
+// partition lock.
+//
+// Consecutive virtual slices which are mapped to consecutive physical slices are coalesced into a
+// single run, so that a request spanning them can be issued as a single operation.
+class SliceMapSnapshot {
+ public:
+  struct Run {
+    uint64_t vslice_start;
+    uint64_t pslice_start;
+    uint64_t count;
+
+    uint64_t vslice_end() const { return vslice_start + count; }
+  };
+
+  using SliceMap = fbl::WAVLTree<uint64_t, fbl::unique_ptr<SliceExtent>>;
+
+  // Copies |slice_map|. Returns ZX_ERR_NO_MEMORY if the runs cannot be allocated.
+  static zx_status_t Create(const SliceMap& slice_map, fbl::unique_ptr<SliceMapSnapshot>* out);
+
+  // Allocates an empty snapshot with room for |capacity| runs, for Assign() to fill in later.
+  // Returns ZX_ERR_NO_MEMORY if the runs cannot be allocated.
+  static zx_status_t Allocate(size_t capacity, fbl::unique_ptr<SliceMapSnapshot>* out);
+
+  // Returns the number of runs a copy of |slice_map| takes.
+  static size_t CountRuns(const SliceMap& slice_map);
+
+  // Replaces the runs with a copy of |slice_map|, which must take no more than capacity() runs.
+  void Assign(const SliceMap& slice_map);
+
+  size_t capacity() const { return runs_.size(); }
+  size_t run_count() const { return run_count_; }
+  const Run& run(size_t index) const { return runs_[index]; }
+
+  // Returns the index of the run containing |vslice|, or run_count() if |vslice| is unallocated.
+  size_t Find(uint64_t vslice) const;
+
+ private:
+  SliceMapSnapshot() = default;
+  DISALLOW_COPY_ASSIGN_AND_MOVE(SliceMapSnapshot);
+
+  // The first |run_count_| are in use, sorted by vslice_start.
+  fbl::Array<Run> runs_;
+  size_t run_count_ = 0;
+};
+
+}  // namespace fvm
@@ -0,0 +1,109 @@
+// Copyright 2019 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <atomic>
+#include <utility>
+
+#include <fbl/macros.h>
+#include <fbl/unique_ptr.h>
+#include <lib/zx/time.h>
+
+namespace fvm {
+
+// SnapshotPtr holds an immutable object which is read far more often than it is replaced.
+//
+// Readers never block: |Read| pins the current object until the returned Reader goes out of
+// scope. |Publish| replaces the object, then waits until every reader which may still see the
+// previous one is done with it before handing it back. Publishers must be serialized by the
+// caller, and must not be readers themselves.
+//
+// Readers are tracked with two counters, in the manner of sleepable RCU: each reader increments
+// the counter of the current epoch, and a publisher flips the epoch twice, each time waiting for
+// the counter of the previous epoch to drain.
+template <typename T>
+class SnapshotPtr {
+ public:
+  class Reader {
+   public:
+    Reader() = default;
+    Reader(Reader&& other) : owner_(other.owner_), epoch_(other.epoch_), ptr_(other.ptr_) {
+      other.owner_ = nullptr;
+      other.ptr_ = nullptr;
+    }
+    Reader& operator=(Reader&& other) {
+      reset();
+      owner_ = other.owner_;
+      epoch_ = other.epoch_;
+      ptr_ = other.ptr_;
+      other.owner_ = nullptr;
+      other.ptr_ = nullptr;
+      return *this;
+    }
+    ~Reader() { reset(); }
+
+    // Stops reading the snapshot, which may be destroyed afterwards.
+    void reset() {
+      if (owner_ != nullptr) {
+        owner_->readers_[epoch_].fetch_sub(1);
+        owner_ = nullptr;
+      }
+      ptr_ = nullptr;
+    }
+
+    const T* get() const { return ptr_; }
+    const T* operator->() const { return ptr_; }
+    explicit operator bool() const { return ptr_ != nullptr; }
+
+   private:
+    friend class SnapshotPtr;
+    DISALLOW_COPY_AND_ASSIGN_ALLOW_MOVE(Reader);
+
+    Reader(const SnapshotPtr* owner, uint32_t epoch)
+        : owner_(owner), epoch_(epoch), ptr_(owner->current_.load()) {}
+
+    const SnapshotPtr* owner_ = nullptr;
+    uint32_t epoch_ = 0;
+    const T* ptr_ = nullptr;
+  };
+
+  SnapshotPtr() = default;
+  ~SnapshotPtr() { delete current_.load(); }
+
+  // Returns a Reader for the current object, which may be null.
+  Reader Read() const {
+    uint32_t epoch = epoch_.load() & 1;
+    readers_[epoch].fetch_add(1);
+    return Reader(this, epoch);
+  }
+
+  // Returns true if an object has been published, without pinning it.
+  bool IsPublished() const { return current_.load() != nullptr; }
+
+  // Replaces the current object with |next|, which may be null, and returns the previous one
+  // once no reader may still see it.
+  fbl::unique_ptr<T> Publish(fbl::unique_ptr<T> next) {
+    fbl::unique_ptr<T> previous(current_.exchange(next.release()));
+    if (previous == nullptr) {
+      return nullptr;
+    }
+    for (int i = 0; i < 2; i++) {
+      uint32_t epoch = epoch_.fetch_add(1) & 1;
+      while (readers_[epoch].load() != 0) {
+        zx::nanosleep(zx::deadline_after(zx::usec(10)));
+      }
+    }
+    return previous;
+  }
+
+ private:
+  DISALLOW_COPY_ASSIGN_AND_MOVE(SnapshotPtr);
+
+  std::atomic<T*> current_ = nullptr;
+  std::atomic<uint32_t> epoch_ = 0;
+  mutable std::atomic<uint64_t> readers_[2] = {};
+};
+
+}  // namespace fvm
@@ -0,0 +1,142 @@
+// Copyright 2019 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "slice-map-snapshot.h"
+
+#include <atomic>
+#include <thread>
+#include <utility>
+
+#include <fbl/unique_ptr.h>
+#include <zxtest/zxtest.h>
+
+#include "snapshot-ptr.h"
+
+namespace fvm {
+namespace {
+
+using SliceMap = fbl::WAVLTree<uint64_t, fbl::unique_ptr<SliceExtent>>;
+
+// Adds an extent starting at |vslice| mapped to |pslices|.
+void AddExtent(SliceMap* map, uint64_t vslice, std::initializer_list<uint64_t> pslices) {
+  fbl::unique_ptr<SliceExtent> extent(new SliceExtent(vslice));
+  for (uint64_t pslice : pslices) {
+    extent->push_back(pslice);
+  }
+  map->insert(std::move(extent));
+}
+
+// Verify that an empty map translates nothing.
+TEST(SliceMapSnapshotTest, EmptyMap) {
+  SliceMap map;
+  fbl::unique_ptr<SliceMapSnapshot> snapshot;
+  ASSERT_OK(SliceMapSnapshot::Create(map, &snapshot));
+  EXPECT_EQ(snapshot->run_count(), 0);
+  EXPECT_EQ(snapshot->Find(0), 0);
+  EXPECT_EQ(snapshot->Find(100), 0);
+}
+
+// Verify that runs break wherever the virtual or physical slices stop being consecutive, and
+// nowhere else.
+TEST(SliceMapSnapshotTest, CoalescesConsecutiveSlices) {
+  SliceMap map;
+  // vslices 1-3 map to pslices 10-12, and vslices 4-5 to pslices 20-21.
+  AddExtent(&map, 1, {10, 11, 12, 20, 21});
+  // vslice 8 maps to pslice 22, which follows pslice 21, but not vslice 5.
+  AddExtent(&map, 8, {22});
+  fbl::unique_ptr<SliceMapSnapshot> snapshot;
+  ASSERT_OK(SliceMapSnapshot::Create(map, &snapshot));
+
+  ASSERT_EQ(snapshot->run_count(), 3);
+  EXPECT_EQ(snapshot->run(0).vslice_start, 1);
+  EXPECT_EQ(snapshot->run(0).pslice_start, 10);
+  EXPECT_EQ(snapshot->run(0).count, 3);
+  EXPECT_EQ(snapshot->run(1).vslice_start, 4);
+  EXPECT_EQ(snapshot->run(1).pslice_start, 20);
+  EXPECT_EQ(snapshot->run(1).count, 2);
+  EXPECT_EQ(snapshot->run(2).vslice_start, 8);
+  EXPECT_EQ(snapshot->run(2).pslice_start, 22);
+  EXPECT_EQ(snapshot->run(2).count, 1);
+}
+
+// Verify that Find returns the run holding each vslice, and nothing for unallocated vslices.
+TEST(SliceMapSnapshotTest, FindsRuns) {
+  SliceMap map;
+  AddExtent(&map, 1, {10, 11, 12, 20, 21});
+  AddExtent(&map, 8, {22});
+  fbl::unique_ptr<SliceMapSnapshot> snapshot;
+  ASSERT_OK(SliceMapSnapshot::Create(map, &snapshot));
+
+  const size_t none = snapshot->run_count();
+  EXPECT_EQ(snapshot->Find(0), none);
+  EXPECT_EQ(snapshot->Find(1), 0);
+  EXPECT_EQ(snapshot->Find(3), 0);
+  EXPECT_EQ(snapshot->Find(4), 1);
+  EXPECT_EQ(snapshot->Find(5), 1);
+  EXPECT_EQ(snapshot->Find(6), none);
+  EXPECT_EQ(snapshot->Find(7), none);
+  EXPECT_EQ(snapshot->Find(8), 2);
+  EXPECT_EQ(snapshot->Find(9), none);
+}
+
+// Verify that a snapshot allocated before the map changes holds the changed map, and that runs
+// past the end of the map are not found.
+TEST(SliceMapSnapshotTest, AssignsIntoPreallocatedRuns) {
+  SliceMap map;
+  AddExtent(&map, 1, {10, 11, 12});
+  EXPECT_EQ(SliceMapSnapshot::CountRuns(map), 1);
+
+  // Mapping two more slices adds at most two runs.
+  fbl::unique_ptr<SliceMapSnapshot> snapshot;
+  ASSERT_OK(SliceMapSnapshot::Allocate(SliceMapSnapshot::CountRuns(map) + 2, &snapshot));
+  EXPECT_EQ(snapshot->capacity(), 3);
+  EXPECT_EQ(snapshot->run_count(), 0);
+  AddExtent(&map, 6, {30});
+  AddExtent(&map, 8, {40});
+  snapshot->Assign(map);
+
+  ASSERT_EQ(snapshot->run_count(), 3);
+  EXPECT_EQ(snapshot->Find(6), 1);
+  EXPECT_EQ(snapshot->Find(8), 2);
+
+  // Assigning a smaller map leaves spare runs which Find ignores.
+  map.erase(8);
+  snapshot->Assign(map);
+  ASSERT_EQ(snapshot->run_count(), 2);
+  EXPECT_EQ(snapshot->Find(8), snapshot->run_count());
+}
+
+// Verify that a published snapshot outlives its readers, and that readers see the latest
+// snapshot published before they started.
+TEST(SnapshotPtrTest, ReadersPinSnapshots) {
+  SnapshotPtr<int> ptr;
+  EXPECT_FALSE(ptr.Read());
+
+  ptr.Publish(fbl::unique_ptr<int>(new int(1)));
+  auto reader = ptr.Read();
+  ASSERT_TRUE(reader);
+  EXPECT_EQ(*reader.get(), 1);
+
+  std::atomic<bool> published = false;
+  std::thread publisher([&] {
+    ptr.Publish(fbl::unique_ptr<int>(new int(2)));
+    published = true;
+  });
+
+  // The publisher waits for |reader| before destroying the first snapshot, while new readers
+  // already see the second one.
+  while (ptr.Read().get() == reader.get()) {
+  }
+  EXPECT_FALSE(published);
+  EXPECT_EQ(*reader.get(), 1);
+  EXPECT_EQ(*ptr.Read().get(), 2);
+
+  reader.reset();
+  publisher.join();
+  EXPECT_TRUE(published);
+  EXPECT_EQ(*ptr.Read().get(), 2);
+}
+
+}  // namespace
+}  // namespace fvm
@@ -2,13 +2,14 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <cstddef>
 #include <type_traits>
 #include <utility>
 
 #include <fbl/algorithm.h>
+#include <fbl/alloc_checker.h>
 #include <fbl/auto_lock.h>
 #include <fbl/unique_ptr.h>
-#include <fbl/vector.h>
 #include <zircon/assert.h>
 
 #include "fvm-private.h"
@@ -17,18 +18,28 @@
 namespace fvm {
 
 VPartition::VPartition(VPartitionManager* vpm, size_t entry_index, size_t block_op_size)
-    : PartitionDeviceType(vpm->zxdev()), mgr_(vpm), entry_index_(entry_index) {
+    : PartitionDeviceType(vpm->zxdev()),
+      mgr_(vpm),
+      entry_index_(entry_index),
+      split_op_stride_(fbl::round_up(block_op_size, alignof(std::max_align_t))) {
   memcpy(&info_, &mgr_->Info(), sizeof(block_info_t));
   info_.block_count = 0;
 }
 
-VPartition::~VPartition() = default;
+VPartition::~VPartition() {
+  fbl::AutoLock lock(&split_txn_lock_);
+  free_split_txns_.clear();
+}
 
 zx_status_t VPartition::Create(VPartitionManager* vpm, size_t entry_index,
                                fbl::unique_ptr<VPartition>* out) {
   ZX_DEBUG_ASSERT(entry_index != 0);
 
   auto vp = std::make_unique<VPartition>(vpm, entry_index, vpm->BlockOpSize());
+  zx_status_t status = vp->InitSplitTxnPool();
+  if (status != ZX_OK) {
+    return status;
+  }
 
   *out = std::move(vp);
   return ZX_OK;
@@ -138,6 +149,22 @@ void VPartition::ExtentDestroyLocked(uint64_t vslice) TA_REQ(lock_) {
   AddBlocksLocked(-((length * mgr_->SliceSize()) / info_.block_size));
 }
 
+zx_status_t VPartition::AllocateSliceMapLocked(size_t added_runs,
+                                               fbl::unique_ptr<SliceMapSnapshot>* out) {
+  zx_status_t status =
+      SliceMapSnapshot::Allocate(SliceMapSnapshot::CountRuns(slice_map_) + added_runs, out);
+  if (status != ZX_OK) {
+    fprintf(stderr, "FVM: Failed to allocate slice map snapshot\n");
+  }
+  return status;
+}
+
+fbl::unique_ptr<SliceMapSnapshot> VPartition::PublishSliceMapLocked(
+    fbl::unique_ptr<SliceMapSnapshot> snapshot) {
+  snapshot->Assign(slice_map_);
+  return slice_map_snapshot_.Publish(std::move(snapshot));
+}
+
 template <typename T>
 static zx_status_t RequestBoundCheck(const T& request, uint64_t vslice_max) {
   if (request.offset == 0 || request.offset > vslice_max) {
@@ -171,43 +198,71 @@ zx_status_t VPartition::DdkGetProtocol(uint32_t proto_id, void* out_protocol) {
   }
 }
 
-typedef struct multi_txn_state {
-  multi_txn_state(size_t total, block_op_t* txn, block_impl_queue_callback cb, void* cookie)
-      : txns_completed(0),
-        txns_total(total),
-        status(ZX_OK),
-        original(txn),
-        completion_cb(cb),
-        cookie(cookie) {}
-
-  fbl::Mutex lock;
-  size_t txns_completed TA_GUARDED(lock);
-  size_t txns_total TA_GUARDED(lock);
-  zx_status_t status TA_GUARDED(lock);
-  block_op_t* original TA_GUARDED(lock);
-  block_impl_queue_callback completion_cb TA_GUARDED(lock);
-  void* cookie TA_GUARDED(lock);
-} multi_txn_state_t;
-
-static void multi_txn_completion(void* cookie, zx_status_t status, block_op_t* txn) {
-  multi_txn_state_t* state = static_cast<multi_txn_state_t*>(cookie);
-  bool last_txn = false;
-  {
-    fbl::AutoLock lock(&state->lock);
-    state->txns_completed++;
-    if (state->status == ZX_OK && status != ZX_OK) {
-      state->status = status;
+zx_status_t VPartition::InitSplitTxnPool() {
+  fbl::AllocChecker ac;
+  split_txn_pool_.reset(new (&ac) SplitTxn[kSplitTxnPoolSize], kSplitTxnPoolSize);
+  if (!ac.check()) {
+    return ZX_ERR_NO_MEMORY;
+  }
+  const size_t ops_size = kSplitTxnPoolOps * split_op_stride_;
+  fbl::AutoLock lock(&split_txn_lock_);
+  for (SplitTxn& txn : split_txn_pool_) {
+    txn.ops.reset(new (&ac) uint8_t[ops_size], ops_size);
+    if (!ac.check()) {
+      free_split_txns_.clear();
+      return ZX_ERR_NO_MEMORY;
     }
-    if (state->txns_completed == state->txns_total) {
-      last_txn = true;
-      state->completion_cb(state->cookie, state->status, state->original);
+    txn.vpartition = this;
+    txn.capacity = kSplitTxnPoolOps;
+    txn.pooled = true;
+    free_split_txns_.push_back(&txn);
+  }
+  return ZX_OK;
+}
+
+VPartition::SplitTxn* VPartition::AcquireSplitTxn(size_t op_count) {
+  if (op_count <= kSplitTxnPoolOps) {
+    fbl::AutoLock lock(&split_txn_lock_);
+    if (!free_split_txns_.is_empty()) {
+      return free_split_txns_.pop_front();
     }
   }
 
-  if (last_txn) {
-    delete state;
+  fbl::AllocChecker ac;
+  fbl::unique_ptr<SplitTxn> txn(new (&ac) SplitTxn());
+  if (!ac.check()) {
+    return nullptr;
+  }
+  const size_t ops_size = op_count * split_op_stride_;
+  txn->ops.reset(new (&ac) uint8_t[ops_size], ops_size);
+  if (!ac.check()) {
+    return nullptr;
+  }
+  txn->vpartition = this;
+  txn->capacity = op_count;
+  txn->pooled = false;
+  return txn.release();
+}
+
+void VPartition::ReleaseSplitTxn(SplitTxn* txn) {
+  if (!txn->pooled) {
+    delete txn;
+    return;
+  }
+  fbl::AutoLock lock(&split_txn_lock_);
+  free_split_txns_.push_front(txn);
+}
+
+void VPartition::SplitTxnCompletion(void* cookie, zx_status_t status, block_op_t* op) {
+  SplitTxn* txn = static_cast<SplitTxn*>(cookie);
+  if (status != ZX_OK) {
+    zx_status_t expected = ZX_OK;
+    txn->status.compare_exchange_strong(expected, status);
+  }
+  if (txn->pending.fetch_sub(1) == 1) {
+    txn->completion_cb(txn->cookie, txn->status.load(), txn->original);
+    txn->vpartition->ReleaseSplitTxn(txn);
   }
-  delete[] txn;
 }
 
 void VPartition::BlockImplQueue(block_op_t* txn, block_impl_queue_callback completion_cb,
@@ -244,94 +299,74 @@ void VPartition::BlockImplQueue(block_op_t* txn, block_impl_queue_callback compl
   uint64_t vslice_start = txn->rw.offset_dev / blocks_per_slice;
   uint64_t vslice_end = (txn->rw.offset_dev + txn->rw.length - 1) / blocks_per_slice;
 
-  fbl::AutoLock lock(&lock_);
-  if (vslice_start == vslice_end) {
-    // Common case: txn occurs within one slice
-    uint64_t pslice;
-    if (!SliceGetLocked(vslice_start, &pslice)) {
-      completion_cb(cookie, ZX_ERR_OUT_OF_RANGE, txn);
-      return;
-    }
-    txn->rw.offset_dev =
-        format_info.GetSliceStart(pslice) / BlockSize() + (txn->rw.offset_dev % blocks_per_slice);
+  // The snapshot is read until the txn is queued, so that slices freed by a concurrent
+  // BlockVolumeShrink cannot be handed out again before it is.
+  // A snapshot is published before the partition's device is added.
+  auto map = slice_map_snapshot_.Read();
+  ZX_DEBUG_ASSERT(map);
+
+  size_t first_run = map->Find(vslice_start);
+  if (first_run == map->run_count()) {
+    completion_cb(cookie, ZX_ERR_OUT_OF_RANGE, txn);
+    return;
+  }
+  auto block_to_dev = [&](const SliceMapSnapshot::Run& run, uint64_t block) {
+    uint64_t pslice = run.pslice_start + (block / blocks_per_slice - run.vslice_start);
+    return format_info.GetSliceStart(pslice) / BlockSize() + block % blocks_per_slice;
+  };
+
+  if (vslice_end < map->run(first_run).vslice_end()) {
+    // Common case: the txn maps to physically contiguous slices.
+    txn->rw.offset_dev = block_to_dev(map->run(first_run), txn->rw.offset_dev);
     mgr_->Queue(txn, completion_cb, cookie);
     return;
   }
 
-  // Less common case: txn spans multiple slices
-
-  // First, check that all slices are allocated.
-  // If any are missing, then this txn will fail.
-  bool contiguous = true;
-  for (size_t vslice = vslice_start; vslice <= vslice_end; vslice++) {
-    uint64_t pslice;
-    if (!SliceGetLocked(vslice, &pslice)) {
+  // Less common case: the txn spans several runs of physical slices, which must all be
+  // allocated.
+  size_t last_run = first_run;
+  while (map->run(last_run).vslice_end() <= vslice_end) {
+    if (last_run + 1 == map->run_count() ||
+        map->run(last_run + 1).vslice_start != map->run(last_run).vslice_end()) {
       completion_cb(cookie, ZX_ERR_OUT_OF_RANGE, txn);
       return;
     }
-    uint64_t prev_pslice;
-    if (vslice != vslice_start && SliceGetLocked(vslice - 1, &prev_pslice) &&
-        prev_pslice + 1 != pslice) {
-      contiguous = false;
-    }
+    last_run++;
   }
 
-  // Ideal case: slices are contiguous
-  if (contiguous) {
-    uint64_t pslice;
-    SliceGetLocked(vslice_start, &pslice);
-    txn->rw.offset_dev =
-        format_info.GetSliceStart(pslice) / BlockSize() + (txn->rw.offset_dev % blocks_per_slice);
-    mgr_->Queue(txn, completion_cb, cookie);
+  const size_t op_count = last_run - first_run + 1;
+  SplitTxn* split = AcquireSplitTxn(op_count);
+  if (split == nullptr) {
+    completion_cb(cookie, ZX_ERR_NO_MEMORY, txn);
     return;
   }
-
-  // Harder case: Noncontiguous slices
-  const uint64_t txn_count = vslice_end - vslice_start + 1;
-  fbl::Vector<block_op_t*> txns;
-  txns.reserve(txn_count);
-
-  fbl::unique_ptr<multi_txn_state_t> state(
-      new multi_txn_state_t(txn_count, txn, completion_cb, cookie));
-
-  uint32_t length_remaining = txn->rw.length;
-  for (size_t i = 0; i < txn_count; i++) {
-    uint64_t vslice = vslice_start + i;
-    uint64_t pslice;
-    SliceGetLocked(vslice, &pslice);
-
-    uint64_t offset_vmo = txn->rw.offset_vmo;
-    uint64_t length;
-    if (vslice == vslice_start) {
-      length = fbl::round_up(txn->rw.offset_dev + 1, blocks_per_slice) - txn->rw.offset_dev;
-    } else if (vslice == vslice_end) {
-      length = length_remaining;
-      offset_vmo += txn->rw.length - length_remaining;
-    } else {
-      length = blocks_per_slice;
-      offset_vmo += txns[0]->rw.length + blocks_per_slice * (i - 1);
-    }
-    ZX_DEBUG_ASSERT(length <= blocks_per_slice);
-    ZX_DEBUG_ASSERT(length <= length_remaining);
-
-    txns.push_back(reinterpret_cast<block_op_t*>(new uint8_t[mgr_->BlockOpSize()]));
-
-    memcpy(txns[i], txn, sizeof(*txn));
-    txns[i]->rw.offset_vmo = offset_vmo;
-    txns[i]->rw.length = static_cast<uint32_t>(length);
-    txns[i]->rw.offset_dev = format_info.GetSliceStart(pslice) / BlockSize();
-    if (vslice == vslice_start) {
-      txns[i]->rw.offset_dev += (txn->rw.offset_dev % blocks_per_slice);
-    }
-    length_remaining -= txns[i]->rw.length;
+  ZX_DEBUG_ASSERT(op_count <= split->capacity);
+  split->original = txn;
+  split->completion_cb = completion_cb;
+  split->cookie = cookie;
+  split->pending.store(op_count);
+  split->status.store(ZX_OK);
+
+  uint64_t offset_dev = txn->rw.offset_dev;
+  uint64_t offset_vmo = txn->rw.offset_vmo;
+  uint64_t length_remaining = txn->rw.length;
+  for (size_t i = 0; i < op_count; i++) {
+    const SliceMapSnapshot::Run& run = map->run(first_run + i);
+    uint64_t length = fbl::min(length_remaining, run.vslice_end() * blocks_per_slice - offset_dev);
+    block_op_t* op = split->op(i);
+    memcpy(op, txn, sizeof(*txn));
+    op->rw.offset_dev = block_to_dev(run, offset_dev);
+    op->rw.offset_vmo = offset_vmo;
+    op->rw.length = static_cast<uint32_t>(length);
+    offset_dev += length;
+    offset_vmo += length;
+    length_remaining -= length;
   }
   ZX_DEBUG_ASSERT(length_remaining == 0);
 
-  for (size_t i = 0; i < txn_count; i++) {
-    mgr_->Queue(txns[i], multi_txn_completion, state.get());
+  for (size_t i = 0; i < op_count; i++) {
+    mgr_->Queue(split->op(i), SplitTxnCompletion, split);
   }
-  // TODO(johngro): ask smklein why it is OK to release this managed pointer.
-  __UNUSED auto ptr = state.release();
 }
 
 void VPartition::BlockImplQuery(block_info_t* info_out, size_t* block_op_size_out) {
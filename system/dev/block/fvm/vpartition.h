@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include <atomic>
 #include <cstdint>
 
 #include <ddk/device.h>
@@ -11,6 +12,8 @@
 #include <ddktl/protocol/block.h>
 #include <ddktl/protocol/block/partition.h>
 #include <ddktl/protocol/block/volume.h>
+#include <fbl/array.h>
+#include <fbl/intrusive_double_list.h>
 #include <fbl/intrusive_wavl_tree.h>
 #include <fbl/mutex.h>
 #include <fbl/unique_ptr.h>
@@ -18,6 +21,8 @@
 #include <zircon/types.h>
 
 #include "slice-extent.h"
+#include "slice-map-snapshot.h"
+#include "snapshot-ptr.h"
 
 namespace fvm {
 
@@ -89,6 +94,20 @@ class VPartition : public PartitionDeviceType,
   // Destroy the extent containing the vslice.
   void ExtentDestroyLocked(uint64_t vslice) TA_REQ(lock_);
 
+  // Allocates a snapshot with room for the slice map once up to |added_runs| runs of slices are
+  // added to it, for PublishSliceMapLocked. Allocating it before changing the slice map lets the
+  // change fail with ZX_ERR_NO_MEMORY while the published snapshot still matches the slice map.
+  zx_status_t AllocateSliceMapLocked(size_t added_runs, fbl::unique_ptr<SliceMapSnapshot>* out)
+      TA_REQ(lock_);
+
+  // Copies the slice map into |snapshot|, which must have room for it, and publishes it for
+  // BlockImplQueue, which translates I/O without holding |lock_|. Must be called once a batch of
+  // changes to the slice map is complete; until then, I/O is translated with the previous
+  // snapshot. Waits for the I/O still being translated with the previous snapshot to be queued,
+  // then returns the previous snapshot, which can be published again if the change is undone.
+  fbl::unique_ptr<SliceMapSnapshot> PublishSliceMapLocked(
+      fbl::unique_ptr<SliceMapSnapshot> snapshot) TA_REQ(lock_);
+
   size_t BlockSize() const TA_NO_THREAD_SAFETY_ANALYSIS { return info_.block_size; }
   void AddBlocksLocked(ssize_t nblocks) TA_REQ(lock_) { info_.block_count += nblocks; }
 
@@ -104,11 +123,52 @@ class VPartition : public PartitionDeviceType,
  private:
   DISALLOW_COPY_ASSIGN_AND_MOVE(VPartition);
 
+  // A request spanning several runs of physical slices, and the operations it is split into.
+  struct SplitTxn : public fbl::DoublyLinkedListable<SplitTxn*> {
+    VPartition* vpartition;
+    block_op_t* original;
+    block_impl_queue_callback completion_cb;
+    void* cookie;
+    std::atomic<size_t> pending;
+    std::atomic<zx_status_t> status;
+    // Room for |capacity| operations, |split_op_stride_| bytes apart.
+    fbl::Array<uint8_t> ops;
+    size_t capacity;
+    // True if the SplitTxn belongs to |split_txn_pool_|.
+    bool pooled;
+
+    block_op_t* op(size_t index) {
+      return reinterpret_cast<block_op_t*>(ops.get() + index * vpartition->split_op_stride_);
+    }
+  };
+
+  // Number of SplitTxns preallocated for each partition, and the number of operations each of
+  // them has room for. Requests split into more operations, or issued while the pool is empty,
+  // allocate their own.
+  static constexpr size_t kSplitTxnPoolSize = 16;
+  static constexpr size_t kSplitTxnPoolOps = 4;
+
+  zx_status_t InitSplitTxnPool();
+
+  // Returns a SplitTxn with room for |op_count| operations, or nullptr if none can be allocated.
+  SplitTxn* AcquireSplitTxn(size_t op_count);
+  void ReleaseSplitTxn(SplitTxn* txn);
+  static void SplitTxnCompletion(void* cookie, zx_status_t status, block_op_t* op);
+
   zx_device_t* GetParent() const;
 
   VPartitionManager* mgr_;
   size_t entry_index_;
 
+  // Copy of |slice_map_| published by PublishSliceMapLocked.
+  SnapshotPtr<SliceMapSnapshot> slice_map_snapshot_;
+
+  // Size of the operations of a SplitTxn, rounded up to keep them aligned.
+  const size_t split_op_stride_;
+  fbl::Array<SplitTxn> split_txn_pool_;
+  fbl::Mutex split_txn_lock_;
+  fbl::DoublyLinkedList<SplitTxn*> free_split_txns_ TA_GUARDED(split_txn_lock_);
+
   // Mapping of virtual slice number (index) to physical slice number (value).
   // Physical slice zero is reserved to mean "unmapped", so a zeroed slice_map
   // indicates that the vpartition is completely unmapped, and uses no
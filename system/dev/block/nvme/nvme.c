@@ -6,6 +6,7 @@
 #include <lib/device-protocol/pci.h>
 #include <lib/sync/completion.h>
 #include <limits.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -41,16 +42,17 @@ typedef struct {
 } nvme_txn_t;
 
 typedef struct {
-  zx_paddr_t phys;  // io buffer phys base (1 page)
-  void* virt;       // io buffer virt base
-  zx_handle_t pmt;  // pinned memory
-  nvme_txn_t* txn;  // related txn
+  uint64_t prp_pages;    // bitmask of the queue's prp list pages held
+  zx_handle_t pmt;       // pinned memory
+  nvme_txn_t* txn;       // related txn
   uint16_t id;
   uint16_t reserved0;
   uint32_t reserved1;
 } nvme_utxn_t;
 
-#define UTXN_COUNT 63
+// Maximum number of utxns per io queue, which bounds the commands in flight on it.
+#define UTXN_MAX 127
+#define UTXN_WORDS ((UTXN_MAX + 63) / 64)
 
 // There's no system constant for this.  Ensure it matches reality.
 #define PAGE_SHIFT (12ULL)
@@ -58,43 +60,73 @@ static_assert(PAGE_SIZE == (1ULL << PAGE_SHIFT), "");
 
 #define PAGE_MASK (PAGE_SIZE - 1ULL)
 
-// Limit maximum transfer size to 1MB which fits comfortably
-// within our single scatter gather page per utxn setup
-#define MAX_XFER (1024 * 1024)
+// Limit maximum transfer size to 4MB, which needs a prp list of
+// several pages chained together per utxn.
+#define MAX_XFER (4 * 1024 * 1024)
+
+// Number of prp entries in one page.  When a prp list spans several
+// pages the last entry of every page but the final one points to the
+// next page of the list.
+#define PRP_PER_PAGE (PAGE_SIZE / sizeof(uint64_t))
+
+// Number of prp list pages shared by the utxns of each io queue.  Only
+// transfers of more than two pages need a list at all, and one list page
+// covers 2MB, so rather than setting aside a list for the largest transfer
+// for every utxn, utxns take pages from this pool as their transfers need
+// them.  It holds enough pages for several of the largest transfers.
+#define PRP_POOL_PAGES 32
+static_assert(PRP_POOL_PAGES < 64, "prp_avail is a 64 bit mask");
+static_assert(PRP_POOL_PAGES >= 1 + (MAX_XFER / PAGE_SIZE - 2) / (PRP_PER_PAGE - 1),
+              "the prp list of the largest transfer must fit in the pool");
 
 // Maximum submission and completion queue item counts, for
-// queues that are a single page in size.
+// admin queues that are a single page in size.
 #define SQMAX (PAGE_SIZE / sizeof(nvme_cmd_t))
 #define CQMAX (PAGE_SIZE / sizeof(nvme_cpl_t))
 
+// Maximum item count of each io submission and completion queue.
+// These span several pages and are limited further by CAP.MQES.
+#define IO_QUEUE_ENTRIES_MAX (UTXN_MAX + 1)
+
+// Upper bound on io queue pairs, and on the msi-x vectors used for them.
+// By default one pair is created per cpu, which can be overridden with
+// the driver.nvme.io-queues boot option.
+#define IO_QUEUES_MAX 32
+#define IRQS_MAX IO_QUEUES_MAX
+
 // global driver state bits
-#define FLAG_IRQ_THREAD_STARTED 0x0001
-#define FLAG_IO_THREAD_STARTED 0x0002
 #define FLAG_SHUTDOWN 0x0004
 
 #define FLAG_HAS_VWC 0x0100
 
+typedef struct nvme_device nvme_device_t;
+
+// An io submission queue and its completion queue.
+//
+// Each queue pair has its own io thread, which is woken by the irq
+// thread of the queue's interrupt vector, its own pool of utxns and
+// its own lists of txns.
 typedef struct {
-  mmio_buffer_t mmio;
-  zx_handle_t irqh;
-  zx_handle_t bti;
-  uint32_t flags;
+  nvme_device_t* nvme;
+  uint16_t id;          // queue id used for both the sq and the cq
+  uint16_t vector;      // interrupt vector of the cq
+  uint16_t entries;     // item count of the sq and the cq
+  uint16_t utxn_count;  // entries - 1, so the sq can never overflow
+
+  // doorbell registers
+  void* sq_tail_db;
+  void* cq_head_db;
+
+  nvme_cpl_t* cq;
+  nvme_cmd_t* sq;
+  uint16_t cq_head;
+  uint16_t cq_toggle;
+  uint16_t sq_tail;
+  uint16_t sq_head;
+
+  // protects pending_txns and active_txns
   mtx_t lock;
 
-  // io queue doorbell registers
-  void* io_sq_tail_db;
-  void* io_cq_head_db;
-
-  nvme_cpl_t* io_cq;
-  nvme_cmd_t* io_sq;
-  uint32_t io_nsid;
-  uint16_t io_cq_head;
-  uint16_t io_cq_toggle;
-  uint16_t io_sq_tail;
-  uint16_t io_sq_head;
-
-  uint64_t utxn_avail;  // bitmask of available utxns
-
   // The pending list is txns that have been received
   // via nvme_queue() and are waiting for io to start.
   // The exception is the head of the pending list which may
@@ -111,6 +143,47 @@ typedef struct {
   // it has work to do.
   sync_completion_t io_signal;
 
+  thrd_t iothread;
+  bool iothread_started;
+
+  // sq followed by cq, physically contiguous
+  io_buffer_t queue_iob;
+
+  // pool of prp list pages for the utxns
+  io_buffer_t prp_iob;
+  uint64_t prp_avail;  // bitmask of available prp list pages
+
+  // scratch space for the pages pinned for one utxn
+  zx_paddr_t* pin_pages;
+
+  uint64_t utxn_avail[UTXN_WORDS];  // bitmask of available utxns
+
+  // pool of utxns
+  nvme_utxn_t utxn[UTXN_MAX];
+} nvme_io_queue_t;
+
+struct nvme_device {
+  mmio_buffer_t mmio;
+  zx_handle_t bti;
+  uint32_t flags;
+  uint64_t cap;
+
+  // interrupt vectors, each with its own irq thread
+  uint32_t irq_count;
+  zx_handle_t irqh[IRQS_MAX];
+  thrd_t irqthread[IRQS_MAX];
+  uint32_t irqthreads_started;
+
+  // io queue pairs, and the queue that the next txn is sent to
+  uint32_t io_queue_count;
+  nvme_io_queue_t* io_queues;
+  atomic_uint next_io_queue;
+
+  // The irq threads run before the controller has settled how many io
+  // queues we get, so rather than io_queue_count they use the number of
+  // queues which have been started, which only ever grows.
+  atomic_uint io_queues_started;
+
   uint32_t max_xfer;
   block_info_t info;
 
@@ -137,42 +210,72 @@ typedef struct {
 
   size_t iosz;
 
-  // source of physical pages for queues and admin commands
+  // source of physical pages for admin queues and admin commands
   io_buffer_t iob;
-
-  thrd_t irqthread;
-  thrd_t iothread;
-
-  // pool of utxns
-  nvme_utxn_t utxn[UTXN_COUNT];
-} nvme_device_t;
+};
 
 // We break IO transactions down into one or more "micro transactions" (utxn)
 // based on the transfer limits of the controller, etc.  Each utxn has an
 // id associated with it, which is used as the command id for the command
 // queued to the NVME device.  This id is the same as its index into the
-// pool of utxns and the bitmask of free txns, to simplify management.
+// queue's pool of utxns and the bitmask of free txns, to simplify management.
 //
-// We maintain a pool of 63 of these, which is the number of commands
-// that can be submitted to NVME via a single page submit queue.
+// Each io queue has one utxn per submission queue entry but one, so
+// commands can always be submitted while a utxn is available.
 //
 // The utxns are not protected by locks.  Instead, after initialization,
-// they may only be touched by the io thread, which is responsible for
-// queueing commands and dequeuing completion messages.
+// they may only be touched by the io thread of their queue, which is
+// responsible for queueing commands and dequeuing completion messages.
 
-static nvme_utxn_t* utxn_get(nvme_device_t* nvme) {
-  uint64_t n = __builtin_ffsll(nvme->utxn_avail);
-  if (n == 0) {
-    return NULL;
+static nvme_utxn_t* utxn_get(nvme_io_queue_t* q) {
+  for (unsigned w = 0; w < UTXN_WORDS; w++) {
+    uint64_t n = __builtin_ffsll(q->utxn_avail[w]);
+    if (n == 0) {
+      continue;
+    }
+    n--;
+    q->utxn_avail[w] &= ~(1ULL << n);
+    return q->utxn + w * 64 + n;
   }
-  n--;
-  nvme->utxn_avail &= ~(1ULL << n);
-  return nvme->utxn + n;
+  return NULL;
 }
 
-static void utxn_put(nvme_device_t* nvme, nvme_utxn_t* utxn) {
+static void utxn_put(nvme_io_queue_t* q, nvme_utxn_t* utxn) {
   uint64_t n = utxn->id;
-  nvme->utxn_avail |= (1ULL << n);
+  q->utxn_avail[n / 64] |= (1ULL << (n % 64));
+}
+
+// Returns the number of prp list pages needed by a transfer touching
+// |pagecount| pages.  Every page of a list but the last gives up its
+// final entry to chain to the next.
+static size_t prp_pages_needed(size_t pagecount) {
+  if (pagecount <= 2) {
+    return 0;
+  }
+  size_t prp_entries = pagecount - 1;
+  return 1 + (prp_entries - 2) / (PRP_PER_PAGE - 1);
+}
+
+// Takes |count| prp list pages from the pool of |q| for |utxn|.  Returns
+// false, taking nothing, if the pool does not have that many available.
+// Like the utxns, the pool is only touched by the io thread of the queue.
+static bool prp_get(nvme_io_queue_t* q, nvme_utxn_t* utxn, size_t count) {
+  if ((size_t)__builtin_popcountll(q->prp_avail) < count) {
+    return false;
+  }
+  uint64_t pages = 0;
+  while (count-- > 0) {
+    uint64_t page = q->prp_avail & -q->prp_avail;
+    q->prp_avail &= ~page;
+    pages |= page;
+  }
+  utxn->prp_pages = pages;
+  return true;
+}
+
+static void prp_put(nvme_io_queue_t* q, nvme_utxn_t* utxn) {
+  q->prp_avail |= utxn->prp_pages;
+  utxn->prp_pages = 0;
 }
 
 static zx_status_t nvme_admin_cq_get(nvme_device_t* nvme, nvme_cpl_t* cpl) {
@@ -211,60 +314,83 @@ static zx_status_t nvme_admin_sq_put(nvme_device_t* nvme, nvme_cmd_t* cmd) {
   return ZX_OK;
 }
 
-static zx_status_t nvme_io_cq_get(nvme_device_t* nvme, nvme_cpl_t* cpl) {
-  if ((readw(&nvme->io_cq[nvme->io_cq_head].status) & 1) != nvme->io_cq_toggle) {
+// IO queues are not necessarily a power of two in size, so
+// their indices wrap explicitly.
+static inline uint16_t io_queue_next(nvme_io_queue_t* q, uint16_t index) {
+  return (index + 1 == q->entries) ? 0 : index + 1;
+}
+
+static zx_status_t nvme_io_cq_get(nvme_io_queue_t* q, nvme_cpl_t* cpl) {
+  if ((readw(&q->cq[q->cq_head].status) & 1) != q->cq_toggle) {
     return ZX_ERR_SHOULD_WAIT;
   }
-  *cpl = nvme->io_cq[nvme->io_cq_head];
+  *cpl = q->cq[q->cq_head];
 
   // advance the head pointer, wrapping and inverting toggle at max
-  uint16_t next = (nvme->io_cq_head + 1) & (CQMAX - 1);
-  if ((nvme->io_cq_head = next) == 0) {
-    nvme->io_cq_toggle ^= 1;
+  uint16_t next = io_queue_next(q, q->cq_head);
+  if ((q->cq_head = next) == 0) {
+    q->cq_toggle ^= 1;
   }
 
   // note the new sq head reported by hw
-  nvme->io_sq_head = cpl->sq_head;
+  q->sq_head = cpl->sq_head;
   return ZX_OK;
 }
 
-static void nvme_io_cq_ack(nvme_device_t* nvme) {
+static void nvme_io_cq_ack(nvme_io_queue_t* q) {
   // ring the doorbell
-  writel(nvme->io_cq_head, nvme->io_cq_head_db);
+  writel(q->cq_head, q->cq_head_db);
 }
 
-static zx_status_t nvme_io_sq_put(nvme_device_t* nvme, nvme_cmd_t* cmd) {
-  uint16_t next = (nvme->io_sq_tail + 1) & (SQMAX - 1);
+static zx_status_t nvme_io_sq_put(nvme_io_queue_t* q, nvme_cmd_t* cmd) {
+  uint16_t next = io_queue_next(q, q->sq_tail);
 
   // if head+1 == tail: queue is full
-  if (next == nvme->io_sq_head) {
+  if (next == q->sq_head) {
     return ZX_ERR_SHOULD_WAIT;
   }
 
-  nvme->io_sq[nvme->io_sq_tail] = *cmd;
-  nvme->io_sq_tail = next;
+  q->sq[q->sq_tail] = *cmd;
+  q->sq_tail = next;
 
   // ring the doorbell
-  writel(next, nvme->io_sq_tail_db);
+  writel(next, q->sq_tail_db);
   return ZX_OK;
 }
 
+typedef struct {
+  nvme_device_t* nvme;
+  uint32_t vector;
+} irq_thread_args_t;
+
 static int irq_thread(void* arg) {
-  nvme_device_t* nvme = arg;
+  irq_thread_args_t* args = arg;
+  nvme_device_t* nvme = args->nvme;
+  uint32_t vector = args->vector;
+  free(args);
+
   for (;;) {
     zx_status_t r;
-    if ((r = zx_interrupt_wait(nvme->irqh, NULL)) != ZX_OK) {
-      zxlogf(ERROR, "nvme: irq wait failed: %d\n", r);
+    if ((r = zx_interrupt_wait(nvme->irqh[vector], NULL)) != ZX_OK) {
+      zxlogf(ERROR, "nvme: irq %u wait failed: %d\n", vector, r);
       break;
     }
 
+    // The admin completion queue always uses the first vector.
     nvme_cpl_t cpl;
-    if (nvme_admin_cq_get(nvme, &cpl) == ZX_OK) {
+    if ((vector == 0) && (nvme_admin_cq_get(nvme, &cpl) == ZX_OK)) {
       nvme->admin_result = cpl;
       sync_completion_signal(&nvme->admin_signal);
     }
 
-    sync_completion_signal(&nvme->io_signal);
+    // Wake the io threads of every started queue using this vector.
+    uint32_t io_queue_count = atomic_load(&nvme->io_queues_started);
+    for (uint32_t n = 0; n < io_queue_count; n++) {
+      nvme_io_queue_t* q = nvme->io_queues + n;
+      if (q->vector == vector) {
+        sync_completion_signal(&q->io_signal);
+      }
+    }
   }
   return 0;
 }
@@ -298,19 +424,59 @@ static inline void txn_complete(nvme_txn_t* txn, zx_status_t status) {
   txn->completion_cb(txn->cookie, status, &txn->op);
 }
 
+// Fills in the data pointers of |cmd| for a transfer touching |pagecount|
+// pages, starting |byteoffset| bytes into the first one.  The prp list, if
+// one is needed, is built in the list pages |utxn| holds, in pool order.
+static void io_setup_prps(nvme_io_queue_t* q, nvme_utxn_t* utxn, nvme_cmd_t* cmd,
+                          const zx_paddr_t* pages, size_t pagecount, size_t byteoffset) {
+  // The NVME command has room for two data pointers inline.
+  // The first is always the pointer to the first page where data is.
+  // The second is the second page if pagecount is 2.
+  // The second is the address of a list of pages 2..n if pagecount > 2
+  cmd->dptr.prp[0] = pages[0] | byteoffset;
+  if (pagecount == 2) {
+    cmd->dptr.prp[1] = pages[1];
+    return;
+  }
+  if (pagecount < 2) {
+    return;
+  }
+
+  uint64_t list_pages = utxn->prp_pages;
+  unsigned page = __builtin_ctzll(list_pages);
+  list_pages &= list_pages - 1;
+
+  cmd->dptr.prp[1] = q->prp_iob.phys_list[page];
+  uint64_t* prp = io_buffer_virt(&q->prp_iob) + page * PAGE_SIZE;
+  size_t slot = 0;
+  for (size_t i = 1; i < pagecount; i++) {
+    // The last slot of a page holds the last entry or, if more
+    // entries follow, the address of the next page of the list.
+    if ((slot == PRP_PER_PAGE - 1) && (i != pagecount - 1)) {
+      page = __builtin_ctzll(list_pages);
+      list_pages &= list_pages - 1;
+      prp[slot] = q->prp_iob.phys_list[page];
+      prp = io_buffer_virt(&q->prp_iob) + page * PAGE_SIZE;
+      slot = 0;
+    }
+    prp[slot++] = pages[i];
+  }
+}
+
 // Attempt to generate utxns and queue nvme commands for a txn
 // Returns true if this could not be completed due to temporary
 // lack of resources or false if either it succeeded or errored out.
-static bool io_process_txn(nvme_device_t* nvme, nvme_txn_t* txn) {
+static bool io_process_txn(nvme_io_queue_t* q, nvme_txn_t* txn) {
+  nvme_device_t* nvme = q->nvme;
   zx_handle_t vmo = txn->op.rw.vmo;
   nvme_utxn_t* utxn;
-  zx_paddr_t* pages;
+  zx_paddr_t* pages = q->pin_pages;
   zx_status_t r;
 
   for (;;) {
     // If there are no available utxns, we can't proceed
     // and we tell the caller to retain the txn (true)
-    if ((utxn = utxn_get(nvme)) == NULL) {
+    if ((utxn = utxn_get(q)) == NULL) {
       return true;
     }
 
@@ -331,12 +497,17 @@ static bool io_process_txn(nvme_device_t* nvme, nvme_txn_t* txn) {
     // Total pages mapped / touched
     size_t pagecount = (byteoffset + bytes + PAGE_MASK) >> PAGE_SHIFT;
 
+    // If the prp list pages for the transfer are all in use, we can't
+    // proceed either, until completions return some of them
+    if (!prp_get(q, utxn, prp_pages_needed(pagecount))) {
+      utxn_put(q, utxn);
+      return true;
+    }
+
     // read disk (OP_READ) -> memory (PERM_WRITE) or
     // write memory (PERM_READ) -> disk (OP_WRITE)
     uint32_t opt = (txn->opcode == NVME_OP_READ) ? ZX_BTI_PERM_WRITE : ZX_BTI_PERM_READ;
 
-    pages = utxn->virt;
-
     if ((r = zx_bti_pin(nvme->bti, opt, vmo, pageoffset, pagecount << PAGE_SHIFT, pages, pagecount,
                         &utxn->pmt)) != ZX_OK) {
       zxlogf(ERROR, "nvme: could not pin pages: %d\n", r);
@@ -349,24 +520,13 @@ static bool io_process_txn(nvme_device_t* nvme, nvme_txn_t* txn) {
     cmd.nsid = 1;
     cmd.u.rw.start_lba = txn->op.rw.offset_dev;
     cmd.u.rw.block_count = blocks - 1;
-    // The NVME command has room for two data pointers inline.
-    // The first is always the pointer to the first page where data is.
-    // The second is the second page if pagecount is 2.
-    // The second is the address of an array of page 2..n if pagecount > 2
-    cmd.dptr.prp[0] = pages[0] | byteoffset;
-    if (pagecount == 2) {
-      cmd.dptr.prp[1] = pages[1];
-    } else if (pagecount > 2) {
-      cmd.dptr.prp[1] = utxn->phys + sizeof(uint64_t);
-    }
+    io_setup_prps(q, utxn, &cmd, pages, pagecount, byteoffset);
 
-    zxlogf(TRACE, "nvme: txn=%p utxn id=%u pages=%zu op=%s\n", txn, utxn->id, pagecount,
-           txn->opcode == NVME_OP_WRITE ? "WR" : "RD");
+    zxlogf(TRACE, "nvme: q%u txn=%p utxn id=%u pages=%zu op=%s\n", q->id, txn, utxn->id,
+           pagecount, txn->opcode == NVME_OP_WRITE ? "WR" : "RD");
     zxlogf(SPEW, "nvme: prp[0]=%016zx prp[1]=%016zx\n", cmd.dptr.prp[0], cmd.dptr.prp[1]);
-    zxlogf(SPEW, "nvme: pages[] = { %016zx, %016zx, %016zx, %016zx, ... }\n", pages[0], pages[1],
-           pages[2], pages[3]);
 
-    if ((r = nvme_io_sq_put(nvme, &cmd)) != ZX_OK) {
+    if ((r = nvme_io_sq_put(q, &cmd)) != ZX_OK) {
       zxlogf(ERROR, "nvme: could not submit cmd (txn=%p id=%u)\n", txn, utxn->id);
       break;
     }
@@ -383,9 +543,9 @@ static bool io_process_txn(nvme_device_t* nvme, nvme_txn_t* txn) {
     // move this txn to the active list and tell the
     // caller not to retain the txn (false)
     if (txn->op.rw.length == 0) {
-      mtx_lock(&nvme->lock);
-      list_add_tail(&nvme->active_txns, &txn->node);
-      mtx_unlock(&nvme->lock);
+      mtx_lock(&q->lock);
+      list_add_tail(&q->active_txns, &txn->node);
+      mtx_unlock(&q->lock);
       return false;
     }
   }
@@ -394,17 +554,18 @@ static bool io_process_txn(nvme_device_t* nvme, nvme_txn_t* txn) {
   if ((r = zx_pmt_unpin(utxn->pmt)) != ZX_OK) {
     zxlogf(ERROR, "nvme: cannot unpin io buffer: %d\n", r);
   }
-  utxn_put(nvme, utxn);
+  prp_put(q, utxn);
+  utxn_put(q, utxn);
 
-  mtx_lock(&nvme->lock);
+  mtx_lock(&q->lock);
   txn->flags |= TXN_FLAG_FAILED;
   if (txn->pending_utxns) {
     // if there are earlier uncompleted IOs we become active now
     // and will finish erroring out when they complete
-    list_add_tail(&nvme->active_txns, &txn->node);
+    list_add_tail(&q->active_txns, &txn->node);
     txn = NULL;
   }
-  mtx_unlock(&nvme->lock);
+  mtx_unlock(&q->lock);
 
   if (txn != NULL) {
     txn_complete(txn, ZX_ERR_INTERNAL);
@@ -414,44 +575,44 @@ static bool io_process_txn(nvme_device_t* nvme, nvme_txn_t* txn) {
   return false;
 }
 
-static void io_process_txns(nvme_device_t* nvme) {
+static void io_process_txns(nvme_io_queue_t* q) {
   nvme_txn_t* txn;
 
   for (;;) {
-    mtx_lock(&nvme->lock);
-    txn = list_remove_head_type(&nvme->pending_txns, nvme_txn_t, node);
-    mtx_unlock(&nvme->lock);
+    mtx_lock(&q->lock);
+    txn = list_remove_head_type(&q->pending_txns, nvme_txn_t, node);
+    mtx_unlock(&q->lock);
 
     if (txn == NULL) {
       return;
     }
 
-    if (io_process_txn(nvme, txn)) {
+    if (io_process_txn(q, txn)) {
       // put txn back at front of queue for further processing later
-      mtx_lock(&nvme->lock);
-      list_add_head(&nvme->pending_txns, &txn->node);
-      mtx_unlock(&nvme->lock);
+      mtx_lock(&q->lock);
+      list_add_head(&q->pending_txns, &txn->node);
+      mtx_unlock(&q->lock);
       return;
     }
   }
 }
 
-static void io_process_cpls(nvme_device_t* nvme) {
+static void io_process_cpls(nvme_io_queue_t* q) {
   bool ring_doorbell = false;
   nvme_cpl_t cpl;
 
-  while (nvme_io_cq_get(nvme, &cpl) == ZX_OK) {
+  while (nvme_io_cq_get(q, &cpl) == ZX_OK) {
     ring_doorbell = true;
 
-    if (cpl.cmd_id >= UTXN_COUNT) {
-      zxlogf(ERROR, "nvme: unexpected cmd id %u\n", cpl.cmd_id);
+    if (cpl.cmd_id >= q->utxn_count) {
+      zxlogf(ERROR, "nvme: q%u unexpected cmd id %u\n", q->id, cpl.cmd_id);
       continue;
     }
-    nvme_utxn_t* utxn = nvme->utxn + cpl.cmd_id;
+    nvme_utxn_t* utxn = q->utxn + cpl.cmd_id;
     nvme_txn_t* txn = utxn->txn;
 
     if (txn == NULL) {
-      zxlogf(ERROR, "nvme: inactive utxn #%u completed?!\n", cpl.cmd_id);
+      zxlogf(ERROR, "nvme: q%u inactive utxn #%u completed?!\n", q->id, cpl.cmd_id);
       continue;
     }
 
@@ -473,43 +634,45 @@ static void io_process_cpls(nvme_device_t* nvme) {
 
     // release the microtransaction
     utxn->txn = NULL;
-    utxn_put(nvme, utxn);
+    prp_put(q, utxn);
+    utxn_put(q, utxn);
 
     txn->pending_utxns--;
     if ((txn->pending_utxns == 0) && (txn->op.rw.length == 0)) {
       // remove from either pending or active list
-      mtx_lock(&nvme->lock);
+      mtx_lock(&q->lock);
       list_delete(&txn->node);
-      mtx_unlock(&nvme->lock);
+      mtx_unlock(&q->lock);
       zxlogf(TRACE, "nvme: txn %p %s\n", txn, txn->flags & TXN_FLAG_FAILED ? "error" : "okay");
       txn_complete(txn, txn->flags & TXN_FLAG_FAILED ? ZX_ERR_IO : ZX_OK);
     }
   }
 
   if (ring_doorbell) {
-    nvme_io_cq_ack(nvme);
+    nvme_io_cq_ack(q);
   }
 }
 
 static int io_thread(void* arg) {
-  nvme_device_t* nvme = arg;
+  nvme_io_queue_t* q = arg;
+  nvme_device_t* nvme = q->nvme;
   for (;;) {
-    if (sync_completion_wait(&nvme->io_signal, ZX_TIME_INFINITE)) {
+    if (sync_completion_wait(&q->io_signal, ZX_TIME_INFINITE)) {
       break;
     }
     if (nvme->flags & FLAG_SHUTDOWN) {
       // TODO: cancel out pending IO
-      zxlogf(INFO, "nvme: io thread exiting\n");
+      zxlogf(INFO, "nvme: q%u io thread exiting\n", q->id);
       break;
     }
 
-    sync_completion_reset(&nvme->io_signal);
+    sync_completion_reset(&q->io_signal);
 
     // process completion messages
-    io_process_cpls(nvme);
+    io_process_cpls(q);
 
     // process work queue
-    io_process_txns(nvme);
+    io_process_txns(q);
   }
   return 0;
 }
@@ -557,11 +720,17 @@ static void nvme_queue(void* ctx, block_op_t* op, block_impl_queue_callback comp
   zxlogf(SPEW, "nvme: io: %s: %ublks @ blk#%zu\n", txn->opcode == NVME_OP_WRITE ? "wr" : "rd",
          txn->op.rw.length + 1U, txn->op.rw.offset_dev);
 
-  mtx_lock(&nvme->lock);
-  list_add_tail(&nvme->pending_txns, &txn->node);
-  mtx_unlock(&nvme->lock);
+  // There's no way to ask which cpu we are running on, so spread txns
+  // over the queues round-robin. Block ops carry no ordering between
+  // them, so it doesn't matter which queue a txn ends up on.
+  unsigned n = atomic_fetch_add(&nvme->next_io_queue, 1) % nvme->io_queue_count;
+  nvme_io_queue_t* q = nvme->io_queues + n;
 
-  sync_completion_signal(&nvme->io_signal);
+  mtx_lock(&q->lock);
+  list_add_tail(&q->pending_txns, &txn->node);
+  mtx_unlock(&q->lock);
+
+  sync_completion_signal(&q->io_signal);
 }
 
 static void nvme_query(void* ctx, block_info_t* info_out, size_t* block_op_size_out) {
@@ -591,26 +760,37 @@ static void nvme_release(void* ctx) {
     mmio_buffer_release(&nvme->mmio);
     // TODO: risks a handle use-after-close, will be resolved by IRQ api
     // changes coming soon
-    zx_handle_close(nvme->irqh);
-  }
-  if (nvme->flags & FLAG_IRQ_THREAD_STARTED) {
-    thrd_join(nvme->irqthread, &r);
+    for (uint32_t n = 0; n < nvme->irq_count; n++) {
+      zx_handle_close(nvme->irqh[n]);
+    }
   }
-  if (nvme->flags & FLAG_IO_THREAD_STARTED) {
-    sync_completion_signal(&nvme->io_signal);
-    thrd_join(nvme->iothread, &r);
+  for (uint32_t n = 0; n < nvme->irqthreads_started; n++) {
+    thrd_join(nvme->irqthread[n], &r);
   }
 
-  // error out any pending txns
-  mtx_lock(&nvme->lock);
-  nvme_txn_t* txn;
-  while ((txn = list_remove_head_type(&nvme->active_txns, nvme_txn_t, node)) != NULL) {
-    txn_complete(txn, ZX_ERR_PEER_CLOSED);
-  }
-  while ((txn = list_remove_head_type(&nvme->pending_txns, nvme_txn_t, node)) != NULL) {
-    txn_complete(txn, ZX_ERR_PEER_CLOSED);
+  for (uint32_t n = 0; n < nvme->io_queue_count; n++) {
+    nvme_io_queue_t* q = nvme->io_queues + n;
+    if (q->iothread_started) {
+      sync_completion_signal(&q->io_signal);
+      thrd_join(q->iothread, &r);
+    }
+
+    // error out any pending txns
+    mtx_lock(&q->lock);
+    nvme_txn_t* txn;
+    while ((txn = list_remove_head_type(&q->active_txns, nvme_txn_t, node)) != NULL) {
+      txn_complete(txn, ZX_ERR_PEER_CLOSED);
+    }
+    while ((txn = list_remove_head_type(&q->pending_txns, nvme_txn_t, node)) != NULL) {
+      txn_complete(txn, ZX_ERR_PEER_CLOSED);
+    }
+    mtx_unlock(&q->lock);
+
+    io_buffer_release(&q->queue_iob);
+    io_buffer_release(&q->prp_iob);
+    free(q->pin_pages);
   }
-  mtx_unlock(&nvme->lock);
+  free(nvme->io_queues);
 
   io_buffer_release(&nvme->iob);
   free(nvme);
@@ -660,12 +840,9 @@ static void infostring(const char* prefix, uint8_t* str, size_t len) {
 // dedicated pages from the page pool
 #define IDX_ADMIN_SQ 0
 #define IDX_ADMIN_CQ 1
-#define IDX_IO_SQ 2
-#define IDX_IO_CQ 3
-#define IDX_SCRATCH 4
-#define IDX_UTXN_POOL 5  // this must always be last
+#define IDX_SCRATCH 2
 
-#define IO_PAGE_COUNT (IDX_UTXN_POOL + UTXN_COUNT)
+#define IO_PAGE_COUNT 3
 
 static inline uint64_t U64(uint8_t* x) { return *((uint64_t*)(void*)x); }
 static inline uint32_t U32(uint8_t* x) { return *((uint32_t*)(void*)x); }
@@ -673,9 +850,105 @@ static inline uint32_t U16(uint8_t* x) { return *((uint16_t*)(void*)x); }
 
 #define WAIT_MS 5000
 
+// Allocates the rings and utxns of io queue pair |q|, creates its
+// completion and submission queues on the controller and starts
+// its io thread.
+static zx_status_t nvme_io_queue_init(nvme_device_t* nvme, nvme_io_queue_t* q) {
+  zx_status_t r;
+
+  // The rings are physically contiguous, so their size is bounded
+  // by what the controller supports rather than by a page.
+  q->entries = IO_QUEUE_ENTRIES_MAX;
+  if (NVME_CAP_MQES(nvme->cap) + 1U < q->entries) {
+    q->entries = NVME_CAP_MQES(nvme->cap) + 1U;
+  }
+  q->utxn_count = q->entries - 1;
+
+  size_t sq_bytes = (q->entries * sizeof(nvme_cmd_t) + PAGE_MASK) & ~PAGE_MASK;
+  size_t cq_bytes = q->entries * sizeof(nvme_cpl_t);
+  if ((r = io_buffer_init(&q->queue_iob, nvme->bti, sq_bytes + cq_bytes,
+                          IO_BUFFER_RW | IO_BUFFER_CONTIG)) != ZX_OK) {
+    zxlogf(ERROR, "nvme: q%u: could not allocate queues: %d\n", q->id, r);
+    return r;
+  }
+  q->sq = io_buffer_virt(&q->queue_iob);
+  q->cq = io_buffer_virt(&q->queue_iob) + sq_bytes;
+  zx_paddr_t sq_phys = io_buffer_phys(&q->queue_iob);
+  zx_paddr_t cq_phys = sq_phys + sq_bytes;
+  q->sq_head = 0;
+  q->sq_tail = 0;
+  q->cq_head = 0;
+  q->cq_toggle = 1;
+
+  q->sq_tail_db = nvme->mmio.vaddr + NVME_REG_SQnTDBL(q->id, nvme->cap);
+  q->cq_head_db = nvme->mmio.vaddr + NVME_REG_CQnHDBL(q->id, nvme->cap);
+
+  // prp list page pool for the utxns, which need not be contiguous
+  if ((r = io_buffer_init(&q->prp_iob, nvme->bti, PRP_POOL_PAGES * PAGE_SIZE, IO_BUFFER_RW)) !=
+          ZX_OK ||
+      (r = io_buffer_physmap(&q->prp_iob)) != ZX_OK) {
+    zxlogf(ERROR, "nvme: q%u: could not allocate prp lists: %d\n", q->id, r);
+    return r;
+  }
+
+  // a transfer of max_xfer blocks touches at most one page more than its size
+  size_t max_pages = ((size_t)nvme->max_xfer * nvme->info.block_size) / PAGE_SIZE + 1;
+  if ((q->pin_pages = calloc(max_pages, sizeof(zx_paddr_t))) == NULL) {
+    return ZX_ERR_NO_MEMORY;
+  }
+
+  // initialize the microtransaction and prp list page pools
+  memset(q->utxn_avail, 0, sizeof(q->utxn_avail));
+  for (unsigned n = 0; n < q->utxn_count; n++) {
+    q->utxn[n].id = n;
+    q->utxn[n].prp_pages = 0;
+    q->utxn_avail[n / 64] |= 1ULL << (n % 64);
+  }
+  q->prp_avail = (1ULL << PRP_POOL_PAGES) - 1;
+
+  nvme_cmd_t cmd;
+
+  // create the IO completion queue
+  memset(&cmd, 0, sizeof(cmd));
+  cmd.cmd =
+      NVME_CMD_CID(0) | NVME_CMD_PRP | NVME_CMD_NORMAL | NVME_CMD_OPC(NVME_ADMIN_OP_CREATE_IOCQ);
+  cmd.dptr.prp[0] = cq_phys;
+  cmd.u.raw[0] = ((q->entries - 1U) << 16) | q->id;  // queue size, queue id
+  cmd.u.raw[1] = ((uint32_t)q->vector << 16) | 2 | 1;  // irq vector, irq enable, phys contig
+
+  if (nvme_admin_txn(nvme, &cmd, NULL) != ZX_OK) {
+    zxlogf(ERROR, "nvme: q%u: completion queue creation op failed\n", q->id);
+    return ZX_ERR_INTERNAL;
+  }
+
+  // create the IO submit queue
+  memset(&cmd, 0, sizeof(cmd));
+  cmd.cmd =
+      NVME_CMD_CID(0) | NVME_CMD_PRP | NVME_CMD_NORMAL | NVME_CMD_OPC(NVME_ADMIN_OP_CREATE_IOSQ);
+  cmd.dptr.prp[0] = sq_phys;
+  cmd.u.raw[0] = ((q->entries - 1U) << 16) | q->id;  // queue size, queue id
+  cmd.u.raw[1] = ((uint32_t)q->id << 16) | 0 | 1;    // cqid, qprio, phys contig
+
+  if (nvme_admin_txn(nvme, &cmd, NULL) != ZX_OK) {
+    zxlogf(ERROR, "nvme: q%u: submit queue creation op failed\n", q->id);
+    return ZX_ERR_INTERNAL;
+  }
+
+  char name[ZX_MAX_NAME_LEN];
+  snprintf(name, sizeof(name), "nvme-io-thread-%u", q->id);
+  if (thrd_create_with_name(&q->iothread, io_thread, q, name)) {
+    zxlogf(ERROR, "nvme: cannot create io thread\n");
+    return ZX_ERR_INTERNAL;
+  }
+  q->iothread_started = true;
+  atomic_fetch_add(&nvme->io_queues_started, 1);
+  return ZX_OK;
+}
+
 static zx_status_t nvme_init(nvme_device_t* nvme) {
   uint32_t n = rd32(VS);
   uint64_t cap = rd64(CAP);
+  nvme->cap = cap;
 
   zxlogf(INFO, "nvme: version %d.%d.%d\n", n >> 16, (n >> 8) & 0xFF, n & 0xFF);
   zxlogf(INFO, "nvme: page size: (MPSMIN): %u (MPSMAX): %u\n",
@@ -696,7 +969,7 @@ static zx_status_t nvme_init(nvme_device_t* nvme) {
     zxlogf(ERROR, "nvme: minimum page size larger than platform page size\n");
     return ZX_ERR_NOT_SUPPORTED;
   }
-  // allocate pages for various queues and the utxn scatter lists
+  // allocate pages for the admin queues and admin commands
   // TODO: these should all be RO to hardware apart from the scratch io page(s)
   if (io_buffer_init(&nvme->iob, nvme->bti, PAGE_SIZE * IO_PAGE_COUNT, IO_BUFFER_RW) ||
       io_buffer_physmap(&nvme->iob)) {
@@ -704,14 +977,6 @@ static zx_status_t nvme_init(nvme_device_t* nvme) {
     return ZX_ERR_NO_MEMORY;
   }
 
-  // initialize the microtransaction pool
-  nvme->utxn_avail = 0x7FFFFFFFFFFFFFFFULL;
-  for (unsigned n = 0; n < UTXN_COUNT; n++) {
-    nvme->utxn[n].id = n;
-    nvme->utxn[n].phys = nvme->iob.phys_list[IDX_UTXN_POOL + n];
-    nvme->utxn[n].virt = nvme->iob.virt + (IDX_UTXN_POOL + n) * PAGE_SIZE;
-  }
-
   if (rd32(CSTS) & NVME_CSTS_RDY) {
     zxlogf(INFO, "nvme: controller is active. resetting...\n");
     wr32(rd32(CC) & ~NVME_CC_EN, CC);  // disable
@@ -761,32 +1026,25 @@ static zx_status_t nvme_init(nvme_device_t* nvme) {
   nvme->admin_cq_head = 0;
   nvme->admin_cq_toggle = 1;
 
-  // registers and buffers for IO queues
-  nvme->io_sq_tail_db = nvme->mmio.vaddr + NVME_REG_SQnTDBL(1, cap);
-  nvme->io_cq_head_db = nvme->mmio.vaddr + NVME_REG_CQnHDBL(1, cap);
-
-  nvme->io_sq = nvme->iob.virt + PAGE_SIZE * IDX_IO_SQ;
-  nvme->io_sq_head = 0;
-  nvme->io_sq_tail = 0;
-
-  nvme->io_cq = nvme->iob.virt + PAGE_SIZE * IDX_IO_CQ;
-  nvme->io_cq_head = 0;
-  nvme->io_cq_toggle = 1;
-
   // scratch page for admin ops
   void* scratch = nvme->iob.virt + PAGE_SIZE * IDX_SCRATCH;
 
-  if (thrd_create_with_name(&nvme->irqthread, irq_thread, nvme, "nvme-irq-thread")) {
-    zxlogf(ERROR, "nvme; cannot create irq thread\n");
-    return ZX_ERR_INTERNAL;
-  }
-  nvme->flags |= FLAG_IRQ_THREAD_STARTED;
-
-  if (thrd_create_with_name(&nvme->iothread, io_thread, nvme, "nvme-io-thread")) {
-    zxlogf(ERROR, "nvme; cannot create io thread\n");
-    return ZX_ERR_INTERNAL;
+  for (uint32_t i = 0; i < nvme->irq_count; i++) {
+    irq_thread_args_t* args = malloc(sizeof(irq_thread_args_t));
+    if (args == NULL) {
+      return ZX_ERR_NO_MEMORY;
+    }
+    args->nvme = nvme;
+    args->vector = i;
+    char name[ZX_MAX_NAME_LEN];
+    snprintf(name, sizeof(name), "nvme-irq-thread-%u", i);
+    if (thrd_create_with_name(&nvme->irqthread[i], irq_thread, args, name)) {
+      zxlogf(ERROR, "nvme; cannot create irq thread\n");
+      free(args);
+      return ZX_ERR_INTERNAL;
+    }
+    nvme->irqthreads_started++;
   }
-  nvme->flags |= FLAG_IO_THREAD_STARTED;
 
   nvme_cmd_t cmd;
 
@@ -865,45 +1123,31 @@ static zx_status_t nvme_init(nvme_device_t* nvme) {
   FEATURE(ONCS, WRITE_UNCORRECTABLE);
   FEATURE(ONCS, COMPARE);
 
-  // set feature (number of queues) to 1 iosq and 1 iocq
+  // set feature (number of queues) to one iosq and one iocq per io queue pair
+  uint32_t nqueues = nvme->io_queue_count;
   memset(&cmd, 0, sizeof(cmd));
   cmd.cmd =
       NVME_CMD_CID(0) | NVME_CMD_PRP | NVME_CMD_NORMAL | NVME_CMD_OPC(NVME_ADMIN_OP_SET_FEATURE);
   cmd.u.raw[0] = NVME_FEATURE_NUMBER_OF_QUEUES;
-  cmd.u.raw[1] = 0;
+  cmd.u.raw[1] = ((nqueues - 1) << 16) | (nqueues - 1);  // iocqs, iosqs (zero based)
 
   nvme_cpl_t cpl;
   if (nvme_admin_txn(nvme, &cmd, &cpl) != ZX_OK) {
     zxlogf(ERROR, "nvme: set feature (number queues) op failed\n");
     return ZX_ERR_INTERNAL;
   }
-  zxlogf(INFO, "cpl.cmd %08x\n", cpl.cmd);
-
-  // create the IO completion queue
-  memset(&cmd, 0, sizeof(cmd));
-  cmd.cmd =
-      NVME_CMD_CID(0) | NVME_CMD_PRP | NVME_CMD_NORMAL | NVME_CMD_OPC(NVME_ADMIN_OP_CREATE_IOCQ);
-  cmd.dptr.prp[0] = nvme->iob.phys_list[IDX_IO_CQ];
-  cmd.u.raw[0] = ((CQMAX - 1) << 16) | 1;  // queue size, queue id
-  cmd.u.raw[1] = (0 << 16) | 2 | 1;        // irq vector, irq enable, phys contig
 
-  if (nvme_admin_txn(nvme, &cmd, NULL) != ZX_OK) {
-    zxlogf(ERROR, "nvme: completion queue creation op failed\n");
-    return ZX_ERR_INTERNAL;
+  // The controller may allocate fewer queues than asked for.
+  uint32_t nsq = (cpl.cmd & 0xFFFF) + 1;
+  uint32_t ncq = (cpl.cmd >> 16) + 1;
+  zxlogf(INFO, "nvme: io queues: requested %u, allocated %u sq / %u cq\n", nqueues, nsq, ncq);
+  if (nsq < nqueues) {
+    nqueues = nsq;
   }
-
-  // create the IO submit queue
-  memset(&cmd, 0, sizeof(cmd));
-  cmd.cmd =
-      NVME_CMD_CID(0) | NVME_CMD_PRP | NVME_CMD_NORMAL | NVME_CMD_OPC(NVME_ADMIN_OP_CREATE_IOSQ);
-  cmd.dptr.prp[0] = nvme->iob.phys_list[IDX_IO_SQ];
-  cmd.u.raw[0] = ((SQMAX - 1) << 16) | 1;  // queue size, queue id
-  cmd.u.raw[1] = (1 << 16) | 0 | 1;        // cqid, qprio, phys contig
-
-  if (nvme_admin_txn(nvme, &cmd, NULL) != ZX_OK) {
-    zxlogf(ERROR, "nvme: submit queue creation op failed\n");
-    return ZX_ERR_INTERNAL;
+  if (ncq < nqueues) {
+    nqueues = ncq;
   }
+  nvme->io_queue_count = nqueues;
 
   // identify namespace 1
   memset(&cmd, 0, sizeof(cmd));
@@ -971,6 +1215,19 @@ static zx_status_t nvme_init(nvme_device_t* nvme) {
   zxlogf(INFO, "nvme: max transfer per r/w op: %u blocks (%u bytes)\n", nvme->max_xfer,
          nvme->max_xfer * nvme->info.block_size);
 
+  // The prp list of the largest transfer must fit in a queue's pool.
+  size_t max_pages = ((size_t)nvme->max_xfer * nvme->info.block_size) / PAGE_SIZE + 1;
+  zxlogf(INFO, "nvme: prp list pages per max transfer: %zu (pool %u)\n",
+         prp_pages_needed(max_pages), PRP_POOL_PAGES);
+
+  for (uint32_t i = 0; i < nvme->io_queue_count; i++) {
+    zx_status_t r;
+    if ((r = nvme_io_queue_init(nvme, nvme->io_queues + i)) != ZX_OK) {
+      return r;
+    }
+  }
+  zxlogf(INFO, "nvme: %u io queues on %u irq vectors\n", nvme->io_queue_count, nvme->irq_count);
+
   device_make_visible(nvme->zxdev);
   return ZX_OK;
 }
@@ -985,11 +1242,35 @@ static zx_status_t nvme_bind(void* ctx, zx_device_t* dev) {
   if ((nvme = calloc(1, sizeof(nvme_device_t))) == NULL) {
     return ZX_ERR_NO_MEMORY;
   }
-  list_initialize(&nvme->pending_txns);
-  list_initialize(&nvme->active_txns);
-  mtx_init(&nvme->lock, mtx_plain);
   mtx_init(&nvme->admin_lock, mtx_plain);
 
+  // One io queue pair per cpu unless overridden, with the queue
+  // count settled once the controller has been asked for queues.
+  uint32_t nqueues = zx_system_get_num_cpus();
+  const char* opt = getenv("driver.nvme.io-queues");
+  if (opt != NULL) {
+    nqueues = (uint32_t)strtoul(opt, NULL, 0);
+  }
+  if (nqueues < 1) {
+    nqueues = 1;
+  }
+  if (nqueues > IO_QUEUES_MAX) {
+    nqueues = IO_QUEUES_MAX;
+  }
+  if ((nvme->io_queues = calloc(nqueues, sizeof(nvme_io_queue_t))) == NULL) {
+    free(nvme);
+    return ZX_ERR_NO_MEMORY;
+  }
+  nvme->io_queue_count = nqueues;
+  for (uint32_t i = 0; i < nqueues; i++) {
+    nvme_io_queue_t* q = nvme->io_queues + i;
+    q->nvme = nvme;
+    q->id = i + 1;  // queue id 0 is the admin queue
+    list_initialize(&q->pending_txns);
+    list_initialize(&q->active_txns);
+    mtx_init(&q->lock, mtx_plain);
+  }
+
   if (device_get_protocol(dev, ZX_PROTOCOL_PCI, &nvme->pci)) {
     goto fail;
   }
@@ -1006,9 +1287,23 @@ static zx_status_t nvme_bind(void* ctx, zx_device_t* dev) {
   };
   uint32_t nirq = 0;
   for (unsigned n = 0; n < countof(modes); n++) {
-    if ((pci_query_irq_mode(&nvme->pci, modes[n], &nirq) == ZX_OK) &&
-        (pci_set_irq_mode(&nvme->pci, modes[n], 1) == ZX_OK)) {
-      zxlogf(INFO, "nvme: irq mode %u, irq count %u (#%u)\n", modes[n], nirq, n);
+    if (pci_query_irq_mode(&nvme->pci, modes[n], &nirq) != ZX_OK) {
+      continue;
+    }
+    // Only msi-x gives each queue pair a vector of its own.
+    uint32_t nvec = 1;
+    if (modes[n] == ZX_PCIE_IRQ_MODE_MSI_X) {
+      nvec = nirq;
+      if (nvec > nqueues) {
+        nvec = nqueues;
+      }
+      if (nvec > IRQS_MAX) {
+        nvec = IRQS_MAX;
+      }
+    }
+    if (pci_set_irq_mode(&nvme->pci, modes[n], nvec) == ZX_OK) {
+      zxlogf(INFO, "nvme: irq mode %u, irq count %u, using %u (#%u)\n", modes[n], nirq, nvec, n);
+      nvme->irq_count = nvec;
       goto irq_configured;
     }
   }
@@ -1016,9 +1311,14 @@ static zx_status_t nvme_bind(void* ctx, zx_device_t* dev) {
   goto fail;
 
 irq_configured:
-  if (pci_map_interrupt(&nvme->pci, 0, &nvme->irqh) != ZX_OK) {
-    zxlogf(ERROR, "nvme: could not map irq\n");
-    goto fail;
+  for (uint32_t i = 0; i < nvme->irq_count; i++) {
+    if (pci_map_interrupt(&nvme->pci, i, &nvme->irqh[i]) != ZX_OK) {
+      zxlogf(ERROR, "nvme: could not map irq %u\n", i);
+      goto fail;
+    }
+  }
+  for (uint32_t i = 0; i < nqueues; i++) {
+    nvme->io_queues[i].vector = i % nvme->irq_count;
   }
   if (pci_enable_bus_master(&nvme->pci, true)) {
     zxlogf(ERROR, "nvme: cannot enable bus mastering\n");
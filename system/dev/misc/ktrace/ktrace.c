@@ -53,6 +53,13 @@ static zx_status_t fidl_Rewind(void* ctx, fidl_txn_t* txn) {
   return fuchsia_tracing_kernel_ControllerRewind_reply(txn, status);
 }
 
+static zx_status_t fidl_SetMode(void* ctx, uint32_t mode, fidl_txn_t* txn) {
+  zx_status_t status =
+      // Please do not use get_root_resource() in new code. See ZX-1467.
+      zx_ktrace_control(get_root_resource(), KTRACE_ACTION_SET_MODE, mode, NULL);
+  return fuchsia_tracing_kernel_ControllerSetMode_reply(txn, status);
+}
+
 static zx_status_t fidl_GetBytesWritten(void* ctx, fidl_txn_t* txn) {
   size_t size = 0;
   // Please do not use get_root_resource() in new code. See ZX-1467.
@@ -64,6 +71,7 @@ static const fuchsia_tracing_kernel_Controller_ops_t fidl_ops = {
     .Start = fidl_Start,
     .Stop = fidl_Stop,
     .Rewind = fidl_Rewind,
+    .SetMode = fidl_SetMode,
     .GetBytesWritten = fidl_GetBytesWritten,
 };
 
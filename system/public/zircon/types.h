@@ -174,6 +174,7 @@ typedef struct zx_wait_item {
 
 // VM Object creation options
 #define ZX_VMO_RESIZABLE                 ((uint32_t)1u << 1)
+#define ZX_VMO_LARGE_PAGES               ((uint32_t)1u << 2)
 
 // VM Object opcodes
 #define ZX_VMO_OP_COMMIT                 ((uint32_t)1u)
@@ -86,6 +86,7 @@ int usage() {
           "         -m|--metrics   Collect filesystem metrics\n"
           "         -j|--journal   Utilize the blobfs journal\n"
           "                        For fsck, the journal is replayed before verification\n"
+          "         -p|--no-pager  Read whole blobs into memory when they are first accessed\n"
           "         -h|--help      Display this message\n"
           "\n"
           "On Fuchsia, blobfs takes the block device argument by handle.\n"
@@ -106,11 +107,12 @@ zx_status_t ProcessArgs(int argc, char** argv, CommandFunction* func,
         {"readonly", no_argument, nullptr, 'r'},
         {"metrics", no_argument, nullptr, 'm'},
         {"journal", no_argument, nullptr, 'j'},
+        {"no-pager", no_argument, nullptr, 'p'},
         {"help", no_argument, nullptr, 'h'},
         {nullptr, 0, nullptr, 0},
     };
     int opt_index;
-    int c = getopt_long(argc, argv, "rmjh", opts, &opt_index);
+    int c = getopt_long(argc, argv, "rmjph", opts, &opt_index);
     if (c < 0) {
       break;
     }
@@ -124,6 +126,9 @@ zx_status_t ProcessArgs(int argc, char** argv, CommandFunction* func,
       case 'j':
         options->journal = true;
         break;
+      case 'p':
+        options->pager = false;
+        break;
       case 'h':
       default:
         return usage();
@@ -12,8 +12,11 @@
 
 #include <fbl/algorithm.h>
 #include <fbl/unique_ptr.h>
+#include <fuchsia/boot/c/fidl.h>
+#include <lib/fdio/directory.h>
 #include <zircon/compiler.h>
 #include <zircon/syscalls.h>
+#include <zircon/syscalls/object.h>
 #include <zircon/time.h>
 #include <zircon/types.h>
 
@@ -30,13 +33,40 @@ void duplicate_handles(uint32_t n, zx_handle_t src, zx_handle_t* dest) {
   }
 }
 
+// Returns the root resource, or ZX_HANDLE_INVALID if it is not available to us.
+zx_handle_t get_root_resource() {
+  zx_handle_t local, remote;
+  if (zx_channel_create(0u, &local, &remote) != ZX_OK) {
+    return ZX_HANDLE_INVALID;
+  }
+  zx_handle_t root_resource = ZX_HANDLE_INVALID;
+  if (fdio_service_connect("/svc/" fuchsia_boot_RootResource_Name, remote) != ZX_OK ||
+      fuchsia_boot_RootResourceGet(local, &root_resource) != ZX_OK) {
+    root_resource = ZX_HANDLE_INVALID;
+  }
+  zx_handle_close(local);
+  return root_resource;
+}
+
+// Returns the amount of free physical memory in bytes.
+uint64_t get_free_bytes(zx_handle_t root_resource) {
+  zx_info_kmem_stats_t stats;
+  __UNUSED zx_status_t status = zx_object_get_info(root_resource, ZX_INFO_KMEM_STATS, &stats,
+                                                   sizeof(stats), nullptr, nullptr);
+  assert(status == ZX_OK);
+  return stats.free_bytes;
+}
+
+// Number of extra messages queued to measure the memory used by each in-flight message.
+constexpr uint32_t kMemoryProbeMessages = 1000;
+
 struct TestArgs {
   uint32_t size;
   uint32_t handles;
   uint32_t queue;
 };
 
-void do_test(uint32_t duration_sec, const TestArgs& test_args) {
+void do_test(uint32_t duration_sec, const TestArgs& test_args, zx_handle_t root_resource) {
   __UNUSED zx_status_t status;
 
   zx_duration_t duration_ns = ZX_SEC(duration_sec);
@@ -97,6 +127,39 @@ void do_test(uint32_t duration_sec, const TestArgs& test_args) {
       break;
   }
 
+  // Estimate how much memory the kernel uses to hold messages in the channel by queuing a batch of
+  // them and looking at the drop in free memory. This is only a lower bound: small messages are
+  // carved out of the kernel's buffer arenas, whose pages stay committed once touched, so anything
+  // served from arena pages committed before the probe (by this or an earlier test) is not seen.
+  int64_t bytes_per_message = 0;
+  if (root_resource != ZX_HANDLE_INVALID) {
+    const uint64_t free_before = get_free_bytes(root_resource);
+    for (uint32_t i = 0; i < kMemoryProbeMessages; i++) {
+      // The first message sends the handles left over from the loop above.
+      if (i > 0)
+        duplicate_handles(test_args.handles, event, handles.get());
+      status =
+          zx_channel_write(mp[0], 0, data.get(), test_args.size, handles.get(), test_args.handles);
+      assert(status == ZX_OK);
+    }
+    const uint64_t free_after = get_free_bytes(root_resource);
+    bytes_per_message =
+        static_cast<int64_t>(free_before - free_after) / static_cast<int64_t>(kMemoryProbeMessages);
+
+    for (uint32_t i = 0; i < kMemoryProbeMessages; i++) {
+      uint32_t r_size = test_args.size;
+      uint32_t r_handles = test_args.handles;
+      status = zx_channel_read(mp[1], 0u, data.get(), handles.get(), r_size, r_handles, &r_size,
+                               &r_handles);
+      assert(status == ZX_OK);
+      for (uint32_t j = 0; j < r_handles; j++) {
+        status = zx_handle_close(handles[j]);
+        assert(status == ZX_OK);
+      }
+    }
+    duplicate_handles(test_args.handles, event, handles.get());
+  }
+
   for (uint32_t i = 0; i < test_args.handles; i++) {
     status = zx_handle_close(handles[i]);
     assert(status == ZX_OK);
@@ -108,12 +171,17 @@ void do_test(uint32_t duration_sec, const TestArgs& test_args) {
   status = zx_handle_close(mp[1]);
   assert(status == ZX_OK);
 
+  // Each iteration writes and reads one message.
   double real_duration = static_cast<double>(zx_time_sub_time(end_ns, start_ns)) / 1000000000.0;
-  double its_per_second = static_cast<double>(big_its) * big_it_size / real_duration;
+  double messages_per_second = static_cast<double>(big_its) * big_it_size / real_duration;
   printf("write/read %" PRIu32 " bytes, %" PRIu32 " handles (%" PRIu32
          " pre-queued): "
-         "%.0f iterations/second\n",
-         test_args.size, test_args.handles, test_args.queue, its_per_second);
+         "%.0f messages/second",
+         test_args.size, test_args.handles, test_args.queue, messages_per_second);
+  if (root_resource != ZX_HANDLE_INVALID) {
+    printf(", >= %" PRId64 " bytes/in-flight message", bytes_per_message);
+  }
+  printf("\n");
 }
 
 }  // namespace
@@ -193,6 +261,12 @@ int main(int argc, char** argv) {
   if (optind < argc)
     argument_error(argv[0], "unexpected positional argument");
 
+  // Memory use is only reported when we can read the kernel's memory stats, and then only as a
+  // lower bound (see do_test()).
+  zx_handle_t root_resource = get_root_resource();
+  if (root_resource == ZX_HANDLE_INVALID)
+    printf("Root resource unavailable, not reporting memory per message\n");
+
   for (uint32_t i = 0; i < repeats; i++) {
     if (repeats > 1u) {
       if (i > 0u)
@@ -207,11 +281,12 @@ int main(int argc, char** argv) {
           {100, 5, 0},  {1000, 5, 0}, {10, 0, 1},   {100, 0, 1},  {1000, 0, 1},
       };
       for (size_t i = 0; i < fbl::count_of(suite); i++)
-        do_test(duration, suite[i]);
+        do_test(duration, suite[i], root_resource);
     } else {
-      do_test(duration, test_args);
+      do_test(duration, test_args, root_resource);
     }
   }
 
+  zx_handle_close(root_resource);
   return EXIT_SUCCESS;
 }
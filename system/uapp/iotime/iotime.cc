@@ -86,6 +86,44 @@ static zx_duration_t iotime_posix(int is_read, int fd, size_t total, size_t bufs
   return zx_time_sub_time(t1, t0);
 }
 
+// Reads or writes |total| bytes at offsets chosen at random among the |bufsz|-aligned offsets
+// within the first |total| bytes of |fd|. Compared with iotime_posix, this measures how a file
+// system performs when it cannot predict the next access, e.g. without the benefit of readahead.
+static zx_duration_t iotime_random(int is_read, int fd, size_t total, size_t bufsz) {
+  if (total < bufsz) {
+    fprintf(stderr, "error: total must be at least the buffer size\n");
+    return ZX_TIME_INFINITE;
+  }
+  void* buffer = malloc(bufsz);
+  if (buffer == NULL) {
+    fprintf(stderr, "error: out of memory\n");
+    return ZX_TIME_INFINITE;
+  }
+
+  const size_t slots = total / bufsz;
+  unsigned int seed = 0;
+  zx_time_t t0 = zx_clock_get_monotonic();
+  const char* fn_name = is_read ? "pread" : "pwrite";
+  for (size_t i = 0; i < slots; i++) {
+    off_t off = static_cast<off_t>((rand_r(&seed) % slots) * bufsz);
+    ssize_t r = is_read ? pread(fd, buffer, bufsz, off) : pwrite(fd, buffer, bufsz, off);
+    if (r < 0) {
+      fprintf(stderr, "error: %s() error %d\n", fn_name, errno);
+      free(buffer);
+      return ZX_TIME_INFINITE;
+    }
+    if ((size_t)r != bufsz) {
+      fprintf(stderr, "error: %s() %zu of %zu bytes processed\n", fn_name, r, bufsz);
+      free(buffer);
+      return ZX_TIME_INFINITE;
+    }
+  }
+  zx_time_t t1 = zx_clock_get_monotonic();
+  free(buffer);
+
+  return zx_time_sub_time(t1, t0);
+}
+
 static zx_duration_t iotime_block(int is_read, int fd, size_t total, size_t bufsz) {
   if ((total % 4096) || (bufsz % 4096)) {
     fprintf(stderr, "error: total and buffer size must be multiples of 4K\n");
@@ -167,8 +205,11 @@ static zx_duration_t iotime_fifo(char* dev, int is_read, int fd, size_t total, s
 
 static int usage(void) {
   fprintf(stderr,
-          "usage: iotime <read|write> <posix|block|fifo> <device|--ramdisk> <bytes> <bufsize>\n\n"
+          "usage: iotime <read|write> <posix|random|block|fifo> <device|--ramdisk> <bytes> "
+          "<bufsize>\n\n"
           "        <bytes> and <bufsize> must be a multiple of 4k for block mode\n"
+          "        random mode accesses <bufsize>-aligned offsets of the first <bytes> bytes\n"
+          "        in random order; compare with posix mode to measure readahead\n"
           "        --ramdisk only supported for block mode\n");
   return -1;
 }
@@ -206,6 +247,8 @@ int main(int argc, char** argv) {
   zx_duration_t res;
   if (!strcmp(argv[2], "posix")) {
     res = iotime_posix(is_read, fd, total, bufsz);
+  } else if (!strcmp(argv[2], "random")) {
+    res = iotime_random(is_read, fd, total, bufsz);
   } else if (!strcmp(argv[2], "block")) {
     res = iotime_block(is_read, fd, total, bufsz);
   } else if (!strcmp(argv[2], "fifo")) {
@@ -0,0 +1,194 @@
+// Copyright 2019 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <fbl/vector.h>
+#include <lib/zx/clock.h>
+#include <lib/zx/event.h>
+#include <lib/zx/eventpair.h>
+#include <zircon/status.h>
+#include <zircon/syscalls.h>
+
+#include <atomic>
+#include <inttypes.h>
+#include <stdio.h>
+#include <threads.h>
+
+#include <utility>
+
+#include "stress_test.h"
+
+// Event Stresser
+//
+// Runs two kinds of workers on every CPU at once, all of which go through the
+// kernel's event primitive:
+//
+//  - Pollers repeatedly wait on an object whose signal is already asserted, so
+//    every wait is satisfied without blocking.
+//  - Pairs of ping-pong workers bounce a signal across an eventpair, so every
+//    wait blocks and every signal wakes a thread.
+//
+// Reports the operations per second of each kind. Pollers scale with the
+// number of CPUs only when satisfied waits do not serialize on the global
+// thread lock; ping-pong workers check that no wakeup is ever lost.
+
+class EventStressTest : public StressTest {
+ public:
+  EventStressTest() = default;
+  virtual ~EventStressTest() = default;
+
+  virtual zx_status_t Start();
+  virtual zx_status_t Stop();
+
+  virtual const char* name() const { return "Event Stress"; }
+
+ private:
+  // Time a ping-pong worker waits for its peer before reporting a lost wakeup.
+  static constexpr zx::duration kPingTimeout = zx::sec(10);
+
+  struct PingPong {
+    EventStressTest* test;
+    zx::eventpair endpoint;
+    bool serve;
+  };
+
+  int poll_thread();
+  int ping_pong_thread(PingPong* ping_pong);
+  int ping_pong_loop(const zx::eventpair& endpoint, bool serve);
+  int report_thread();
+
+  std::atomic<bool> shutdown_{false};
+
+  // Operations since the last report.
+  std::atomic<uint64_t> polls_{0};
+  std::atomic<uint64_t> pings_{0};
+
+  thrd_t report_thread_;
+  fbl::Vector<thrd_t> worker_threads_;
+  fbl::Vector<PingPong*> ping_pongs_;
+} eventstress;
+
+int EventStressTest::poll_thread() {
+  zx::event event;
+  zx_status_t status = zx::event::create(0, &event);
+  if (status == ZX_OK) {
+    status = event.signal(0, ZX_EVENT_SIGNALED);
+  }
+  if (status != ZX_OK) {
+    PrintfAlways("event stress: failed to create event: %s\n", zx_status_get_string(status));
+    return -1;
+  }
+
+  while (!shutdown_.load()) {
+    for (int i = 0; i < 1000; i++) {
+      status = event.wait_one(ZX_EVENT_SIGNALED, zx::time::infinite(), nullptr);
+      if (status != ZX_OK) {
+        PrintfAlways("event stress: wait failed: %s\n", zx_status_get_string(status));
+        return -1;
+      }
+    }
+    polls_.fetch_add(1000);
+  }
+  return 0;
+}
+
+int EventStressTest::ping_pong_thread(PingPong* ping_pong) {
+  int ret = ping_pong_loop(ping_pong->endpoint, ping_pong->serve);
+  // Closing the endpoint wakes the peer if it is waiting for this worker.
+  ping_pong->endpoint.reset();
+  return ret;
+}
+
+int EventStressTest::ping_pong_loop(const zx::eventpair& endpoint, bool serve) {
+  bool send = serve;
+  while (!shutdown_.load()) {
+    if (send) {
+      zx_status_t status = endpoint.signal_peer(0, ZX_USER_SIGNAL_0);
+      if (status != ZX_OK) {
+        PrintfAlways("event stress: signal failed: %s\n", zx_status_get_string(status));
+        return -1;
+      }
+    }
+    send = true;
+
+    zx_signals_t observed;
+    zx_status_t status =
+        endpoint.wait_one(ZX_USER_SIGNAL_0 | ZX_EVENTPAIR_PEER_CLOSED,
+                          zx::deadline_after(kPingTimeout), &observed);
+    if (status != ZX_OK) {
+      PrintfAlways("event stress: ping wait failed: %s\n", zx_status_get_string(status));
+      return -1;
+    }
+    if (observed & ZX_EVENTPAIR_PEER_CLOSED) {
+      break;
+    }
+    endpoint.signal(ZX_USER_SIGNAL_0, 0);
+    pings_.fetch_add(1);
+  }
+  return 0;
+}
+
+int EventStressTest::report_thread() {
+  zx::time next_report = zx::clock::get_monotonic() + zx::sec(1);
+  while (!shutdown_.load()) {
+    zx::nanosleep(next_report);
+    next_report += zx::sec(1);
+
+    Printf("event stress: %" PRIu64 " polls/s %" PRIu64 " pings/s\n", polls_.exchange(0),
+           pings_.exchange(0));
+  }
+  return 0;
+}
+
+zx_status_t EventStressTest::Start() {
+  PrintfAlways("Event stress test: using %u pollers and %u ping-pong pairs\n", num_cpus_,
+               num_cpus_);
+
+  auto poller = [](void* arg) -> int { return static_cast<EventStressTest*>(arg)->poll_thread(); };
+  auto ping_ponger = [](void* arg) -> int {
+    auto ping_pong = static_cast<PingPong*>(arg);
+    return ping_pong->test->ping_pong_thread(ping_pong);
+  };
+  for (uint32_t i = 0; i < num_cpus_; i++) {
+    thrd_t thread;
+    if (thrd_create_with_name(&thread, poller, this, "event_poller") != thrd_success) {
+      return ZX_ERR_NO_RESOURCES;
+    }
+    worker_threads_.push_back(thread);
+
+    zx::eventpair endpoints[2];
+    zx_status_t status = zx::eventpair::create(0, &endpoints[0], &endpoints[1]);
+    if (status != ZX_OK) {
+      return status;
+    }
+    for (int j = 0; j < 2; j++) {
+      auto ping_pong = new PingPong{this, std::move(endpoints[j]), j == 0};
+      ping_pongs_.push_back(ping_pong);
+      if (thrd_create_with_name(&thread, ping_ponger, ping_pong, "event_ping_pong") !=
+          thrd_success) {
+        return ZX_ERR_NO_RESOURCES;
+      }
+      worker_threads_.push_back(thread);
+    }
+  }
+
+  auto report = [](void* arg) -> int {
+    return static_cast<EventStressTest*>(arg)->report_thread();
+  };
+  thrd_create_with_name(&report_thread_, report, this, "event_report");
+
+  return ZX_OK;
+}
+
+zx_status_t EventStressTest::Stop() {
+  shutdown_.store(true);
+  thrd_join(report_thread_, nullptr);
+
+  for (auto& thread : worker_threads_) {
+    thrd_join(thread, nullptr);
+  }
+  for (PingPong* ping_pong : ping_pongs_) {
+    delete ping_pong;
+  }
+  return ZX_OK;
+}
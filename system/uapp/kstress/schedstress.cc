@@ -0,0 +1,163 @@
+// Copyright 2019 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <fbl/algorithm.h>
+#include <fbl/vector.h>
+#include <lib/zx/clock.h>
+#include <zircon/status.h>
+#include <zircon/syscalls.h>
+
+#include <atomic>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <threads.h>
+
+#include "stress_test.h"
+
+// Scheduler Stresser
+//
+// Wakes a pool of worker threads in bursts that are larger than the number of
+// CPUs in the system. Each worker runs for a random amount of time after waking
+// and then waits for the next burst, so CPUs go idle at different times while
+// other CPUs still have threads queued. This exercises the idle-time work
+// stealing and periodic load balancing paths of the scheduler.
+//
+// Reports the average and maximum latency from the start of a burst to each
+// worker running, which drops when idle CPUs pull queued work from busy ones.
+
+class SchedStressTest : public StressTest {
+ public:
+  SchedStressTest() = default;
+  virtual ~SchedStressTest() = default;
+
+  virtual zx_status_t Start();
+  virtual zx_status_t Stop();
+
+  virtual const char* name() const { return "Sched Stress"; }
+
+ private:
+  // Number of workers per CPU woken by each burst.
+  static constexpr uint32_t kWorkersPerCpu = 4;
+
+  // Period between the starts of bursts.
+  static constexpr zx::duration kBurstPeriod = zx::msec(20);
+
+  // Maximum time a worker spins after waking.
+  static constexpr zx::duration kMaxSpinTime = zx::msec(4);
+
+  int control_thread();
+  int worker_thread();
+
+  std::atomic<bool> shutdown_{false};
+
+  // Incremented at the start of every burst. Workers wait on this as a futex.
+  std::atomic<int32_t> generation_{0};
+
+  // Monotonic time at the start of the current burst.
+  std::atomic<zx_time_t> burst_start_{0};
+
+  // Wake latency statistics since the last report.
+  std::atomic<uint64_t> latency_total_{0};
+  std::atomic<uint64_t> latency_max_{0};
+  std::atomic<uint64_t> latency_samples_{0};
+
+  thrd_t control_thread_;
+  fbl::Vector<thrd_t> worker_threads_;
+} schedstress;
+
+int SchedStressTest::worker_thread() {
+  int32_t generation = generation_.load();
+  while (!shutdown_.load()) {
+    zx_status_t status = zx_futex_wait(reinterpret_cast<zx_futex_t*>(&generation_), generation,
+                                       ZX_HANDLE_INVALID, zx_deadline_after(ZX_MSEC(100)));
+    if (status != ZX_OK && status != ZX_ERR_BAD_STATE && status != ZX_ERR_TIMED_OUT) {
+      PrintfAlways("sched stress: futex wait failed: %s\n", zx_status_get_string(status));
+      return -1;
+    }
+
+    const int32_t current_generation = generation_.load();
+    if (current_generation == generation) {
+      continue;
+    }
+    generation = current_generation;
+
+    // Record how long it took for this worker to run after the burst started.
+    const zx_time_t now = zx_clock_get_monotonic();
+    const uint64_t latency = now - burst_start_.load();
+    latency_total_.fetch_add(latency);
+    latency_samples_.fetch_add(1);
+    uint64_t max = latency_max_.load();
+    while (latency > max && !latency_max_.compare_exchange_weak(max, latency)) {
+    }
+
+    // Simulate a short request.
+    const zx_time_t spin_deadline = now + rand() % kMaxSpinTime.get();
+    while (zx_clock_get_monotonic() < spin_deadline) {
+    }
+  }
+  return 0;
+}
+
+int SchedStressTest::control_thread() {
+  zx::time deadline = zx::clock::get_monotonic();
+  zx::time next_report = deadline + zx::sec(1);
+  while (!shutdown_.load()) {
+    burst_start_.store(zx_clock_get_monotonic());
+    generation_.fetch_add(1);
+    zx_futex_wake(reinterpret_cast<zx_futex_t*>(&generation_), UINT32_MAX);
+
+    deadline += kBurstPeriod;
+    zx::nanosleep(deadline);
+
+    if (deadline >= next_report) {
+      next_report += zx::sec(1);
+
+      const uint64_t samples = latency_samples_.exchange(0);
+      const uint64_t total = latency_total_.exchange(0);
+      const uint64_t max = latency_max_.exchange(0);
+      if (samples != 0) {
+        Printf("sched stress: wakeups %" PRIu64 " avg latency %" PRIu64 " us max %" PRIu64
+               " us\n",
+               samples, total / samples / 1000, max / 1000);
+      }
+    }
+  }
+  return 0;
+}
+
+zx_status_t SchedStressTest::Start() {
+  const uint32_t num_workers = num_cpus_ * kWorkersPerCpu;
+  PrintfAlways("Sched stress test: using %u workers\n", num_workers);
+
+  auto worker = [](void* arg) -> int {
+    return static_cast<SchedStressTest*>(arg)->worker_thread();
+  };
+  for (uint32_t i = 0; i < num_workers; i++) {
+    thrd_t thread;
+    if (thrd_create_with_name(&thread, worker, this, "sched_worker") != thrd_success) {
+      return ZX_ERR_NO_RESOURCES;
+    }
+    worker_threads_.push_back(thread);
+  }
+
+  auto control = [](void* arg) -> int {
+    return static_cast<SchedStressTest*>(arg)->control_thread();
+  };
+  thrd_create_with_name(&control_thread_, control, this, "sched_control");
+
+  return ZX_OK;
+}
+
+zx_status_t SchedStressTest::Stop() {
+  shutdown_.store(true);
+  thrd_join(control_thread_, nullptr);
+
+  generation_.fetch_add(1);
+  zx_futex_wake(reinterpret_cast<zx_futex_t*>(&generation_), UINT32_MAX);
+  for (auto& thread : worker_threads_) {
+    thrd_join(thread, nullptr);
+  }
+  return ZX_OK;
+}
@@ -0,0 +1,188 @@
+// Copyright 2019 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <fbl/vector.h>
+#include <lib/zx/clock.h>
+#include <lib/zx/vmar.h>
+#include <lib/zx/vmo.h>
+#include <zircon/status.h>
+#include <zircon/syscalls.h>
+
+#include <atomic>
+#include <inttypes.h>
+#include <stdio.h>
+#include <threads.h>
+
+#include "stress_test.h"
+
+// Unmap Stresser
+//
+// Runs a worker on every CPU, all in this process, so that every unmap and
+// protect has to invalidate the TLB entries of the other CPUs running it. Each
+// worker owns a range of address space in which it repeatedly:
+//
+//  - Maps one of two VMOs page by page, each page as a separate mapping.
+//  - Makes the whole range read-only at once, which changes every mapping in
+//    one VMAR operation.
+//  - Checks that every page reads back the value of the VMO it maps.
+//  - Unmaps the whole range at once, and switches to the other VMO.
+//
+// Workers move between CPUs as they run, and each one maps the other VMO where
+// it just unmapped one, so a TLB entry which survives an unmap on any CPU shows
+// up as a page holding the other VMO's value. This includes entries left on
+// CPUs which were not running this process when the unmap happened.
+//
+// Reports the operations per second.
+
+class UnmapStressTest : public StressTest {
+ public:
+  UnmapStressTest() = default;
+  virtual ~UnmapStressTest() = default;
+
+  virtual zx_status_t Start();
+  virtual zx_status_t Stop();
+
+  virtual const char* name() const { return "Unmap Stress"; }
+
+ private:
+  // Pages in the range of each worker, and in each VMO.
+  static constexpr size_t kPages = 16;
+
+  // Value held by page |page| of VMO |vmo|.
+  static uint64_t PageValue(size_t vmo, size_t page) { return (vmo + 1) << 32 | page; }
+
+  int worker_thread();
+  int report_thread();
+
+  std::atomic<bool> shutdown_{false};
+
+  // Rounds of map, protect, check and unmap since the last report.
+  std::atomic<uint64_t> rounds_{0};
+
+  zx::vmo vmos_[2];
+
+  thrd_t report_thread_;
+  fbl::Vector<thrd_t> worker_threads_;
+} unmapstress;
+
+int UnmapStressTest::worker_thread() {
+  const size_t range_size = kPages * ZX_PAGE_SIZE;
+  zx::vmar vmar;
+  uintptr_t base;
+  zx_status_t status = zx::vmar::root_self()->allocate(
+      0, range_size, ZX_VM_CAN_MAP_READ | ZX_VM_CAN_MAP_WRITE | ZX_VM_CAN_MAP_SPECIFIC, &vmar,
+      &base);
+  if (status != ZX_OK) {
+    PrintfAlways("unmap stress: failed to allocate vmar: %s\n", zx_status_get_string(status));
+    return -1;
+  }
+
+  int ret = 0;
+  size_t vmo = 0;
+  while (!shutdown_.load()) {
+    for (size_t page = 0; page < kPages; page++) {
+      uintptr_t addr;
+      status = vmar.map(page * ZX_PAGE_SIZE, vmos_[vmo], page * ZX_PAGE_SIZE, ZX_PAGE_SIZE,
+                        ZX_VM_PERM_READ | ZX_VM_PERM_WRITE | ZX_VM_SPECIFIC, &addr);
+      if (status != ZX_OK) {
+        PrintfAlways("unmap stress: map failed: %s\n", zx_status_get_string(status));
+        ret = -1;
+        break;
+      }
+    }
+    if (ret != 0) {
+      break;
+    }
+
+    status = vmar.protect(base, range_size, ZX_VM_PERM_READ);
+    if (status != ZX_OK) {
+      PrintfAlways("unmap stress: protect failed: %s\n", zx_status_get_string(status));
+      ret = -1;
+      break;
+    }
+
+    for (size_t page = 0; page < kPages; page++) {
+      uint64_t value = *reinterpret_cast<volatile uint64_t*>(base + page * ZX_PAGE_SIZE);
+      if (value != PageValue(vmo, page)) {
+        PrintfAlways("unmap stress: page %zu at %#" PRIxPTR " reads %#" PRIx64
+                     ", expected %#" PRIx64 "\n",
+                     page, base + page * ZX_PAGE_SIZE, value, PageValue(vmo, page));
+        ret = -1;
+        break;
+      }
+    }
+    if (ret != 0) {
+      break;
+    }
+
+    status = vmar.unmap(base, range_size);
+    if (status != ZX_OK) {
+      PrintfAlways("unmap stress: unmap failed: %s\n", zx_status_get_string(status));
+      ret = -1;
+      break;
+    }
+    vmo ^= 1;
+    rounds_.fetch_add(1);
+  }
+
+  vmar.destroy();
+  return ret;
+}
+
+int UnmapStressTest::report_thread() {
+  zx::time next_report = zx::clock::get_monotonic() + zx::sec(1);
+  while (!shutdown_.load()) {
+    zx::nanosleep(next_report);
+    next_report += zx::sec(1);
+
+    Printf("unmap stress: %" PRIu64 " rounds/s\n", rounds_.exchange(0));
+  }
+  return 0;
+}
+
+zx_status_t UnmapStressTest::Start() {
+  PrintfAlways("Unmap stress test: using %u workers of %zu mappings\n", num_cpus_, kPages);
+
+  for (size_t vmo = 0; vmo < 2; vmo++) {
+    zx_status_t status = zx::vmo::create(kPages * ZX_PAGE_SIZE, 0, &vmos_[vmo]);
+    if (status != ZX_OK) {
+      return status;
+    }
+    for (size_t page = 0; page < kPages; page++) {
+      uint64_t value = PageValue(vmo, page);
+      status = vmos_[vmo].write(&value, page * ZX_PAGE_SIZE, sizeof(value));
+      if (status != ZX_OK) {
+        return status;
+      }
+    }
+  }
+
+  auto worker = [](void* arg) -> int {
+    return static_cast<UnmapStressTest*>(arg)->worker_thread();
+  };
+  for (uint32_t i = 0; i < num_cpus_; i++) {
+    thrd_t thread;
+    if (thrd_create_with_name(&thread, worker, this, "unmap_worker") != thrd_success) {
+      return ZX_ERR_NO_RESOURCES;
+    }
+    worker_threads_.push_back(thread);
+  }
+
+  auto report = [](void* arg) -> int {
+    return static_cast<UnmapStressTest*>(arg)->report_thread();
+  };
+  thrd_create_with_name(&report_thread_, report, this, "unmap_report");
+
+  return ZX_OK;
+}
+
+zx_status_t UnmapStressTest::Stop() {
+  shutdown_.store(true);
+  thrd_join(report_thread_, nullptr);
+
+  for (auto& thread : worker_threads_) {
+    thrd_join(thread, nullptr);
+  }
+  return ZX_OK;
+}
@@ -9,11 +9,16 @@
 #include <string.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <vector>
+
 #include <fbl/string.h>
 #include <fbl/unique_fd.h>
 #include <fuchsia/tracing/kernel/c/fidl.h>
 #include <lib/fdio/fdio.h>
+#include <lib/zircon-internal/ktrace.h>
 #include <lib/zx/channel.h>
+#include <lib/zx/clock.h>
 #include <zircon/status.h>
 
 static const char kDevicePath[] = "/dev/misc/ktrace";
@@ -26,9 +31,17 @@ Where <control> is one of:\n\
   stop                - stop tracing\n\
   rewind              - rewind trace buffer\n\
   written             - print bytes written to trace buffer\n\
-    Note: This value doesn't reset on \"rewind\". Instead, the rewind\n\
-    takes effect on the next \"start\".\n\
-  save <path>         - save contents of trace buffer to <path>\n\
+  mode <mode>         - set what happens when a cpu's trace buffer fills,\n\
+                        tracing must be stopped. <mode> is one of:\n\
+    oneshot    - stop tracing (the default)\n\
+    circular   - overwrite the oldest records\n\
+    streaming  - drop new records until the buffer is read\n\
+  save <path>         - save contents of trace buffer to <path>, with the\n\
+                        records of all cpus merged by timestamp\n\
+  stream <group_mask> <seconds> <path>\n\
+                      - trace in streaming mode for <seconds>, saving the\n\
+                        records to <path> as they are recorded. The records\n\
+                        are saved as read from each cpu's buffer, unmerged.\n\
 \n\
 Options:\n\
   --help  - Duh.\n\
@@ -112,6 +125,21 @@ static int DoRewind() {
   return EXIT_SUCCESS;
 }
 
+static int DoSetMode(uint32_t mode) {
+  zx::channel channel{OpenKtraceDeviceAsChannel()};
+  zx_status_t mode_status;
+  zx_status_t status = fuchsia_tracing_kernel_ControllerSetMode(channel.get(), mode, &mode_status);
+  if (status != ZX_OK) {
+    return LogFidlError(status);
+  }
+  if (mode_status != ZX_OK) {
+    fprintf(stderr, "Error setting ktrace mode: %s(%d)\n", zx_status_get_string(mode_status),
+            mode_status);
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
 static int DoWritten() {
   zx::channel channel{OpenKtraceDeviceAsChannel()};
   zx_status_t written_status;
@@ -130,6 +158,59 @@ static int DoWritten() {
   return EXIT_SUCCESS;
 }
 
+static bool WriteAll(int fd, const uint8_t* data, size_t size) {
+  while (size > 0) {
+    ssize_t bytes_written = write(fd, data, size);
+    if (bytes_written <= 0) {
+      fprintf(stderr, "I/O error saving buffer: %s\n", strerror(errno));
+      return false;
+    }
+    data += bytes_written;
+    size -= bytes_written;
+  }
+  return true;
+}
+
+// The kernel returns the metadata followed by the records of each cpu in turn.
+// Reorder them into a single timeline: the metadata in the order read, then the
+// records of all cpus merged by timestamp. The padding at the end of each cpu's
+// buffer is dropped.
+static std::vector<uint8_t> MergeCpuRecords(const std::vector<uint8_t>& trace) {
+  std::vector<uint8_t> merged;
+  merged.reserve(trace.size());
+  std::vector<const ktrace_header_t*> records;
+
+  size_t offset = 0;
+  while (offset + sizeof(ktrace_header_t) <= trace.size()) {
+    auto record = reinterpret_cast<const ktrace_header_t*>(&trace[offset]);
+    const size_t len = KTRACE_LEN(record->tag);
+    if (len == 0 || offset + len > trace.size()) {
+      break;
+    }
+    offset += len;
+
+    if (KTRACE_EVENT(record->tag) == KTRACE_EVENT(TAG_PAD)) {
+      continue;
+    }
+    if (KTRACE_GROUP(record->tag) & KTRACE_GRP_META) {
+      auto bytes = reinterpret_cast<const uint8_t*>(record);
+      merged.insert(merged.end(), bytes, bytes + len);
+    } else {
+      records.push_back(record);
+    }
+  }
+
+  // Records from each cpu are already nearly in order; a stable sort keeps
+  // records with equal timestamps in the order they were recorded.
+  std::stable_sort(records.begin(), records.end(),
+                   [](const ktrace_header_t* a, const ktrace_header_t* b) { return a->ts < b->ts; });
+  for (const ktrace_header_t* record : records) {
+    auto bytes = reinterpret_cast<const uint8_t*>(record);
+    merged.insert(merged.end(), bytes, bytes + KTRACE_LEN(record->tag));
+  }
+  return merged;
+}
+
 static int DoSave(const char* path) {
   fbl::unique_fd in_fd{OpenKtraceDeviceAsFd()};
   fbl::unique_fd out_fd(open(path, O_CREAT | O_TRUNC | O_WRONLY, 0666));
@@ -138,18 +219,74 @@ static int DoSave(const char* path) {
     return EXIT_FAILURE;
   }
 
-  // Read/write this many bytes at a time.
+  // Records of different cpus can only be merged once all are read.
+  std::vector<uint8_t> trace;
   char buf[4096];
   ssize_t bytes_read;
   while ((bytes_read = read(in_fd.get(), buf, sizeof(buf))) > 0) {
-    ssize_t bytes_written = write(out_fd.get(), buf, bytes_read);
-    if (bytes_written < 0) {
-      fprintf(stderr, "I/O error saving buffer: %s\n", strerror(errno));
+    trace.insert(trace.end(), buf, buf + bytes_read);
+  }
+  if (bytes_read < 0) {
+    fprintf(stderr, "I/O error reading buffer: %s\n", strerror(errno));
+    return EXIT_FAILURE;
+  }
+
+  std::vector<uint8_t> merged = MergeCpuRecords(trace);
+  if (!WriteAll(out_fd.get(), merged.data(), merged.size())) {
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+static int DoStream(uint32_t group_mask, uint32_t seconds, const char* path) {
+  fbl::unique_fd out_fd(open(path, O_CREAT | O_TRUNC | O_WRONLY, 0666));
+  if (!out_fd.is_valid()) {
+    fprintf(stderr, "Unable to open file for writing: %s, %s\n", path, strerror(errno));
+    return EXIT_FAILURE;
+  }
+
+  // The mode can only be changed while tracing is stopped.
+  int ret = DoStop();
+  if (ret == EXIT_SUCCESS) {
+    ret = DoSetMode(KTRACE_MODE_STREAMING);
+  }
+  if (ret == EXIT_SUCCESS) {
+    ret = DoRewind();
+  }
+  if (ret == EXIT_SUCCESS) {
+    ret = DoStart(group_mask);
+  }
+  if (ret != EXIT_SUCCESS) {
+    return ret;
+  }
+
+  // Every read drains the records it returns, so keep reading until tracing
+  // has been stopped and the buffers are empty.
+  fbl::unique_fd in_fd{OpenKtraceDeviceAsFd()};
+  const zx::time deadline = zx::deadline_after(zx::sec(seconds));
+  bool stopped = false;
+  std::vector<uint8_t> buf(65536);
+  for (;;) {
+    ssize_t bytes_read = read(in_fd.get(), buf.data(), buf.size());
+    if (bytes_read < 0) {
+      fprintf(stderr, "I/O error reading buffer: %s\n", strerror(errno));
+      DoStop();
       return EXIT_FAILURE;
     }
-    if (bytes_written != bytes_read) {
-      fprintf(stderr, "Short write saving buffer: %zd vs %zd\n", bytes_written, bytes_read);
-      return EXIT_FAILURE;
+    if (bytes_read > 0) {
+      if (!WriteAll(out_fd.get(), buf.data(), bytes_read)) {
+        DoStop();
+        return EXIT_FAILURE;
+      }
+    } else if (stopped) {
+      break;
+    } else if (zx::clock::get_monotonic() >= deadline) {
+      if ((ret = DoStop()) != EXIT_SUCCESS) {
+        return ret;
+      }
+      stopped = true;
+    } else {
+      zx::nanosleep(zx::deadline_after(zx::msec(100)));
     }
   }
 
@@ -193,10 +330,36 @@ int main(int argc, char** argv) {
   } else if (cmd == "written") {
     EnsureNArgs(cmd, argc, 2);
     return DoWritten();
+  } else if (cmd == "mode") {
+    EnsureNArgs(cmd, argc, 3);
+    const fbl::String mode{argv[2]};
+    if (mode == "oneshot") {
+      return DoSetMode(KTRACE_MODE_ONESHOT);
+    } else if (mode == "circular") {
+      return DoSetMode(KTRACE_MODE_CIRCULAR);
+    } else if (mode == "streaming") {
+      return DoSetMode(KTRACE_MODE_STREAMING);
+    }
+    fprintf(stderr, "Invalid mode\n");
+    return EXIT_FAILURE;
   } else if (cmd == "save") {
     EnsureNArgs(cmd, argc, 3);
     const char* path = argv[2];
     return DoSave(path);
+  } else if (cmd == "stream") {
+    EnsureNArgs(cmd, argc, 5);
+    int group_mask = atoi(argv[2]);
+    if (group_mask < 0) {
+      fprintf(stderr, "Invalid group mask\n");
+      return EXIT_FAILURE;
+    }
+    int seconds = atoi(argv[3]);
+    if (seconds <= 0) {
+      fprintf(stderr, "Invalid number of seconds\n");
+      return EXIT_FAILURE;
+    }
+    const char* path = argv[4];
+    return DoStream(group_mask, seconds, path);
   }
 
   PrintUsage(stderr);
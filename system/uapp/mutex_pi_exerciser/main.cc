@@ -6,12 +6,14 @@
 #include <lib/sync/condition.h>
 #include <lib/sync/mutex.h>
 #include <pthread.h>
+#include <string.h>
 #include <vector>
 #include <zircon/assert.h>
 #include <lib/zircon-internal/thread_annotations.h>
 #include <zircon/types.h>
 
 #include "event.h"
+#include "scaling.h"
 #include "thread.h"
 #include "tracer.h"
 #include "utils.h"
@@ -365,6 +367,12 @@ int main(int argc, char** argv) {
   zx_status_t res;
   ThreadCollection threads;
 
+  // The scaling test is a throughput measurement, not a PI trace, so it runs
+  // on its own and does not need the tracer or the scheduler service.
+  if ((argc > 1) && !strcmp(argv[1], "scaling")) {
+    return (ExerciseKernelMutexScaling() == ZX_OK) ? 0 : -1;
+  }
+
   // Create the thread objects for the threads we will use during testing.  We
   // don't actually want to create new threads for each pass of the testing as
   // that makes the traces difficult to read.  Having one set we use over and
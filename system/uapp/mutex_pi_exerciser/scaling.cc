@@ -0,0 +1,90 @@
+// Copyright 2019 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "scaling.h"
+
+#include <lib/start-together/start-together.h>
+#include <lib/zx/clock.h>
+#include <lib/zx/time.h>
+#include <lib/zx/vmo.h>
+#include <stdio.h>
+#include <zircon/syscalls.h>
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace {
+
+// Each operation writes this much to a VMO while holding the VMO's kernel
+// mutex.  It needs to be large enough that a pile of writers outlasts the
+// mutex's adaptive spin and ends up blocking in the kernel.
+constexpr size_t kWriteSize = 16 * ZX_PAGE_SIZE;
+constexpr zx::duration kTrialDuration = zx::sec(1);
+
+enum class Sharing { SharedVmo, PrivateVmos };
+
+// Run |thread_count| threads writing to VMOs for kTrialDuration, and return
+// the aggregate number of writes completed per second, or a negative status on
+// failure.
+int64_t RunTrial(uint32_t thread_count, Sharing sharing) {
+  std::vector<zx::vmo> vmos(sharing == Sharing::SharedVmo ? 1 : thread_count);
+  for (auto& vmo : vmos) {
+    zx_status_t res = zx::vmo::create(kWriteSize, 0, &vmo);
+    if (res != ZX_OK) {
+      fprintf(stderr, "Failed to create VMO (res = %d)\n", res);
+      return res;
+    }
+  }
+
+  std::atomic<int64_t> total_ops{0};
+  zx::duration elapsed;
+  zx_status_t res = start_together::RunTogether(
+      thread_count,
+      [&vmos, &total_ops](uint32_t index) -> zx_status_t {
+        const zx::vmo& vmo = vmos[index % vmos.size()];
+        auto buf = std::make_unique<uint8_t[]>(kWriteSize);
+        int64_t ops = 0;
+
+        // The threads are released together, so their deadlines line up.
+        const zx::time deadline = zx::deadline_after(kTrialDuration);
+        while (zx::clock::get_monotonic() < deadline) {
+          vmo.write(buf.get(), 0, kWriteSize);
+          ++ops;
+        }
+
+        total_ops.fetch_add(ops);
+        return ZX_OK;
+      },
+      &elapsed);
+  if (res != ZX_OK) {
+    fprintf(stderr, "Failed to run writer threads (res = %d)\n", res);
+    return res;
+  }
+
+  return total_ops.load() * ZX_SEC(1) / elapsed.get();
+}
+
+}  // namespace
+
+zx_status_t ExerciseKernelMutexScaling() {
+  const uint32_t max_threads = zx_system_get_num_cpus() * 2;
+
+  printf("%8s %16s %16s\n", "threads", "shared ops/s", "private ops/s");
+  for (uint32_t thread_count = 1; thread_count <= max_threads; thread_count *= 2) {
+    int64_t shared_ops = RunTrial(thread_count, Sharing::SharedVmo);
+    if (shared_ops < 0) {
+      return static_cast<zx_status_t>(shared_ops);
+    }
+
+    int64_t private_ops = RunTrial(thread_count, Sharing::PrivateVmos);
+    if (private_ops < 0) {
+      return static_cast<zx_status_t>(private_ops);
+    }
+
+    printf("%8u %16ld %16ld\n", thread_count, shared_ops, private_ops);
+  }
+
+  return ZX_OK;
+}
@@ -0,0 +1,11 @@
+// Copyright 2019 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <zircon/types.h>
+
+// Measure how the throughput of a contended kernel mutex scales with the
+// number of threads contending for it.  See README.md for details.
+zx_status_t ExerciseKernelMutexScaling();
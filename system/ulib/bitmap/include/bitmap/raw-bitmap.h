@@ -12,6 +12,7 @@
 #include <string.h>
 
 #include <fbl/algorithm.h>
+#include <fbl/array.h>
 #include <fbl/macros.h>
 #include <zircon/assert.h>
 #include <zircon/types.h>
@@ -75,11 +76,33 @@ class RawBitmapBase : public Bitmap {
   // Clear all bits in the bitmap.
   void ClearAll() override;
 
+  // Builds a summary of the bitmap, which lets Scan, Find and their reverse
+  // variants skip over groups of kBits words whose bits are all set or all
+  // clear. Once built, the summary is kept up to date by Set, Clear, Reset
+  // and Grow; bits written to the storage directly are only accounted for
+  // by calling BuildSummary again. Allocates memory, and can fail.
+  zx_status_t BuildSummary();
+
  protected:
+  // Rebuilds the summary, if one was built, after the storage changed.
+  zx_status_t RefreshSummary() { return summarized_ ? BuildSummary() : ZX_OK; }
+
   // The size of this bitmap, in bits.
   size_t size_ = 0;
   // Owned by bits_, cached
   size_t* data_ = nullptr;
+
+ private:
+  // Returns true if all the bits of summary group |group| match |is_set|.
+  bool GroupMatches(size_t group, bool is_set) const;
+
+  // Accounts for word |idx| changing from |old_word| to |new_word|.
+  void UpdateSummary(size_t idx, size_t old_word, size_t new_word);
+
+  // True once BuildSummary succeeded.
+  bool summarized_ = false;
+  // The number of bits set in each group of kBits words.
+  fbl::Array<uint16_t> summary_;
 };
 
 // A simple bitmap backed by generic storage.
@@ -128,7 +151,7 @@ class RawBitmapGeneric final : public RawBitmapBase {
 
     // Clear the partial bits not included in the new "size_t"s.
     Clear(old_size, fbl::min(old_len * kBits, size_));
-    return ZX_OK;
+    return RefreshSummary();
   }
 
   template <typename U = Storage>
@@ -142,7 +165,7 @@ class RawBitmapGeneric final : public RawBitmapBase {
     size_ = size;
     if (size_ == 0) {
       data_ = nullptr;
-      return ZX_OK;
+      return RefreshSummary();
     }
     size_t last_idx = LastIdx(size);
     zx_status_t status = bits_.Allocate(sizeof(size_t) * (last_idx + 1));
@@ -151,7 +174,7 @@ class RawBitmapGeneric final : public RawBitmapBase {
     }
     data_ = static_cast<size_t*>(bits_.GetData());
     ClearAll();
-    return ZX_OK;
+    return RefreshSummary();
   }
 
   // This function allows access to underlying data, but is dangerous: It
@@ -8,7 +8,10 @@
 #include <limits.h>
 #include <stddef.h>
 
+#include <utility>
+
 #include <fbl/algorithm.h>
+#include <fbl/alloc_checker.h>
 #include <fbl/macros.h>
 #include <zircon/types.h>
 
@@ -18,6 +21,11 @@ namespace {
 // Translates a bit offset into a starting index in the bitmap array.
 constexpr size_t FirstIdx(size_t bitoff) { return bitoff / kBits; }
 
+// The number of words, and of bits, summarized by each entry of the summary.
+constexpr size_t kGroupWords = kBits;
+constexpr size_t kGroupBits = kGroupWords * kBits;
+static_assert(kGroupBits <= UINT16_MAX, "summary entries cannot count the bits of a group");
+
 // GetMask returns a 64-bit bitmask. If the block of the bitmap we're looking
 // at isn't the first or last, all bits are set.  Otherwise, the bits outside of
 // [off,max) are cleared.  Bits are counted with the LSB as 0 and the MSB as 63.
@@ -59,12 +67,15 @@ size_t MaskBits(size_t data, size_t idx, size_t bitoff, size_t bitmax, bool is_s
 #if (SIZE_MAX == UINT_MAX)
 #define CLZ(x) (x == 0 ? kBits : __builtin_clz(x))
 #define CTZ(x) (x == 0 ? kBits : __builtin_ctz(x))
+#define POPCOUNT(x) __builtin_popcount(x)
 #elif (SIZE_MAX == ULONG_MAX)
 #define CLZ(x) (x == 0 ? kBits : __builtin_clzl(x))
 #define CTZ(x) (x == 0 ? kBits : __builtin_ctzl(x))
+#define POPCOUNT(x) __builtin_popcountl(x)
 #elif (SIZE_MAX == ULLONG_MAX)
 #define CLZ(x) (x == 0 ? kBits : __builtin_clzll(x))
 #define CTZ(x) (x == 0 ? kBits : __builtin_ctzll(x))
+#define POPCOUNT(x) __builtin_popcountll(x)
 #else
 #error "Unsupported size_t length"
 #endif
@@ -84,16 +95,30 @@ bool RawBitmapBase::Scan(size_t bitoff, size_t bitmax, bool is_set, size_t* out)
   if (bitoff >= bitmax) {
     return true;
   }
-  size_t i = FirstIdx(bitoff);
+  const size_t first_idx = FirstIdx(bitoff);
+  const size_t last_idx = LastIdx(bitmax);
+  // The value of the words whose bits all match is_set.
+  const size_t match = is_set ? ~size_t(0) : 0;
+  size_t i = first_idx;
   while (true) {
-    size_t masked = MaskBits(data_[i], i, bitoff, bitmax, is_set);
+    if (summarized_ && (i == first_idx || i % kGroupWords == 0) &&
+        GroupMatches(i / kGroupWords, is_set)) {
+      i = fbl::round_up(i + 1, kGroupWords);
+      if (i > last_idx) {
+        return true;
+      }
+      continue;
+    }
+    size_t masked = (i == first_idx || i == last_idx)
+                        ? MaskBits(data_[i], i, bitoff, bitmax, is_set)
+                        : data_[i] ^ match;
     if (masked != 0) {
       if (out) {
         *out = i * bitmap::kBits + CTZ(masked);
       }
       return false;
     }
-    if (i == LastIdx(bitmax)) {
+    if (i == last_idx) {
       return true;
     }
     ++i;
@@ -105,16 +130,30 @@ bool RawBitmapBase::ReverseScan(size_t bitoff, size_t bitmax, bool is_set, size_
   if (bitoff >= bitmax) {
     return true;
   }
-  size_t i = LastIdx(bitmax);
+  const size_t first_idx = FirstIdx(bitoff);
+  const size_t last_idx = LastIdx(bitmax);
+  const size_t match = is_set ? ~size_t(0) : 0;
+  size_t i = last_idx;
   while (true) {
-    size_t masked = MaskBits(data_[i], i, bitoff, bitmax, is_set);
+    if (summarized_ && (i == last_idx || i % kGroupWords == kGroupWords - 1) &&
+        GroupMatches(i / kGroupWords, is_set)) {
+      const size_t group_start = fbl::round_down(i, kGroupWords);
+      if (group_start <= first_idx) {
+        return true;
+      }
+      i = group_start - 1;
+      continue;
+    }
+    size_t masked = (i == first_idx || i == last_idx)
+                        ? MaskBits(data_[i], i, bitoff, bitmax, is_set)
+                        : data_[i] ^ match;
     if (masked != 0) {
       if (out) {
         *out = (i + 1) * bitmap::kBits - (CLZ(masked) + 1);
       }
       return false;
     }
-    if (i == FirstIdx(bitoff)) {
+    if (i == first_idx) {
       return true;
     }
     --i;
@@ -178,7 +217,11 @@ zx_status_t RawBitmapBase::Set(size_t bitoff, size_t bitmax) {
   size_t first_idx = FirstIdx(bitoff);
   size_t last_idx = LastIdx(bitmax);
   for (size_t i = first_idx; i <= last_idx; ++i) {
+    const size_t old_word = data_[i];
     data_[i] |= GetMask(i == first_idx, i == last_idx, bitoff, bitmax);
+    if (summarized_) {
+      UpdateSummary(i, old_word, data_[i]);
+    }
   }
   return ZX_OK;
 }
@@ -193,7 +236,11 @@ zx_status_t RawBitmapBase::Clear(size_t bitoff, size_t bitmax) {
   size_t first_idx = FirstIdx(bitoff);
   size_t last_idx = LastIdx(bitmax);
   for (size_t i = first_idx; i <= last_idx; ++i) {
+    const size_t old_word = data_[i];
     data_[i] &= ~(GetMask(i == first_idx, i == last_idx, bitoff, bitmax));
+    if (summarized_) {
+      UpdateSummary(i, old_word, data_[i]);
+    }
   }
   return ZX_OK;
 }
@@ -206,6 +253,40 @@ void RawBitmapBase::ClearAll() {
   for (size_t i = 0; i <= last_idx; ++i) {
     data_[i] = 0;
   }
+  for (size_t group = 0; group < summary_.size(); ++group) {
+    summary_[group] = 0;
+  }
+}
+
+zx_status_t RawBitmapBase::BuildSummary() {
+  const size_t words = size_ == 0 ? 0 : LastIdx(size_) + 1;
+  const size_t groups = fbl::round_up(words, kGroupWords) / kGroupWords;
+  fbl::AllocChecker ac;
+  fbl::Array<uint16_t> summary(new (&ac) uint16_t[groups](), groups);
+  if (!ac.check()) {
+    summarized_ = false;
+    summary_.reset();
+    return ZX_ERR_NO_MEMORY;
+  }
+  for (size_t i = 0; i < words; ++i) {
+    summary[i / kGroupWords] = static_cast<uint16_t>(summary[i / kGroupWords] + POPCOUNT(data_[i]));
+  }
+  summary_ = std::move(summary);
+  summarized_ = true;
+  return ZX_OK;
+}
+
+bool RawBitmapBase::GroupMatches(size_t group, bool is_set) const {
+  // The last group may extend past the end of the bitmap, and is always scanned.
+  if ((group + 1) * kGroupBits > size_ || group >= summary_.size()) {
+    return false;
+  }
+  return summary_[group] == (is_set ? kGroupBits : 0);
+}
+
+void RawBitmapBase::UpdateSummary(size_t idx, size_t old_word, size_t new_word) {
+  uint16_t& count = summary_[idx / kGroupWords];
+  count = static_cast<uint16_t>(count + POPCOUNT(new_word) - POPCOUNT(old_word));
 }
 
 }  // namespace bitmap
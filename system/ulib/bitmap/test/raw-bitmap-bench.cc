@@ -0,0 +1,69 @@
+// Copyright 2019 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <bitmap/raw-bitmap.h>
+#include <bitmap/storage.h>
+#include <zircon/assert.h>
+
+#include <fbl/string.h>
+#include <fbl/string_printf.h>
+#include <perftest/perftest.h>
+
+// Measures how long RawBitmap::Find takes to find free bits in large, nearly full bitmaps, as
+// filesystem allocators do, with and without a summary.
+
+namespace bitmap {
+namespace {
+
+// The distance between the lone clear bits left in the bitmap when looking for longer runs.
+constexpr size_t kHoleStride = 1 << 16;
+
+bool FindTest(perftest::RepeatState* state, size_t bits, size_t run_len, bool summarize) {
+  RawBitmapGeneric<DefaultStorage> bitmap;
+  ZX_ASSERT(bitmap.Reset(bits) == ZX_OK);
+  if (summarize) {
+    ZX_ASSERT(bitmap.BuildSummary() == ZX_OK);
+  }
+  ZX_ASSERT(bitmap.Set(0, bits) == ZX_OK);
+
+  // The only run which is long enough is near the end of the bitmap. Runs which are too short
+  // are scattered before it.
+  const size_t target = bits - bits / 10;
+  if (run_len > 1) {
+    for (size_t bit = kHoleStride; bit < target; bit += kHoleStride) {
+      ZX_ASSERT(bitmap.ClearOne(bit) == ZX_OK);
+    }
+  }
+  ZX_ASSERT(bitmap.Clear(target, target + run_len) == ZX_OK);
+
+  while (state->KeepRunning()) {
+    size_t out;
+    ZX_ASSERT(bitmap.Find(false, 0, bits, run_len, &out) == ZX_OK);
+    ZX_ASSERT(out == target);
+  }
+  return true;
+}
+
+void RegisterTests() {
+  static const size_t kMegabits[] = {1, 10, 100};
+  static const size_t kRunLengths[] = {1, 64};
+  for (size_t megabits : kMegabits) {
+    for (size_t run_len : kRunLengths) {
+      for (bool summarize : {false, true}) {
+        fbl::String name =
+            fbl::StringPrintf("RawBitmap/Find/%zuMbits/Run%zu/%s", megabits, run_len,
+                              summarize ? "Summary" : "NoSummary");
+        perftest::RegisterTest(name.c_str(), FindTest, megabits * 1000000, run_len, summarize);
+      }
+    }
+  }
+}
+PERFTEST_CTOR(RegisterTests)
+
+}  // namespace
+}  // namespace bitmap
+
+int main(int argc, char** argv) {
+  return perftest::PerfTestMain(argc, argv, "fuchsia.zircon.bitmap");
+}
@@ -542,6 +542,141 @@ static bool GrowShrink(void) {
   END_TEST;
 }
 
+// Returns a pseudo-random number in [0, max), updating |seed|.
+static size_t Random(uint64_t* seed, size_t max) {
+  *seed = *seed * 6364136223846793005ull + 1442695040888963407ull;
+  return static_cast<size_t>(*seed >> 33) % max;
+}
+
+// Checks that Scan, Find and their reverse variants return the same results on |bitmap| and
+// |reference| across random ranges.
+template <typename RawBitmap>
+static bool SameScans(const RawBitmap& bitmap, const RawBitmap& reference, uint64_t* seed) {
+  BEGIN_HELPER;
+  for (int i = 0; i < 200; i++) {
+    size_t bitoff = Random(seed, bitmap.size());
+    size_t bitmax = bitoff + 1 + Random(seed, bitmap.size() - bitoff);
+    bool is_set = Random(seed, 2) == 1;
+
+    size_t out = 0, reference_out = 0;
+    EXPECT_EQ(bitmap.Scan(bitoff, bitmax, is_set, &out),
+              reference.Scan(bitoff, bitmax, is_set, &reference_out));
+    EXPECT_EQ(out, reference_out);
+    out = reference_out = 0;
+    EXPECT_EQ(bitmap.ReverseScan(bitoff, bitmax, is_set, &out),
+              reference.ReverseScan(bitoff, bitmax, is_set, &reference_out));
+    EXPECT_EQ(out, reference_out);
+
+    size_t run_len = 1 + Random(seed, 2 * kBits);
+    out = reference_out = 0;
+    EXPECT_EQ(bitmap.Find(is_set, bitoff, bitmax, run_len, &out),
+              reference.Find(is_set, bitoff, bitmax, run_len, &reference_out));
+    EXPECT_EQ(out, reference_out);
+    out = reference_out = 0;
+    EXPECT_EQ(bitmap.ReverseFind(is_set, bitoff, bitmax, run_len, &out),
+              reference.ReverseFind(is_set, bitoff, bitmax, run_len, &reference_out));
+    EXPECT_EQ(out, reference_out);
+  }
+  END_HELPER;
+}
+
+template <typename RawBitmap>
+static bool Summary(void) {
+  BEGIN_TEST;
+
+  // Several groups of kBits words, followed by a partial group.
+  const size_t kSize = 5 * kBits * kBits + 100;
+  RawBitmap bitmap, reference;
+  ASSERT_EQ(bitmap.Reset(kSize), ZX_OK);
+  ASSERT_EQ(reference.Reset(kSize), ZX_OK);
+  ASSERT_EQ(bitmap.BuildSummary(), ZX_OK);
+
+  // Entirely set groups are skipped.
+  ASSERT_EQ(bitmap.Set(kBits * kBits - 1, 4 * kBits * kBits + 1), ZX_OK);
+  ASSERT_EQ(reference.Set(kBits * kBits - 1, 4 * kBits * kBits + 1), ZX_OK);
+  size_t out;
+  EXPECT_FALSE(bitmap.Scan(kBits * kBits, kSize, true, &out));
+  EXPECT_EQ(out, 4 * kBits * kBits + 1);
+  EXPECT_FALSE(bitmap.ReverseScan(0, 4 * kBits * kBits, true, &out));
+  EXPECT_EQ(out, kBits * kBits - 2);
+  EXPECT_EQ(bitmap.Find(false, kBits * kBits - 1, kSize, 10, &out), ZX_OK);
+  EXPECT_EQ(out, 4 * kBits * kBits + 1);
+
+  uint64_t seed = 1;
+  ASSERT_TRUE(SameScans(bitmap, reference, &seed));
+
+  // Random ranges of bits are set and cleared, which may make groups entirely set or clear.
+  for (int i = 0; i < 1000; i++) {
+    size_t bitoff = Random(&seed, kSize);
+    size_t bitmax = bitoff + Random(&seed, fbl::min(kSize - bitoff, 3 * kBits * kBits));
+    if (Random(&seed, 2) == 0) {
+      ASSERT_EQ(bitmap.Set(bitoff, bitmax), ZX_OK);
+      ASSERT_EQ(reference.Set(bitoff, bitmax), ZX_OK);
+    } else {
+      ASSERT_EQ(bitmap.Clear(bitoff, bitmax), ZX_OK);
+      ASSERT_EQ(reference.Clear(bitoff, bitmax), ZX_OK);
+    }
+    if (i % 50 == 0) {
+      ASSERT_TRUE(SameScans(bitmap, reference, &seed));
+    }
+  }
+
+  // Bits written to the storage directly are accounted for once the summary is rebuilt.
+  ASSERT_EQ(bitmap.Set(0, kSize), ZX_OK);
+  ASSERT_EQ(reference.Set(0, kSize), ZX_OK);
+  size_t* data = static_cast<size_t*>(const_cast<void*>(bitmap.StorageUnsafe()->GetData()));
+  data[2 * kBits + 3] = 0;
+  ASSERT_EQ(bitmap.BuildSummary(), ZX_OK);
+  ASSERT_EQ(reference.Clear((2 * kBits + 3) * kBits, (2 * kBits + 4) * kBits), ZX_OK);
+  EXPECT_FALSE(bitmap.Scan(0, kSize, true, &out));
+  EXPECT_EQ(out, (2 * kBits + 3) * kBits);
+  ASSERT_TRUE(SameScans(bitmap, reference, &seed));
+
+  bitmap.ClearAll();
+  EXPECT_TRUE(bitmap.Scan(0, kSize, false));
+  EXPECT_EQ(bitmap.Find(false, 0, kSize, kSize, &out), ZX_OK);
+  EXPECT_EQ(out, 0u);
+
+  END_TEST;
+}
+
+template <typename RawBitmap>
+static bool SummaryGrowShrink(void) {
+  BEGIN_TEST;
+
+  RawBitmap bitmap, reference;
+  ASSERT_EQ(bitmap.Reset(2 * kBits * kBits), ZX_OK);
+  ASSERT_EQ(reference.Reset(2 * kBits * kBits), ZX_OK);
+  ASSERT_EQ(bitmap.BuildSummary(), ZX_OK);
+  ASSERT_EQ(bitmap.Set(0, 2 * kBits * kBits), ZX_OK);
+  ASSERT_EQ(reference.Set(0, 2 * kBits * kBits), ZX_OK);
+
+  // Shrinking leaves a partial group, which is never skipped.
+  ASSERT_EQ(bitmap.Shrink(2 * kBits * kBits - 1), ZX_OK);
+  ASSERT_EQ(reference.Shrink(2 * kBits * kBits - 1), ZX_OK);
+  uint64_t seed = 2;
+  ASSERT_TRUE(SameScans(bitmap, reference, &seed));
+
+  // Growing clears the bits past the old size, and summarizes the new groups.
+  ASSERT_EQ(bitmap.Grow(6 * kBits * kBits), ZX_OK);
+  ASSERT_EQ(reference.Grow(6 * kBits * kBits), ZX_OK);
+  size_t out;
+  EXPECT_FALSE(bitmap.Scan(0, bitmap.size(), true, &out));
+  EXPECT_EQ(out, 2 * kBits * kBits - 1);
+  ASSERT_EQ(bitmap.Set(3 * kBits * kBits, 5 * kBits * kBits), ZX_OK);
+  ASSERT_EQ(reference.Set(3 * kBits * kBits, 5 * kBits * kBits), ZX_OK);
+  ASSERT_TRUE(SameScans(bitmap, reference, &seed));
+
+  // Resetting keeps summarizing the bitmap.
+  ASSERT_EQ(bitmap.Reset(3 * kBits * kBits), ZX_OK);
+  ASSERT_EQ(reference.Reset(3 * kBits * kBits), ZX_OK);
+  ASSERT_EQ(bitmap.Set(kBits, 3 * kBits * kBits), ZX_OK);
+  ASSERT_EQ(reference.Set(kBits, 3 * kBits * kBits), ZX_OK);
+  ASSERT_TRUE(SameScans(bitmap, reference, &seed));
+
+  END_TEST;
+}
+
 template <typename RawBitmap>
 static bool GrowFailure(void) {
   BEGIN_TEST;
@@ -569,7 +704,8 @@ static bool GrowFailure(void) {
   RUN_TEMPLATIZED_TEST(ClearSubrange, specialization)     \
   RUN_TEMPLATIZED_TEST(BoundaryArguments, specialization) \
   RUN_TEMPLATIZED_TEST(ClearAll, specialization)          \
-  RUN_TEMPLATIZED_TEST(SetOutOfOrder, specialization)
+  RUN_TEMPLATIZED_TEST(SetOutOfOrder, specialization)     \
+  RUN_TEMPLATIZED_TEST(Summary, specialization)
 
 BEGIN_TEST_CASE(raw_bitmap_tests)
 ALL_TESTS(RawBitmapGeneric<DefaultStorage>)
@@ -578,6 +714,7 @@ RUN_TEST(MoveConstructorTest<RawBitmapGeneric<VmoStorage>>)
 RUN_TEST(MoveAssignmentTest<RawBitmapGeneric<VmoStorage>>)
 RUN_TEST(GrowAcrossPage<RawBitmapGeneric<VmoStorage>>)
 RUN_TEST(GrowShrink<RawBitmapGeneric<VmoStorage>>)
+RUN_TEST(SummaryGrowShrink<RawBitmapGeneric<VmoStorage>>)
 RUN_TEST(GrowFailure<RawBitmapGeneric<DefaultStorage>>)
 END_TEST_CASE(raw_bitmap_tests)
 
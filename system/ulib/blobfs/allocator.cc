@@ -87,7 +87,11 @@ zx_status_t Allocator::ResetFromStorage(fs::ReadTxn txn) {
   txn.Enqueue(block_map_vmoid, 0, BlockMapStartBlock(info), BlockMapBlocks(info));
   txn.Enqueue(node_map_vmoid, 0, NodeMapStartBlock(info), NodeMapBlocks(info));
 
-  return txn.Transact();
+  if ((status = txn.Transact()) != ZX_OK) {
+    return status;
+  }
+  // The block map was read into its storage directly.
+  return block_map_.BuildSummary();
 }
 
 const zx::vmo& Allocator::GetBlockMapVmo() const { return block_map_.StorageUnsafe()->GetVmo(); }
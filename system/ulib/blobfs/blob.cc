@@ -17,6 +17,7 @@
 #include <vector>
 
 #include <blobfs/blobfs.h>
+#include <blobfs/compression/chunked.h>
 #include <blobfs/compression/lz4.h>
 #include <blobfs/compression/zstd.h>
 #include <blobfs/iterator/allocated-extent-iterator.h>
@@ -44,6 +45,11 @@ using digest::MerkleTree;
 // "blob-1abc8" or "compressedBlob-5c"
 constexpr char kBlobVmoNamePrefix[] = "blob";
 constexpr char kCompressedBlobVmoNamePrefix[] = "compressedBlob";
+constexpr char kMerkleVmoNamePrefix[] = "blobMerkle";
+constexpr char kTransferVmoNamePrefix[] = "blobTransfer";
+
+// Hashing and decompressing whole blobs is split between up to one thread per CPU.
+size_t WorkerThreadCount() { return zx_system_get_num_cpus(); }
 
 void FormatVmoName(const char* prefix, fbl::StringBuffer<ZX_MAX_NAME_LEN>* vmo_name, size_t index) {
   vmo_name->Clear();
@@ -65,7 +71,8 @@ zx_status_t Blob::Verify() const {
   //
   // For now, we aggressively verify the entire VMO up front.
   Digest digest(GetKey());
-  zx_status_t status = MerkleTree::Verify(data, data_size, tree, merkle_size, 0, data_size, digest);
+  zx_status_t status = MerkleTree::VerifyParallel(data, data_size, tree, merkle_size, 0, data_size,
+                                                  digest, WorkerThreadCount());
   blobfs_->Metrics().UpdateMerkleVerify(data_size, merkle_size, ticker.End());
 
   if (status != ZX_OK) {
@@ -80,7 +87,7 @@ zx_status_t Blob::Verify() const {
 zx_status_t Blob::InitVmos() {
   TRACE_DURATION("blobfs", "Blobfs::InitVmos");
 
-  if (mapping_.vmo()) {
+  if (mapping_.vmo() || paged_vmo_) {
     return ZX_OK;
   }
 
@@ -96,6 +103,17 @@ zx_status_t Blob::InitVmos() {
   // Reverts blob back to uninitialized state on error.
   auto cleanup = fbl::MakeAutoCall([this]() { BlobCloseHandles(); });
 
+  // LZ4 and ZSTD blobs can only be decompressed as a whole, so they are still read up front.
+  const uint16_t streamed = kBlobFlagLZ4Compressed | kBlobFlagZSTDCompressed;
+  if (blobfs_->pager() != nullptr && (inode_.header.flags & streamed) == 0) {
+    zx_status_t status = InitPaged();
+    if (status != ZX_OK) {
+      return status;
+    }
+    cleanup.cancel();
+    return ZX_OK;
+  }
+
   size_t vmo_size;
   if (mul_overflow(num_blocks, kBlobfsBlockSize, &vmo_size)) {
     FS_TRACE_ERROR("Multiplication overflow");
@@ -122,6 +140,10 @@ zx_status_t Blob::InitVmos() {
     if ((status = InitCompressed(CompressionAlgorithm::ZSTD)) != ZX_OK) {
       return status;
     }
+  } else if ((inode_.header.flags & kBlobFlagChunkCompressed) != 0) {
+    if ((status = InitCompressed(CompressionAlgorithm::CHUNKED)) != ZX_OK) {
+      return status;
+    }
   } else {
     if ((status = InitUncompressed()) != ZX_OK) {
       return status;
@@ -135,6 +157,100 @@ zx_status_t Blob::InitVmos() {
   return ZX_OK;
 }
 
+zx_status_t Blob::InitPaged() {
+  TRACE_DURATION("blobfs", "Blobfs::InitPaged", "size", inode_.blob_size, "blocks",
+                 inode_.block_count);
+  fs::Ticker ticker(blobfs_->Metrics().Collecting());
+  const uint32_t merkle_blocks = MerkleTreeBlocks(inode_);
+  if (inode_.block_count < merkle_blocks) {
+    return ZX_ERR_IO_DATA_INTEGRITY;
+  }
+  // For compressed blobs, these hold the compressed data.
+  const uint32_t data_blocks = inode_.block_count - merkle_blocks;
+
+  // The Merkle tree is read now, since every page request needs it.
+  fbl::StringBuffer<ZX_MAX_NAME_LEN> vmo_name;
+  fzl::OwnedVmoMapper merkle;
+  vmoid_t merkle_vmoid = VMOID_INVALID;
+  zx_status_t status;
+  if (merkle_blocks > 0) {
+    FormatVmoName(kMerkleVmoNamePrefix, &vmo_name, Ino());
+    if ((status = merkle.CreateAndMap(merkle_blocks * kBlobfsBlockSize, vmo_name.c_str())) !=
+        ZX_OK) {
+      FS_TRACE_ERROR("Failed to initialize merkle vmo; error: %d\n", status);
+      return status;
+    }
+    if ((status = blobfs_->AttachVmo(merkle.vmo(), &merkle_vmoid)) != ZX_OK) {
+      FS_TRACE_ERROR("Failed to attach merkle VMO to block device; error: %d\n", status);
+      return status;
+    }
+  }
+  auto detach = fbl::MakeAutoCall([this, &merkle_vmoid]() {
+    if (merkle_vmoid != VMOID_INVALID) {
+      blobfs_->DetachVmo(merkle_vmoid);
+    }
+  });
+
+  const uint64_t data_start = DataStartBlock(blobfs_->Info());
+  AllocatedExtentIterator extent_iter(blobfs_->GetAllocator(), GetMapIndex());
+  BlockIterator block_iter(&extent_iter);
+  fs::ReadTxn txn(blobfs_);
+  status = StreamBlocks(&block_iter, merkle_blocks,
+                        [&](uint64_t vmo_offset, uint64_t dev_offset, uint32_t length) {
+                          txn.Enqueue(merkle_vmoid, vmo_offset, dev_offset + data_start, length);
+                          return ZX_OK;
+                        });
+  if (status != ZX_OK) {
+    return status;
+  }
+
+  // The data is only located now. The allocator may change while pages are being served on the
+  // pager thread, so the page source gets its own copy of the extents.
+  ZX_DEBUG_ASSERT(block_iter.BlockIndex() == merkle_blocks);
+  fbl::Vector<DataExtent> extents;
+  status = StreamBlocks(&block_iter, data_blocks,
+                        [&](uint64_t vmo_offset, uint64_t dev_offset, uint32_t length) {
+                          extents.push_back({vmo_offset - merkle_blocks, dev_offset, length});
+                          return ZX_OK;
+                        });
+  if (status != ZX_OK) {
+    return status;
+  }
+
+  if ((status = txn.Transact()) != ZX_OK) {
+    FS_TRACE_ERROR("Failed to read merkle tree: %d\n", status);
+    return status;
+  }
+  blobfs_->Metrics().UpdateMerkleDiskRead(merkle_blocks * kBlobfsBlockSize, ticker.End());
+
+  auto source = fbl::MakeRefCounted<PageSource>(blobfs_, blobfs_, &blobfs_->Metrics(), GetKey(),
+                                                inode_.blob_size, data_start, std::move(merkle),
+                                                std::move(extents));
+  FormatVmoName(kTransferVmoNamePrefix, &vmo_name, Ino());
+  const bool chunked = (inode_.header.flags & kBlobFlagChunkCompressed) != 0;
+  if ((status = source->Init(vmo_name.c_str(), chunked)) != ZX_OK) {
+    return status;
+  }
+
+  zx::vmo vmo;
+  if ((status = blobfs_->pager()->CreateVmo(std::move(source), &vmo)) != ZX_OK) {
+    FS_TRACE_ERROR("Failed to create paged vmo; error: %d\n", status);
+    return status;
+  }
+  FormatVmoName(kBlobVmoNamePrefix, &vmo_name, Ino());
+  vmo.set_property(ZX_PROP_NAME, vmo_name.c_str(), vmo_name.length());
+  paged_vmo_ = std::move(vmo);
+  blobfs_->Metrics().UpdatePagedVmo(inode_.blob_size);
+  return ZX_OK;
+}
+
+void Blob::ReleasePagedVmo() {
+  if (paged_vmo_) {
+    blobfs_->pager()->DetachVmo(paged_vmo_);
+    paged_vmo_.reset();
+  }
+}
+
 zx_status_t Blob::InitCompressed(CompressionAlgorithm algorithm) {
   TRACE_DURATION("blobfs", "Blobfs::InitCompressed", "size", inode_.blob_size, "blocks",
                  inode_.block_count);
@@ -214,6 +330,10 @@ zx_status_t Blob::InitCompressed(CompressionAlgorithm algorithm) {
     case CompressionAlgorithm::ZSTD:
       status = ZSTDDecompress(GetData(), &target_size, compressed_buffer, &compressed_size);
       break;
+    case CompressionAlgorithm::CHUNKED:
+      status = ChunkedDecompressParallel(GetData(), &target_size, compressed_buffer,
+                                         &compressed_size, WorkerThreadCount());
+      break;
     default:
       FS_TRACE_ERROR("Unsupported decompression algorithm");
       return ZX_ERR_NOT_SUPPORTED;
@@ -290,6 +410,7 @@ Blob::Blob(Blobfs* bs, const Digest& digest)
 
 void Blob::BlobCloseHandles() {
   mapping_.Reset();
+  ReleasePagedVmo();
   readable_event_.reset();
 }
 
@@ -351,7 +472,8 @@ zx_status_t Blob::SpaceAllocate(uint64_t size_data) {
 
   fbl::StringBuffer<ZX_MAX_NAME_LEN> vmo_name;
   if (inode_.blob_size >= kCompressionMinBytesSaved) {
-    write_info->compressor = BlobCompressor::Create(CompressionAlgorithm::ZSTD, inode_.blob_size);
+    write_info->compressor =
+        BlobCompressor::Create(CompressionAlgorithm::CHUNKED, inode_.blob_size);
     if (!write_info->compressor) {
       FS_TRACE_ERROR("blobfs: Failed to initialize compressor: %d\n", status);
       return status;
@@ -447,7 +569,8 @@ fit::promise<void, zx_status_t> Blob::WriteMetadata() {
     ZX_ASSERT(populator.Walk(on_node, on_extent) == ZX_OK);
 
     // Ensure all non-allocation flags are propagated to the inode.
-    const uint16_t non_allocation_flags = kBlobFlagZSTDCompressed | kBlobFlagLZ4Compressed;
+    const uint16_t non_allocation_flags =
+        kBlobFlagZSTDCompressed | kBlobFlagLZ4Compressed | kBlobFlagChunkCompressed;
     mapped_inode->header.flags |= (inode_.header.flags & non_allocation_flags);
   } else {
     // Special case: Empty node.
@@ -529,8 +652,9 @@ zx_status_t Blob::WriteInternal(const void* data, size_t len, size_t* actual) {
       // Tracking generation time.
       fs::Ticker ticker(blobfs_->Metrics().Collecting());
 
-      if ((status = MerkleTree::Create(blob_data, inode_.blob_size, merkle_data, merkle_size,
-                                       &digest)) != ZX_OK) {
+      if ((status = MerkleTree::CreateParallel(blob_data, inode_.blob_size, merkle_data,
+                                               merkle_size, &digest, WorkerThreadCount())) !=
+          ZX_OK) {
         return status;
       } else if (digest != GetKey()) {
         // Downloaded blob did not match provided digest.
@@ -591,7 +715,7 @@ zx_status_t Blob::WriteInternal(const void* data, size_t len, size_t* actual) {
       ZX_DEBUG_ASSERT(inode_.block_count > blocks);
 
       inode_.block_count = blocks;
-      inode_.header.flags |= kBlobFlagZSTDCompressed;
+      inode_.header.flags |= kBlobFlagChunkCompressed;
     } else {
       uint64_t blocks64 = fbl::round_up(inode_.blob_size, kBlobfsBlockSize) / kBlobfsBlockSize;
       ZX_DEBUG_ASSERT(blocks64 <= std::numeric_limits<uint32_t>::max());
@@ -672,12 +796,16 @@ zx_status_t Blob::CloneVmo(zx_rights_t rights, zx_handle_t* out_vmo, size_t* out
     return status;
   }
 
-  // TODO(smklein): Only clone / verify the part of the vmo that
-  // was requested.
-  const size_t merkle_bytes = MerkleTreeBlocks(inode_) * kBlobfsBlockSize;
+  // Paged VMOs hold only the blob's data. Otherwise the data follows the Merkle tree.
+  const zx::vmo& vmo = paged_vmo_ ? paged_vmo_ : mapping_.vmo();
   zx::vmo clone;
-  if ((status = mapping_.vmo().create_child(ZX_VMO_CHILD_COPY_ON_WRITE, merkle_bytes,
-                                            inode_.blob_size, &clone)) != ZX_OK) {
+  if (paged_vmo_) {
+    status = vmo.create_child(ZX_VMO_CHILD_PRIVATE_PAGER_COPY, 0, inode_.blob_size, &clone);
+  } else {
+    const size_t merkle_bytes = MerkleTreeBlocks(inode_) * kBlobfsBlockSize;
+    status = vmo.create_child(ZX_VMO_CHILD_COPY_ON_WRITE, merkle_bytes, inode_.blob_size, &clone);
+  }
+  if (status != ZX_OK) {
     return status;
   }
 
@@ -697,7 +825,7 @@ zx_status_t Blob::CloneVmo(zx_rights_t rights, zx_handle_t* out_vmo, size_t* out
   *out_size = inode_.blob_size;
 
   if (clone_watcher_.object() == ZX_HANDLE_INVALID) {
-    clone_watcher_.set_object(mapping_.vmo().get());
+    clone_watcher_.set_object(vmo.get());
     clone_watcher_.set_trigger(ZX_VMO_ZERO_CHILDREN);
 
     // Keep a reference to "this" alive, preventing the blob
@@ -748,8 +876,13 @@ zx_status_t Blob::ReadInternal(void* data, size_t len, size_t off, size_t* actua
     len = inode_.blob_size - off;
   }
 
-  const size_t merkle_bytes = MerkleTreeBlocks(inode_) * kBlobfsBlockSize;
-  status = mapping_.vmo().read(data, merkle_bytes + off, len);
+  if (paged_vmo_) {
+    // Faults in the pages being read, which are verified before being supplied.
+    status = paged_vmo_.read(data, off, len);
+  } else {
+    const size_t merkle_bytes = MerkleTreeBlocks(inode_) * kBlobfsBlockSize;
+    status = mapping_.vmo().read(data, merkle_bytes + off, len);
+  }
   if (status == ZX_OK) {
     *actual = len;
   }
@@ -771,7 +904,12 @@ zx_status_t Blob::VerifyBlob(Blobfs* bs, uint32_t node_index) {
 
   // If we are unable to read in the blob from disk, this should also be a VerifyBlob error.
   // Since InitVmos calls Verify as its final step, we can just return its result here.
-  return vn->InitVmos();
+  zx_status_t status = vn->InitVmos();
+  if (status != ZX_OK || !vn->paged_vmo_) {
+    return status;
+  }
+  // Paged blobs are verified as they are paged in, so page in all of it.
+  return vn->paged_vmo_.op_range(ZX_VMO_OP_COMMIT, 0, vn->inode_.blob_size, nullptr, 0);
 }
 
 BlobCache& Blob::Cache() { return blobfs_->Cache(); }
@@ -793,6 +931,7 @@ void Blob::ActivateLowMemory() {
     blobfs_->DetachVmo(vmoid_);
   }
   mapping_.Reset();
+  ReleasePagedVmo();
 }
 
 Blob::~Blob() { ActivateLowMemory(); }
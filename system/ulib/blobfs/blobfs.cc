@@ -29,6 +29,7 @@
 #include <digest/digest.h>
 #include <digest/merkle-tree.h>
 #include <fbl/auto_call.h>
+#include <fbl/auto_lock.h>
 #include <fbl/ref_ptr.h>
 #include <fs/journal/replay.h>
 #include <fs/journal/superblock.h>
@@ -512,6 +513,9 @@ Blobfs::Blobfs(std::unique_ptr<BlockDevice> device, const Superblock* info)
 Blobfs::~Blobfs() {
   journal_.reset();
   Cache().Reset();
+  // Blobs have detached their VMOs by now. Stopping the pager releases what remains of their
+  // page sources, which still need the block device.
+  pager_.reset();
 }
 
 void Blobfs::ScheduleMetricFlush() {
@@ -623,6 +627,13 @@ zx_status_t Blobfs::Create(std::unique_ptr<BlockDevice> device, MountOptions* op
     }
   }
 
+  if (options->pager) {
+    if ((status = BlobPager::Create(&fs->pager_)) != ZX_OK) {
+      FS_TRACE_ERROR("blobfs: Failed to create pager: %d\n", status);
+      return status;
+    }
+  }
+
   fs->SetReadonly(options->writability != blobfs::Writability::Writable);
   fs->Cache().SetCachePolicy(options->cache_policy);
   RawBitmap block_map;
@@ -664,8 +675,8 @@ zx_status_t Blobfs::Create(std::unique_ptr<BlockDevice> device, MountOptions* op
   } else if ((status = fs->CreateFsId()) != ZX_OK) {
     FS_TRACE_ERROR("blobfs: Failed to create fs_id: %d\n", status);
     return status;
-  } else if ((status = fs->InitializeVnodes()) != ZX_OK) {
-    FS_TRACE_ERROR("blobfs: Failed to initialize Vnodes\n");
+  } else if ((status = fs->InitializeDigestIndex()) != ZX_OK) {
+    FS_TRACE_ERROR("blobfs: Failed to initialize digest index\n");
     return status;
   }
 
@@ -673,8 +684,16 @@ zx_status_t Blobfs::Create(std::unique_ptr<BlockDevice> device, MountOptions* op
   return ZX_OK;
 }
 
-zx_status_t Blobfs::InitializeVnodes() {
+zx_status_t Blobfs::InitializeDigestIndex() {
+  TRACE_DURATION("blobfs", "Blobfs::InitializeDigestIndex");
+  fs::Ticker ticker(Metrics().Collecting());
   Cache().Reset();
+  fbl::AutoLock lock(&index_lock_);
+  digest_index_.Reset();
+  zx_status_t status = digest_index_.Reserve(info_.alloc_inode_count);
+  if (status != ZX_OK) {
+    return status;
+  }
   uint32_t total_allocated = 0;
 
   for (uint32_t node_index = 0; node_index < info_.inode_count; node_index++) {
@@ -691,25 +710,20 @@ zx_status_t Blobfs::InitializeVnodes() {
     if (inode->header.IsExtentContainer()) {
       continue;
     }
-    Digest digest(inode->merkle_root_hash);
-    fbl::RefPtr<Blob> vnode = fbl::AdoptRef(new Blob(this, digest));
-    vnode->SetState(kBlobStateReadable);
-    vnode->PopulateInode(node_index);
-
-    // This blob is added to the cache, where it will quickly be relocated into the "closed
-    // set" once we drop our reference to |vnode|. Although we delay reading any of the
-    // contents of the blob from disk until requested, this pre-caching scheme allows us to
-    // quickly verify or deny the presence of a blob during blob lookup and creation.
-    zx_status_t status = Cache().Add(vnode);
-    if (status != ZX_OK) {
-      Digest digest(vnode->GetNode().merkle_root_hash);
+
+    // Only the digest and node index are kept. The vnode is created from the inode when the blob
+    // is first looked up.
+    status = digest_index_.Insert(inode->merkle_root_hash, node_index);
+    if (status == ZX_ERR_ALREADY_EXISTS) {
+      Digest digest(inode->merkle_root_hash);
       char name[digest::Digest::kLength * 2 + 1];
       digest.ToString(name, sizeof(name));
       FS_TRACE_ERROR("blobfs: CORRUPTED FILESYSTEM: Duplicate node: %s @ index %u\n", name,
-                     node_index - 1);
+                     node_index);
+      return status;
+    } else if (status != ZX_OK) {
       return status;
     }
-    Metrics().UpdateLookup(vnode->SizeData());
   }
 
   if (total_allocated != info_.alloc_inode_count) {
@@ -719,9 +733,55 @@ zx_status_t Blobfs::InitializeVnodes() {
     return ZX_ERR_IO_OVERRUN;
   }
 
+  Metrics().UpdateMount(digest_index_.size(), digest_index_.MemoryUsage(), ticker.End());
   return ZX_OK;
 }
 
+zx_status_t Blobfs::LookupBlob(const Digest& digest, fbl::RefPtr<Blob>* out) {
+  TRACE_DURATION("blobfs", "Blobfs::LookupBlob");
+  // Declared outside the lock, so that it is never released while the lock is held.
+  fbl::RefPtr<Blob> vnode;
+  {
+    // The index is checked first: a blob only leaves it by moving into the cache, while the lock
+    // is held, so a blob in neither does not exist.
+    fbl::AutoLock lock(&index_lock_);
+    uint32_t node_index;
+    zx_status_t status = digest_index_.Lookup(digest.get(), &node_index);
+    if (status == ZX_OK) {
+      if (out == nullptr) {
+        return ZX_OK;
+      }
+      vnode = fbl::AdoptRef(new Blob(this, digest));
+      vnode->PopulateInode(node_index);
+      if ((status = Cache().Add(vnode)) != ZX_OK) {
+        return status;
+      }
+      ZX_ASSERT(digest_index_.Erase(digest.get()) == ZX_OK);
+      Metrics().UpdateVnodeCreated(digest_index_.size(), digest_index_.MemoryUsage());
+      *out = std::move(vnode);
+      return ZX_OK;
+    }
+  }
+
+  fbl::RefPtr<CacheNode> cache_node;
+  zx_status_t status = Cache().Lookup(digest, out == nullptr ? nullptr : &cache_node);
+  if (status != ZX_OK) {
+    return status;
+  }
+  if (out != nullptr) {
+    *out = fbl::RefPtr<Blob>::Downcast(std::move(cache_node));
+  }
+  return ZX_OK;
+}
+
+zx_status_t Blobfs::AddNewBlob(const fbl::RefPtr<Blob>& blob) {
+  fbl::AutoLock lock(&index_lock_);
+  if (digest_index_.Lookup(blob->GetKey(), nullptr) == ZX_OK) {
+    return ZX_ERR_ALREADY_EXISTS;
+  }
+  return Cache().Add(blob);
+}
+
 zx_status_t Blobfs::Reload() {
   TRACE_DURATION("blobfs", "Blobfs::Reload");
 
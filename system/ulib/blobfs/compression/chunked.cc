@@ -0,0 +1,359 @@
+// Copyright 2019 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <inttypes.h>
+#include <string.h>
+
+#include <atomic>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <blobfs/compression/chunked.h>
+#include <blobfs/compression/compressor.h>
+#include <blobfs/format.h>
+#include <fbl/algorithm.h>
+#include <fbl/macros.h>
+#include <fbl/unique_ptr.h>
+#include <fs/trace.h>
+#include <zircon/types.h>
+#include <zstd/zstd.h>
+
+namespace blobfs {
+namespace {
+
+constexpr int kCompressionLevel = 3;
+
+// Frames are the unit of decompression, and must hold whole blocks so that page requests, which
+// are widened to blocks, never split a frame.
+static_assert(kChunkedFrameSize % kBlobfsBlockSize == 0, "Frames must be whole blocks");
+
+// The fewest frames worth handing to a decompression thread.
+constexpr uint64_t kMinFramesPerThread = 4;
+
+uint64_t FrameCount(uint64_t data_size, uint32_t frame_size) {
+  return fbl::round_up(data_size, frame_size) / frame_size;
+}
+
+size_t SeekTableOffset() { return sizeof(ChunkedHeader); }
+
+}  // namespace
+
+size_t ChunkedHeaderSize(size_t data_size) {
+  return SeekTableOffset() + (FrameCount(data_size, kChunkedFrameSize) + 1) * sizeof(uint64_t);
+}
+
+ChunkedCompressor::ChunkedCompressor(ZSTD_CCtx* ctx, fbl::Array<uint8_t> frame,
+                                     void* compression_buffer, size_t compression_buffer_length)
+    : ctx_(ctx),
+      frame_(std::move(frame)),
+      buf_(static_cast<uint8_t*>(compression_buffer)),
+      buf_max_(compression_buffer_length) {}
+
+ChunkedCompressor::~ChunkedCompressor() { ZSTD_freeCCtx(ctx_); }
+
+ChunkedHeader* ChunkedCompressor::Header() const { return reinterpret_cast<ChunkedHeader*>(buf_); }
+
+uint64_t* ChunkedCompressor::SeekTable() const {
+  return reinterpret_cast<uint64_t*>(buf_ + SeekTableOffset());
+}
+
+zx_status_t ChunkedCompressor::Create(size_t input_size, void* compression_buffer,
+                                      size_t compression_buffer_length,
+                                      fbl::unique_ptr<ChunkedCompressor>* out) {
+  if (BufferMax(input_size) > compression_buffer_length) {
+    return ZX_ERR_BUFFER_TOO_SMALL;
+  }
+  const uint64_t frame_count = FrameCount(input_size, kChunkedFrameSize);
+  if (frame_count > UINT32_MAX) {
+    return ZX_ERR_OUT_OF_RANGE;
+  }
+
+  ZSTD_CCtx* ctx = ZSTD_createCCtx();
+  if (ctx == nullptr) {
+    return ZX_ERR_NO_MEMORY;
+  }
+  fbl::Array<uint8_t> frame(new uint8_t[kChunkedFrameSize], kChunkedFrameSize);
+  auto compressor = fbl::unique_ptr<ChunkedCompressor>(new ChunkedCompressor(
+      ctx, std::move(frame), compression_buffer, compression_buffer_length));
+
+  // The seek table is filled in as frames are compressed.
+  ChunkedHeader* header = compressor->Header();
+  header->magic = kChunkedMagic;
+  header->data_size = input_size;
+  header->frame_size = kChunkedFrameSize;
+  header->frame_count = static_cast<uint32_t>(frame_count);
+  compressor->buf_used_ = ChunkedHeaderSize(input_size);
+  compressor->SeekTable()[0] = compressor->buf_used_;
+
+  *out = std::move(compressor);
+  return ZX_OK;
+}
+
+size_t ChunkedCompressor::BufferMax(size_t input_length) {
+  const size_t full_frames = input_length / kChunkedFrameSize;
+  const size_t remainder = input_length % kChunkedFrameSize;
+  return ChunkedHeaderSize(input_length) + full_frames * ZSTD_compressBound(kChunkedFrameSize) +
+         (remainder ? ZSTD_compressBound(remainder) : 0);
+}
+
+zx_status_t ChunkedCompressor::CompressFrame(const void* data, size_t length) {
+  if (frames_written_ == Header()->frame_count) {
+    FS_TRACE_ERROR("[blobfs][chunked] More input than expected\n");
+    return ZX_ERR_INVALID_ARGS;
+  }
+  size_t r = ZSTD_compressCCtx(ctx_, buf_ + buf_used_, buf_max_ - buf_used_, data, length,
+                               kCompressionLevel);
+  if (ZSTD_isError(r)) {
+    FS_TRACE_ERROR("[blobfs][chunked] Failed to compress: %s\n", ZSTD_getErrorName(r));
+    return ZX_ERR_IO_DATA_INTEGRITY;
+  }
+  buf_used_ += r;
+  SeekTable()[++frames_written_] = buf_used_;
+  return ZX_OK;
+}
+
+zx_status_t ChunkedCompressor::Update(const void* input_data, size_t input_length) {
+  const uint8_t* input = static_cast<const uint8_t*>(input_data);
+  input_consumed_ += input_length;
+  if (input_consumed_ > Header()->data_size) {
+    FS_TRACE_ERROR("[blobfs][chunked] More input than expected\n");
+    return ZX_ERR_INVALID_ARGS;
+  }
+
+  while (input_length > 0) {
+    zx_status_t status;
+    // Whole frames are compressed straight from the input.
+    if (frame_used_ == 0 && input_length >= kChunkedFrameSize) {
+      if ((status = CompressFrame(input, kChunkedFrameSize)) != ZX_OK) {
+        return status;
+      }
+      input += kChunkedFrameSize;
+      input_length -= kChunkedFrameSize;
+      continue;
+    }
+
+    const size_t length = fbl::min(kChunkedFrameSize - frame_used_, input_length);
+    memcpy(frame_.get() + frame_used_, input, length);
+    frame_used_ += length;
+    input += length;
+    input_length -= length;
+    if (frame_used_ == kChunkedFrameSize) {
+      if ((status = CompressFrame(frame_.get(), frame_used_)) != ZX_OK) {
+        return status;
+      }
+      frame_used_ = 0;
+    }
+  }
+  return ZX_OK;
+}
+
+zx_status_t ChunkedCompressor::End() {
+  if (input_consumed_ != Header()->data_size) {
+    FS_TRACE_ERROR("[blobfs][chunked] Expected %" PRIu64 " bytes of input, got %zu\n",
+                   Header()->data_size, input_consumed_);
+    return ZX_ERR_BAD_STATE;
+  }
+  if (frame_used_ > 0) {
+    zx_status_t status = CompressFrame(frame_.get(), frame_used_);
+    if (status != ZX_OK) {
+      return status;
+    }
+    frame_used_ = 0;
+  }
+  ZX_DEBUG_ASSERT(frames_written_ == Header()->frame_count);
+  return ZX_OK;
+}
+
+size_t ChunkedCompressor::Size() const { return buf_used_; }
+
+ChunkedDecompressor::ChunkedDecompressor(ZSTD_DCtx* ctx, uint64_t data_size, uint32_t frame_size,
+                                         fbl::Array<uint64_t> seek_table)
+    : ctx_(ctx), data_size_(data_size), frame_size_(frame_size),
+      seek_table_(std::move(seek_table)) {}
+
+ChunkedDecompressor::~ChunkedDecompressor() { ZSTD_freeDCtx(ctx_); }
+
+zx_status_t ChunkedDecompressor::HeaderSize(const void* buf, size_t buf_length, size_t* out) {
+  ChunkedHeader header;
+  if (buf_length < sizeof(header)) {
+    return ZX_ERR_BUFFER_TOO_SMALL;
+  }
+  memcpy(&header, buf, sizeof(header));
+  if (header.magic != kChunkedMagic || header.frame_size == 0 ||
+      header.frame_size % kBlobfsBlockSize != 0 ||
+      header.frame_count != FrameCount(header.data_size, header.frame_size)) {
+    FS_TRACE_ERROR("[blobfs][chunked] Invalid header\n");
+    return ZX_ERR_IO_DATA_INTEGRITY;
+  }
+  *out = SeekTableOffset() + (header.frame_count + 1ul) * sizeof(uint64_t);
+  return ZX_OK;
+}
+
+zx_status_t ChunkedDecompressor::Create(const void* buf, size_t buf_length, uint64_t data_size,
+                                        uint64_t compressed_size,
+                                        fbl::unique_ptr<ChunkedDecompressor>* out) {
+  size_t header_size;
+  zx_status_t status = HeaderSize(buf, buf_length, &header_size);
+  if (status != ZX_OK) {
+    return status;
+  }
+  if (buf_length < header_size) {
+    return ZX_ERR_BUFFER_TOO_SMALL;
+  }
+  ChunkedHeader header;
+  memcpy(&header, buf, sizeof(header));
+  if (header.data_size != data_size) {
+    FS_TRACE_ERROR("[blobfs][chunked] Expected %" PRIu64 " bytes of data, header has %" PRIu64
+                   "\n", data_size, header.data_size);
+    return ZX_ERR_IO_DATA_INTEGRITY;
+  }
+
+  const size_t entries = header.frame_count + 1ul;
+  fbl::Array<uint64_t> seek_table(new uint64_t[entries], entries);
+  memcpy(seek_table.get(), static_cast<const uint8_t*>(buf) + SeekTableOffset(),
+         entries * sizeof(uint64_t));
+  // Every frame must be non-empty and lie within the compressed data.
+  if (seek_table[0] != header_size || seek_table[entries - 1] > compressed_size) {
+    FS_TRACE_ERROR("[blobfs][chunked] Invalid seek table\n");
+    return ZX_ERR_IO_DATA_INTEGRITY;
+  }
+  for (size_t i = 1; i < entries; i++) {
+    if (seek_table[i] <= seek_table[i - 1]) {
+      FS_TRACE_ERROR("[blobfs][chunked] Invalid seek table\n");
+      return ZX_ERR_IO_DATA_INTEGRITY;
+    }
+  }
+
+  ZSTD_DCtx* ctx = ZSTD_createDCtx();
+  if (ctx == nullptr) {
+    return ZX_ERR_NO_MEMORY;
+  }
+  out->reset(new ChunkedDecompressor(ctx, data_size, header.frame_size, std::move(seek_table)));
+  return ZX_OK;
+}
+
+zx_status_t ChunkedDecompressor::MapRange(uint64_t offset, uint64_t length,
+                                          ChunkedRange* out) const {
+  const uint64_t end = fbl::min(offset + length, data_size_);
+  if (offset >= end) {
+    return ZX_ERR_OUT_OF_RANGE;
+  }
+  const uint64_t first = offset / frame_size_;
+  const uint64_t last = (end - 1) / frame_size_ + 1;
+  out->data_offset = first * frame_size_;
+  out->data_length = fbl::min(last * frame_size_, data_size_) - out->data_offset;
+  out->compressed_offset = seek_table_[first];
+  out->compressed_length = seek_table_[last] - seek_table_[first];
+  return ZX_OK;
+}
+
+zx_status_t ChunkedDecompressor::DecompressRange(const ChunkedRange& range, void* target,
+                                                 const void* src) {
+  TRACE_DURATION("blobfs", "ChunkedDecompressor::DecompressRange", "offset", range.data_offset,
+                 "length", range.data_length);
+  ZX_DEBUG_ASSERT(range.data_offset % frame_size_ == 0);
+  ZX_DEBUG_ASSERT(range.data_offset + range.data_length <= data_size_);
+  const uint64_t first = range.data_offset / frame_size_;
+  for (uint64_t offset = 0; offset < range.data_length; offset += frame_size_) {
+    const uint64_t frame = first + offset / frame_size_;
+    const size_t frame_length = fbl::min<uint64_t>(frame_size_, range.data_length - offset);
+    const uint8_t* frame_src =
+        static_cast<const uint8_t*>(src) + (seek_table_[frame] - range.compressed_offset);
+    size_t r = ZSTD_decompressDCtx(ctx_, static_cast<uint8_t*>(target) + offset, frame_length,
+                                   frame_src, seek_table_[frame + 1] - seek_table_[frame]);
+    if (ZSTD_isError(r)) {
+      FS_TRACE_ERROR("[blobfs][chunked] Failed to decompress: %s\n", ZSTD_getErrorName(r));
+      return ZX_ERR_IO_DATA_INTEGRITY;
+    }
+    if (r != frame_length) {
+      FS_TRACE_ERROR("[blobfs][chunked] Frame %" PRIu64 " decompressed to %zu of %zu bytes\n",
+                     frame, r, frame_length);
+      return ZX_ERR_IO_DATA_INTEGRITY;
+    }
+  }
+  return ZX_OK;
+}
+
+zx_status_t ChunkedDecompress(void* target_buf, size_t* target_size, const void* src_buf,
+                              size_t* src_size) {
+  return ChunkedDecompressParallel(target_buf, target_size, src_buf, src_size, 1);
+}
+
+zx_status_t ChunkedDecompressParallel(void* target_buf, size_t* target_size, const void* src_buf,
+                                      size_t* src_size, size_t num_threads) {
+  TRACE_DURATION("blobfs", "ChunkedDecompress", "target_size", *target_size, "src_size",
+                 *src_size, "threads", num_threads);
+  size_t header_size;
+  zx_status_t status = ChunkedDecompressor::HeaderSize(src_buf, *src_size, &header_size);
+  if (status != ZX_OK) {
+    return status;
+  }
+  ChunkedHeader header;
+  memcpy(&header, src_buf, sizeof(header));
+  fbl::unique_ptr<ChunkedDecompressor> decompressor;
+  if ((status = ChunkedDecompressor::Create(src_buf, *src_size, header.data_size, *src_size,
+                                            &decompressor)) != ZX_OK) {
+    return status;
+  }
+
+  // Only whole frames are decompressed, so stop at the last one which fits.
+  uint64_t length = fbl::min<uint64_t>(*target_size, header.data_size);
+  if (length < header.data_size) {
+    length = fbl::round_down(length, header.frame_size);
+  }
+  ChunkedRange range;
+  if (length == 0 || decompressor->MapRange(0, length, &range) != ZX_OK) {
+    *target_size = 0;
+    *src_size = header_size;
+    return ZX_OK;
+  }
+
+  // Frames are independent, so each thread decompresses a run of them with its own context.
+  const uint64_t frames = FrameCount(range.data_length, header.frame_size);
+  num_threads =
+      fbl::max<uint64_t>(fbl::min<uint64_t>(num_threads, frames / kMinFramesPerThread), 1);
+  std::atomic<zx_status_t> result(ZX_OK);
+  auto decompress = [&](size_t i, ChunkedDecompressor* frame_decompressor) {
+    const uint64_t first = frames * i / num_threads;
+    const uint64_t last = frames * (i + 1) / num_threads;
+    ChunkedRange frame_range;
+    zx_status_t frame_status =
+        frame_decompressor->MapRange(first * header.frame_size,
+                                     (last - first) * header.frame_size, &frame_range);
+    if (frame_status == ZX_OK) {
+      frame_status = frame_decompressor->DecompressRange(
+          frame_range, static_cast<uint8_t*>(target_buf) + frame_range.data_offset,
+          static_cast<const uint8_t*>(src_buf) + frame_range.compressed_offset);
+    }
+    if (frame_status != ZX_OK) {
+      zx_status_t expected = ZX_OK;
+      result.compare_exchange_strong(expected, frame_status);
+    }
+  };
+  std::vector<fbl::unique_ptr<ChunkedDecompressor>> decompressors(num_threads - 1);
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < num_threads; i++) {
+    if ((status = ChunkedDecompressor::Create(src_buf, *src_size, header.data_size, *src_size,
+                                              &decompressors[i - 1])) != ZX_OK) {
+      result.store(status);
+      break;
+    }
+    threads.emplace_back(decompress, i, decompressors[i - 1].get());
+  }
+  if (result.load() == ZX_OK) {
+    decompress(0, decompressor.get());
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  if ((status = result.load()) != ZX_OK) {
+    return status;
+  }
+  *target_size = range.data_length;
+  *src_size = range.compressed_offset + range.compressed_length;
+  return ZX_OK;
+}
+
+}  // namespace blobfs
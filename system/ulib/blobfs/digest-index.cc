@@ -0,0 +1,136 @@
+// Copyright 2019 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <string.h>
+
+#include <utility>
+
+#include <blobfs/digest-index.h>
+#include <fbl/algorithm.h>
+#include <fbl/alloc_checker.h>
+#include <zircon/assert.h>
+
+namespace blobfs {
+namespace {
+
+constexpr size_t kMinCapacity = 16;
+
+// The table is grown before more than 3/4 of its slots are full, which keeps probe sequences
+// short.
+bool Overloaded(size_t count, size_t capacity) { return count * 4 > capacity * 3; }
+
+}  // namespace
+
+void DigestIndex::Reset() {
+  table_.reset();
+  count_ = 0;
+}
+
+zx_status_t DigestIndex::Reserve(size_t count) {
+  size_t capacity = fbl::max(table_.size(), kMinCapacity);
+  while (Overloaded(count, capacity)) {
+    capacity *= 2;
+  }
+  if (capacity == table_.size()) {
+    return ZX_OK;
+  }
+  return Rehash(capacity);
+}
+
+zx_status_t DigestIndex::Insert(const uint8_t* digest, uint32_t node_index) {
+  ZX_DEBUG_ASSERT(node_index != kEmpty);
+  if (table_.size() == 0 || Overloaded(count_ + 1, table_.size())) {
+    zx_status_t status = Reserve(count_ + 1);
+    if (status != ZX_OK) {
+      return status;
+    }
+  }
+  Entry& entry = table_[Find(digest)];
+  if (entry.node_index != kEmpty) {
+    return ZX_ERR_ALREADY_EXISTS;
+  }
+  memcpy(entry.digest, digest, sizeof(entry.digest));
+  entry.node_index = node_index;
+  count_++;
+  return ZX_OK;
+}
+
+zx_status_t DigestIndex::Lookup(const uint8_t* digest, uint32_t* out) const {
+  if (count_ == 0) {
+    return ZX_ERR_NOT_FOUND;
+  }
+  const Entry& entry = table_[Find(digest)];
+  if (entry.node_index == kEmpty) {
+    return ZX_ERR_NOT_FOUND;
+  }
+  if (out != nullptr) {
+    *out = entry.node_index;
+  }
+  return ZX_OK;
+}
+
+zx_status_t DigestIndex::Erase(const uint8_t* digest) {
+  if (count_ == 0) {
+    return ZX_ERR_NOT_FOUND;
+  }
+  size_t hole = Find(digest);
+  if (table_[hole].node_index == kEmpty) {
+    return ZX_ERR_NOT_FOUND;
+  }
+  // Shift later entries of the probe sequence back into the hole, so that lookups never have to
+  // skip over removed entries. An entry may only move back if the hole is between its home slot
+  // and its current slot.
+  const size_t mask = table_.size() - 1;
+  for (size_t slot = (hole + 1) & mask; table_[slot].node_index != kEmpty;
+       slot = (slot + 1) & mask) {
+    size_t home = Home(table_[slot].digest);
+    if (((slot - home) & mask) >= ((slot - hole) & mask)) {
+      table_[hole] = table_[slot];
+      hole = slot;
+    }
+  }
+  table_[hole].node_index = kEmpty;
+  count_--;
+  return ZX_OK;
+}
+
+size_t DigestIndex::Home(const uint8_t* digest) const {
+  uint64_t hash;
+  memcpy(&hash, digest, sizeof(hash));
+  return hash & (table_.size() - 1);
+}
+
+size_t DigestIndex::Find(const uint8_t* digest) const {
+  ZX_DEBUG_ASSERT(table_.size() > count_);
+  const size_t mask = table_.size() - 1;
+  size_t slot = Home(digest);
+  while (table_[slot].node_index != kEmpty &&
+         memcmp(table_[slot].digest, digest, sizeof(table_[slot].digest)) != 0) {
+    slot = (slot + 1) & mask;
+  }
+  return slot;
+}
+
+zx_status_t DigestIndex::Rehash(size_t capacity) {
+  ZX_DEBUG_ASSERT((capacity & (capacity - 1)) == 0);
+  fbl::AllocChecker ac;
+  fbl::Array<Entry> table(new (&ac) Entry[capacity], capacity);
+  if (!ac.check()) {
+    return ZX_ERR_NO_MEMORY;
+  }
+  for (size_t i = 0; i < capacity; i++) {
+    table[i].node_index = kEmpty;
+  }
+  std::swap(table, table_);
+  for (size_t i = 0; i < table.size(); i++) {
+    if (table[i].node_index != kEmpty) {
+      Entry& entry = table_[Find(table[i].digest)];
+      ZX_DEBUG_ASSERT(entry.node_index == kEmpty);
+      entry = table[i];
+    }
+  }
+  return ZX_OK;
+}
+
+}  // namespace blobfs
@@ -25,8 +25,6 @@ namespace blobfs {
 
 Directory::Directory(Blobfs* bs) : blobfs_(bs) {}
 
-BlobCache& Directory::Cache() { return blobfs_->Cache(); }
-
 Directory::~Directory() = default;
 
 zx_status_t Directory::GetNodeInfo(uint32_t flags, fuchsia_io_NodeInfo* info) {
@@ -73,11 +71,10 @@ zx_status_t Directory::Lookup(fbl::RefPtr<fs::Vnode>* out, fbl::StringPiece name
   if ((status = digest.Parse(name.data(), name.length())) != ZX_OK) {
     return status;
   }
-  fbl::RefPtr<CacheNode> cache_node;
-  if ((status = Cache().Lookup(digest, &cache_node)) != ZX_OK) {
+  fbl::RefPtr<Blob> vnode;
+  if ((status = blobfs_->LookupBlob(digest, &vnode)) != ZX_OK) {
     return status;
   }
-  auto vnode = fbl::RefPtr<Blob>::Downcast(std::move(cache_node));
   blobfs_->Metrics().UpdateLookup(vnode->SizeData());
   *out = std::move(vnode);
   return ZX_OK;
@@ -108,7 +105,7 @@ zx_status_t Directory::Create(fbl::RefPtr<fs::Vnode>* out, fbl::StringPiece name
   }
 
   fbl::RefPtr<Blob> vn = fbl::AdoptRef(new Blob(blobfs_, std::move(digest)));
-  if ((status = Cache().Add(vn)) != ZX_OK) {
+  if ((status = blobfs_->AddNewBlob(vn)) != ZX_OK) {
     return status;
   }
   vn->Open(0, nullptr);
@@ -152,11 +149,10 @@ zx_status_t Directory::Unlink(fbl::StringPiece name, bool must_be_dir) {
   if ((status = digest.Parse(name.data(), name.length())) != ZX_OK) {
     return status;
   }
-  fbl::RefPtr<CacheNode> cache_node;
-  if ((status = Cache().Lookup(digest, &cache_node)) != ZX_OK) {
+  fbl::RefPtr<Blob> vnode;
+  if ((status = blobfs_->LookupBlob(digest, &vnode)) != ZX_OK) {
     return status;
   }
-  auto vnode = fbl::RefPtr<Blob>::Downcast(std::move(cache_node));
   blobfs_->Metrics().UpdateLookup(vnode->SizeData());
   return vnode->QueueUnlink();
 }
@@ -29,6 +29,7 @@
 
 #define ZXDEBUG 0
 
+#include <blobfs/compression/chunked.h>
 #include <blobfs/compression/compressor.h>
 #include <blobfs/compression/zstd.h>
 #include <blobfs/format.h>
@@ -43,9 +44,10 @@ constexpr uint32_t kExtentCount = 5;
 namespace blobfs {
 namespace {
 
-using HostCompressor = ZSTDCompressor;
-const auto HostDecompressor = ZSTDDecompress;
-constexpr uint32_t kBlobFlagCompressed = kBlobFlagZSTDCompressed;
+// Blobs are written in the chunked format. Images written before it existed use ZSTD.
+using HostCompressor = ChunkedCompressor;
+constexpr uint32_t kBlobFlagCompressed = kBlobFlagChunkCompressed;
+constexpr uint32_t kBlobFlagsCompressed = kBlobFlagChunkCompressed | kBlobFlagZSTDCompressed;
 
 zx_status_t ReadBlockOffset(int fd, uint64_t bno, off_t offset, void* data) {
   off_t off = offset + bno * kBlobfsBlockSize;
@@ -68,13 +70,15 @@ zx_status_t WriteBlockOffset(int fd, uint64_t bno, off_t offset, const void* dat
 // From a buffer, create a merkle tree.
 //
 // Given a mapped blob at |blob_data| of length |length|, compute the
-// Merkle digest and the output merkle tree as a uint8_t array.
-zx_status_t buffer_create_merkle(const FileMapping& mapping, MerkleInfo* out_info) {
+// Merkle digest and the output merkle tree as a uint8_t array, using up to
+// |num_threads| threads.
+zx_status_t buffer_create_merkle(const FileMapping& mapping, MerkleInfo* out_info,
+                                 size_t num_threads = 1) {
   zx_status_t status;
   size_t merkle_size = MerkleTree::GetTreeLength(mapping.length());
   auto merkle_tree = fbl::unique_ptr<uint8_t[]>(new uint8_t[merkle_size]);
-  if ((status = MerkleTree::Create(mapping.data(), mapping.length(), merkle_tree.get(), merkle_size,
-                                   &out_info->digest)) != ZX_OK) {
+  if ((status = MerkleTree::CreateParallel(mapping.data(), mapping.length(), merkle_tree.get(),
+                                           merkle_size, &out_info->digest, num_threads)) != ZX_OK) {
     return status;
   }
   out_info->merkle.reset(merkle_tree.release(), merkle_size);
@@ -440,14 +444,15 @@ zx_status_t blobfs_create_sparse(fbl::unique_ptr<Blobfs>* out, fbl::unique_fd fd
   return ZX_OK;
 }
 
-zx_status_t blobfs_preprocess(int data_fd, bool compress, MerkleInfo* out_info) {
+zx_status_t blobfs_preprocess(int data_fd, bool compress, MerkleInfo* out_info,
+                              size_t num_threads) {
   FileMapping mapping;
   zx_status_t status = mapping.Map(data_fd);
   if (status != ZX_OK) {
     return status;
   }
 
-  if ((status = buffer_create_merkle(mapping, out_info)) != ZX_OK) {
+  if ((status = buffer_create_merkle(mapping, out_info, num_threads)) != ZX_OK) {
     return status;
   }
 
@@ -752,7 +757,7 @@ zx_status_t Blobfs::VerifyBlob(uint32_t node_index) {
 
   // Create data buffer.
   fbl::unique_ptr<uint8_t[]> data(new uint8_t[target_size]);
-  if (inode.header.flags & kBlobFlagCompressed) {
+  if (inode.header.flags & kBlobFlagsCompressed) {
     // Read in uncompressed merkle blocks.
     for (unsigned i = 0; i < merkle_blocks; i++) {
       ReadBlock(data_start_block_ + inode.extents[0].Start() + i);
@@ -780,8 +785,10 @@ zx_status_t Blobfs::VerifyBlob(uint32_t node_index) {
     zx_status_t status;
     target_size = inode.blob_size;
     uint8_t* data_ptr = data.get() + (merkle_blocks * kBlobfsBlockSize);
-    if ((status = HostDecompressor(data_ptr, &target_size, compressed_data.get(),
-                                   &compressed_size)) != ZX_OK) {
+    const auto decompress =
+        (inode.header.flags & kBlobFlagChunkCompressed) ? ChunkedDecompress : ZSTDDecompress;
+    if ((status = decompress(data_ptr, &target_size, compressed_data.get(), &compressed_size)) !=
+        ZX_OK) {
       return status;
     }
     if (target_size != inode.blob_size) {
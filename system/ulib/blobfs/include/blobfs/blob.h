@@ -208,14 +208,20 @@ class Blob final : public CacheNode, fbl::Recyclable<Blob> {
   // Requires: kBlobStateReadable
   zx_status_t ReadInternal(void* data, size_t len, size_t off, size_t* actual);
 
-  // Reads both VMOs into memory, if we haven't already.
+  // Prepares the blob's VMO, if we haven't already.
   //
-  // TODO(ZX-1481): When we have can register the Blob Store as a pager
-  // service, and it can properly handle pages faults on a vnode's contents,
-  // then we can avoid reading the entire blob up-front. Until then, read
-  // the contents of a VMO into memory when it is opened.
+  // When blobfs has a pager, uncompressed blobs are served by it and only
+  // their Merkle tree is read here. Otherwise the blob is read into memory
+  // and verified in whole.
   zx_status_t InitVmos();
 
+  // Initializes a blob whose contents are supplied by the pager, reading
+  // only its Merkle tree and the location of its data.
+  zx_status_t InitPaged();
+
+  // Detaches and releases the paged VMO, if any.
+  void ReleasePagedVmo();
+
   // Initializes a compressed blob by reading it from disk and decompressing it.
   // Does not verify the blob.
   zx_status_t InitCompressed(CompressionAlgorithm algorithm);
@@ -246,6 +252,10 @@ class Blob final : public CacheNode, fbl::Recyclable<Blob> {
   fzl::OwnedVmoMapper mapping_;
   vmoid_t vmoid_ = {};
 
+  // The blob's data, supplied on demand by the pager. Only one of
+  // |mapping_| and |paged_vmo_| is set at a time.
+  zx::vmo paged_vmo_;
+
   // Watches any clones of "vmo_" provided to clients.
   // Observes the ZX_VMO_ZERO_CHILDREN signal.
   async::WaitMethod<Blob, &Blob::HandleNoClones> clone_watcher_;
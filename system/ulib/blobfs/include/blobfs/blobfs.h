@@ -34,6 +34,7 @@
 #include <blobfs/blob-cache.h>
 #include <blobfs/blob.h>
 #include <blobfs/common.h>
+#include <blobfs/digest-index.h>
 #include <blobfs/directory.h>
 #include <blobfs/extent-reserver.h>
 #include <blobfs/format.h>
@@ -41,12 +42,14 @@
 #include <blobfs/iterator/extent-iterator.h>
 #include <blobfs/metrics.h>
 #include <blobfs/node-reserver.h>
+#include <blobfs/pager.h>
 #include <blobfs/transaction-manager.h>
 #include <block-client/cpp/block-device.h>
 #include <block-client/cpp/client.h>
 #include <digest/digest.h>
 #include <fbl/algorithm.h>
 #include <fbl/macros.h>
+#include <fbl/mutex.h>
 #include <fbl/ref_counted.h>
 #include <fbl/ref_ptr.h>
 #include <fbl/unique_fd.h>
@@ -85,6 +88,9 @@ struct MountOptions {
   bool metrics = false;
   bool journal = false;
   CachePolicy cache_policy = CachePolicy::EvictImmediately;
+  // Serve the contents of uncompressed blobs on demand through a userspace pager, reading and
+  // verifying only the parts that are accessed, rather than reading whole blobs when opened.
+  bool pager = true;
 };
 
 class Blobfs : public fs::ManagedVfs, public fbl::RefCounted<Blobfs>, public TransactionManager {
@@ -186,6 +192,21 @@ class Blobfs : public fs::ManagedVfs, public fbl::RefCounted<Blobfs>, public Tra
 
   BlobCache& Cache() { return blob_cache_; }
 
+  // Finds the blob named by |digest|. If |out| is not null, the blob's vnode is placed in it;
+  // the vnode is created the first time the blob is looked up after mount.
+  //
+  // Returns ZX_ERR_NOT_FOUND if no such blob exists.
+  zx_status_t LookupBlob(const Digest& digest, fbl::RefPtr<Blob>* out);
+
+  // Adds |blob|, which is about to be written, to the cache.
+  //
+  // Returns ZX_ERR_ALREADY_EXISTS if a blob with the same digest exists, whether or not it has
+  // been looked up since mount.
+  zx_status_t AddNewBlob(const fbl::RefPtr<Blob>& blob);
+
+  // Returns the pager serving blob VMOs, or nullptr if blobs are read in whole.
+  BlobPager* pager() { return pager_.get(); }
+
   zx_status_t Readdir(fs::vdircookie_t* cookie, void* dirents, size_t len, size_t* out_actual);
 
   BlockDevice* Device() const { return block_device_.get(); }
@@ -201,13 +222,11 @@ class Blobfs : public fs::ManagedVfs, public fbl::RefCounted<Blobfs>, public Tra
   // disk.
   void FreeInode(uint32_t node_index, fs::UnbufferedOperationsBuilder* operations);
 
-  // Does a single pass of all blobs, creating uninitialized Vnode
-  // objects for them all.
+  // Does a single pass of all nodes, marking them allocated and indexing blobs by digest.
   //
-  // By executing this function at mount, we can quickly assert
-  // either the presence or absence of a blob on the system without
-  // further scanning.
-  zx_status_t InitializeVnodes();
+  // By executing this function at mount, we can quickly assert either the presence or absence of
+  // a blob on the system without further scanning, and without creating a vnode for every blob.
+  zx_status_t InitializeDigestIndex();
 
   // Writes node data to the inode table and updates disk.
   void PersistNode(uint32_t node_index, fs::UnbufferedOperationsBuilder* operations);
@@ -263,12 +282,21 @@ class Blobfs : public fs::ManagedVfs, public fbl::RefCounted<Blobfs>, public Tra
 
   BlobCache blob_cache_;
 
+  // Blobs on disk which have not been looked up since mount. A blob's entry moves to
+  // |blob_cache_| when its vnode is created, so every blob is in exactly one of the two.
+  //
+  // Acquired before the lock of |blob_cache_|.
+  fbl::Mutex index_lock_;
+  DigestIndex digest_index_ __TA_GUARDED(index_lock_);
+
   std::unique_ptr<BlockDevice> block_device_;
   fuchsia_hardware_block_BlockInfo block_info_ = {};
   std::atomic<groupid_t> next_group_ = {};
 
   fbl::unique_ptr<Allocator> allocator_;
 
+  std::unique_ptr<BlobPager> pager_;
+
   fzl::ResizeableVmoMapper info_mapping_;
   vmoid_t info_vmoid_ = {};
 
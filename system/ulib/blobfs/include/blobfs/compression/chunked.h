@@ -0,0 +1,136 @@
+// Copyright 2019 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <blobfs/compression/compressor.h>
+#include <fbl/array.h>
+#include <fbl/macros.h>
+#include <fbl/unique_ptr.h>
+#include <zircon/types.h>
+#include <zstd/zstd.h>
+
+namespace blobfs {
+
+// The chunked format splits a blob into frames of |kChunkedFrameSize| uncompressed bytes (the last
+// frame may be shorter), each of which is compressed as an independent ZSTD frame. The frames are
+// preceded by a seek table, so any range of the blob can be decompressed without decompressing
+// everything before it:
+//
+//   ChunkedHeader
+//   uint64_t frame_offsets[frame_count + 1]
+//   frame 0, frame 1, ... frame (frame_count - 1)
+//
+// Frame |i| occupies compressed bytes [frame_offsets[i], frame_offsets[i + 1]), relative to the
+// start of the header. All fields are little-endian.
+constexpr uint64_t kChunkedMagic = 0x64656b6e75686362ULL;  // "bchunked"
+constexpr uint32_t kChunkedFrameSize = 64 * 1024;
+
+struct ChunkedHeader {
+  uint64_t magic;
+  // Size of the uncompressed data.
+  uint64_t data_size;
+  // Uncompressed size of every frame but the last.
+  uint32_t frame_size;
+  uint32_t frame_count;
+};
+
+static_assert(sizeof(ChunkedHeader) == 24, "ChunkedHeader must be packed");
+
+// Returns the size of the header and seek table for a blob of |data_size| bytes.
+size_t ChunkedHeaderSize(size_t data_size);
+
+class ChunkedCompressor : public Compressor {
+ public:
+  // Returns the maximum possible size a buffer would need to be
+  // in order to compress data of size |input_length|.
+  static size_t BufferMax(size_t input_length);
+
+  static zx_status_t Create(size_t input_size, void* compression_buffer,
+                            size_t compression_buffer_length,
+                            fbl::unique_ptr<ChunkedCompressor>* out);
+  ~ChunkedCompressor();
+
+  ////////////////////////////////////////
+  // Compressor interface
+  size_t Size() const final;
+  zx_status_t Update(const void* input_data, size_t input_length) final;
+  zx_status_t End() final;
+
+ private:
+  ChunkedCompressor(ZSTD_CCtx* ctx, fbl::Array<uint8_t> frame, void* compression_buffer,
+                    size_t compression_buffer_length);
+
+  // Compresses one frame into the buffer and records it in the seek table.
+  zx_status_t CompressFrame(const void* data, size_t length);
+
+  ChunkedHeader* Header() const;
+  uint64_t* SeekTable() const;
+
+  ZSTD_CCtx* ctx_ = nullptr;
+  // Input which does not yet fill a whole frame.
+  fbl::Array<uint8_t> frame_;
+  size_t frame_used_ = 0;
+  size_t input_consumed_ = 0;
+  uint32_t frames_written_ = 0;
+  uint8_t* buf_ = nullptr;
+  size_t buf_max_ = 0;
+  size_t buf_used_ = 0;
+};
+
+// A range of a chunked blob, in both its uncompressed and compressed forms.
+struct ChunkedRange {
+  uint64_t data_offset;
+  uint64_t data_length;
+  uint64_t compressed_offset;
+  uint64_t compressed_length;
+};
+
+// Decompresses arbitrary ranges of a chunked blob, using its seek table.
+class ChunkedDecompressor {
+ public:
+  DISALLOW_COPY_ASSIGN_AND_MOVE(ChunkedDecompressor);
+  ~ChunkedDecompressor();
+
+  // Reads the size of the header and seek table from the start of a chunked blob. |buf| must hold
+  // at least |sizeof(ChunkedHeader)| bytes.
+  static zx_status_t HeaderSize(const void* buf, size_t buf_length, size_t* out);
+
+  // Parses the seek table from |buf|, which holds at least the first |HeaderSize()| bytes of a
+  // blob of |data_size| bytes, compressed into at most |compressed_size| bytes.
+  static zx_status_t Create(const void* buf, size_t buf_length, uint64_t data_size,
+                            uint64_t compressed_size, fbl::unique_ptr<ChunkedDecompressor>* out);
+
+  uint64_t data_size() const { return data_size_; }
+
+  // Widens the uncompressed range [offset, offset + length) to whole frames, and returns that
+  // range along with the compressed bytes holding it.
+  zx_status_t MapRange(uint64_t offset, uint64_t length, ChunkedRange* out) const;
+
+  // Decompresses |range|, as returned by MapRange(), into |target|. |src| holds the compressed
+  // bytes of |range|, and |target| must hold |range.data_length| bytes.
+  zx_status_t DecompressRange(const ChunkedRange& range, void* target, const void* src);
+
+ private:
+  ChunkedDecompressor(ZSTD_DCtx* ctx, uint64_t data_size, uint32_t frame_size,
+                      fbl::Array<uint64_t> seek_table);
+
+  ZSTD_DCtx* ctx_ = nullptr;
+  const uint64_t data_size_;
+  const uint32_t frame_size_;
+  // frame_count + 1 compressed offsets, as stored on disk.
+  fbl::Array<uint64_t> seek_table_;
+};
+
+// Decompress the source buffer into the target buffer, until either the source is drained or
+// the target is filled (or both).
+zx_status_t ChunkedDecompress(void* target_buf, size_t* target_size, const void* src_buf,
+                              size_t* src_size);
+
+// Same as ChunkedDecompress(), but decompresses runs of frames on up to |num_threads| threads,
+// including the calling thread.
+zx_status_t ChunkedDecompressParallel(void* target_buf, size_t* target_size, const void* src_buf,
+                                      size_t* src_size, size_t num_threads);
+
+}  // namespace blobfs
@@ -14,6 +14,8 @@ namespace blobfs {
 enum class CompressionAlgorithm {
   LZ4,
   ZSTD,
+  // ZSTD, in independently decompressible frames.
+  CHUNKED,
 };
 
 // A Compressor is used to compress data transparently before it is written
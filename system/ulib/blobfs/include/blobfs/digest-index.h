@@ -0,0 +1,79 @@
+// Copyright 2019 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <digest/digest.h>
+#include <fbl/array.h>
+#include <fbl/macros.h>
+#include <zircon/types.h>
+
+namespace blobfs {
+
+// Maps the Merkle roots of blobs to the indices of their inodes.
+//
+// This lets blobfs answer whether a blob exists, and find its inode, without creating a vnode
+// for every blob at mount. Entries are kept in an open-addressed hash table; Merkle roots are
+// already uniformly distributed, so their leading bytes are used as the hash.
+//
+// Thread-compatible.
+class DigestIndex {
+ public:
+  DISALLOW_COPY_ASSIGN_AND_MOVE(DigestIndex);
+  DigestIndex() = default;
+
+  // Returns the number of blobs in the index.
+  size_t size() const { return count_; }
+
+  // Returns the number of bytes of memory used by the index.
+  size_t MemoryUsage() const { return table_.size() * sizeof(Entry); }
+
+  // Removes all entries, and releases the table.
+  void Reset();
+
+  // Grows the table so that |count| entries fit without growing it again.
+  zx_status_t Reserve(size_t count);
+
+  // Maps |digest| to |node_index|.
+  //
+  // Returns ZX_ERR_ALREADY_EXISTS if |digest| is already in the index.
+  zx_status_t Insert(const uint8_t* digest, uint32_t node_index);
+
+  // Finds the node index of |digest|, and places it in |out| if |out| is not null.
+  //
+  // Returns ZX_ERR_NOT_FOUND if |digest| is not in the index.
+  zx_status_t Lookup(const uint8_t* digest, uint32_t* out) const;
+
+  // Removes |digest| from the index.
+  //
+  // Returns ZX_ERR_NOT_FOUND if |digest| is not in the index.
+  zx_status_t Erase(const uint8_t* digest);
+
+ private:
+  // Marks an empty slot. Inode indices are always smaller, since |Superblock::inode_count| is
+  // at most this value.
+  static constexpr uint32_t kEmpty = UINT32_MAX;
+
+  struct Entry {
+    uint8_t digest[digest::Digest::kLength];
+    uint32_t node_index;
+  };
+
+  // Returns the slot |digest| would occupy in an empty table.
+  size_t Home(const uint8_t* digest) const;
+
+  // Returns the slot holding |digest|, or the empty slot where it would be inserted.
+  size_t Find(const uint8_t* digest) const;
+
+  // Reallocates the table with |capacity| slots, a power of two, and reinserts every entry.
+  zx_status_t Rehash(size_t capacity);
+
+  fbl::Array<Entry> table_;
+  size_t count_ = 0;
+};
+
+}  // namespace blobfs
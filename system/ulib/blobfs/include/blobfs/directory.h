@@ -57,11 +57,6 @@ class Directory final : public fs::Vnode {
   zx_status_t Serve(fs::Vfs* vfs, zx::channel channel, uint32_t flags) final;
   bool IsDirectory() const final { return true; }
 
-  ////////////////
-  // Other methods.
-
-  BlobCache& Cache();
-
   Blobfs* const blobfs_;
 };
 
@@ -251,8 +251,10 @@ zx_status_t blobfs_create(fbl::unique_ptr<Blobfs>* out, fbl::unique_fd blockfd);
 
 // Pre-process a blob by creating a merkle tree and digest from the supplied file.
 // Also return the length of the file. If |compress| is true and we decide to compress the file,
-// the compressed length and data are returned.
-zx_status_t blobfs_preprocess(int data_fd, bool compress, MerkleInfo* out_info);
+// the compressed length and data are returned. The Merkle tree is built on up to |num_threads|
+// threads.
+zx_status_t blobfs_preprocess(int data_fd, bool compress, MerkleInfo* out_info,
+                              size_t num_threads = 1);
 
 // blobfs_add_blob may be called by multiple threads to gain concurrent
 // merkle tree generation. No other methods are thread safe.
@@ -38,6 +38,15 @@ class BlobfsMetrics {
   bool Collecting() const { return cobalt_metrics_.IsEnabled(); }
   void Disable() { cobalt_metrics_.EnableMetrics(false); }
 
+  // Updates information about mounting: the number of blobs found, the
+  // memory used by the digest index holding them, and how long it took to
+  // build.
+  void UpdateMount(uint64_t blobs_indexed, uint64_t index_size, const fs::Duration& duration);
+
+  // Updates aggregate information about blob vnodes created when blobs are
+  // first looked up, and the digest index which those blobs leave.
+  void UpdateVnodeCreated(uint64_t blobs_indexed, uint64_t index_size);
+
   // Updates aggregate information about the total number of created
   // blobs since mounting.
   void UpdateAllocation(uint64_t size_data, const fs::Duration& duration);
@@ -70,6 +79,16 @@ class BlobfsMetrics {
   // since mounting.
   void UpdateMerkleVerify(uint64_t size_data, uint64_t size_merkle, const fs::Duration& duration);
 
+  // Updates aggregate information about blob VMOs whose contents are
+  // supplied on demand by the pager.
+  void UpdatePagedVmo(uint64_t size_data);
+
+  // Updates aggregate information about page requests served by the pager.
+  // |size_requested| is the size of the range that faulted, and |size_fetched|
+  // is how much was read from disk and verified to serve it.
+  void UpdatePagedRead(uint64_t size_requested, uint64_t size_fetched,
+                       const fs::Duration& read_duration, const fs::Duration& verify_duration);
+
   // Returns a new Latency event for the given event. This requires the event to be backed up by
   // an histogram in both cobalt metrics and Inspect.
   LatencyEvent NewLatencyEvent(fs_metrics::Event event) {
@@ -82,6 +101,16 @@ class BlobfsMetrics {
  private:
   static cobalt_client::CollectorOptions GetBlobfsOptions();
 
+  // MOUNT STATS
+
+  // Blobs whose vnodes have not been created yet, and the memory used to
+  // index them.
+  uint64_t blobs_indexed_ = 0;
+  uint64_t index_size_ = 0;
+  zx::ticks total_mount_time_ticks_ = {};
+  // Blob vnodes created on first lookup.
+  uint64_t vnodes_created_ = 0;
+
   // ALLOCATION STATS
 
   // Created with external-facing "Create".
@@ -123,6 +152,18 @@ class BlobfsMetrics {
   uint64_t blobs_verified_total_size_merkle_ = 0;
   zx::ticks total_verification_time_ticks_ = {};
 
+  // PAGER STATS
+
+  // Blob VMOs created by the pager, and the bytes of blob data they map.
+  uint64_t paged_vmos_created_ = 0;
+  uint64_t paged_bytes_mapped_ = 0;
+  // Page requests, and the bytes faulted, fetched and verified to serve them.
+  uint64_t paged_reads_ = 0;
+  uint64_t paged_bytes_requested_ = 0;
+  uint64_t paged_bytes_fetched_ = 0;
+  zx::ticks total_paged_read_time_ticks_ = {};
+  zx::ticks total_paged_verify_time_ticks_ = {};
+
   // FVM STATS
   // TODO(smklein)
 
@@ -0,0 +1,165 @@
+// Copyright 2019 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// This file contains the userspace pager which serves the VMOs of blobs.
+
+#ifndef BLOBFS_PAGER_H_
+#define BLOBFS_PAGER_H_
+
+#ifndef __Fuchsia__
+#error Fuchsia-only Header
+#endif
+
+#include <lib/fzl/owned-vmo-mapper.h>
+#include <lib/zx/pager.h>
+#include <lib/zx/port.h>
+#include <lib/zx/vmo.h>
+#include <threads.h>
+
+#include <map>
+#include <memory>
+
+#include <blobfs/compression/chunked.h>
+#include <blobfs/metrics.h>
+#include <digest/digest.h>
+#include <fbl/macros.h>
+#include <fbl/mutex.h>
+#include <fbl/ref_counted.h>
+#include <fbl/ref_ptr.h>
+#include <fbl/unique_ptr.h>
+#include <fbl/vector.h>
+#include <fs/buffer/vmoid_registry.h>
+#include <fs/transaction/block_transaction.h>
+
+namespace blobfs {
+
+// A run of a blob's data blocks which is contiguous on disk.
+struct DataExtent {
+  // Block offset within the blob's data as stored, not counting the Merkle tree. For compressed
+  // blobs, this is an offset within the compressed data.
+  uint64_t data_block;
+  // Block offset within the data region of the device.
+  uint64_t dev_block;
+  uint32_t length;
+};
+
+// Reads, verifies and supplies the pages of one blob's paged VMO.
+//
+// A PageSource is used by the pager thread, and may outlive the blob it was created for, so it
+// holds its own copy of everything needed to resolve page requests: the Merkle tree, the location
+// of the data on disk, and a buffer to read data into. Blobs stored in the chunked compression
+// format also keep their seek table, and only the frames covering a request are read and
+// decompressed.
+class PageSource : public fbl::RefCounted<PageSource> {
+ public:
+  DISALLOW_COPY_ASSIGN_AND_MOVE(PageSource);
+
+  // |merkle| holds the blob's Merkle tree, and |extents| describes where its data lives on disk,
+  // relative to |data_start|.
+  PageSource(fs::TransactionHandler* handler, fs::VmoidRegistry* vmoid_registry,
+             BlobfsMetrics* metrics, const uint8_t* root, uint64_t data_size, uint64_t data_start,
+             fzl::OwnedVmoMapper merkle, fbl::Vector<DataExtent> extents);
+  ~PageSource();
+
+  // Creates the buffer which data is read into before it is supplied to the paged VMO. If
+  // |chunked|, the data is stored in the chunked compression format, and its seek table is read.
+  zx_status_t Init(const char* name, bool chunked);
+
+  // Reads the blob's data covering [offset, offset + length), verifies it against the Merkle
+  // tree and supplies it to |vmo|.
+  //
+  // The range is widened to whole blocks, which are also the unit of verification, and for
+  // compressed blobs to whole frames.
+  zx_status_t Populate(const zx::pager& pager, const zx::vmo& vmo, uint64_t offset,
+                       uint64_t length);
+
+  uint64_t data_size() const { return data_size_; }
+
+ private:
+  // Enqueues reads for stored data blocks [start, start + length) into |vmoid|, at the same
+  // block offsets.
+  void EnqueueReads(fs::ReadTxn* txn, vmoid_t vmoid, uint64_t start, uint64_t length) const;
+
+  // Reads the seek table of a compressed blob and creates |decompressor_|.
+  zx_status_t ReadSeekTable();
+
+  // Reads data bytes [start, end) into the transfer buffer.
+  zx_status_t ReadUncompressed(uint64_t start, uint64_t end);
+
+  // Reads and decompresses the frames covering data bytes [*start, *end) into the transfer
+  // buffer, widening the range to cover them.
+  zx_status_t ReadCompressed(uint64_t* start, uint64_t* end);
+
+  fs::TransactionHandler* const handler_;
+  fs::VmoidRegistry* const vmoid_registry_;
+  BlobfsMetrics* const metrics_;
+  const digest::Digest root_;
+  const uint64_t data_size_;
+  const uint64_t data_start_;
+  fzl::OwnedVmoMapper merkle_;
+  fbl::Vector<DataExtent> extents_;
+
+  // Holds the blob's data, at the same offsets as the paged VMO, until it has been verified and
+  // supplied. Supplying pages moves them into the paged VMO, so only the pages of in-flight
+  // requests are ever committed here.
+  fzl::OwnedVmoMapper transfer_;
+  vmoid_t transfer_vmoid_ = {};
+
+  // Only used by compressed blobs. Holds compressed data, at the same offsets as it is stored,
+  // until it has been decompressed into the transfer buffer.
+  fbl::unique_ptr<ChunkedDecompressor> decompressor_;
+  fzl::OwnedVmoMapper compressed_;
+  vmoid_t compressed_vmoid_ = {};
+};
+
+// Serves page requests for the VMOs of blobs.
+//
+// Requests are handled on a dedicated thread, so that the dispatcher thread may itself fault
+// on blob VMOs (for example, when reading a blob) without deadlocking.
+class BlobPager {
+ public:
+  DISALLOW_COPY_ASSIGN_AND_MOVE(BlobPager);
+
+  ~BlobPager();
+
+  static zx_status_t Create(std::unique_ptr<BlobPager>* out);
+
+  // Creates a VMO of |source->data_size()| bytes (rounded up to a page) whose contents are
+  // supplied on demand by |source|.
+  zx_status_t CreateVmo(fbl::RefPtr<PageSource> source, zx::vmo* out);
+
+  // Detaches |vmo| from the pager. Any further page requests for it fail.
+  //
+  // The source of the VMO is released once the pager thread has seen the VMO complete.
+  void DetachVmo(const zx::vmo& vmo);
+
+ private:
+  BlobPager() = default;
+
+  int PagerThread();
+
+  // A VMO served by the pager, and the source of its pages.
+  struct PagedVmo {
+    fbl::RefPtr<PageSource> source;
+    zx::vmo vmo;
+  };
+
+  // Handles a page request for the VMO with packet key |key|.
+  void HandleRequest(uint64_t key, const zx_packet_page_request_t& request);
+
+  zx::pager pager_;
+  zx::port port_;
+  thrd_t thread_;
+  bool thread_started_ = false;
+
+  // Entries are added by CreateVmo() and only removed by the pager thread, so the pager thread
+  // may keep using an entry after dropping the lock.
+  fbl::Mutex lock_;
+  uint64_t next_key_ __TA_GUARDED(lock_) = 1;
+  std::map<uint64_t, PagedVmo> vmos_ __TA_GUARDED(lock_);
+};
+
+}  // namespace blobfs
+
+#endif  // BLOBFS_PAGER_H_
@@ -31,6 +31,11 @@ void BlobfsMetrics::Dump() const {
   }
   constexpr uint64_t mb = 1 << 20;
 
+  FS_TRACE_INFO("Mount Info:\n");
+  FS_TRACE_INFO("  Indexed blobs in %zu ms, created %zu vnodes on lookup\n",
+                TicksToMs(total_mount_time_ticks_), vnodes_created_);
+  FS_TRACE_INFO("  %zu blobs without vnodes (%zu KB index)\n", blobs_indexed_,
+                index_size_ / 1024);
   FS_TRACE_INFO("Allocation Info:\n");
   FS_TRACE_INFO("  Allocated %zu blobs (%zu MB) in %zu ms\n", blobs_created_,
                 blobs_created_total_size_ / mb, TicksToMs(total_allocation_time_ticks_));
@@ -49,6 +54,30 @@ void BlobfsMetrics::Dump() const {
   FS_TRACE_INFO("  Spent %zu ms reading %zu MB from disk, %zu ms verifying\n",
                 TicksToMs(total_read_from_disk_time_ticks_), bytes_read_from_disk_ / mb,
                 TicksToMs(total_verification_time_ticks_));
+  FS_TRACE_INFO("Pager Info:\n");
+  FS_TRACE_INFO("  Created %zu paged blob vmos (%zu MB mapped)\n", paged_vmos_created_,
+                paged_bytes_mapped_ / mb);
+  FS_TRACE_INFO("  Served %zu page requests (%zu MB requested, %zu MB fetched)\n", paged_reads_,
+                paged_bytes_requested_ / mb, paged_bytes_fetched_ / mb);
+  FS_TRACE_INFO("  Spent %zu ms reading pages from disk, %zu ms verifying\n",
+                TicksToMs(total_paged_read_time_ticks_), TicksToMs(total_paged_verify_time_ticks_));
+}
+
+void BlobfsMetrics::UpdateMount(uint64_t blobs_indexed, uint64_t index_size,
+                                const fs::Duration& duration) {
+  if (Collecting()) {
+    blobs_indexed_ = blobs_indexed;
+    index_size_ = index_size;
+    total_mount_time_ticks_ += duration;
+  }
+}
+
+void BlobfsMetrics::UpdateVnodeCreated(uint64_t blobs_indexed, uint64_t index_size) {
+  if (Collecting()) {
+    vnodes_created_++;
+    blobs_indexed_ = blobs_indexed;
+    index_size_ = index_size;
+  }
 }
 
 void BlobfsMetrics::UpdateAllocation(uint64_t size_data, const fs::Duration& duration) {
@@ -112,4 +141,23 @@ void BlobfsMetrics::UpdateMerkleVerify(uint64_t size_data, uint64_t size_merkle,
   }
 }
 
+void BlobfsMetrics::UpdatePagedVmo(uint64_t size_data) {
+  if (Collecting()) {
+    paged_vmos_created_++;
+    paged_bytes_mapped_ += size_data;
+  }
+}
+
+void BlobfsMetrics::UpdatePagedRead(uint64_t size_requested, uint64_t size_fetched,
+                                    const fs::Duration& read_duration,
+                                    const fs::Duration& verify_duration) {
+  if (Collecting()) {
+    paged_reads_++;
+    paged_bytes_requested_ += size_requested;
+    paged_bytes_fetched_ += size_fetched;
+    total_paged_read_time_ticks_ += read_duration;
+    total_paged_verify_time_ticks_ += verify_duration;
+  }
+}
+
 }  // namespace blobfs
@@ -0,0 +1,326 @@
+// Copyright 2019 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <blobfs/pager.h>
+
+#include <string.h>
+#include <zircon/status.h>
+#include <zircon/syscalls/port.h>
+
+#include <utility>
+
+#include <blobfs/format.h>
+#include <digest/merkle-tree.h>
+#include <fbl/algorithm.h>
+#include <fbl/auto_lock.h>
+#include <fs/ticker.h>
+#include <fs/trace.h>
+#include <trace/event.h>
+
+namespace blobfs {
+
+using digest::MerkleTree;
+
+// Page requests are widened to whole blocks, so that every request covers whole nodes of the
+// Merkle tree and can be verified on its own.
+static_assert(kBlobfsBlockSize == MerkleTree::kNodeSize,
+              "Blocks must match the nodes of the Merkle tree");
+static_assert(kBlobfsBlockSize % ZX_PAGE_SIZE == 0, "Blocks must be whole pages");
+
+PageSource::PageSource(fs::TransactionHandler* handler, fs::VmoidRegistry* vmoid_registry,
+                       BlobfsMetrics* metrics, const uint8_t* root, uint64_t data_size,
+                       uint64_t data_start, fzl::OwnedVmoMapper merkle,
+                       fbl::Vector<DataExtent> extents)
+    : handler_(handler),
+      vmoid_registry_(vmoid_registry),
+      metrics_(metrics),
+      root_(root),
+      data_size_(data_size),
+      data_start_(data_start),
+      merkle_(std::move(merkle)),
+      extents_(std::move(extents)) {}
+
+PageSource::~PageSource() {
+  if (transfer_vmoid_ != VMOID_INVALID) {
+    vmoid_registry_->DetachVmo(transfer_vmoid_);
+  }
+  if (compressed_vmoid_ != VMOID_INVALID) {
+    vmoid_registry_->DetachVmo(compressed_vmoid_);
+  }
+}
+
+zx_status_t PageSource::Init(const char* name, bool chunked) {
+  zx_status_t status =
+      transfer_.CreateAndMap(fbl::round_up(data_size_, kBlobfsBlockSize), name);
+  if (status != ZX_OK) {
+    FS_TRACE_ERROR("blobfs: Failed to create transfer vmo: %d\n", status);
+    return status;
+  }
+  if ((status = vmoid_registry_->AttachVmo(transfer_.vmo(), &transfer_vmoid_)) != ZX_OK) {
+    FS_TRACE_ERROR("blobfs: Failed to attach transfer vmo: %d\n", status);
+    return status;
+  }
+  if (!chunked) {
+    return ZX_OK;
+  }
+
+  uint64_t compressed_blocks = 0;
+  for (const DataExtent& extent : extents_) {
+    compressed_blocks += extent.length;
+  }
+  if ((status = compressed_.CreateAndMap(compressed_blocks * kBlobfsBlockSize, name)) != ZX_OK) {
+    FS_TRACE_ERROR("blobfs: Failed to create compressed vmo: %d\n", status);
+    return status;
+  }
+  if ((status = vmoid_registry_->AttachVmo(compressed_.vmo(), &compressed_vmoid_)) != ZX_OK) {
+    FS_TRACE_ERROR("blobfs: Failed to attach compressed vmo: %d\n", status);
+    return status;
+  }
+  return ReadSeekTable();
+}
+
+zx_status_t PageSource::ReadSeekTable() {
+  // The seek table is at the start of the compressed data, and usually fits in its first block.
+  const uint64_t compressed_blocks = compressed_.size() / kBlobfsBlockSize;
+  if (compressed_blocks == 0) {
+    return ZX_ERR_IO_DATA_INTEGRITY;
+  }
+  fs::ReadTxn txn(handler_);
+  EnqueueReads(&txn, compressed_vmoid_, 0, 1);
+  zx_status_t status = txn.Transact();
+  if (status != ZX_OK) {
+    FS_TRACE_ERROR("blobfs: Failed to read seek table: %s\n", zx_status_get_string(status));
+    return status;
+  }
+  size_t header_size;
+  if ((status = ChunkedDecompressor::HeaderSize(compressed_.start(), kBlobfsBlockSize,
+                                                &header_size)) != ZX_OK) {
+    return status;
+  }
+  const uint64_t header_blocks = fbl::round_up(header_size, kBlobfsBlockSize) / kBlobfsBlockSize;
+  if (header_blocks > compressed_blocks) {
+    return ZX_ERR_IO_DATA_INTEGRITY;
+  }
+  if (header_blocks > 1) {
+    fs::ReadTxn rest(handler_);
+    EnqueueReads(&rest, compressed_vmoid_, 1, header_blocks - 1);
+    if ((status = rest.Transact()) != ZX_OK) {
+      FS_TRACE_ERROR("blobfs: Failed to read seek table: %s\n", zx_status_get_string(status));
+      return status;
+    }
+  }
+
+  status = ChunkedDecompressor::Create(compressed_.start(), header_size, data_size_,
+                                       compressed_.size(), &decompressor_);
+  compressed_.vmo().op_range(ZX_VMO_OP_DECOMMIT, 0, header_blocks * kBlobfsBlockSize, nullptr, 0);
+  return status;
+}
+
+void PageSource::EnqueueReads(fs::ReadTxn* txn, vmoid_t vmoid, uint64_t start,
+                              uint64_t length) const {
+  const uint64_t end = start + length;
+  for (const DataExtent& extent : extents_) {
+    const uint64_t extent_end = extent.data_block + extent.length;
+    if (extent_end <= start || extent.data_block >= end) {
+      continue;
+    }
+    const uint64_t first = fbl::max(start, extent.data_block);
+    const uint64_t last = fbl::min(end, extent_end);
+    txn->Enqueue(vmoid, first, data_start_ + extent.dev_block + (first - extent.data_block),
+                 last - first);
+  }
+}
+
+zx_status_t PageSource::ReadUncompressed(uint64_t start, uint64_t end) {
+  fs::ReadTxn txn(handler_);
+  EnqueueReads(&txn, transfer_vmoid_, start / kBlobfsBlockSize, (end - start) / kBlobfsBlockSize);
+  zx_status_t status = txn.Transact();
+  if (status != ZX_OK) {
+    FS_TRACE_ERROR("blobfs: Failed to read pages: %s\n", zx_status_get_string(status));
+  }
+  return status;
+}
+
+zx_status_t PageSource::ReadCompressed(uint64_t* start, uint64_t* end) {
+  ChunkedRange range;
+  zx_status_t status = decompressor_->MapRange(*start, *end - *start, &range);
+  if (status != ZX_OK) {
+    return status;
+  }
+  const uint64_t first_block = range.compressed_offset / kBlobfsBlockSize;
+  const uint64_t last_block =
+      fbl::round_up(range.compressed_offset + range.compressed_length, kBlobfsBlockSize) /
+      kBlobfsBlockSize;
+  fs::ReadTxn txn(handler_);
+  EnqueueReads(&txn, compressed_vmoid_, first_block, last_block - first_block);
+  if ((status = txn.Transact()) != ZX_OK) {
+    FS_TRACE_ERROR("blobfs: Failed to read compressed pages: %s\n", zx_status_get_string(status));
+    return status;
+  }
+
+  status = decompressor_->DecompressRange(
+      range, static_cast<uint8_t*>(transfer_.start()) + range.data_offset,
+      static_cast<const uint8_t*>(compressed_.start()) + range.compressed_offset);
+  // The compressed data is not needed once it has been decompressed.
+  compressed_.vmo().op_range(ZX_VMO_OP_DECOMMIT, first_block * kBlobfsBlockSize,
+                             (last_block - first_block) * kBlobfsBlockSize, nullptr, 0);
+  if (status != ZX_OK) {
+    return status;
+  }
+  *start = range.data_offset;
+  *end = fbl::round_up(range.data_offset + range.data_length, kBlobfsBlockSize);
+  return ZX_OK;
+}
+
+zx_status_t PageSource::Populate(const zx::pager& pager, const zx::vmo& vmo, uint64_t offset,
+                                 uint64_t length) {
+  TRACE_DURATION("blobfs", "PageSource::Populate", "offset", offset, "length", length);
+  uint64_t start = fbl::round_down(offset, kBlobfsBlockSize);
+  uint64_t end = fbl::min(fbl::round_up(offset + length, kBlobfsBlockSize),
+                          fbl::round_up(data_size_, kBlobfsBlockSize));
+  if (start >= end) {
+    return ZX_ERR_OUT_OF_RANGE;
+  }
+
+  // For compressed blobs, the read time includes decompression.
+  fs::Ticker ticker(metrics_->Collecting());
+  zx_status_t status = decompressor_ ? ReadCompressed(&start, &end) : ReadUncompressed(start, end);
+  if (status != ZX_OK) {
+    return status;
+  }
+  fs::Duration read_time = ticker.End();
+  ticker.Reset();
+
+  // Only the part of the blob that was read is looked at.
+  const uint64_t merkle_size = MerkleTree::GetTreeLength(data_size_);
+  status = MerkleTree::Verify(transfer_.start(), data_size_,
+                              merkle_size ? merkle_.start() : nullptr, merkle_size, start,
+                              fbl::min(end, data_size_) - start, root_);
+  metrics_->UpdatePagedRead(length, end - start, read_time, ticker.End());
+  if (status != ZX_OK) {
+    FS_TRACE_ERROR("blobfs: Failed to verify pages [%lu, %lu): %s\n", start, end,
+                   zx_status_get_string(status));
+    return status;
+  }
+
+  // The tail of the last block is not covered by the Merkle tree, so don't trust its contents.
+  if (end > data_size_) {
+    memset(static_cast<uint8_t*>(transfer_.start()) + data_size_, 0, end - data_size_);
+  }
+
+  // The last block may extend past the end of the VMO, which is only rounded up to a page.
+  const uint64_t supply_end = fbl::min(end, fbl::round_up(data_size_, ZX_PAGE_SIZE));
+  if (supply_end < end) {
+    transfer_.vmo().op_range(ZX_VMO_OP_DECOMMIT, supply_end, end - supply_end, nullptr, 0);
+  }
+  return pager.supply_pages(vmo, start, supply_end - start, transfer_.vmo(), start);
+}
+
+BlobPager::~BlobPager() {
+  if (thread_started_) {
+    zx_port_packet_t packet = {};
+    packet.type = ZX_PKT_TYPE_USER;
+    ZX_ASSERT(port_.queue(&packet) == ZX_OK);
+    thrd_join(thread_, nullptr);
+  }
+}
+
+zx_status_t BlobPager::Create(std::unique_ptr<BlobPager>* out) {
+  std::unique_ptr<BlobPager> pager(new BlobPager());
+  zx_status_t status = zx::pager::create(0, &pager->pager_);
+  if (status != ZX_OK) {
+    FS_TRACE_ERROR("blobfs: Failed to create pager: %d\n", status);
+    return status;
+  }
+  if ((status = zx::port::create(0, &pager->port_)) != ZX_OK) {
+    FS_TRACE_ERROR("blobfs: Failed to create pager port: %d\n", status);
+    return status;
+  }
+  auto thread = [](void* arg) { return static_cast<BlobPager*>(arg)->PagerThread(); };
+  if (thrd_create_with_name(&pager->thread_, thread, pager.get(), "blobfs-pager") !=
+      thrd_success) {
+    return ZX_ERR_NO_RESOURCES;
+  }
+  pager->thread_started_ = true;
+  *out = std::move(pager);
+  return ZX_OK;
+}
+
+zx_status_t BlobPager::CreateVmo(fbl::RefPtr<PageSource> source, zx::vmo* out) {
+  const uint64_t size = fbl::round_up(source->data_size(), ZX_PAGE_SIZE);
+  fbl::AutoLock lock(&lock_);
+  const uint64_t key = next_key_++;
+  zx::vmo vmo;
+  zx_status_t status = pager_.create_vmo(0, port_, key, size, &vmo);
+  if (status != ZX_OK) {
+    return status;
+  }
+  PagedVmo paged_vmo;
+  if ((status = vmo.duplicate(ZX_RIGHT_SAME_RIGHTS, &paged_vmo.vmo)) != ZX_OK) {
+    return status;
+  }
+  paged_vmo.source = std::move(source);
+  vmos_.emplace(key, std::move(paged_vmo));
+  *out = std::move(vmo);
+  return ZX_OK;
+}
+
+void BlobPager::DetachVmo(const zx::vmo& vmo) {
+  zx_status_t status = pager_.detach_vmo(vmo);
+  if (status != ZX_OK) {
+    FS_TRACE_ERROR("blobfs: Failed to detach vmo: %d\n", status);
+  }
+}
+
+void BlobPager::HandleRequest(uint64_t key, const zx_packet_page_request_t& request) {
+  fbl::RefPtr<PageSource> source;
+  zx::unowned_vmo vmo;
+  PagedVmo completed;
+  {
+    fbl::AutoLock lock(&lock_);
+    auto entry = vmos_.find(key);
+    if (entry == vmos_.end()) {
+      return;
+    }
+    if (request.command == ZX_PAGER_VMO_COMPLETE) {
+      // Release the source outside the lock, since it detaches its buffer from the device.
+      completed = std::move(entry->second);
+      vmos_.erase(entry);
+      return;
+    }
+    source = entry->second.source;
+    vmo = zx::unowned_vmo(entry->second.vmo);
+  }
+
+  if (request.command != ZX_PAGER_VMO_READ) {
+    return;
+  }
+  zx_status_t status = source->Populate(pager_, *vmo, request.offset, request.length);
+  if (status != ZX_OK) {
+    // There is no way to fail a single request, so fail them all. Corrupt data is never
+    // supplied, and threads faulting on the VMO get an error instead of waiting forever.
+    FS_TRACE_ERROR("blobfs: Failed to supply pages: %s\n", zx_status_get_string(status));
+    DetachVmo(*vmo);
+  }
+}
+
+int BlobPager::PagerThread() {
+  for (;;) {
+    zx_port_packet_t packet;
+    zx_status_t status = port_.wait(zx::time::infinite(), &packet);
+    if (status != ZX_OK) {
+      FS_TRACE_ERROR("blobfs: Pager port wait failed: %d\n", status);
+      return -1;
+    }
+    if (packet.type == ZX_PKT_TYPE_USER) {
+      // Sent by the destructor.
+      return 0;
+    }
+    if (packet.type == ZX_PKT_TYPE_PAGE_REQUEST) {
+      HandleRequest(packet.key, packet.page_request);
+    }
+  }
+}
+
+}  // namespace blobfs
@@ -13,12 +13,14 @@
 #include <utime.h>
 #include <zircon/device/vfs.h>
 
+#include <algorithm>
 #include <array>
 #include <atomic>
 #include <thread>
 #include <vector>
 
 #include <digest/digest.h>
+#include <fbl/algorithm.h>
 #include <fbl/auto_call.h>
 #include <zxtest/zxtest.h>
 
@@ -317,6 +319,57 @@ TEST_F(BlobfsTest, MmapUseAfterClose) { RunMmapUseAfterCloseTest(); }
 
 TEST_F(BlobfsTestWithFvm, MmapUseAfterClose) { RunMmapUseAfterCloseTest(); }
 
+// Touches the pages of a blob read back from disk out of order, so that they are paged in one
+// request at a time rather than all at once. Compressible blobs are stored compressed, and are
+// decompressed a frame at a time.
+void RunMmapPagedTest(FilesystemTest* test, bool compressible) {
+  constexpr size_t kBlobSize = (1 << 20) + 1234;
+  std::unique_ptr<fs_test_utils::BlobInfo> info;
+  if (compressible) {
+    ASSERT_TRUE(fs_test_utils::GenerateBlob(
+        [](char* data, size_t length) {
+          for (size_t i = 0; i < length; i++) {
+            data[i] = static_cast<char>(rand() % 4);
+          }
+        },
+        kMountPath, kBlobSize, &info));
+  } else {
+    ASSERT_TRUE(fs_test_utils::GenerateRandomBlob(kMountPath, kBlobSize, &info));
+  }
+
+  fbl::unique_fd fd;
+  ASSERT_NO_FAILURES(MakeBlob(info.get(), &fd));
+  fd.reset();
+  ASSERT_NO_FAILURES(test->Remount());
+
+  fd.reset(open(info->path, O_RDONLY));
+  ASSERT_TRUE(fd, "Failed to-reopen blob");
+  void* addr = mmap(NULL, info->size_data, PROT_READ, MAP_PRIVATE, fd.get(), 0);
+  ASSERT_NE(addr, MAP_FAILED, "Could not mmap blob");
+  fd.reset();
+
+  const uint8_t* data = static_cast<const uint8_t*>(addr);
+  const size_t page_count = fbl::round_up(info->size_data, ZX_PAGE_SIZE) / ZX_PAGE_SIZE;
+  for (size_t i = page_count; i-- > 0;) {
+    const size_t page = (i * 7) % page_count;
+    const size_t offset = page * ZX_PAGE_SIZE;
+    const size_t length = std::min<size_t>(ZX_PAGE_SIZE, info->size_data - offset);
+    ASSERT_BYTES_EQ(data + offset, info->data.get() + offset, length);
+  }
+  ASSERT_BYTES_EQ(addr, info->data.get(), info->size_data);
+
+  ASSERT_EQ(0, munmap(addr, info->size_data));
+  ASSERT_EQ(0, unlink(info->path));
+}
+
+TEST_F(BlobfsTest, MmapPaged) { RunMmapPagedTest(this, false); }
+
+TEST_F(BlobfsTestWithFvm, MmapPaged) { RunMmapPagedTest(this, false); }
+
+TEST_F(BlobfsTest, MmapPagedCompressed) { RunMmapPagedTest(this, true); }
+
+TEST_F(BlobfsTestWithFvm, MmapPagedCompressed) { RunMmapPagedTest(this, true); }
+
 void RunReadDirectoryTest() {
   constexpr size_t kMaxEntries = 50;
   constexpr size_t kBlobSize = 1 << 10;
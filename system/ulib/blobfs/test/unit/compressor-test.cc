@@ -6,11 +6,15 @@
 
 #include <algorithm>
 #include <memory>
+#include <utility>
 
 #include <blobfs/compression/blob-compressor.h>
+#include <blobfs/compression/chunked.h>
 #include <blobfs/compression/compressor.h>
 #include <blobfs/compression/lz4.h>
 #include <blobfs/compression/zstd.h>
+#include <blobfs/format.h>
+#include <fbl/algorithm.h>
 #include <zircon/assert.h>
 #include <zxtest/zxtest.h>
 
@@ -76,6 +80,9 @@ void DecompressionHelper(CompressionAlgorithm algorithm, const void* compressed,
     case CompressionAlgorithm::ZSTD:
       ASSERT_OK(ZSTDDecompress(output.get(), &target_size, compressed, &src_size));
       break;
+    case CompressionAlgorithm::CHUNKED:
+      ASSERT_OK(ChunkedDecompress(output.get(), &target_size, compressed, &src_size));
+      break;
     default:
       ASSERT_TRUE(false, "Bad algorithm");
   }
@@ -169,6 +176,34 @@ TEST(CompressorTests, CompressDecompressZSTDCompressible4) {
   RunCompressDecompressTest(CompressionAlgorithm::ZSTD, DataType::Random, 1 << 15, 1 << 10);
 }
 
+TEST(CompressorTests, CompressDecompressChunkedRandom1) {
+  RunCompressDecompressTest(CompressionAlgorithm::CHUNKED, DataType::Random, 1 << 0, 1 << 0);
+}
+
+TEST(CompressorTests, CompressDecompressChunkedRandom2) {
+  RunCompressDecompressTest(CompressionAlgorithm::CHUNKED, DataType::Random, 1 << 15, 1 << 10);
+}
+
+TEST(CompressorTests, CompressDecompressChunkedRandom3) {
+  RunCompressDecompressTest(CompressionAlgorithm::CHUNKED, DataType::Random,
+                            3 * kChunkedFrameSize + 1234, 1 << 12);
+}
+
+TEST(CompressorTests, CompressDecompressChunkedCompressible1) {
+  RunCompressDecompressTest(CompressionAlgorithm::CHUNKED, DataType::Compressible, 1 << 15,
+                            1 << 10);
+}
+
+TEST(CompressorTests, CompressDecompressChunkedCompressible2) {
+  RunCompressDecompressTest(CompressionAlgorithm::CHUNKED, DataType::Compressible, 1 << 20,
+                            1 << 20);
+}
+
+TEST(CompressorTests, CompressDecompressChunkedCompressible3) {
+  RunCompressDecompressTest(CompressionAlgorithm::CHUNKED, DataType::Compressible,
+                            4 * kChunkedFrameSize, kChunkedFrameSize - 1);
+}
+
 void RunUpdateNoDataTest(CompressionAlgorithm algorithm) {
   const size_t input_size = 1024;
   auto compressor = BlobCompressor::Create(algorithm, input_size);
@@ -192,6 +227,117 @@ TEST(CompressorTests, UpdateNoDataLZ4) { RunUpdateNoDataTest(CompressionAlgorith
 
 TEST(CompressorTests, UpdateNoDataZSTD) { RunUpdateNoDataTest(CompressionAlgorithm::ZSTD); }
 
+TEST(CompressorTests, UpdateNoDataChunked) { RunUpdateNoDataTest(CompressionAlgorithm::CHUNKED); }
+
+// Decompresses ranges of a chunked blob without touching the frames around them.
+TEST(CompressorTests, ChunkedDecompressRange) {
+  const size_t size = 5 * kChunkedFrameSize + 4321;
+  std::unique_ptr<char[]> input(GenerateInput(DataType::Compressible, 0, size));
+  std::optional<BlobCompressor> compressor;
+  ASSERT_NO_FAILURES(
+      CompressionHelper(CompressionAlgorithm::CHUNKED, input.get(), size, 1 << 14, &compressor));
+
+  size_t header_size;
+  ASSERT_OK(ChunkedDecompressor::HeaderSize(compressor->Data(), compressor->Size(), &header_size));
+  EXPECT_EQ(ChunkedHeaderSize(size), header_size);
+  fbl::unique_ptr<ChunkedDecompressor> decompressor;
+  ASSERT_OK(ChunkedDecompressor::Create(compressor->Data(), header_size, size, compressor->Size(),
+                                        &decompressor));
+
+  const uint64_t offsets[] = {size - 1, 0, 2 * kChunkedFrameSize + 17, kChunkedFrameSize - 1};
+  std::unique_ptr<char[]> output(new char[2 * kChunkedFrameSize]);
+  for (uint64_t offset : offsets) {
+    ChunkedRange range;
+    ASSERT_OK(decompressor->MapRange(offset, 2, &range));
+    EXPECT_EQ(0, range.data_offset % kChunkedFrameSize);
+    EXPECT_LE(range.data_offset, offset);
+    EXPECT_GE(range.data_offset + range.data_length, std::min<uint64_t>(offset + 2, size));
+    EXPECT_LE(range.data_length, 2 * kChunkedFrameSize);
+    EXPECT_LT(range.compressed_length, compressor->Size());
+
+    // Only the compressed bytes of the range are supplied.
+    std::unique_ptr<char[]> src(new char[range.compressed_length]);
+    memcpy(src.get(), static_cast<const char*>(compressor->Data()) + range.compressed_offset,
+           range.compressed_length);
+    ASSERT_OK(decompressor->DecompressRange(range, output.get(), src.get()));
+    EXPECT_BYTES_EQ(input.get() + range.data_offset, output.get(), range.data_length);
+  }
+
+  ChunkedRange range;
+  EXPECT_EQ(ZX_ERR_OUT_OF_RANGE, decompressor->MapRange(size, 1, &range));
+}
+
+TEST(CompressorTests, ChunkedCorruptSeekTable) {
+  const size_t size = 3 * kChunkedFrameSize;
+  std::unique_ptr<char[]> input(GenerateInput(DataType::Compressible, 0, size));
+  std::optional<BlobCompressor> compressor;
+  ASSERT_NO_FAILURES(
+      CompressionHelper(CompressionAlgorithm::CHUNKED, input.get(), size, size, &compressor));
+
+  std::unique_ptr<uint8_t[]> compressed(new uint8_t[compressor->Size()]);
+  memcpy(compressed.get(), compressor->Data(), compressor->Size());
+  fbl::unique_ptr<ChunkedDecompressor> decompressor;
+
+  // The size of the data must match the size of the blob.
+  EXPECT_EQ(ZX_ERR_IO_DATA_INTEGRITY,
+            ChunkedDecompressor::Create(compressed.get(), compressor->Size(), size + 1,
+                                        compressor->Size(), &decompressor));
+
+  // Frames must not extend past the compressed data.
+  EXPECT_EQ(ZX_ERR_IO_DATA_INTEGRITY,
+            ChunkedDecompressor::Create(compressed.get(), compressor->Size(), size,
+                                        compressor->Size() - 1, &decompressor));
+
+  // Frames must be in order.
+  uint64_t* seek_table = reinterpret_cast<uint64_t*>(compressed.get() + sizeof(ChunkedHeader));
+  std::swap(seek_table[1], seek_table[2]);
+  EXPECT_EQ(ZX_ERR_IO_DATA_INTEGRITY,
+            ChunkedDecompressor::Create(compressed.get(), compressor->Size(), size,
+                                        compressor->Size(), &decompressor));
+}
+
+// Blobfs only knows the size of compressed data in blocks, so the chunked format must not depend
+// on it.
+TEST(CompressorTests, ChunkedDecompressPadded) {
+  const size_t size = 2 * kChunkedFrameSize + 99;
+  std::unique_ptr<char[]> input(GenerateInput(DataType::Compressible, 0, size));
+  std::optional<BlobCompressor> compressor;
+  ASSERT_NO_FAILURES(
+      CompressionHelper(CompressionAlgorithm::CHUNKED, input.get(), size, size, &compressor));
+
+  const size_t padded_size = fbl::round_up(compressor->Size(), kBlobfsBlockSize);
+  std::unique_ptr<char[]> padded(new char[padded_size]());
+  memcpy(padded.get(), compressor->Data(), compressor->Size());
+  std::unique_ptr<char[]> output(new char[size]);
+  size_t target_size = size;
+  size_t src_size = padded_size;
+  ASSERT_OK(ChunkedDecompress(output.get(), &target_size, padded.get(), &src_size));
+  EXPECT_EQ(size, target_size);
+  EXPECT_EQ(compressor->Size(), src_size);
+  EXPECT_BYTES_EQ(input.get(), output.get(), size);
+}
+
+// Decompressing on several threads must produce the same data, however the frames are split.
+TEST(CompressorTests, ChunkedDecompressParallel) {
+  const size_t size = 37 * kChunkedFrameSize + 1234;
+  std::unique_ptr<char[]> input(GenerateInput(DataType::Random, 0, size));
+  std::optional<BlobCompressor> compressor;
+  ASSERT_NO_FAILURES(
+      CompressionHelper(CompressionAlgorithm::CHUNKED, input.get(), size, size, &compressor));
+
+  std::unique_ptr<char[]> output(new char[size]);
+  for (size_t num_threads : {1, 2, 3, 16}) {
+    memset(output.get(), 0, size);
+    size_t target_size = size;
+    size_t src_size = compressor->Size();
+    ASSERT_OK(ChunkedDecompressParallel(output.get(), &target_size, compressor->Data(),
+                                        &src_size, num_threads));
+    EXPECT_EQ(size, target_size);
+    EXPECT_EQ(compressor->Size(), src_size);
+    EXPECT_BYTES_EQ(input.get(), output.get(), size);
+  }
+}
+
 // TODO(smklein): Add a test of:
 // - Compress
 // - Round up compressed size to block
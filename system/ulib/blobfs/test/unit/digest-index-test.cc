@@ -0,0 +1,91 @@
+// Copyright 2019 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <blobfs/digest-index.h>
+#include <digest/digest.h>
+#include <zxtest/zxtest.h>
+
+namespace blobfs {
+namespace {
+
+using digest::Digest;
+
+Digest GenerateDigest(size_t seed) {
+  Digest digest;
+  ZX_ASSERT(digest.Init() == ZX_OK);
+  digest.Update(&seed, sizeof(seed));
+  digest.Final();
+  return digest;
+}
+
+TEST(DigestIndexTest, Empty) {
+  DigestIndex index;
+  Digest digest = GenerateDigest(0);
+  EXPECT_EQ(0, index.size());
+  EXPECT_EQ(0, index.MemoryUsage());
+  EXPECT_STATUS(index.Lookup(digest.get(), nullptr), ZX_ERR_NOT_FOUND);
+  EXPECT_STATUS(index.Erase(digest.get()), ZX_ERR_NOT_FOUND);
+}
+
+TEST(DigestIndexTest, InsertLookupErase) {
+  DigestIndex index;
+  Digest digest = GenerateDigest(0);
+  ASSERT_OK(index.Insert(digest.get(), 5));
+  EXPECT_EQ(1, index.size());
+  EXPECT_STATUS(index.Insert(digest.get(), 6), ZX_ERR_ALREADY_EXISTS);
+
+  uint32_t node_index = 0;
+  ASSERT_OK(index.Lookup(digest.get(), &node_index));
+  EXPECT_EQ(5, node_index);
+  EXPECT_OK(index.Lookup(digest.get(), nullptr));
+
+  ASSERT_OK(index.Erase(digest.get()));
+  EXPECT_EQ(0, index.size());
+  EXPECT_STATUS(index.Lookup(digest.get(), nullptr), ZX_ERR_NOT_FOUND);
+  EXPECT_STATUS(index.Erase(digest.get()), ZX_ERR_NOT_FOUND);
+}
+
+TEST(DigestIndexTest, Reserve) {
+  DigestIndex index;
+  constexpr size_t kCount = 1000;
+  ASSERT_OK(index.Reserve(kCount));
+  const size_t memory = index.MemoryUsage();
+  EXPECT_GT(memory, 0);
+  for (uint32_t i = 0; i < kCount; i++) {
+    ASSERT_OK(index.Insert(GenerateDigest(i).get(), i));
+  }
+  EXPECT_EQ(memory, index.MemoryUsage());
+
+  index.Reset();
+  EXPECT_EQ(0, index.size());
+  EXPECT_EQ(0, index.MemoryUsage());
+}
+
+// Erasing entries must not hide the entries which were inserted after them.
+TEST(DigestIndexTest, ManyEntries) {
+  DigestIndex index;
+  constexpr uint32_t kCount = 10000;
+  for (uint32_t i = 0; i < kCount; i++) {
+    ASSERT_OK(index.Insert(GenerateDigest(i).get(), i));
+  }
+  EXPECT_EQ(kCount, index.size());
+
+  for (uint32_t i = 0; i < kCount; i += 2) {
+    ASSERT_OK(index.Erase(GenerateDigest(i).get()));
+  }
+  EXPECT_EQ(kCount / 2, index.size());
+
+  for (uint32_t i = 0; i < kCount; i++) {
+    uint32_t node_index;
+    if (i % 2 == 0) {
+      EXPECT_STATUS(index.Lookup(GenerateDigest(i).get(), &node_index), ZX_ERR_NOT_FOUND);
+    } else {
+      ASSERT_OK(index.Lookup(GenerateDigest(i).get(), &node_index));
+      EXPECT_EQ(i, node_index);
+    }
+  }
+}
+
+}  // namespace
+}  // namespace blobfs
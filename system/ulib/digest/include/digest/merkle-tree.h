@@ -58,6 +58,12 @@ class MerkleTree final {
   static zx_status_t Create(const void* data, size_t data_len, void* tree, size_t tree_len,
                             Digest* digest);
 
+  // Same as Create(), but hashes the nodes of each level on up to |num_threads|
+  // threads, including the calling thread.  The tree and root digest are
+  // identical to those written by Create().
+  static zx_status_t CreateParallel(const void* data, size_t data_len, void* tree,
+                                    size_t tree_len, Digest* digest, size_t num_threads);
+
   // Checks the integrity of a the region of data given by the offset and
   // length.  It checks integrity using the given Merkle tree and trusted root
   // digest. |tree_len| must be at least as much as returned by
@@ -66,6 +72,12 @@ class MerkleTree final {
   static zx_status_t Verify(const void* data, size_t data_len, const void* tree, size_t tree_len,
                             size_t offset, size_t length, const Digest& digest);
 
+  // Same as Verify(), but checks the nodes of each level on up to
+  // |num_threads| threads, including the calling thread.
+  static zx_status_t VerifyParallel(const void* data, size_t data_len, const void* tree,
+                                    size_t tree_len, size_t offset, size_t length,
+                                    const Digest& digest, size_t num_threads);
+
   // The stateful instance methods below are only needed when creating a
   // Merkle tree using the Init/Update/Final methods.
   MerkleTree();
@@ -105,6 +117,12 @@ class MerkleTree final {
   static zx_status_t VerifyLevel(const void* data, size_t data_len, const void* tree, size_t offset,
                                  size_t length, uint64_t level);
 
+  // Same as VerifyLevel(), but splits the nodes being checked between up to
+  // |num_threads| threads.
+  static zx_status_t VerifyLevelParallel(const void* data, size_t data_len, const void* tree,
+                                         size_t offset, size_t length, uint64_t level,
+                                         size_t num_threads);
+
   // See CreateFinal.  This implements that method, with an extra parameter to
   // allow levels other than the bottommost to be padded.
   zx_status_t CreateFinalInternal(const void* data, void* tree, Digest* root);
@@ -13,6 +13,10 @@
 #include <fbl/alloc_checker.h>
 #include <fbl/unique_ptr.h>
 
+#include <atomic>
+#include <thread>
+#include <vector>
+
 namespace digest {
 
 // Size of a node in bytes.  Defined in tree.h.
@@ -93,6 +97,56 @@ size_t NextAligned(size_t length) {
   return fbl::round_up(NextLength(length), MerkleTree::kNodeSize);
 }
 
+////////
+// Helper functions for hashing nodes in parallel.
+
+// The fewest nodes worth handing to a thread.  Spawning a thread costs about as much as hashing a
+// few nodes, so small levels are hashed by fewer threads, or only by the caller.
+constexpr size_t kMinNodesPerThread = 16;
+
+// Hashes node |node| of a level holding |data_len| bytes of |data| into |out|.
+zx_status_t HashNode(const uint8_t* data, size_t data_len, uint64_t level, size_t node,
+                     Digest* out) {
+  zx_status_t rc;
+  size_t offset = node * MerkleTree::kNodeSize;
+  if ((rc = DigestInit(out, offset | level, data_len - offset)) != ZX_OK) {
+    return rc;
+  }
+  offset += DigestUpdate(out, data + offset, offset, data_len - offset);
+  DigestFinal(out, offset);
+  return ZX_OK;
+}
+
+// Calls |func(first, last)| on disjoint ranges of nodes covering [0, count), using up to
+// |num_threads| threads including the calling one.  Returns the first error any call returns.
+template <typename Func>
+zx_status_t ForEachNodeRange(size_t count, size_t num_threads, Func func) {
+  num_threads = fbl::max<size_t>(fbl::min(num_threads, count / kMinNodesPerThread), 1);
+  if (num_threads == 1) {
+    return count == 0 ? ZX_OK : func(0, count);
+  }
+  std::atomic<zx_status_t> result(ZX_OK);
+  auto run = [&](size_t i) {
+    size_t first = count * i / num_threads;
+    size_t last = count * (i + 1) / num_threads;
+    zx_status_t rc = func(first, last);
+    if (rc != ZX_OK) {
+      zx_status_t expected = ZX_OK;
+      result.compare_exchange_strong(expected, rc);
+    }
+  };
+  std::vector<std::thread> threads;
+  threads.reserve(num_threads - 1);
+  for (size_t i = 1; i < num_threads; ++i) {
+    threads.emplace_back(run, i);
+  }
+  run(0);
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  return result.load();
+}
+
 }  // namespace
 
 ////////
@@ -115,6 +169,58 @@ zx_status_t MerkleTree::Create(const void* data, size_t data_len, void* tree, si
   return ZX_OK;
 }
 
+zx_status_t MerkleTree::CreateParallel(const void* data, size_t data_len, void* tree,
+                                       size_t tree_len, Digest* digest, size_t num_threads) {
+  zx_status_t rc;
+  // Must have data to read, a root to write and a tree to fill if expecting more than one digest.
+  if ((!data && data_len != 0) || !digest || (!tree && data_len > kNodeSize)) {
+    return ZX_ERR_INVALID_ARGS;
+  }
+  // Hash each level into the next one up.  Every digest in a level is independent of the others,
+  // so the nodes of a level can be split between threads, but the levels must be built in order.
+  const uint8_t* in = static_cast<const uint8_t*>(data);
+  uint8_t* out = static_cast<uint8_t*>(tree);
+  uint64_t level = 0;
+  while (data_len > kNodeSize) {
+    size_t next_len = NextAligned(data_len);
+    if (tree_len < next_len) {
+      return ZX_ERR_BUFFER_TOO_SMALL;
+    }
+    // Unused digests in the last node of the next level are zero, as in CreateUpdate.
+    size_t used = NextLength(data_len);
+    memset(out + used, 0, next_len - used);
+    rc = ForEachNodeRange(used / Digest::kLength, num_threads, [&](size_t first, size_t last) {
+      Digest actual;
+      for (size_t node = first; node < last; ++node) {
+        zx_status_t status;
+        if ((status = HashNode(in, data_len, level, node, &actual)) != ZX_OK) {
+          return status;
+        }
+        actual.CopyTo(out + node * Digest::kLength, Digest::kLength);
+      }
+      return ZX_OK;
+    });
+    if (rc != ZX_OK) {
+      return rc;
+    }
+    // Ascend the tree.
+    in = out;
+    data_len = next_len;
+    out += next_len;
+    tree_len -= next_len;
+    ++level;
+  }
+  // The remaining level fits in a single node, whose digest is the root.
+  if ((rc = DigestInit(digest, level, data_len)) != ZX_OK) {
+    return rc;
+  }
+  if (data_len != 0) {
+    DigestUpdate(digest, in, 0, data_len);
+  }
+  DigestFinal(digest, data_len);
+  return ZX_OK;
+}
+
 MerkleTree::MerkleTree() : initialized_(false), next_(nullptr), level_(0), offset_(0), length_(0) {}
 
 MerkleTree::~MerkleTree() {}
@@ -244,12 +350,23 @@ zx_status_t MerkleTree::CreateFinalInternal(const void* data, void* tree, Digest
 
 zx_status_t MerkleTree::Verify(const void* data, size_t data_len, const void* tree, size_t tree_len,
                                size_t offset, size_t length, const Digest& root) {
+  return VerifyParallel(data, data_len, tree, tree_len, offset, length, root, 1);
+}
+
+zx_status_t MerkleTree::VerifyParallel(const void* data, size_t data_len, const void* tree,
+                                       size_t tree_len, size_t offset, size_t length,
+                                       const Digest& root, size_t num_threads) {
   uint64_t level = 0;
   size_t root_len = data_len;
   while (data_len > kNodeSize) {
     zx_status_t rc;
     // Verify the data in this level.
-    if ((rc = VerifyLevel(data, data_len, tree, offset, length, level)) != ZX_OK) {
+    if (num_threads > 1 && length > kNodeSize) {
+      rc = VerifyLevelParallel(data, data_len, tree, offset, length, level, num_threads);
+    } else {
+      rc = VerifyLevel(data, data_len, tree, offset, length, level);
+    }
+    if (rc != ZX_OK) {
       return rc;
     }
     // Ascend to the next level up.
@@ -324,6 +441,24 @@ zx_status_t MerkleTree::VerifyLevel(const void* data, size_t data_len, const voi
   return ZX_OK;
 }
 
+zx_status_t MerkleTree::VerifyLevelParallel(const void* data, size_t data_len, const void* tree,
+                                            size_t offset, size_t length, uint64_t level,
+                                            size_t num_threads) {
+  ZX_DEBUG_ASSERT(offset + length >= offset);
+  // Must not overrun expected length.  The remaining checks are left to VerifyLevel.
+  if (offset + length > data_len) {
+    return ZX_ERR_OUT_OF_RANGE;
+  }
+  // Split the nodes covering the range between threads.
+  size_t first = offset / kNodeSize;
+  size_t last = fbl::round_up(offset + length, kNodeSize) / kNodeSize;
+  return ForEachNodeRange(last - first, num_threads, [&](size_t range_first, size_t range_last) {
+    size_t start = (first + range_first) * kNodeSize;
+    size_t end = fbl::min((first + range_last) * kNodeSize, data_len);
+    return VerifyLevel(data, data_len, tree, start, end - start, level);
+  });
+}
+
 }  // namespace digest
 
 ////////
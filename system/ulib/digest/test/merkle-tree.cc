@@ -405,6 +405,54 @@ TEST_F(MerkleTreeTestCase, VerifyBadLeaves) {
                 ZX_ERR_IO_DATA_INTEGRITY);
 }
 
+// Enough threads that every level with more than one node is split.
+constexpr size_t kNumThreads = 4;
+
+TEST_F(MerkleTreeTestCase, CreateParallel) {
+  uint8_t tree[sizeof(tree_)];
+  for (auto rc = NextCreate(); rc != ZX_ERR_STOP; rc = NextCreate()) {
+    ASSERT_STATUS(rc, ZX_ERR_NEXT);
+    ASSERT_OK(MerkleTree::Create(data_, data_len_, tree_, tree_len_, &actual_));
+    memset(tree, 0xff, sizeof(tree));
+    ASSERT_OK(
+        MerkleTree::CreateParallel(data_, data_len_, tree, tree_len_, &actual_, kNumThreads));
+    EXPECT_TRUE(actual_ == expected_);
+    EXPECT_BYTES_EQ(tree, tree_, tree_len_);
+  }
+}
+
+TEST_F(MerkleTreeTestCase, CreateParallelTreeTooSmall) {
+  ASSERT_OK(InitCreate(kLarge));
+  EXPECT_STATUS(MerkleTree::CreateParallel(data_, data_len_, tree_, tree_len_ - 1, &actual_,
+                                           kNumThreads),
+                ZX_ERR_BUFFER_TOO_SMALL);
+}
+
+TEST_F(MerkleTreeTestCase, VerifyParallel) {
+  for (auto rc = NextVerify(); rc != ZX_ERR_STOP; rc = NextVerify()) {
+    ASSERT_STATUS(rc, ZX_ERR_NEXT);
+    EXPECT_OK(MerkleTree::VerifyParallel(data_, data_len_, tree_, tree_len_, 0, data_len_,
+                                         actual_, kNumThreads));
+  }
+}
+
+TEST_F(MerkleTreeTestCase, VerifyParallelOutOfBounds) {
+  ASSERT_OK(InitVerify(kUnalignedLarge));
+  EXPECT_STATUS(MerkleTree::VerifyParallel(data_, data_len_, tree_, tree_len_, kNodeSize,
+                                           data_len_, actual_, kNumThreads),
+                ZX_ERR_OUT_OF_RANGE);
+}
+
+TEST_F(MerkleTreeTestCase, VerifyParallelBadLeaves) {
+  ASSERT_OK(InitVerify(kUnalignedLarge));
+  data_[data_len_ - 1] ^= 1;
+  EXPECT_OK(MerkleTree::VerifyParallel(data_, data_len_, tree_, tree_len_, 0, kLarge, actual_,
+                                       kNumThreads));
+  EXPECT_STATUS(MerkleTree::VerifyParallel(data_, data_len_, tree_, tree_len_, 0, data_len_,
+                                           actual_, kNumThreads),
+                ZX_ERR_IO_DATA_INTEGRITY);
+}
+
 TEST_F(MerkleTreeTestCase, CreateAndVerifyHugePRNGData) {
   uint8_t buffer[Digest::kLength];
   for (size_t data_len = kNodeSize; data_len <= sizeof(data_); data_len <<= 1) {
@@ -30,6 +30,7 @@ struct {
     {"length", Option::kLength, "[bytes]", "Remaining Length",
      "Length in bytes of minfs partition"},
     {"compress", Option::kCompress, "", nullptr, "Compress files before adding them to blobfs"},
+    {"extents", Option::kExtents, "", nullptr, "Map the files of a new minfs with extents"},
     {"sizes", Option::kSizes, "[file]", nullptr, "Record sizes of written entries to file"},
     {"help", Option::kHelp, "", nullptr, "Display this message"},
 };
@@ -235,7 +236,7 @@ zx_status_t FsCreator::ProcessArgs(int argc, char** argv) {
     opts[index] = {nullptr, 0, nullptr, 0};
 
     int opt_index;
-    int c = getopt_long(argc, argv, "+dro:l:cs:h", opts, &opt_index);
+    int c = getopt_long(argc, argv, "+dro:l:ces:h", opts, &opt_index);
     if (c < 0) {
       break;
     }
@@ -263,6 +264,9 @@ zx_status_t FsCreator::ProcessArgs(int argc, char** argv) {
       case 'c':
         compress_ = true;
         break;
+      case 'e':
+        extents_ = true;
+        break;
       case 's': {
         const char* const sizes_file = optarg;
         if (!size_recorder_.OpenSizeFile(sizes_file)) {
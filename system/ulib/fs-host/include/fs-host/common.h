@@ -39,6 +39,7 @@ enum class Option {
   kOffset,
   kLength,
   kCompress,
+  kExtents,
   kSizes,
   kHelp,
 };
@@ -135,6 +136,7 @@ class FsCreator {
   off_t GetOffset() const { return offset_; }
   off_t GetLength() const { return length_; }
   bool ShouldCompress() const { return compress_; }
+  bool ShouldUseExtents() const { return extents_; }
 
   FileSizeRecorder* size_recorder() { return &size_recorder_; }
 
@@ -162,6 +164,7 @@ class FsCreator {
   off_t length_{0};
   bool read_only_{false};
   bool compress_{false};
+  bool extents_{false};
   std::mutex depfile_lock_;
   fbl::unique_fd depfile_;
 
@@ -136,6 +136,13 @@ class RingBufferReservation {
   zx_status_t CopyRequests(const fbl::Vector<fs::UnbufferedOperation>& requests, size_t offset,
                            fbl::Vector<fs::BufferedOperation>* out);
 
+  // Absorbs |other| into this reservation, so that both are accessed, and released, as one.
+  //
+  // Preconditions:
+  // - Both reservations must be from the same |RingBuffer|.
+  // - |other| must directly follow this reservation within the buffer.
+  void Merge(RingBufferReservation* other);
+
   BlockBufferView buffer_view() { return view_; }
 
   // The first reservation block, relative to the start of |RingBuffer|.
@@ -210,6 +210,18 @@ zx_status_t RingBufferReservation::CopyRequests(
   return ZX_OK;
 }
 
+void RingBufferReservation::Merge(RingBufferReservation* other) {
+  ZX_DEBUG_ASSERT(Reserved());
+  ZX_DEBUG_ASSERT(other->Reserved());
+  ZX_DEBUG_ASSERT_MSG(buffer_ == other->buffer_, "Merging reservations of different buffers");
+  ZX_DEBUG_ASSERT_MSG((start() + length()) % buffer_->capacity() == other->start(),
+                      "Merging reservations which are not adjacent");
+  view_ = BlockBufferView(buffer_->buffer(), start(), length() + other->length());
+  // The blocks of |other| are now released along with this reservation.
+  other->buffer_ = nullptr;
+  other->Reset();
+}
+
 vmoid_t RingBufferReservation::vmoid() const {
   ZX_DEBUG_ASSERT(Reserved());
   return view_.vmoid();
@@ -95,6 +95,48 @@ TEST(RingBufferTest, ReservationBufferView) {
   EXPECT_EQ(1, reservation_b.length());
 }
 
+TEST(RingBufferTest, MergeAdjacentReservations) {
+  MockVmoidRegistry vmoid_registry;
+  std::unique_ptr<RingBuffer> buffer;
+  const size_t kBlocks = 5;
+  ASSERT_OK(RingBuffer::Create(&vmoid_registry, kBlocks, kBlockSize, "test-buffer", &buffer));
+  RingBufferReservation reservation_a;
+  RingBufferReservation reservation_b;
+  RingBufferReservation reservation_c;
+  ASSERT_OK(buffer->Reserve(2, &reservation_a));
+  ASSERT_OK(buffer->Reserve(3, &reservation_b));
+  EXPECT_EQ(ZX_ERR_NO_SPACE, buffer->Reserve(1, &reservation_c));
+
+  reservation_a.Merge(&reservation_b);
+  EXPECT_EQ(0, reservation_a.start());
+  EXPECT_EQ(5, reservation_a.length());
+  EXPECT_EQ(0, reservation_b.length());
+
+  // Releasing the merged reservation releases the blocks of both.
+  reservation_a = RingBufferReservation();
+  ASSERT_OK(buffer->Reserve(kBlocks, &reservation_c));
+}
+
+TEST(RingBufferTest, MergeReservationsWraparound) {
+  MockVmoidRegistry vmoid_registry;
+  std::unique_ptr<RingBuffer> buffer;
+  const size_t kBlocks = 5;
+  ASSERT_OK(RingBuffer::Create(&vmoid_registry, kBlocks, kBlockSize, "test-buffer", &buffer));
+  RingBufferReservation reservation_a;
+  RingBufferReservation reservation_b;
+  ASSERT_OK(buffer->Reserve(3, &reservation_a));
+  reservation_a = RingBufferReservation();
+
+  ASSERT_OK(buffer->Reserve(1, &reservation_a));
+  ASSERT_OK(buffer->Reserve(3, &reservation_b));
+  EXPECT_EQ(3, reservation_a.start());
+  EXPECT_EQ(4, reservation_b.start());
+
+  reservation_a.Merge(&reservation_b);
+  EXPECT_EQ(3, reservation_a.start());
+  EXPECT_EQ(4, reservation_a.length());
+}
+
 TEST(RingBufferTest, ReserveAndFreeOutOfOrder) {
   MockVmoidRegistry vmoid_registry;
   std::unique_ptr<RingBuffer> buffer;
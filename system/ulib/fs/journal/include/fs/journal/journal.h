@@ -8,11 +8,16 @@
 #include <lib/fit/barrier.h>
 #include <lib/fit/promise.h>
 #include <lib/fit/sequencer.h>
+#include <lib/sync/completion.h>
 #include <zircon/status.h>
 #include <zircon/types.h>
 
 #include <algorithm>
+#include <optional>
 
+#include <fbl/mutex.h>
+#include <fbl/ref_counted.h>
+#include <fbl/ref_ptr.h>
 #include <fbl/vector.h>
 #include <fs/buffer/blocking_ring_buffer.h>
 #include <fs/buffer/ring_buffer.h>
@@ -25,6 +30,26 @@
 
 namespace fs {
 
+// Controls group commit: coalescing metadata transactions which are queued concurrently into a
+// single journal entry, so that they share one header, one commit block and one set of writes
+// to the device.
+struct JournalOptions {
+  // The largest number of payload blocks which a single journal entry may hold. Transactions are
+  // only coalesced while their combined size stays within this limit (which is further capped by
+  // the size of the journal and by |kMaxBlockDescriptors|).
+  //
+  // Zero disables group commit, writing one journal entry per transaction.
+  uint64_t max_group_blocks = 0;
+
+  // How long a journal entry waits for more transactions to join it, measured from the moment its
+  // first transaction was queued, before it is written. The journal's executor does not run other
+  // work while it waits.
+  //
+  // Zero never delays a write: an entry only coalesces the transactions which were queued while
+  // prior entries were being written.
+  zx_duration_t max_group_latency = 0;
+};
+
 // This class implements an interface for filesystems to write back data to the underlying
 // device. It provides methods for the following functionality:
 // - Writing data to the underlying device
@@ -59,9 +84,11 @@ class Journal final : public fit::executor {
   // |journal_superblock| represents the journal info block.
   // |journal_buffer| must be the size of the entries (not including the info block).
   // |journal_start_block| must point to the start of the journal info block.
+  // |options| controls how metadata transactions are grouped into journal entries.
   Journal(fs::TransactionHandler* transaction_handler, JournalSuperblock journal_superblock,
           std::unique_ptr<fs::BlockingRingBuffer> journal_buffer,
-          std::unique_ptr<fs::BlockingRingBuffer> writeback_buffer, uint64_t journal_start_block);
+          std::unique_ptr<fs::BlockingRingBuffer> writeback_buffer, uint64_t journal_start_block,
+          JournalOptions options = {});
 
   // Constructs a journal where metadata and data are both treated as data, effectively
   // disabling the journal.
@@ -83,6 +110,11 @@ class Journal final : public fit::executor {
   //
   // Multiple requests to WriteMetadata are ordered. They are ordered by the invocation
   // of the |WriteMetadata| method, not by the completion of the returned promise.
+  //
+  // If group commit is enabled (see |JournalOptions|), requests may be coalesced into a single
+  // journal entry. The entry is written once the promises of all of its requests have started
+  // executing (or have been abandoned), and each of those promises completes with the result of
+  // that write. A request whose promise is abandoned is still written with the rest of its entry.
   Promise WriteMetadata(fbl::Vector<fs::UnbufferedOperation> operations);
 
   // Returns a promise which identifies that all previous promises returned from the journal
@@ -101,6 +133,53 @@ class Journal final : public fit::executor {
   void schedule_task(fit::pending_task task) final { executor_.schedule_task(std::move(task)); }
 
  private:
+  // A journal entry into which metadata transactions are coalesced.
+  //
+  // Each group is written by a "commit" task, which the journal schedules when the group is
+  // created. Transactions join the group until its commit task starts running, and the group is
+  // written once the promises of all of its transactions have been reached (or abandoned), so
+  // that work which callers chain before a transaction completes before it is written.
+  struct EntryGroup : public fbl::RefCounted<EntryGroup> {
+    // The entry being built, and the operations of all of its transactions.
+    std::optional<internal::JournalWorkItem> work;
+    // The number of payload blocks in |work|.
+    uint64_t payload_blocks = 0;
+    // When the first transaction of the group was queued.
+    zx_time_t opened = 0;
+    // Signalled when the group cannot fit any more transactions.
+    sync_completion_t full;
+    // The number of transactions in the group, and how many of them are ready to be written.
+    size_t members = 0;
+    size_t ready = 0;
+    // Once set, no more transactions may join the group.
+    bool closed = false;
+    // Once set, |result| holds the result of writing the group.
+    bool written = false;
+    fit::result<void, zx_status_t> result;
+    // The commit task, while it waits for transactions to become ready.
+    fit::suspended_task commit_task;
+    // Transactions waiting for the group to be written.
+    fbl::Vector<fit::suspended_task> waiters;
+  };
+
+  // Implements |WriteMetadata| for group commit.
+  Promise WriteGroupedMetadata(fbl::Vector<fs::UnbufferedOperation> operations);
+
+  // Tries to add a transaction, whose operations were copied into |reservation| as
+  // |operations|, to |group|.
+  //
+  // Returns false if the transaction could not join the group. Otherwise, the transaction becomes
+  // part of the group, and |reservation| is consumed.
+  bool JoinGroup(EntryGroup* group, fs::BlockingRingBufferReservation* reservation,
+                 fbl::Vector<fs::BufferedOperation>* operations) __TA_REQUIRES(group_lock_);
+
+  // Marks one transaction of |group| as ready to be written.
+  void MarkReady(EntryGroup* group);
+
+  // The body of the commit task of |group|: closes the group, waits until all of its
+  // transactions are ready, and writes it to the journal.
+  fit::result<void, zx_status_t> CommitGroup(fit::context& context, EntryGroup* group);
+
   std::unique_ptr<fs::BlockingRingBuffer> journal_buffer_;
   std::unique_ptr<fs::BlockingRingBuffer> writeback_buffer_;
 
@@ -117,6 +196,22 @@ class Journal final : public fit::executor {
 
   internal::JournalWriter writer_;
 
+  // The maximum number of payload blocks per group, or zero if group commit is disabled.
+  const uint64_t max_group_blocks_ = 0;
+  const zx_duration_t max_group_latency_ = 0;
+
+  // Serializes reservations in |journal_buffer_| made by |WriteGroupedMetadata|, so that the
+  // blocks of consecutive transactions are adjacent in the buffer, and transactions are ordered
+  // by |metadata_sequencer_| in the same order as they are grouped.
+  //
+  // Acquired before |group_lock_|.
+  fbl::Mutex reservation_lock_;
+
+  // Protects the groups shared between callers of |WriteMetadata| and the executor.
+  // Never held while blocking on the journal buffer or the device.
+  fbl::Mutex group_lock_;
+  fbl::RefPtr<EntryGroup> open_group_ __TA_GUARDED(group_lock_);
+
   // Intentionally place the executor at the end of the journal. This ensures that
   // during destruction, the executor can complete pending tasks operation on the writeback
   // buffers before the writeback buffers are destroyed.
@@ -2,9 +2,13 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <lib/fit/defer.h>
 #include <lib/sync/completion.h>
+#include <string.h>
 #include <zircon/status.h>
+#include <zircon/syscalls.h>
 
+#include <fbl/auto_lock.h>
 #include <fs/journal/journal.h>
 #include <fs/trace.h>
 #include <fs/transaction/writeback.h>
@@ -34,11 +38,16 @@ fit::result<void, zx_status_t> SignalSyncComplete(sync_completion_t* completion)
 
 Journal::Journal(TransactionHandler* transaction_handler, JournalSuperblock journal_superblock,
                  std::unique_ptr<BlockingRingBuffer> journal_buffer,
-                 std::unique_ptr<BlockingRingBuffer> writeback_buffer, uint64_t journal_start_block)
+                 std::unique_ptr<BlockingRingBuffer> writeback_buffer, uint64_t journal_start_block,
+                 JournalOptions options)
     : journal_buffer_(std::move(journal_buffer)),
       writeback_buffer_(std::move(writeback_buffer)),
       writer_(transaction_handler, std::move(journal_superblock), journal_start_block,
-              journal_buffer_->capacity()) {}
+              journal_buffer_->capacity()),
+      max_group_blocks_(std::min({options.max_group_blocks,
+                                  journal_buffer_->capacity() - kEntryMetadataBlocks,
+                                  uint64_t{kMaxBlockDescriptors - 1}})),
+      max_group_latency_(options.max_group_latency) {}
 
 Journal::Journal(TransactionHandler* transaction_handler,
                  std::unique_ptr<BlockingRingBuffer> writeback_buffer)
@@ -101,6 +110,10 @@ Journal::Promise Journal::WriteMetadata(fbl::Vector<UnbufferedOperation> operati
     return fit::make_error_promise(status);
   }
 
+  if (max_group_blocks_ > 0) {
+    return WriteGroupedMetadata(std::move(operations));
+  }
+
   // Ensure there is enough space in the journal buffer.
   // Note that in addition to the operation's blocks, we also reserve space for the journal
   // entry's metadata (header, footer, etc).
@@ -136,6 +149,193 @@ Journal::Promise Journal::WriteMetadata(fbl::Vector<UnbufferedOperation> operati
   return barrier_.wrap(std::move(ordered_promise));
 }
 
+Journal::Promise Journal::WriteGroupedMetadata(fbl::Vector<UnbufferedOperation> operations) {
+  const uint64_t block_count = BlockCount(operations);
+  fbl::RefPtr<EntryGroup> group;
+  fbl::AutoLock reservation_lock(&reservation_lock_);
+
+  // Transactions which fit in the open group only reserve space for their own payload, which
+  // directly follows the group in the journal buffer.
+  bool try_join = false;
+  {
+    fbl::AutoLock lock(&group_lock_);
+    try_join = open_group_ && open_group_->payload_blocks + block_count <= max_group_blocks_;
+  }
+  if (try_join) {
+    BlockingRingBufferReservation reservation;
+    zx_status_t status = journal_buffer_->Reserve(block_count, &reservation);
+    if (status != ZX_OK) {
+      FS_TRACE_ERROR("journal: Failed to reserve space in journal buffer: %s\n",
+                     zx_status_get_string(status));
+      return fit::make_error_promise(status);
+    }
+    fbl::Vector<BufferedOperation> buffered_operations;
+    status = reservation.CopyRequests(operations, 0, &buffered_operations);
+    if (status != ZX_OK) {
+      FS_TRACE_ERROR("journal: Failed to copy operations into journal buffer: %s\n",
+                     zx_status_get_string(status));
+      return fit::make_error_promise(status);
+    }
+    fbl::AutoLock lock(&group_lock_);
+    if (JoinGroup(open_group_.get(), &reservation, &buffered_operations)) {
+      group = open_group_;
+    }
+    // Otherwise, the group was written while this transaction was being buffered, and
+    // |reservation| is released. The transaction starts a new group instead.
+  }
+
+  if (!group) {
+    // Reserve space for a new journal entry, including its header and commit blocks.
+    BlockingRingBufferReservation reservation;
+    zx_status_t status = journal_buffer_->Reserve(block_count + kEntryMetadataBlocks, &reservation);
+    if (status != ZX_OK) {
+      FS_TRACE_ERROR("journal: Failed to reserve space in journal buffer: %s\n",
+                     zx_status_get_string(status));
+      return fit::make_error_promise(status);
+    }
+    fbl::Vector<BufferedOperation> buffered_operations;
+    status = reservation.CopyRequests(operations, kJournalEntryHeaderBlocks, &buffered_operations);
+    if (status != ZX_OK) {
+      FS_TRACE_ERROR("journal: Failed to copy operations into journal buffer: %s\n",
+                     zx_status_get_string(status));
+      return fit::make_error_promise(status);
+    }
+
+    group = fbl::AdoptRef(new EntryGroup());
+    group->work.emplace(std::move(reservation), std::move(buffered_operations));
+    group->payload_blocks = block_count;
+    group->members = 1;
+    group->opened = zx_clock_get_monotonic();
+    {
+      fbl::AutoLock lock(&group_lock_);
+      if (open_group_) {
+        // The previous group cannot grow any further, so there is no point in waiting to write it.
+        sync_completion_signal(&open_group_->full);
+      }
+      open_group_ = group;
+    }
+
+    // Schedule the write of the group. Scheduling it here, rather than in the promises of its
+    // transactions, orders groups by their creation.
+    auto commit = fit::make_promise(
+        [this, group](fit::context& context) -> fit::result<void, zx_status_t> {
+          return CommitGroup(context, group.get());
+        });
+    schedule_task(barrier_.wrap(metadata_sequencer_.wrap(std::move(commit))));
+  }
+
+  // The transaction is ready to be written once its promise is reached, or abandoned.
+  auto ready = fit::defer([this, group]() { MarkReady(group.get()); });
+  auto promise = fit::make_promise(
+      [this, group = std::move(group), ready = std::move(ready)](
+          fit::context& context) mutable -> fit::result<void, zx_status_t> {
+        ready.call();
+        fbl::AutoLock lock(&group_lock_);
+        if (group->written) {
+          return group->result;
+        }
+        group->waiters.push_back(context.suspend_task());
+        return fit::pending();
+      });
+
+  // Track write ops to ensure that invocations of |sync| can flush all prior work.
+  return barrier_.wrap(std::move(promise));
+}
+
+bool Journal::JoinGroup(EntryGroup* group, BlockingRingBufferReservation* reservation,
+                        fbl::Vector<BufferedOperation>* operations) {
+  if (group == nullptr || group->closed) {
+    return false;
+  }
+  internal::JournalWorkItem& work = group->work.value();
+  const size_t capacity = journal_buffer_->capacity();
+  if ((work.reservation.start() + work.reservation.length()) % capacity != reservation->start()) {
+    return false;
+  }
+
+  // The group's commit block sits directly before the payload of the new transaction. Move the
+  // final payload block of the transaction into it, so that the payloads of both transactions are
+  // contiguous and the last block of the merged reservation is free for the commit block.
+  const uint64_t block_count = reservation->length();
+  const size_t commit = work.reservation.length() - kJournalEntryCommitBlocks;
+  memcpy(work.reservation.Data(commit), reservation->Data(block_count - 1), kJournalBlockSize);
+  BufferedOperation& last_operation = (*operations)[operations->size() - 1];
+  BufferedOperation moved = last_operation;
+  moved.op.vmo_offset = (work.reservation.start() + commit) % capacity;
+  moved.op.dev_offset = last_operation.op.dev_offset + last_operation.op.length - 1;
+  moved.op.length = 1;
+  if (--last_operation.op.length == 0) {
+    operations->pop_back();
+  }
+
+  work.reservation.Merge(reservation);
+  work.operations.push_back(moved);
+  for (auto& operation : *operations) {
+    work.operations.push_back(operation);
+  }
+  group->payload_blocks += block_count;
+  group->members++;
+  if (group->payload_blocks == max_group_blocks_) {
+    sync_completion_signal(&group->full);
+  }
+  return true;
+}
+
+void Journal::MarkReady(EntryGroup* group) {
+  fit::suspended_task commit_task;
+  {
+    fbl::AutoLock lock(&group_lock_);
+    group->ready++;
+    if (group->ready == group->members) {
+      commit_task = std::move(group->commit_task);
+    }
+  }
+  // Resumes the commit task if it was waiting for this transaction; otherwise, does nothing.
+  commit_task.resume_task();
+}
+
+fit::result<void, zx_status_t> Journal::CommitGroup(fit::context& context, EntryGroup* group) {
+  bool wait = false;
+  {
+    fbl::AutoLock lock(&group_lock_);
+    wait = !group->closed && max_group_latency_ > 0 && group->payload_blocks < max_group_blocks_;
+  }
+  if (wait) {
+    // Give concurrently queued transactions a chance to join the group.
+    sync_completion_wait_deadline(&group->full,
+                                  zx_time_add_duration(group->opened, max_group_latency_));
+  }
+
+  {
+    fbl::AutoLock lock(&group_lock_);
+    group->closed = true;
+    if (open_group_.get() == group) {
+      open_group_.reset();
+    }
+    if (group->ready < group->members) {
+      // Resumed by |MarkReady| once the last transaction is ready.
+      group->commit_task = context.suspend_task();
+      return fit::pending();
+    }
+  }
+
+  // No transactions may join the group anymore, so its work item may be used without the lock.
+  auto result = writer_.WriteMetadata(std::move(group->work.value()));
+  group->work.reset();
+
+  fbl::Vector<fit::suspended_task> waiters;
+  {
+    fbl::AutoLock lock(&group_lock_);
+    group->result = result;
+    group->written = true;
+    waiters = std::move(group->waiters);
+  }
+  for (auto& waiter : waiters) {
+    waiter.resume_task();
+  }
+  return result;
+}
+
 Journal::Promise Journal::Sync() {
   auto update = fit::make_promise(
       [this]() mutable -> fit::result<void, zx_status_t> { return writer_.Sync(); });
@@ -0,0 +1,176 @@
+// Copyright 2019 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <lib/sync/completion.h>
+#include <lib/zx/time.h>
+#include <lib/zx/vmo.h>
+#include <stdio.h>
+#include <zircon/assert.h>
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <fbl/string_printf.h>
+#include <fs/journal/journal.h>
+#include <perftest/perftest.h>
+
+// Measures how many metadata transactions per second the journal sustains when several clients
+// write metadata concurrently, and how many device transactions each metadata transaction costs,
+// with and without group commit.
+
+namespace fs {
+namespace {
+
+constexpr uint32_t kBlockSize = 8192;
+constexpr size_t kJournalLength = 256;
+constexpr size_t kWritebackLength = 16;
+constexpr size_t kTransactionsPerClient = 16;
+// Simulated latency of a round-trip to the block device.
+constexpr zx::duration kDeviceLatency = zx::usec(100);
+
+class BenchVmoidRegistry : public VmoidRegistry {
+ public:
+  zx_status_t AttachVmo(const zx::vmo& vmo, vmoid_t* out) final {
+    *out = next_vmoid_++;
+    return ZX_OK;
+  }
+
+  zx_status_t DetachVmo(vmoid_t vmoid) final { return ZX_OK; }
+
+ private:
+  vmoid_t next_vmoid_ = 1;
+};
+
+// A block device which takes |kDeviceLatency| to complete each transaction, and counts them.
+class BenchTransactionHandler final : public TransactionHandler {
+ public:
+  uint64_t transactions() const { return transactions_.load(); }
+
+  // TransactionHandler interface:
+
+  uint32_t FsBlockSize() const final { return kBlockSize; }
+
+  groupid_t BlockGroupID() final { return 1; }
+
+  uint32_t DeviceBlockSize() const final { return kBlockSize; }
+
+  uint64_t BlockNumberToDevice(uint64_t block_num) const final { return block_num; }
+
+  zx_status_t RunOperation(const Operation& operation, BlockBuffer* buffer) final {
+    return ZX_ERR_NOT_SUPPORTED;
+  }
+
+  block_client::BlockDevice* GetDevice() final { return nullptr; }
+
+  zx_status_t Transaction(block_fifo_request_t* requests, size_t count) final {
+    transactions_++;
+    zx::nanosleep(zx::deadline_after(kDeviceLatency));
+    return ZX_OK;
+  }
+
+ private:
+  std::atomic<uint64_t> transactions_{0};
+};
+
+std::unique_ptr<Journal> CreateJournal(BenchVmoidRegistry* registry,
+                                       BenchTransactionHandler* handler, JournalOptions options) {
+  std::unique_ptr<BlockingRingBuffer> journal_buffer;
+  ZX_ASSERT(BlockingRingBuffer::Create(registry, kJournalLength, kBlockSize, "journal-buffer",
+                                       &journal_buffer) == ZX_OK);
+  std::unique_ptr<BlockingRingBuffer> writeback_buffer;
+  ZX_ASSERT(BlockingRingBuffer::Create(registry, kWritebackLength, kBlockSize, "writeback-buffer",
+                                       &writeback_buffer) == ZX_OK);
+  auto info_buffer = std::make_unique<VmoBuffer>();
+  ZX_ASSERT(info_buffer->Initialize(registry, kJournalMetadataBlocks, kBlockSize, "info-block") ==
+            ZX_OK);
+  JournalSuperblock info_block(std::move(info_buffer));
+  info_block.Update(0, 0);
+  return std::make_unique<Journal>(handler, std::move(info_block), std::move(journal_buffer),
+                                   std::move(writeback_buffer), /* journal_start_block= */ 0,
+                                   options);
+}
+
+// Each run has |clients| threads write |kTransactionsPerClient| single-block metadata
+// transactions each, one after another, waiting for each transaction to complete before issuing
+// the next one.
+bool MetadataTransactionTest(perftest::RepeatState* state, const fbl::String& name,
+                             size_t clients, uint64_t max_group_blocks) {
+  BenchVmoidRegistry registry;
+  BenchTransactionHandler handler;
+  JournalOptions options;
+  options.max_group_blocks = max_group_blocks;
+  std::unique_ptr<Journal> journal = CreateJournal(&registry, &handler, options);
+
+  zx::vmo metadata;
+  ZX_ASSERT(zx::vmo::create(clients * kBlockSize, 0, &metadata) == ZX_OK);
+
+  auto client = [&](size_t index) {
+    const UnbufferedOperation operation = {
+        zx::unowned_vmo(metadata.get()),
+        {
+            OperationType::kWrite,
+            .vmo_offset = index,
+            .dev_offset = 1000 + index,
+            .length = 1,
+        },
+    };
+    for (size_t i = 0; i < kTransactionsPerClient; i++) {
+      sync_completion_t completion;
+      journal->schedule_task(
+          journal->WriteMetadata({operation})
+              .then([&completion](fit::result<void, zx_status_t>& result) {
+                ZX_ASSERT(result.is_ok());
+                sync_completion_signal(&completion);
+              }));
+      ZX_ASSERT(sync_completion_wait(&completion, ZX_TIME_INFINITE) == ZX_OK);
+    }
+  };
+
+  uint64_t runs = 0;
+  zx::duration elapsed;
+  const uint64_t start_transactions = handler.transactions();
+  while (state->KeepRunning()) {
+    zx::time start = zx::clock::get_monotonic();
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < clients; i++) {
+      threads.emplace_back(client, i);
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    elapsed += zx::clock::get_monotonic() - start;
+    runs++;
+  }
+
+  const double transactions = static_cast<double>(runs * clients * kTransactionsPerClient);
+  const double device_transactions =
+      static_cast<double>(handler.transactions() - start_transactions);
+  printf("%s: %.0f transactions/sec, %.2f device transactions per transaction\n", name.c_str(),
+         transactions / (static_cast<double>(elapsed.to_nsecs()) / ZX_SEC(1)),
+         device_transactions / transactions);
+  return true;
+}
+
+void RegisterTests() {
+  static const size_t kClients[] = {1, 4, 16};
+  static const uint64_t kMaxGroupBlocks[] = {0, 64};
+  for (size_t clients : kClients) {
+    for (uint64_t max_group_blocks : kMaxGroupBlocks) {
+      fbl::String name = fbl::StringPrintf("Journal/WriteMetadata/%zuClients/%s", clients,
+                                           max_group_blocks == 0 ? "NoGroupCommit" : "GroupCommit");
+      perftest::RegisterTest(name.c_str(), MetadataTransactionTest, name, clients,
+                             max_group_blocks);
+    }
+  }
+}
+PERFTEST_CTOR(RegisterTests)
+
+}  // namespace
+}  // namespace fs
+
+int main(int argc, char** argv) {
+  return perftest::PerfTestMain(argc, argv, "fuchsia.zircon.journal");
+}
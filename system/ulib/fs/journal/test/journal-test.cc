@@ -2593,6 +2593,380 @@ TEST_F(JournalTest, PayloadBlocksWithJournalMagicAreEscaped) {
   }
 }
 
+// Returns the total number of blocks written by |requests|.
+uint64_t RequestBlocks(const block_fifo_request_t* requests, size_t count) {
+  uint64_t blocks = 0;
+  for (size_t i = 0; i < count; i++) {
+    blocks += requests[i].length;
+  }
+  return blocks;
+}
+
+// Tests that metadata transactions which are queued together are written as a single entry.
+//
+// Each test below waits until its groups are full before writing them, so that groups are formed
+// regardless of when the journal's executor runs.
+//
+// Operations 1-3: [ H, 1, 3, 2, 4, C, _, _, _, _ ]
+//               : Info block update prompted by termination.
+TEST_F(JournalTest, GroupCommitCoalescesQueuedTransactions) {
+  fs::VmoBuffer metadata = registry()->InitializeBuffer(4);
+  const fs::UnbufferedOperation operations[] = {
+      {
+          zx::unowned_vmo(metadata.vmo().get()),
+          {
+              fs::OperationType::kWrite,
+              .vmo_offset = 0,
+              .dev_offset = 20,
+              .length = 1,
+          },
+      },
+      {
+          zx::unowned_vmo(metadata.vmo().get()),
+          {
+              fs::OperationType::kWrite,
+              .vmo_offset = 1,
+              .dev_offset = 30,
+              .length = 2,
+          },
+      },
+      {
+          zx::unowned_vmo(metadata.vmo().get()),
+          {
+              fs::OperationType::kWrite,
+              .vmo_offset = 3,
+              .dev_offset = 40,
+              .length = 1,
+          },
+      },
+  };
+
+  // The final block of each joining transaction takes the place of the previous commit block.
+  auto block = [&](uint64_t vmo_offset, uint64_t dev_offset) {
+    return fs::UnbufferedOperation{
+        zx::unowned_vmo(metadata.vmo().get()),
+        {
+            fs::OperationType::kWrite,
+            .vmo_offset = vmo_offset,
+            .dev_offset = dev_offset,
+            .length = 1,
+        },
+    };
+  };
+  const std::vector<fs::UnbufferedOperation> replayed = {
+      block(0, 20),
+      block(2, 31),
+      block(1, 30),
+      block(3, 40),
+  };
+  constexpr uint64_t kEntryLength = 4 + kEntryMetadataBlocks;
+
+  constexpr uint64_t kJournalStartBlock = 55;
+  JournalRequestVerifier verifier(registry()->info(), registry()->journal(),
+                                  registry()->writeback(), kJournalStartBlock);
+  MockTransactionHandler::TransactionCallback callbacks[] = {
+      [&](const block_fifo_request_t* requests, size_t count) {
+        EXPECT_EQ(1, count);
+        CheckWriteRequest(requests[0], kJournalVmoid, 0,
+                          kJournalStartBlock + kJournalMetadataBlocks, kEntryLength);
+        registry()->VerifyReplay(replayed, 1);
+        return ZX_OK;
+      },
+      [&](const block_fifo_request_t* requests, size_t count) {
+        EXPECT_EQ(4, RequestBlocks(requests, count));
+        for (size_t i = 0; i < count; i++) {
+          EXPECT_EQ(kJournalVmoid, requests[i].vmoid);
+        }
+        verifier.ExtendJournalOffset(kEntryLength);
+        return ZX_OK;
+      },
+      [&](const block_fifo_request_t* requests, size_t count) {
+        uint64_t sequence_number = 1;
+        verifier.VerifyInfoBlockWrite(sequence_number, requests, count);
+        registry()->VerifyReplay({}, sequence_number);
+        return ZX_OK;
+      },
+  };
+  MockTransactionHandler handler(callbacks, std::size(callbacks));
+  {
+    JournalOptions options;
+    options.max_group_blocks = 4;
+    options.max_group_latency = ZX_TIME_INFINITE;
+    Journal journal(&handler, take_info(), take_journal_buffer(), take_data_buffer(),
+                    kJournalStartBlock, options);
+    auto promise0 = journal.WriteMetadata({operations[0]});
+    auto promise1 = journal.WriteMetadata({operations[1]});
+    auto promise2 = journal.WriteMetadata({operations[2]});
+    journal.schedule_task(std::move(promise0));
+    journal.schedule_task(std::move(promise1));
+    journal.schedule_task(std::move(promise2));
+  }
+}
+
+// Tests that a group never grows beyond |JournalOptions::max_group_blocks|.
+//
+// Operations 1-2: [ H, 1, 2, C, _, _, _, _, _, _ ]
+// Operation 3   : [ _, _, _, _, H, 3, 3, C, _, _ ]
+//               : Info block update prompted by termination.
+TEST_F(JournalTest, GroupCommitRespectsMaxGroupBlocks) {
+  fs::VmoBuffer metadata = registry()->InitializeBuffer(4);
+  std::vector<fs::UnbufferedOperation> operations;
+  for (uint64_t i = 0; i < 3; i++) {
+    operations.push_back({
+        zx::unowned_vmo(metadata.vmo().get()),
+        {
+            fs::OperationType::kWrite,
+            .vmo_offset = i,
+            .dev_offset = 20 + i,
+            .length = i == 2 ? 2u : 1u,
+        },
+    });
+  }
+
+  constexpr uint64_t kJournalStartBlock = 55;
+  JournalRequestVerifier verifier(registry()->info(), registry()->journal(),
+                                  registry()->writeback(), kJournalStartBlock);
+  MockTransactionHandler::TransactionCallback callbacks[] = {
+      [&](const block_fifo_request_t* requests, size_t count) {
+        EXPECT_EQ(2 + kEntryMetadataBlocks, RequestBlocks(requests, count));
+        registry()->VerifyReplay({operations[0], operations[1]}, 1);
+        return ZX_OK;
+      },
+      [&](const block_fifo_request_t* requests, size_t count) {
+        EXPECT_EQ(2, RequestBlocks(requests, count));
+        verifier.ExtendJournalOffset(2 + kEntryMetadataBlocks);
+        return ZX_OK;
+      },
+      [&](const block_fifo_request_t* requests, size_t count) {
+        verifier.VerifyJournalWrite(operations[2], requests, count);
+        registry()->VerifyReplay(operations, 2);
+        return ZX_OK;
+      },
+      [&](const block_fifo_request_t* requests, size_t count) {
+        verifier.VerifyMetadataWrite(operations[2], requests, count);
+        verifier.ExtendJournalOffset(operations[2].op.length + kEntryMetadataBlocks);
+        return ZX_OK;
+      },
+      [&](const block_fifo_request_t* requests, size_t count) {
+        uint64_t sequence_number = 2;
+        verifier.VerifyInfoBlockWrite(sequence_number, requests, count);
+        registry()->VerifyReplay({}, sequence_number);
+        return ZX_OK;
+      },
+  };
+  MockTransactionHandler handler(callbacks, std::size(callbacks));
+  {
+    JournalOptions options;
+    options.max_group_blocks = 2;
+    options.max_group_latency = ZX_TIME_INFINITE;
+    Journal journal(&handler, take_info(), take_journal_buffer(), take_data_buffer(),
+                    kJournalStartBlock, options);
+    auto promise0 = journal.WriteMetadata({operations[0]});
+    auto promise1 = journal.WriteMetadata({operations[1]});
+    auto promise2 = journal.WriteMetadata({operations[2]});
+    journal.schedule_task(std::move(promise0));
+    journal.schedule_task(std::move(promise1));
+    journal.schedule_task(std::move(promise2));
+  }
+}
+
+// Tests that a group may wrap around the end of the journal buffer, with the block displaced by
+// the joining transaction landing at the start of the buffer.
+//
+// Operation 1   : [ H, 1, 1, 1, 1, C, _, _, _, _ ]
+//               : Info block update prompted by lack of space.
+// Operations 2-3: [ 3, C, _, _, _, _, H, 2, 3, 3 ]
+//               : Info block update prompted by termination.
+TEST_F(JournalTest, GroupCommitWraparound) {
+  fs::VmoBuffer metadata = registry()->InitializeBuffer(8);
+  const fs::UnbufferedOperation operations[] = {
+      {
+          zx::unowned_vmo(metadata.vmo().get()),
+          {
+              fs::OperationType::kWrite,
+              .vmo_offset = 0,
+              .dev_offset = 100,
+              .length = 4,
+          },
+      },
+      {
+          zx::unowned_vmo(metadata.vmo().get()),
+          {
+              fs::OperationType::kWrite,
+              .vmo_offset = 4,
+              .dev_offset = 200,
+              .length = 1,
+          },
+      },
+      {
+          zx::unowned_vmo(metadata.vmo().get()),
+          {
+              fs::OperationType::kWrite,
+              .vmo_offset = 5,
+              .dev_offset = 300,
+              .length = 3,
+          },
+      },
+  };
+  auto block = [&](uint64_t vmo_offset, uint64_t dev_offset) {
+    return fs::UnbufferedOperation{
+        zx::unowned_vmo(metadata.vmo().get()),
+        {
+            fs::OperationType::kWrite,
+            .vmo_offset = vmo_offset,
+            .dev_offset = dev_offset,
+            .length = 1,
+        },
+    };
+  };
+  const std::vector<fs::UnbufferedOperation> replayed = {
+      block(4, 200),
+      block(7, 302),
+      block(5, 300),
+      block(6, 301),
+  };
+  constexpr uint64_t kEntryStart = 6;
+  constexpr uint64_t kEntryLength = 4 + kEntryMetadataBlocks;
+
+  constexpr uint64_t kJournalStartBlock = 55;
+  JournalRequestVerifier verifier(registry()->info(), registry()->journal(),
+                                  registry()->writeback(), kJournalStartBlock);
+  MockTransactionHandler::TransactionCallback callbacks[] = {
+      [&](const block_fifo_request_t* requests, size_t count) {
+        verifier.VerifyJournalWrite(operations[0], requests, count);
+        return ZX_OK;
+      },
+      [&](const block_fifo_request_t* requests, size_t count) {
+        verifier.VerifyMetadataWrite(operations[0], requests, count);
+        verifier.ExtendJournalOffset(operations[0].op.length + kEntryMetadataBlocks);
+        return ZX_OK;
+      },
+      [&](const block_fifo_request_t* requests, size_t count) {
+        uint64_t sequence_number = 1;
+        verifier.VerifyInfoBlockWrite(sequence_number, requests, count);
+        return ZX_OK;
+      },
+      [&](const block_fifo_request_t* requests, size_t count) {
+        const uint64_t entries_start = kJournalStartBlock + kJournalMetadataBlocks;
+        const uint64_t pre_wrap_length = kJournalLength - kEntryStart;
+        EXPECT_EQ(2, count);
+        CheckWriteRequest(requests[0], kJournalVmoid, kEntryStart, entries_start + kEntryStart,
+                          pre_wrap_length);
+        if (count == 2) {
+          CheckWriteRequest(requests[1], kJournalVmoid, 0, entries_start,
+                            kEntryLength - pre_wrap_length);
+        }
+        registry()->VerifyReplay(replayed, 2);
+        return ZX_OK;
+      },
+      [&](const block_fifo_request_t* requests, size_t count) {
+        EXPECT_EQ(4, RequestBlocks(requests, count));
+        verifier.ExtendJournalOffset(kEntryLength);
+        return ZX_OK;
+      },
+      [&](const block_fifo_request_t* requests, size_t count) {
+        uint64_t sequence_number = 2;
+        verifier.VerifyInfoBlockWrite(sequence_number, requests, count);
+        registry()->VerifyReplay({}, sequence_number);
+        return ZX_OK;
+      },
+  };
+  MockTransactionHandler handler(callbacks, std::size(callbacks));
+  {
+    JournalOptions options;
+    options.max_group_blocks = 4;
+    options.max_group_latency = ZX_TIME_INFINITE;
+    Journal journal(&handler, take_info(), take_journal_buffer(), take_data_buffer(),
+                    kJournalStartBlock, options);
+
+    // Write the first operation on its own, so that the group which follows starts near the end of
+    // the journal.
+    sync_completion_t completion;
+    journal.schedule_task(journal.WriteMetadata({operations[0]}).and_then([&] {
+      sync_completion_signal(&completion);
+    }));
+    ASSERT_OK(sync_completion_wait(&completion, ZX_TIME_INFINITE));
+
+    auto promise1 = journal.WriteMetadata({operations[1]});
+    auto promise2 = journal.WriteMetadata({operations[2]});
+    journal.schedule_task(std::move(promise1));
+    journal.schedule_task(std::move(promise2));
+  }
+}
+
+// Tests that a group is not written until the promises of all of its transactions are reached,
+// so that work chained before a transaction still completes before the transaction is written.
+TEST_F(JournalTest, GroupCommitWaitsForChainedData) {
+  fs::VmoBuffer buffer = registry()->InitializeBuffer(3);
+  const fs::UnbufferedOperation metadata[] = {
+      {
+          zx::unowned_vmo(buffer.vmo().get()),
+          {
+              fs::OperationType::kWrite,
+              .vmo_offset = 0,
+              .dev_offset = 20,
+              .length = 1,
+          },
+      },
+      {
+          zx::unowned_vmo(buffer.vmo().get()),
+          {
+              fs::OperationType::kWrite,
+              .vmo_offset = 1,
+              .dev_offset = 30,
+              .length = 1,
+          },
+      },
+  };
+  const fs::UnbufferedOperation data = {
+      zx::unowned_vmo(buffer.vmo().get()),
+      {
+          fs::OperationType::kWrite,
+          .vmo_offset = 2,
+          .dev_offset = 40,
+          .length = 1,
+      },
+  };
+
+  constexpr uint64_t kJournalStartBlock = 55;
+  JournalRequestVerifier verifier(registry()->info(), registry()->journal(),
+                                  registry()->writeback(), kJournalStartBlock);
+  MockTransactionHandler::TransactionCallback callbacks[] = {
+      [&](const block_fifo_request_t* requests, size_t count) {
+        verifier.VerifyDataWrite(data, requests, count);
+        return ZX_OK;
+      },
+      [&](const block_fifo_request_t* requests, size_t count) {
+        EXPECT_EQ(2 + kEntryMetadataBlocks, RequestBlocks(requests, count));
+        registry()->VerifyReplay({metadata[0], metadata[1]}, 1);
+        return ZX_OK;
+      },
+      [&](const block_fifo_request_t* requests, size_t count) {
+        EXPECT_EQ(2, RequestBlocks(requests, count));
+        verifier.ExtendJournalOffset(2 + kEntryMetadataBlocks);
+        return ZX_OK;
+      },
+      [&](const block_fifo_request_t* requests, size_t count) {
+        uint64_t sequence_number = 1;
+        verifier.VerifyInfoBlockWrite(sequence_number, requests, count);
+        return ZX_OK;
+      },
+  };
+  MockTransactionHandler handler(callbacks, std::size(callbacks));
+  {
+    JournalOptions options;
+    options.max_group_blocks = 2;
+    options.max_group_latency = ZX_TIME_INFINITE;
+    Journal journal(&handler, take_info(), take_journal_buffer(), take_data_buffer(),
+                    kJournalStartBlock, options);
+    auto promise0 = journal.WriteMetadata({metadata[0]});
+    auto promise1 = journal.WriteMetadata({metadata[1]});
+    auto data_promise = journal.WriteData({data});
+    journal.schedule_task(std::move(promise0));
+    journal.schedule_task(data_promise.and_then(std::move(promise1)));
+  }
+}
+
 // TODO(ZX-4775): Test abandoning promises. This may require additional barrier support.
 
 }  // namespace
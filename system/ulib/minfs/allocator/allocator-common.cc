@@ -40,6 +40,11 @@ zx_status_t Allocator::Create(fs::ReadTxn* txn, fbl::unique_ptr<AllocatorStorage
   return ZX_OK;
 }
 
+zx_status_t Allocator::SummarizeMap() {
+  AutoLock lock(&lock_);
+  return map_.BuildSummary();
+}
+
 size_t Allocator::GetAvailable() const {
   AutoLock lock(&lock_);
   return GetAvailableLocked();
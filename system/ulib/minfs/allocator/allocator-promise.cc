@@ -42,11 +42,13 @@ size_t AllocatorPromise::Allocate(PendingWork* transaction) {
 }
 
 #ifdef __Fuchsia__
-size_t AllocatorPromise::Swap(size_t old_index) {
+size_t AllocatorPromise::Swap(size_t old_index) { return Swap(old_index, 0); }
+
+size_t AllocatorPromise::Swap(size_t old_index, size_t hint) {
   ZX_DEBUG_ASSERT(allocator_ != nullptr);
   ZX_DEBUG_ASSERT(reserved_ > 0);
   reserved_--;
-  return allocator_->Swap({}, old_index);
+  return allocator_->Swap({}, old_index, hint);
 }
 
 void AllocatorPromise::SwapCommit(PendingWork* transaction) {
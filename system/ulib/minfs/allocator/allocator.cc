@@ -74,7 +74,7 @@ size_t Allocator::FindLocked() const {
   }
 }
 
-size_t Allocator::Swap(AllocatorPromiseKey, size_t old_index) {
+size_t Allocator::Swap(AllocatorPromiseKey, size_t old_index, size_t hint) {
   AutoLock lock(&lock_);
   ZX_DEBUG_ASSERT(reserved_ > 0);
 
@@ -83,15 +83,42 @@ size_t Allocator::Swap(AllocatorPromiseKey, size_t old_index) {
     ZX_ASSERT(swap_out_.SetOne(old_index) == ZX_OK);
   }
 
-  size_t new_index = FindLocked();
+  size_t new_index;
+  if (hint > 0 && hint < map_.size() && !map_.GetOne(hint) && !swap_in_.GetOne(hint)) {
+    // Free elements may precede the hinted one, in which case the first free element is unchanged.
+    new_index = hint;
+    if (new_index == first_free_) {
+      first_free_ = new_index + 1;
+    }
+  } else {
+    new_index = FindLocked();
+    first_free_ = new_index + 1;
+  }
   ZX_DEBUG_ASSERT(!swap_in_.GetOne(new_index));
   ZX_ASSERT(swap_in_.SetOne(new_index) == ZX_OK);
   reserved_--;
-  first_free_ = new_index + 1;
   ZX_DEBUG_ASSERT(swap_in_.num_bits() >= swap_out_.num_bits());
   return new_index;
 }
 
+size_t Allocator::FindRun(size_t count) const {
+  AutoLock lock(&lock_);
+  for (; count > 1; count /= 2) {
+    size_t start = first_free_;
+    size_t index;
+    while (map_.Find(false, start, map_.size(), count, &index) == ZX_OK) {
+      // The run may collide with elements being swapped in, in which case the search resumes past
+      // them.
+      size_t collision;
+      if (swap_in_.Find(true, index, index + count, 1, &collision) != ZX_OK) {
+        return index;
+      }
+      start = collision + 1;
+    }
+  }
+  return 0;
+}
+
 void Allocator::SwapCommit(AllocatorPromiseKey, PendingWork* transaction) {
   AutoLock lock(&lock_);
   if (swap_in_.num_bits() == 0 && swap_out_.num_bits() == 0) {
@@ -81,6 +81,11 @@ class Allocator {
   // Returns |true| if |index| is allocated. Returns |false| otherwise.
   bool CheckAllocated(size_t index) const FS_TA_EXCLUDES(lock_);
 
+  // Summarizes the map of allocated elements, which speeds up the search for free elements on
+  // large, mostly allocated maps. Must be called once the transaction passed to |Create| has
+  // completed, since the map is read from storage directly.
+  zx_status_t SummarizeMap() FS_TA_EXCLUDES(lock_);
+
   // AllocatorPromise Methods:
   //
   // The following methods are restricted to AllocatorPromise via the passkey
@@ -105,9 +110,15 @@ class Allocator {
   // and return the index of a new element to be swapped in.
   // This is currently only used for the block allocator.
   //
+  // If |hint| is non-zero and free, it is the element swapped in.
+  //
   // PRECONDITION: |index| must be allocated in the internal map.
   // PRECONDITION: AllocatorPromise must have |reserved| > 0.
-  size_t Swap(AllocatorPromiseKey, size_t index) FS_TA_EXCLUDES(lock_);
+  size_t Swap(AllocatorPromiseKey, size_t index, size_t hint) FS_TA_EXCLUDES(lock_);
+
+  // Returns the first element of a run of up to |count| free elements, looking for runs half as
+  // long each time one cannot be found. Returns zero if there is no run of more than one element.
+  size_t FindRun(size_t count) const FS_TA_EXCLUDES(lock_);
 
   // Allocate / de-allocate elements from the swap_in / swap_out maps (respectively).
   // This persists the results of |Swap|.
@@ -332,6 +332,36 @@ TEST(AllocatorTest, AllocateSwap) {
   ASSERT_NO_FATAL_FAILURES(PerformFree(allocator.get(), indices));
 }
 
+TEST(AllocatorTest, SwapHint) {
+  fbl::unique_ptr<Allocator> allocator;
+  ASSERT_NO_FATAL_FAILURES(CreateAllocator(&allocator));
+
+  AllocatorPromise promise;
+  ASSERT_OK(promise.Initialize(nullptr, kTotalElements, allocator.get()));
+
+  // Allocate the first few elements, leaving the rest of the map as one free run.
+  fbl::Array<size_t> indices;
+  ASSERT_NO_FATAL_FAILURES(PerformAllocate(4, &promise, &indices));
+  EXPECT_EQ(5, allocator->FindRun(8));
+
+  // Free hints are swapped in, while the first free element is still found without a hint.
+  EXPECT_EQ(10, promise.Swap(0, 10));
+  EXPECT_EQ(11, promise.Swap(0, 11));
+  EXPECT_EQ(5, promise.Swap(0, 0));
+
+  // Allocated hints, and hints which are already being swapped in, are ignored.
+  EXPECT_EQ(6, promise.Swap(0, 1));
+  EXPECT_EQ(7, promise.Swap(0, 10));
+
+  // Runs avoid the elements being swapped in, and shrink when there is no room for them.
+  EXPECT_EQ(12, allocator->FindRun(32));
+  EXPECT_EQ(12, allocator->FindRun(128));
+  EXPECT_EQ(0, allocator->FindRun(1));
+  promise.SwapCommit(nullptr);
+
+  promise.Cancel();
+}
+
 class FakeTransaction : public PendingWork {
  public:
   void EnqueueMetadata(WriteData source, fs::Operation operation) final {
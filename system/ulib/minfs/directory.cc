@@ -3,6 +3,7 @@
 // found in the LICENSE file.
 
 #include <fcntl.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -13,6 +14,8 @@
 #include <zircon/time.h>
 
 #include <fbl/algorithm.h>
+#include <fbl/alloc_checker.h>
+#include <fbl/array.h>
 #include <fbl/auto_call.h>
 #include <fbl/string_piece.h>
 
@@ -40,13 +43,15 @@ constexpr zx_status_t kDirIteratorNext = 1;
 // Identify that the direntry record was modified. Stop iterating.
 constexpr zx_status_t kDirIteratorSaveSync = 2;
 
-zx_status_t ValidateDirent(Dirent* de, size_t bytes_read, size_t off) {
+// Validates the dirent at |off|, of which |bytes_read| bytes were read, in a directory whose
+// dirents may not extend past |limit|.
+zx_status_t ValidateDirent(Dirent* de, size_t bytes_read, size_t off, size_t limit) {
   uint32_t reclen = static_cast<uint32_t>(MinfsReclen(de, off));
   if ((bytes_read < MINFS_DIRENT_SIZE) || (reclen < MINFS_DIRENT_SIZE)) {
     FS_TRACE_ERROR("vn_dir: Could not read dirent at offset: %zd\n", off);
     return ZX_ERR_IO;
-  } else if ((off + reclen > kMinfsMaxDirectorySize) || (reclen & 3)) {
-    FS_TRACE_ERROR("vn_dir: bad reclen %u > %u\n", reclen, kMinfsMaxDirectorySize);
+  } else if ((off + reclen > limit) || (reclen & 3)) {
+    FS_TRACE_ERROR("vn_dir: bad reclen %u > %zu\n", reclen, limit - off);
     return ZX_ERR_IO;
   } else if (de->ino != 0) {
     if ((de->namelen == 0) || (de->namelen > (reclen - MINFS_DIRENT_SIZE))) {
@@ -64,6 +69,74 @@ zx_status_t NextDirent(Dirent* de, DirectoryOffset* offs) {
   return kDirIteratorNext;
 }
 
+// The start of a |DirectoryIndex|, which is all that is needed to find a bucket.
+struct DirectoryIndexHeader {
+  uint32_t magic;
+  uint32_t depth;
+};
+
+static_assert(offsetof(DirectoryIndex, bucket_depth) == sizeof(DirectoryIndexHeader),
+              "DirectoryIndexHeader does not match DirectoryIndex");
+
+// Packs dirents one after another into a bucket block of an indexed directory.
+class BucketBuilder {
+ public:
+  explicit BucketBuilder(uint8_t* block) : block_(block) { memset(block_, 0, kMinfsBlockSize); }
+
+  // Appends a copy of the live dirent |de|.
+  void Append(const Dirent* de) {
+    uint32_t size = DirentSize(de->namelen);
+    ZX_DEBUG_ASSERT(off_ + size <= kMinfsBlockSize);
+    last_ = reinterpret_cast<Dirent*>(block_ + off_);
+    memcpy(last_, de, size);
+    last_->reclen = size;
+    off_ += size;
+  }
+
+  // Extends the last dirent to the end of the block, or covers the block with a single empty
+  // dirent if no dirents were appended.
+  void Finish() {
+    if (last_ == nullptr) {
+      reinterpret_cast<Dirent*>(block_)->reclen = kMinfsBlockSize;
+    } else {
+      last_->reclen += static_cast<uint32_t>(kMinfsBlockSize - off_);
+    }
+  }
+
+ private:
+  uint8_t* block_;
+  size_t off_ = 0;
+  Dirent* last_ = nullptr;
+};
+
+// Calls |func| with each live dirent among the |len| bytes of |data|, which hold the dirents of
+// a directory from offset |base| onwards, in a directory whose dirents may not extend past
+// |limit|.
+template <typename Callback>
+zx_status_t ForEachLiveDirent(uint8_t* data, size_t len, size_t base, size_t limit,
+                              Callback func) {
+  size_t off = 0;
+  while (off + MINFS_DIRENT_SIZE <= len) {
+    Dirent* de = reinterpret_cast<Dirent*>(data + off);
+    zx_status_t status = ValidateDirent(de, len - off, base + off, limit);
+    if (status != ZX_OK) {
+      return status;
+    }
+    if (de->ino != 0) {
+      if (DirentSize(de->namelen) > len - off) {
+        FS_TRACE_ERROR("vn_dir: truncated dirent at offset: %zd\n", base + off);
+        return ZX_ERR_IO;
+      }
+      func(de);
+    }
+    if (de->reclen & kMinfsReclenLast) {
+      break;
+    }
+    off += MinfsReclen(de, base + off);
+  }
+  return ZX_OK;
+}
+
 }  // namespace
 
 Directory::Directory(Minfs* fs) : VnodeMinfs(fs) {}
@@ -74,6 +147,10 @@ blk_t Directory::GetBlockCount() const { return inode_.block_count; }
 
 uint64_t Directory::GetSize() const { return inode_.size; }
 
+size_t Directory::DirentLimit() const {
+  return IsIndexed() ? GetSize() : kMinfsMaxDirectorySize;
+}
+
 void Directory::SetSize(uint32_t new_size) { inode_.size = new_size; }
 
 void Directory::AcquireWritableBlock(Transaction* transaction, blk_t local_bno, blk_t old_bno,
@@ -149,13 +226,15 @@ zx_status_t Directory::UnlinkChild(Transaction* transaction, fbl::RefPtr<VnodeMi
   // Verify they are free and small enough to merge.
   size_t coalesced_size = MinfsReclen(de, off);
   // Coalesce with "next" first, so the kMinfsReclenLast bit can easily flow
-  // back to "de" and "de_prev".
-  if (!(de->reclen & kMinfsReclenLast)) {
+  // back to "de" and "de_prev". Dirents of indexed directories are never coalesced with those
+  // of another bucket.
+  bool next_in_bucket = !IsIndexed() || (off_next % kMinfsBlockSize != 0);
+  if (!(de->reclen & kMinfsReclenLast) && next_in_bucket) {
     size_t len = MINFS_DIRENT_SIZE;
     if ((status = ReadExactInternal(transaction, &de_next, len, off_next)) != ZX_OK) {
       FS_TRACE_ERROR("unlink: Failed to read next dirent\n");
       return status;
-    } else if ((status = ValidateDirent(&de_next, len, off_next)) != ZX_OK) {
+    } else if ((status = ValidateDirent(&de_next, len, off_next, DirentLimit())) != ZX_OK) {
       FS_TRACE_ERROR("unlink: Read invalid dirent\n");
       return status;
     }
@@ -170,7 +249,7 @@ zx_status_t Directory::UnlinkChild(Transaction* transaction, fbl::RefPtr<VnodeMi
     if ((status = ReadExactInternal(transaction, &de_prev, len, off_prev)) != ZX_OK) {
       FS_TRACE_ERROR("unlink: Failed to read previous dirent\n");
       return status;
-    } else if ((status = ValidateDirent(&de_prev, len, off_prev)) != ZX_OK) {
+    } else if ((status = ValidateDirent(&de_prev, len, off_prev, DirentLimit())) != ZX_OK) {
       FS_TRACE_ERROR("unlink: Read invalid dirent\n");
       return status;
     }
@@ -348,7 +427,7 @@ zx_status_t Directory::AppendDirent(DirArgs* args) {
       ReadInternal(args->transaction, data, kMinfsMaxDirentSize, args->offs.off, &r);
   if (status != ZX_OK) {
     return status;
-  } else if ((status = ValidateDirent(de, r, args->offs.off)) != ZX_OK) {
+  } else if ((status = ValidateDirent(de, r, args->offs.off, DirentLimit())) != ZX_OK) {
     return status;
   }
 
@@ -415,20 +494,37 @@ zx_status_t Directory::AppendDirent(DirArgs* args) {
 //  'offs': Offset info about where in the directory this direntry is located.
 //          Since 'func' may create / remove surrounding dirents, it is responsible for
 //          updating the offset information to access the next dirent.
+//
+// In an indexed directory, only the dirents of the bucket which 'args->name' hashes to are
+// visited: no other bucket may hold that name, or be given a dirent for it.
 zx_status_t Directory::ForEachDirent(DirArgs* args, const DirentCallback func) {
   char data[kMinfsMaxDirentSize];
   Dirent* de = (Dirent*)data;
-  args->offs.off = 0;
-  args->offs.off_prev = 0;
-  while (args->offs.off + MINFS_DIRENT_SIZE < kMinfsMaxDirectorySize) {
+  size_t start = 0;
+  size_t end = kMinfsMaxDirectorySize;
+  if (IsIndexed()) {
+    size_t bucket;
+    zx_status_t status = FindBucket(args->transaction, args->name, &bucket);
+    if (status != ZX_OK) {
+      return status;
+    }
+    start = bucket * kMinfsBlockSize;
+    end = start + kMinfsBlockSize;
+  }
+  args->offs.off = start;
+  args->offs.off_prev = start;
+  while (args->offs.off + MINFS_DIRENT_SIZE < end) {
     FS_TRACE_DEBUG("Reading dirent at offset %zd\n", args->offs.off);
     size_t r;
     zx_status_t status =
         ReadInternal(args->transaction, data, kMinfsMaxDirentSize, args->offs.off, &r);
     if (status != ZX_OK) {
       return status;
-    } else if ((status = ValidateDirent(de, r, args->offs.off)) != ZX_OK) {
+    } else if ((status = ValidateDirent(de, r, args->offs.off, DirentLimit())) != ZX_OK) {
       return status;
+    } else if (args->offs.off + MinfsReclen(de, args->offs.off) > end) {
+      FS_TRACE_ERROR("vn_dir: dirent at offset %zd spans buckets\n", args->offs.off);
+      return ZX_ERR_IO;
     }
 
     switch ((status = func(fbl::RefPtr<Directory>(this), de, args))) {
@@ -448,6 +544,249 @@ zx_status_t Directory::ForEachDirent(DirArgs* args, const DirentCallback func) {
   return ZX_ERR_NOT_FOUND;
 }
 
+zx_status_t Directory::FindBucket(PendingWork* transaction, fbl::StringPiece name,
+                                  size_t* out_bucket) {
+  ZX_DEBUG_ASSERT(IsIndexed());
+  if (name == "." || name == "..") {
+    *out_bucket = 0;
+    return ZX_OK;
+  }
+
+  DirectoryIndexHeader header;
+  zx_status_t status =
+      ReadExactInternal(transaction, &header, sizeof(header), kMinfsDirectoryIndexOffset);
+  if (status != ZX_OK) {
+    return status;
+  }
+  if (header.magic != kMinfsDirectoryIndexMagic || header.depth > kMinfsMaxDirectoryIndexDepth) {
+    FS_TRACE_ERROR("vn_dir: ino#%u: bad directory index\n", GetIno());
+    return ZX_ERR_IO;
+  }
+
+  uint32_t slot = MinfsDirentHash(name.data(), name.length()) & ((1u << header.depth) - 1);
+  uint16_t bucket;
+  status = ReadExactInternal(transaction, &bucket, sizeof(bucket),
+                             kMinfsDirectoryIndexOffset + offsetof(DirectoryIndex, buckets) +
+                                 slot * sizeof(bucket));
+  if (status != ZX_OK) {
+    return status;
+  }
+  if (bucket == 0 || bucket >= GetSize() / kMinfsBlockSize) {
+    FS_TRACE_ERROR("vn_dir: ino#%u: bad directory index bucket %u\n", GetIno(), bucket);
+    return ZX_ERR_IO;
+  }
+  *out_bucket = bucket;
+  return ZX_OK;
+}
+
+zx_status_t Directory::FindSpaceForDirent(DirArgs* args) {
+  while (true) {
+    zx_status_t status = ForEachDirent(args, DirentCallbackFindSpace);
+    if (status == ZX_ERR_NOT_FOUND) {
+      if (!IsIndexed()) {
+        return ZX_ERR_NO_SPACE;
+      }
+      // The bucket for the new dirent is full.
+      status = SplitBucket(args->name);
+    } else if (status == ZX_OK && !IsIndexed() && GetSize() <= kMinfsBlockSize) {
+      // Index the directory rather than letting it outgrow its first block.
+      Dirent de;
+      if ((status = ReadExactInternal(args->transaction, &de, MINFS_DIRENT_SIZE,
+                                      args->offs.off)) != ZX_OK) {
+        return status;
+      }
+      size_t end = args->offs.off + args->reclen + (de.ino != 0 ? DirentSize(de.namelen) : 0);
+      if (end <= kMinfsBlockSize) {
+        return ZX_OK;
+      }
+      status = IndexDirectory();
+    } else {
+      return status;
+    }
+    if (status != ZX_OK) {
+      return status;
+    }
+  }
+}
+
+zx_status_t Directory::IndexDirectory() {
+  ZX_DEBUG_ASSERT(!IsIndexed());
+  ZX_DEBUG_ASSERT(GetSize() <= kMinfsBlockSize);
+
+  fbl::AllocChecker ac;
+  fbl::Array<uint8_t> buffer(new (&ac) uint8_t[3 * kMinfsBlockSize], 3 * kMinfsBlockSize);
+  if (!ac.check()) {
+    return ZX_ERR_NO_MEMORY;
+  }
+  uint8_t* old_block = &buffer[0];
+  uint8_t* index_block = &buffer[kMinfsBlockSize];
+  uint8_t* bucket_block = &buffer[2 * kMinfsBlockSize];
+
+  size_t len;
+  zx_status_t status = ReadInternal(nullptr, old_block, kMinfsBlockSize, 0, &len);
+  if (status != ZX_OK) {
+    return status;
+  }
+
+  // Every dirent other than '.' and '..' moves to the first bucket.
+  ino_t parent = 0;
+  BucketBuilder bucket(bucket_block);
+  status = ForEachLiveDirent(old_block, len, 0, kMinfsMaxDirectorySize, [&](Dirent* de) {
+    fbl::StringPiece name(de->name, de->namelen);
+    if (name == "..") {
+      parent = de->ino;
+    } else if (name != ".") {
+      bucket.Append(de);
+    }
+  });
+  if (status != ZX_OK) {
+    return status;
+  }
+  if (parent == 0) {
+    FS_TRACE_ERROR("minfs: ino#%u: cannot index directory without '..'\n", GetIno());
+    return ZX_ERR_IO;
+  }
+  bucket.Finish();
+
+  // The first block keeps '.' and '..', and the index lives in the rest of the '..' record.
+  memset(index_block, 0, kMinfsBlockSize);
+  InitializeDirectory(index_block, GetIno(), parent);
+  Dirent* dotdot = reinterpret_cast<Dirent*>(index_block + DirentSize(1));
+  dotdot->reclen = kMinfsBlockSize - DirentSize(1);
+  DirectoryIndex* index =
+      reinterpret_cast<DirectoryIndex*>(index_block + kMinfsDirectoryIndexOffset);
+  index->magic = kMinfsDirectoryIndexMagic;
+  index->depth = 0;
+  index->bucket_depth[1] = 0;
+  index->buckets[0] = 1;
+
+  blk_t reserve_blocks;
+  if ((status = GetRequiredBlockCount(kMinfsBlockSize, kMinfsBlockSize, &reserve_blocks)) !=
+      ZX_OK) {
+    return status;
+  }
+  fbl::unique_ptr<Transaction> transaction;
+  if ((status = fs_->BeginTransaction(0, reserve_blocks, &transaction)) != ZX_OK) {
+    return status;
+  }
+  if ((status = WriteExactInternal(transaction.get(), index_block, kMinfsBlockSize, 0)) !=
+          ZX_OK ||
+      (status = WriteExactInternal(transaction.get(), bucket_block, kMinfsBlockSize,
+                                   kMinfsBlockSize)) != ZX_OK) {
+    return status;
+  }
+
+  inode_.flags |= kMinfsDirFlagIndexed;
+  // Dirents have moved, so offsets held by Readdir cookies are stale.
+  inode_.seq_num++;
+  InodeSync(transaction.get(), kMxFsSyncMtime);
+  fs_->UpdateMinorVersion(transaction.get(), kMinfsMinorVersionDirectoryIndex);
+  transaction->PinVnode(fbl::WrapRefPtr(this));
+  fs_->CommitTransaction(std::move(transaction));
+  return ZX_OK;
+}
+
+zx_status_t Directory::SplitBucket(fbl::StringPiece name) {
+  ZX_DEBUG_ASSERT(IsIndexed());
+  const size_t block_count = GetSize() / kMinfsBlockSize;
+  if (block_count >= kMinfsMaxIndexedDirectoryBlocks) {
+    return ZX_ERR_NO_SPACE;
+  }
+
+  constexpr size_t kBufferSize = sizeof(DirectoryIndex) + 3 * kMinfsBlockSize;
+  fbl::AllocChecker ac;
+  fbl::Array<uint8_t> buffer(new (&ac) uint8_t[kBufferSize], kBufferSize);
+  if (!ac.check()) {
+    return ZX_ERR_NO_MEMORY;
+  }
+  DirectoryIndex* index = reinterpret_cast<DirectoryIndex*>(&buffer[0]);
+  uint8_t* old_block = &buffer[sizeof(DirectoryIndex)];
+  uint8_t* kept_block = old_block + kMinfsBlockSize;
+  uint8_t* moved_block = kept_block + kMinfsBlockSize;
+
+  zx_status_t status =
+      ReadExactInternal(nullptr, index, sizeof(DirectoryIndex), kMinfsDirectoryIndexOffset);
+  if (status != ZX_OK) {
+    return status;
+  }
+  if (index->magic != kMinfsDirectoryIndexMagic || index->depth > kMinfsMaxDirectoryIndexDepth) {
+    FS_TRACE_ERROR("vn_dir: ino#%u: bad directory index\n", GetIno());
+    return ZX_ERR_IO;
+  }
+  const uint32_t slot = MinfsDirentHash(name.data(), name.length()) & ((1u << index->depth) - 1);
+  const uint16_t old_bucket = index->buckets[slot];
+  const uint16_t new_bucket = static_cast<uint16_t>(block_count);
+  if (old_bucket == 0 || old_bucket >= block_count) {
+    FS_TRACE_ERROR("vn_dir: ino#%u: bad directory index bucket %u\n", GetIno(), old_bucket);
+    return ZX_ERR_IO;
+  }
+
+  // The dirents of the bucket share its depth's worth of low hash bits; the next bit decides
+  // which of them move to the new bucket. If every slot of the index is already needed to tell
+  // the bucket apart from its neighbors, the index doubles first.
+  const uint32_t depth = index->bucket_depth[old_bucket];
+  if (depth == index->depth) {
+    if (index->depth == kMinfsMaxDirectoryIndexDepth) {
+      return ZX_ERR_NO_SPACE;
+    }
+    const size_t slots = 1u << index->depth;
+    memcpy(&index->buckets[slots], &index->buckets[0], slots * sizeof(index->buckets[0]));
+    index->depth++;
+  }
+  for (size_t i = 0; i < (1u << index->depth); i++) {
+    if (index->buckets[i] == old_bucket && ((i >> depth) & 1)) {
+      index->buckets[i] = new_bucket;
+    }
+  }
+  index->bucket_depth[old_bucket] = static_cast<uint8_t>(depth + 1);
+  index->bucket_depth[new_bucket] = static_cast<uint8_t>(depth + 1);
+
+  const size_t old_off = old_bucket * kMinfsBlockSize;
+  if ((status = ReadExactInternal(nullptr, old_block, kMinfsBlockSize, old_off)) != ZX_OK) {
+    return status;
+  }
+  BucketBuilder kept(kept_block);
+  BucketBuilder moved(moved_block);
+  status = ForEachLiveDirent(old_block, kMinfsBlockSize, old_off, old_off + kMinfsBlockSize,
+                             [&](Dirent* de) {
+                               uint32_t hash = MinfsDirentHash(de->name, de->namelen);
+                               if ((hash >> depth) & 1) {
+                                 moved.Append(de);
+                               } else {
+                                 kept.Append(de);
+                               }
+                             });
+  if (status != ZX_OK) {
+    return status;
+  }
+  kept.Finish();
+  moved.Finish();
+
+  blk_t reserve_blocks;
+  if ((status = GetRequiredBlockCount(GetSize(), kMinfsBlockSize, &reserve_blocks)) != ZX_OK) {
+    return status;
+  }
+  fbl::unique_ptr<Transaction> transaction;
+  if ((status = fs_->BeginTransaction(0, reserve_blocks, &transaction)) != ZX_OK) {
+    return status;
+  }
+  if ((status = WriteExactInternal(transaction.get(), moved_block, kMinfsBlockSize,
+                                   new_bucket * kMinfsBlockSize)) != ZX_OK ||
+      (status = WriteExactInternal(transaction.get(), kept_block, kMinfsBlockSize, old_off)) !=
+          ZX_OK ||
+      (status = WriteExactInternal(transaction.get(), index, sizeof(DirectoryIndex),
+                                   kMinfsDirectoryIndexOffset)) != ZX_OK) {
+    return status;
+  }
+
+  // Dirents have moved, so offsets held by Readdir cookies are stale.
+  inode_.seq_num++;
+  InodeSync(transaction.get(), kMxFsSyncMtime);
+  transaction->PinVnode(fbl::WrapRefPtr(this));
+  fs_->CommitTransaction(std::move(transaction));
+  return ZX_OK;
+}
+
 zx_status_t Directory::ValidateFlags(uint32_t flags) {
   FS_TRACE_DEBUG("Directory::ValidateFlags(0x%x) vn=%p(#%u)\n", flags, this, GetIno());
   if (flags & ZX_FS_FLAG_NOT_DIRECTORY) {
@@ -523,12 +862,12 @@ zx_status_t Directory::Readdir(fs::vdircookie_t* cookie, void* dirents, size_t l
 
     size_t off_recovered = 0;
     while (off_recovered < off) {
-      if (off_recovered + MINFS_DIRENT_SIZE >= kMinfsMaxDirectorySize) {
+      if (off_recovered + MINFS_DIRENT_SIZE >= DirentLimit()) {
         FS_TRACE_ERROR("minfs: Readdir: Corrupt dirent; dirent reclen too large\n");
         goto fail;
       }
       zx_status_t status = ReadInternal(nullptr, de, kMinfsMaxDirentSize, off_recovered, &r);
-      if ((status != ZX_OK) || (ValidateDirent(de, r, off_recovered) != ZX_OK)) {
+      if ((status != ZX_OK) || (ValidateDirent(de, r, off_recovered, DirentLimit()) != ZX_OK)) {
         FS_TRACE_ERROR("minfs: Readdir: Corrupt dirent unreadable/failed validation\n");
         goto fail;
       }
@@ -537,12 +876,12 @@ zx_status_t Directory::Readdir(fs::vdircookie_t* cookie, void* dirents, size_t l
     off = off_recovered;
   }
 
-  while (off + MINFS_DIRENT_SIZE < kMinfsMaxDirectorySize) {
+  while (off + MINFS_DIRENT_SIZE < DirentLimit()) {
     zx_status_t status = ReadInternal(nullptr, de, kMinfsMaxDirentSize, off, &r);
     if (status != ZX_OK) {
       FS_TRACE_ERROR("minfs: Readdir: Unreadable dirent %d\n", status);
       goto fail;
-    } else if ((status = ValidateDirent(de, r, off)) != ZX_OK) {
+    } else if ((status = ValidateDirent(de, r, off, DirentLimit())) != ZX_OK) {
       FS_TRACE_ERROR("minfs: Readdir: Corrupt dirent failed validation %d\n", status);
       goto fail;
     }
@@ -601,10 +940,7 @@ zx_status_t Directory::Create(fbl::RefPtr<fs::Vnode>* out, fbl::StringPiece name
   // before updating any other metadata.
   args.type = type;
   args.reclen = static_cast<uint32_t>(DirentSize(static_cast<uint8_t>(name.length())));
-  status = ForEachDirent(&args, DirentCallbackFindSpace);
-  if (status == ZX_ERR_NOT_FOUND) {
-    return ZX_ERR_NO_SPACE;
-  } else if (status != ZX_OK) {
+  if ((status = FindSpaceForDirent(&args)) != ZX_OK) {
     return status;
   }
 
@@ -757,14 +1093,11 @@ zx_status_t Directory::Rename(fbl::RefPtr<fs::Vnode> _newdir, fbl::StringPiece o
 
   // Ensure that we have enough space to write the vnode's new direntry
   // before updating any other metadata.
+  args.name = newname;
   args.type = oldvn->IsDirectory() ? kMinfsTypeDir : kMinfsTypeFile;
   args.reclen = static_cast<uint32_t>(DirentSize(static_cast<uint8_t>(newname.length())));
 
-  status = newdir->ForEachDirent(&args, DirentCallbackFindSpace);
-  if (status == ZX_ERR_NOT_FOUND) {
-    return ZX_ERR_NO_SPACE;
-  }
-  if (status != ZX_OK) {
+  if ((status = newdir->FindSpaceForDirent(&args)) != ZX_OK) {
     return status;
   }
 
@@ -855,10 +1188,7 @@ zx_status_t Directory::Link(fbl::StringPiece name, fbl::RefPtr<fs::Vnode> _targe
   // before updating any other metadata.
   args.type = kMinfsTypeFile;  // We can't hard link directories
   args.reclen = static_cast<uint32_t>(DirentSize(static_cast<uint8_t>(name.length())));
-  status = ForEachDirent(&args, DirentCallbackFindSpace);
-  if (status == ZX_ERR_NOT_FOUND) {
-    return ZX_ERR_NO_SPACE;
-  } else if (status != ZX_OK) {
+  if ((status = FindSpaceForDirent(&args)) != ZX_OK) {
     return status;
   }
 
@@ -80,6 +80,12 @@ class Directory final : public VnodeMinfs, public fbl::Recyclable<Directory> {
   // Lookup which can traverse '..'
   zx_status_t LookupInternal(fbl::RefPtr<fs::Vnode>* out, fbl::StringPiece name);
 
+  // Returns true if the directory is indexed (see |kMinfsDirFlagIndexed|).
+  bool IsIndexed() const { return inode_.flags & kMinfsDirFlagIndexed; }
+
+  // Returns the offset which dirents of this directory may not extend past.
+  size_t DirentLimit() const;
+
   // Verify that the 'newdir' inode is not a subdirectory of this Vnode.
   // Traces the path from newdir back to the root inode.
   zx_status_t CheckNotSubdirectory(fbl::RefPtr<Directory> newdir);
@@ -106,6 +112,25 @@ class Directory final : public VnodeMinfs, public fbl::Recyclable<Directory> {
   // the same |args| that were passed into DirentCallbackFindSpace.
   zx_status_t AppendDirent(DirArgs* args);
 
+  // Finds space for a new dirent of |args->reclen| bytes named |args->name|, like
+  // DirentCallbackFindSpace, to be passed to |AppendDirent|.
+  //
+  // A directory which would outgrow its first block is indexed first, and a full bucket of an
+  // indexed directory is split first. Both are committed in transactions of their own.
+  zx_status_t FindSpaceForDirent(DirArgs* args);
+
+  // Finds the block of an indexed directory which holds, or would hold, |name|.
+  zx_status_t FindBucket(PendingWork* transaction, fbl::StringPiece name, size_t* out_bucket);
+
+  // Converts a directory of at most one block into an indexed directory.
+  zx_status_t IndexDirectory();
+
+  // Splits the bucket of an indexed directory which |name| hashes to, moving half of its
+  // dirents (by hash) to a new block at the end of the directory.
+  //
+  // Returns ZX_ERR_NO_SPACE if the directory or its index cannot grow any further.
+  zx_status_t SplitBucket(fbl::StringPiece name);
+
   zx_status_t UnlinkChild(Transaction* transaction, fbl::RefPtr<VnodeMinfs> child, Dirent* de,
                           DirectoryOffset* offs);
 };
@@ -0,0 +1,351 @@
+// Copyright 2019 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "extent-map.h"
+
+#include <string.h>
+#include <zircon/assert.h>
+
+#include <utility>
+
+#include <fbl/algorithm.h>
+#include <fbl/alloc_checker.h>
+#include <fbl/array.h>
+
+namespace minfs {
+namespace {
+
+static_assert(kMinfsIndirect < 32, "leaf slots must fit in a 32-bit bitmap");
+
+blk_t ExtentEnd(const MinfsExtent& extent) { return extent.file_block + extent.length; }
+
+// Returns true if |next| continues |prev|, both within the file and on disk.
+bool Contiguous(const MinfsExtent& prev, const MinfsExtent& next) {
+  return ExtentEnd(prev) == next.file_block && prev.start + prev.length == next.start;
+}
+
+// Appends |extent| to |extents|, merging it into the last extent if it continues it. |extents|
+// must have room for one more extent.
+void AppendExtent(fbl::Vector<MinfsExtent>* extents, const MinfsExtent& extent) {
+  if (!extents->is_empty() && Contiguous((*extents)[extents->size() - 1], extent)) {
+    (*extents)[extents->size() - 1].length += extent.length;
+    return;
+  }
+  ZX_DEBUG_ASSERT(extents->size() < extents->capacity());
+  extents->push_back(extent);
+}
+
+uint32_t LeafCapacity(uint32_t slot) {
+  return slot == ExtentMap::kInlineSlot ? kMinfsInlineExtents : kMinfsExtentsPerLeaf;
+}
+
+// Returns the number of extents at the start of |extents| which are in use.
+uint32_t LeafCount(const MinfsExtent* extents, uint32_t capacity) {
+  uint32_t count = 0;
+  while (count < capacity && extents[count].length != 0) {
+    count++;
+  }
+  return count;
+}
+
+}  // namespace
+
+ExtentMap::ExtentMap() { leaves_.push_back({kInlineSlot, 0, 0, false}); }
+
+zx_status_t ExtentMap::Load(const Inode& inode, ExtentLeafStorage* storage) {
+  // Leaves may be pointed at in any order, so all of them are read before being put in the order
+  // of the extents they hold.
+  const uint32_t kMaxLeaves = kMinfsIndirect + 1;
+  fbl::AllocChecker ac;
+  fbl::Array<MinfsExtent> buffer(new (&ac) MinfsExtent[kMaxLeaves * kMinfsExtentsPerLeaf],
+                                 kMaxLeaves * kMinfsExtentsPerLeaf);
+  if (!ac.check()) {
+    return ZX_ERR_NO_MEMORY;
+  }
+  Leaf leaves[kMaxLeaves];
+  uint32_t leaf_count = 0;
+  size_t extent_count = 0;
+
+  MinfsExtent* inline_extents = &buffer[0];
+  memcpy(inline_extents, inode.dnum, kMinfsInlineExtents * sizeof(MinfsExtent));
+  leaves[leaf_count++] = {kInlineSlot, 0, LeafCount(inline_extents, kMinfsInlineExtents), false};
+  extent_count += leaves[0].count;
+
+  uint32_t slots_used = 0;
+  for (uint32_t slot = 0; slot < kMinfsIndirect; slot++) {
+    if (inode.inum[slot] == 0) {
+      continue;
+    }
+    MinfsExtent* extents = &buffer[leaf_count * kMinfsExtentsPerLeaf];
+    zx_status_t status;
+    if ((status = storage->ReadLeaf(slot, inode.inum[slot], extents)) != ZX_OK) {
+      return status;
+    }
+    uint32_t count = LeafCount(extents, kMinfsExtentsPerLeaf);
+    if (count == 0) {
+      return ZX_ERR_IO_DATA_INTEGRITY;
+    }
+    leaves[leaf_count++] = {slot, inode.inum[slot], count, false};
+    extent_count += count;
+    slots_used |= 1u << slot;
+  }
+
+  // Sort the leaves by their first extent. The inline leaf may be empty, in which case it goes
+  // first.
+  auto leaf_extents = [&buffer](uint32_t index) -> const MinfsExtent* {
+    return index == 0 ? &buffer[0] : &buffer[index * kMinfsExtentsPerLeaf];
+  };
+  uint32_t order[kMaxLeaves];
+  for (uint32_t i = 0; i < leaf_count; i++) {
+    uint32_t j = i;
+    for (; j > 0; j--) {
+      const uint32_t prev = order[j - 1];
+      const bool before = leaves[i].count == 0 ||
+                          (leaves[prev].count != 0 &&
+                           leaf_extents(i)[0].file_block < leaf_extents(prev)[0].file_block);
+      if (!before) {
+        break;
+      }
+      order[j] = prev;
+    }
+    order[j] = i;
+  }
+
+  fbl::Vector<MinfsExtent> extents;
+  extents.reserve(extent_count, &ac);
+  if (!ac.check()) {
+    return ZX_ERR_NO_MEMORY;
+  }
+  fbl::Vector<Leaf> sorted_leaves;
+  sorted_leaves.reserve(leaf_count, &ac);
+  if (!ac.check()) {
+    return ZX_ERR_NO_MEMORY;
+  }
+  for (uint32_t i = 0; i < leaf_count; i++) {
+    const Leaf& leaf = leaves[order[i]];
+    const MinfsExtent* leaf_start = leaf_extents(order[i]);
+    for (uint32_t e = 0; e < leaf.count; e++) {
+      const MinfsExtent& extent = leaf_start[e];
+      if (extent.start == 0 || extent.file_block + extent.length < extent.file_block ||
+          extent.file_block + extent.length > kMinfsMaxFileBlock ||
+          (!extents.is_empty() && ExtentEnd(extents[extents.size() - 1]) > extent.file_block)) {
+        return ZX_ERR_IO_DATA_INTEGRITY;
+      }
+      extents.push_back(extent);
+    }
+    sorted_leaves.push_back(leaf);
+  }
+
+  extents_ = std::move(extents);
+  leaves_ = std::move(sorted_leaves);
+  slots_used_ = slots_used;
+  return ZX_OK;
+}
+
+size_t ExtentMap::FindExtent(blk_t file_block) const {
+  size_t low = 0;
+  size_t high = extents_.size();
+  while (low < high) {
+    size_t mid = low + (high - low) / 2;
+    if (ExtentEnd(extents_[mid]) <= file_block) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low;
+}
+
+blk_t ExtentMap::Lookup(blk_t file_block) const {
+  size_t index = FindExtent(file_block);
+  if (index == extents_.size() || extents_[index].file_block > file_block) {
+    return 0;
+  }
+  return extents_[index].start + (file_block - extents_[index].file_block);
+}
+
+blk_t ExtentMap::End() const {
+  return extents_.is_empty() ? 0 : ExtentEnd(extents_[extents_.size() - 1]);
+}
+
+uint32_t ExtentMap::FreeLeafSlots() const {
+  return kMinfsIndirect - static_cast<uint32_t>(__builtin_popcount(slots_used_));
+}
+
+zx_status_t ExtentMap::Map(blk_t file_block, blk_t count, const blk_t* bnos) {
+  if (count == 0) {
+    return ZX_OK;
+  }
+  const blk_t end = file_block + count;
+  size_t first = FindExtent(file_block);
+  size_t last = first;
+  while (last < extents_.size() && extents_[last].file_block < end) {
+    last++;
+  }
+
+  // The replacement holds what remains of the extents which overlap the range, the new extents,
+  // and the neighbouring extents when they are contiguous with those.
+  fbl::AllocChecker ac;
+  fbl::Vector<MinfsExtent> replacement;
+  replacement.reserve(count + 4, &ac);
+  if (!ac.check()) {
+    return ZX_ERR_NO_MEMORY;
+  }
+  if (first < last && extents_[first].file_block < file_block) {
+    MinfsExtent head = extents_[first];
+    head.length = file_block - head.file_block;
+    AppendExtent(&replacement, head);
+  } else if (first > 0 && ExtentEnd(extents_[first - 1]) == file_block &&
+             extents_[first - 1].start + extents_[first - 1].length == bnos[0]) {
+    first--;
+    AppendExtent(&replacement, extents_[first]);
+  }
+  for (blk_t i = 0; i < count; i++) {
+    ZX_DEBUG_ASSERT(bnos[i] != 0);
+    AppendExtent(&replacement, {file_block + i, bnos[i], 1});
+  }
+  if (first < last && ExtentEnd(extents_[last - 1]) > end) {
+    const MinfsExtent& tail = extents_[last - 1];
+    AppendExtent(&replacement,
+                 {end, tail.start + (end - tail.file_block), ExtentEnd(tail) - end});
+  }
+  if (last < extents_.size() && Contiguous(replacement[replacement.size() - 1], extents_[last])) {
+    AppendExtent(&replacement, extents_[last]);
+    last++;
+  }
+  return Replace(first, last, replacement);
+}
+
+zx_status_t ExtentMap::Truncate(blk_t file_block) {
+  size_t first = FindExtent(file_block);
+  if (first == extents_.size()) {
+    return ZX_OK;
+  }
+  fbl::AllocChecker ac;
+  fbl::Vector<MinfsExtent> replacement;
+  replacement.reserve(1, &ac);
+  if (!ac.check()) {
+    return ZX_ERR_NO_MEMORY;
+  }
+  if (extents_[first].file_block < file_block) {
+    MinfsExtent head = extents_[first];
+    head.length = file_block - head.file_block;
+    replacement.push_back(head);
+  }
+  return Replace(first, extents_.size(), replacement);
+}
+
+zx_status_t ExtentMap::Replace(size_t first, size_t last,
+                               const fbl::Vector<MinfsExtent>& replacement) {
+  fbl::AllocChecker ac;
+  fbl::Vector<MinfsExtent> extents;
+  extents.reserve(extents_.size() - (last - first) + replacement.size(), &ac);
+  if (!ac.check()) {
+    return ZX_ERR_NO_MEMORY;
+  }
+  for (size_t i = 0; i < first; i++) {
+    extents.push_back(extents_[i]);
+  }
+  for (const MinfsExtent& extent : replacement) {
+    extents.push_back(extent);
+  }
+  for (size_t i = last; i < extents_.size(); i++) {
+    extents.push_back(extents_[i]);
+  }
+
+  // The replacement goes to the leaf which holds the first replaced extent or, if no extent is
+  // replaced, to the leaf which holds the extent preceding it.
+  const size_t target = (first < last || first == 0) ? first : first - 1;
+  bool placed = false;
+  size_t leaf_start = 0;
+  for (Leaf& leaf : leaves_) {
+    const size_t leaf_end = leaf_start + leaf.count;
+    const size_t overlap_start = fbl::max(leaf_start, first);
+    const size_t overlap_end = fbl::min(leaf_end, last);
+    if (overlap_start < overlap_end) {
+      leaf.count -= static_cast<uint32_t>(overlap_end - overlap_start);
+      leaf.dirty = true;
+    }
+    if (!placed && (target < leaf_end || (target == 0 && first == 0 && leaf_start == 0))) {
+      leaf.count += static_cast<uint32_t>(replacement.size());
+      leaf.dirty = true;
+      placed = true;
+    }
+    leaf_start = leaf_end;
+  }
+  ZX_DEBUG_ASSERT(placed);
+
+  extents_ = std::move(extents);
+  return ZX_OK;
+}
+
+void ExtentMap::Sync(Inode* inode, ExtentLeafStorage* storage) {
+  // Split the leaves which overflow. Each half keeps room to grow.
+  for (size_t i = 0; i < leaves_.size(); i++) {
+    const uint32_t capacity = LeafCapacity(leaves_[i].slot);
+    if (leaves_[i].count <= capacity) {
+      continue;
+    }
+    ZX_ASSERT_MSG(FreeLeafSlots() > 0, "minfs: out of extent leaves\n");
+    uint32_t slot = 0;
+    while (slots_used_ & (1u << slot)) {
+      slot++;
+    }
+    slots_used_ |= 1u << slot;
+    const uint32_t keep = capacity / 2;
+    Leaf leaf = {slot, storage->AllocateLeaf(), leaves_[i].count - keep, true};
+    leaves_[i].count = keep;
+    leaves_[i].dirty = true;
+    leaves_.insert(i + 1, leaf);
+  }
+
+  // Merge the neighbouring leaves which fit in half of a leaf, so that mapping a range of blocks
+  // only ever touches a few leaves. Merged leaves are left empty, and freed below.
+  size_t prev = 0;
+  for (size_t i = 1; i < leaves_.size(); i++) {
+    Leaf& leaf = leaves_[i];
+    if (leaf.count == 0) {
+      continue;
+    }
+    Leaf& head = leaves_[prev];
+    if (head.slot != kInlineSlot && (head.dirty || leaf.dirty) &&
+        head.count + leaf.count <= kMinfsExtentsPerLeaf / 2) {
+      head.count += leaf.count;
+      head.dirty = true;
+      leaf.count = 0;
+      continue;
+    }
+    prev = i;
+  }
+
+  size_t leaf_start = 0;
+  for (size_t i = 0; i < leaves_.size();) {
+    Leaf& leaf = leaves_[i];
+    if (leaf.slot == kInlineSlot) {
+      if (leaf.dirty) {
+        MinfsExtent extents[kMinfsInlineExtents] = {};
+        memcpy(extents, &extents_[leaf_start], leaf.count * sizeof(MinfsExtent));
+        memset(inode->dnum, 0, sizeof(inode->dnum));
+        memcpy(inode->dnum, extents, sizeof(extents));
+      }
+    } else if (leaf.count == 0) {
+      storage->FreeLeaf(leaf.bno);
+      inode->inum[leaf.slot] = 0;
+      slots_used_ &= ~(1u << leaf.slot);
+      leaves_.erase(i);
+      continue;
+    } else if (leaf.dirty) {
+      MinfsExtent extents[kMinfsExtentsPerLeaf] = {};
+      memcpy(extents, &extents_[leaf_start], leaf.count * sizeof(MinfsExtent));
+      storage->WriteLeaf(leaf.slot, leaf.bno, extents);
+      inode->inum[leaf.slot] = leaf.bno;
+    }
+    leaf.dirty = false;
+    leaf_start += leaf.count;
+    i++;
+  }
+  ZX_DEBUG_ASSERT(leaf_start == extents_.size());
+}
+
+}  // namespace minfs
@@ -0,0 +1,112 @@
+// Copyright 2019 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// This file describes the in-memory representation of the extents of an extent-mapped Minfs file.
+
+#ifndef ZIRCON_SYSTEM_ULIB_MINFS_EXTENT_MAP_H_
+#define ZIRCON_SYSTEM_ULIB_MINFS_EXTENT_MAP_H_
+
+#include <stdint.h>
+#include <zircon/types.h>
+
+#include <fbl/vector.h>
+#include <minfs/format.h>
+
+namespace minfs {
+
+// The blocks which hold the leaves of an ExtentMap.
+class ExtentLeafStorage {
+ public:
+  virtual ~ExtentLeafStorage() = default;
+
+  // Reads the kMinfsExtentsPerLeaf extents of the leaf pointed at by |inum[slot]|, |bno|.
+  virtual zx_status_t ReadLeaf(uint32_t slot, blk_t bno, MinfsExtent* extents) = 0;
+
+  // Returns a newly allocated block for a leaf.
+  virtual blk_t AllocateLeaf() = 0;
+
+  // Frees the block of a leaf which no longer holds any extents.
+  virtual void FreeLeaf(blk_t bno) = 0;
+
+  // Writes the kMinfsExtentsPerLeaf extents of the leaf pointed at by |inum[slot]|, |bno|.
+  virtual void WriteLeaf(uint32_t slot, blk_t bno, const MinfsExtent* extents) = 0;
+};
+
+// ExtentMap holds the extents of an extent-mapped file (see |kMinfsFileFlagExtents|), sorted by
+// file block, along with the leaves which hold them.
+//
+// Changes to the mapping only affect the in-memory state, and the leaves holding the changed
+// extents, until they are written out by |Sync|.
+class ExtentMap {
+ public:
+  // The slot of the inline leaf.
+  static constexpr uint32_t kInlineSlot = kMinfsIndirect;
+
+  // The largest number of blocks which may be mapped by a single call to |Map| so that the next
+  // |Sync| allocates at most one leaf.
+  static constexpr blk_t kMaxMapBlocks = kMinfsExtentsPerLeaf / 2 - 3;
+
+  // Returns the number of leaves which may have to be allocated to map |count| blocks, whether
+  // they are mapped one at a time or in calls of up to |kMaxMapBlocks| blocks.
+  static blk_t RequiredLeaves(blk_t count) { return 1 + (3 * count) / kMaxMapBlocks; }
+
+  struct Leaf {
+    uint32_t slot;   // Index of the leaf's block within |inum|, or kInlineSlot.
+    blk_t bno;       // Zero for the inline leaf.
+    uint32_t count;  // Number of consecutive extents held by the leaf.
+    bool dirty;      // True if the leaf must be written by the next Sync.
+  };
+
+  ExtentMap();
+
+  // Loads the extents of |inode|.
+  zx_status_t Load(const Inode& inode, ExtentLeafStorage* storage);
+
+  const fbl::Vector<MinfsExtent>& extents() const { return extents_; }
+  const fbl::Vector<Leaf>& leaves() const { return leaves_; }
+
+  // Returns the data block mapped to |file_block|, or zero if the block is sparse.
+  blk_t Lookup(blk_t file_block) const;
+
+  // Returns the block following the last mapped block of the file.
+  blk_t End() const;
+
+  // Returns the number of leaf blocks which may still be allocated.
+  uint32_t FreeLeafSlots() const;
+
+  // Maps the |count| blocks of the file starting at |file_block| to |bnos|, which are non-zero.
+  // Extents which become contiguous are merged.
+  zx_status_t Map(blk_t file_block, blk_t count, const blk_t* bnos);
+
+  // Unmaps all blocks of the file at and after |file_block|.
+  zx_status_t Truncate(blk_t file_block);
+
+  // Splits the leaves which hold more extents than they can, merges neighbouring leaves which
+  // hold fewer than half as many, frees the leaves which no longer hold any, and writes out the
+  // leaves modified since the last Sync. The inline leaf and the pointers to the other leaves are
+  // updated in |inode|.
+  //
+  // At most one leaf is allocated for each leaf which overflows by up to half of its capacity;
+  // the caller must make sure that enough leaf slots are free (see |FreeLeafSlots|). Since
+  // neighbouring leaves are kept at least half full, mapping up to |kMaxMapBlocks| blocks
+  // modifies at most three leaves besides the one allocated.
+  void Sync(Inode* inode, ExtentLeafStorage* storage);
+
+ private:
+  // Returns the index of the first extent which ends after |file_block|.
+  size_t FindExtent(blk_t file_block) const;
+
+  // Replaces extents [first, last) with |replacement|, and updates the leaves holding them.
+  zx_status_t Replace(size_t first, size_t last, const fbl::Vector<MinfsExtent>& replacement);
+
+  fbl::Vector<MinfsExtent> extents_;
+  // Leaves, in the order of the extents they hold.
+  fbl::Vector<Leaf> leaves_;
+  // Bitmap of the slots of |inum| which point at leaves.
+  uint32_t slots_used_ = 0;
+};
+
+}  // namespace minfs
+
+#endif  // ZIRCON_SYSTEM_ULIB_MINFS_EXTENT_MAP_H_
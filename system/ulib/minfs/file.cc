@@ -87,7 +87,11 @@ void File::AllocateData() {
     // Transfer reserved blocks from the vnode's allocation state to the current Transaction.
     transaction->MergeBlockPromise(allocation_state_.GetPromise());
 
-    if (bno_start + bno_count >= kMinfsDirect) {
+    if (IsExtentMapped()) {
+      // Extent-mapped files have no indirect blocks, but mapping a limited number of blocks at
+      // once limits the number of leaves which may be allocated and written.
+      bno_count = fbl::min(bno_count, fbl::min(ExtentMap::kMaxMapBlocks, max_writeback_blocks));
+    } else if (bno_start + bno_count >= kMinfsDirect) {
       // Calculate the number of pre-indirect blocks. These will not factor into the number
       // of indirect blocks being touched, and can be added back at the end.
       blk_t pre_indirect = bno_start < kMinfsDirect ? kMinfsDirect - bno_start : 0;
@@ -116,15 +120,20 @@ void File::AllocateData() {
     // Since we reserved enough space ahead of time, this should not fail.
     ZX_ASSERT(BlocksSwap(transaction.get(), bno_start, bno_count, &allocated_blocks[0]) == ZX_OK);
 
-    // Enqueue each data block one at a time, as they may not be contiguous on disk.
-    for (blk_t i = 0; i < bno_count; i++) {
+    // Enqueue the data blocks in runs which are contiguous on disk.
+    for (blk_t i = 0; i < bno_count;) {
+      blk_t run = 1;
+      while (i + run < bno_count && allocated_blocks[i + run] == allocated_blocks[i] + run) {
+        run++;
+      }
       fs::Operation op = {
         .type = fs::OperationType::kWrite,
         .vmo_offset = bno_start + i,
         .dev_offset = allocated_blocks[i] + fs_->Info().dat_block,
-        .length = 1,
+        .length = run,
       };
       transaction->EnqueueData(vmo_.get(), std::move(op));
+      i += run;
     }
 
     // Since we are updating the file in "chunks", only update the on-disk inode size
@@ -150,8 +159,13 @@ void File::AllocateData() {
     transaction->PinVnode(fbl::WrapRefPtr(this));
     transaction->Resolve();
 
-    // Return remaining reserved blocks back to the allocation state.
+    // Return remaining reserved blocks back to the allocation state. Extent-mapped files also
+    // keep the blocks reserved for the leaves which may be needed to map the remaining blocks.
     blk_t bno_remaining = expected_blocks - bno_count;
+    if (IsExtentMapped()) {
+      ZX_DEBUG_ASSERT(transaction->GetReservedBlocks() >= bno_remaining);
+      bno_remaining = static_cast<blk_t>(transaction->GetReservedBlocks());
+    }
     transaction->GiveBlocksToPromise(bno_remaining, allocation_state_.GetPromise());
 
     // Commit may fail if we are in a readonly state, but we should continue resolving all
@@ -161,13 +175,18 @@ void File::AllocateData() {
 }
 
 zx_status_t File::BlocksSwap(Transaction* transaction, blk_t start, blk_t count, blk_t* bnos) {
-  auto block_callback = [this, transaction](blk_t local_bno, blk_t old_bno, blk_t* out_bno) {
+  // New blocks are taken from a run of free blocks when one is found, so that consecutive blocks
+  // of the file are laid out contiguously on disk.
+  blk_t hint = fs_->FindBlockRun(count);
+  auto block_callback = [this, transaction, &hint](blk_t local_bno, blk_t old_bno,
+                                                   blk_t* out_bno) {
     ZX_DEBUG_ASSERT(allocation_state_.IsPending(local_bno));
     if (old_bno == 0) {
       inode_.block_count++;
     }
     // For copy-on-write, swap the block out if it's a data block.
-    fs_->BlockSwap(transaction, old_bno, out_bno);
+    fs_->BlockSwap(transaction, old_bno, hint, out_bno);
+    hint = *out_bno + 1;
     bool cleared = allocation_state_.ClearPending(local_bno, old_bno != 0);
     ZX_DEBUG_ASSERT(cleared);
   };
@@ -242,6 +261,20 @@ bool File::HasPendingAllocation(blk_t vmo_offset) {
   return allocation_state_.IsPending(vmo_offset);
 }
 
+void File::ReserveExtentLeaves(Transaction* transaction) {
+  const blk_t pending = allocation_state_.GetTotalPending();
+  if (!IsExtentMapped() || pending == 0) {
+    return;
+  }
+  const blk_t required = pending + ExtentMap::RequiredLeaves(pending);
+  const blk_t reserved = static_cast<blk_t>(allocation_state_.GetPromise()->GetReserved());
+  if (required > reserved) {
+    const blk_t available = static_cast<blk_t>(transaction->GetReservedBlocks());
+    transaction->GiveBlocksToPromise(fbl::min(required - reserved, available),
+                                     allocation_state_.GetPromise());
+  }
+}
+
 void File::CancelPendingWriteback() {
   // Drop all pending writes, revert the size of the inode to the "pre-pending-write" size.
   allocation_state_.Reset(inode_.size);
@@ -249,6 +282,22 @@ void File::CancelPendingWriteback() {
 
 #endif
 
+zx_status_t File::CheckExtentLeaves(blk_t data_blocks) {
+  const ExtentMap* extents;
+  zx_status_t status;
+  if ((status = GetExtents(&extents)) != ZX_OK) {
+    return status;
+  }
+#ifdef __Fuchsia__
+  data_blocks += allocation_state_.GetTotalPending();
+#endif
+  if (extents->FreeLeafSlots() < ExtentMap::RequiredLeaves(data_blocks)) {
+    FS_TRACE_ERROR("minfs: ino %u is out of extent leaves\n", GetIno());
+    return ZX_ERR_NO_SPACE;
+  }
+  return ZX_OK;
+}
+
 zx_status_t File::CanUnlink() const { return ZX_OK; }
 
 zx_status_t File::ValidateFlags(uint32_t flags) {
@@ -288,16 +337,30 @@ zx_status_t File::Write(const void* data, size_t len, size_t offset, size_t* out
   if (status != ZX_OK) {
     return status;
   }
+  blk_t data_blocks = 0;
+  if (IsExtentMapped() && len > 0) {
+    // Extent-mapped files have no indirect blocks, but may need new leaves to map the blocks.
+    data_blocks = static_cast<blk_t>((offset + len - 1) / kMinfsBlockSize -
+                                     offset / kMinfsBlockSize + 1);
+    reserve_blocks = data_blocks + ExtentMap::RequiredLeaves(data_blocks);
+  }
   fbl::unique_ptr<Transaction> transaction;
   if ((status = fs_->BeginTransaction(0, reserve_blocks, &transaction)) != ZX_OK) {
     return status;
   }
 
+  if (data_blocks > 0 && (status = CheckExtentLeaves(data_blocks)) != ZX_OK) {
+    return status;
+  }
+
   status = WriteInternal(transaction.get(), data, len, offset, out_actual);
   if (status != ZX_OK) {
     return status;
   }
   if (*out_actual != 0) {
+#ifdef __Fuchsia__
+    ReserveExtentLeaves(transaction.get());
+#endif
     // Enqueue metadata allocated via write.
     InodeSync(transaction.get(), kMxFsSyncMtime);  // Successful writes updates mtime
     transaction->PinVnode(fbl::WrapRefPtr(this));
@@ -327,19 +390,27 @@ zx_status_t File::Truncate(size_t len) {
       fbl::MakeAutoCall([&ticker, this] { fs_->UpdateTruncateMetrics(ticker.End()); });
 
   fbl::unique_ptr<Transaction> transaction;
-  // Due to file copy-on-write, up to 1 new (data) block may be required.
-  size_t reserve_blocks = 1;
+  // Due to file copy-on-write, up to 1 new (data) block may be required, along with a leaf to map
+  // it if the file is extent-mapped.
+  size_t reserve_blocks = IsExtentMapped() ? 1 + ExtentMap::RequiredLeaves(1) : 1;
   zx_status_t status;
 
   if ((status = fs_->BeginTransaction(0, reserve_blocks, &transaction)) != ZX_OK) {
     return status;
   }
 
+  // Only a partial block may be copied on write; truncating to a block boundary always succeeds.
+  if (IsExtentMapped() && len % kMinfsBlockSize != 0 && (status = CheckExtentLeaves(1)) != ZX_OK) {
+    return status;
+  }
+
   if ((status = TruncateInternal(transaction.get(), len)) != ZX_OK) {
     return status;
   }
 
 #ifdef __Fuchsia__
+  ReserveExtentLeaves(transaction.get());
+
   // Shortcut case: If we don't have any data blocks to update, we may as well just update
   // the inode by itself.
   //
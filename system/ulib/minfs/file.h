@@ -54,6 +54,10 @@ class File final : public VnodeMinfs, public fbl::Recyclable<File> {
   void CancelPendingWriteback() final;
 #endif
 
+  // Returns ZX_ERR_NO_SPACE if an extent-mapped file may run out of leaves while mapping
+  // |data_blocks| more blocks, along with the blocks pending allocation.
+  zx_status_t CheckExtentLeaves(blk_t data_blocks);
+
   // fs::Vnode interface.
   zx_status_t ValidateFlags(uint32_t flags) final;
   zx_status_t Read(void* data, size_t len, size_t off, size_t* out_actual) final;
@@ -70,6 +74,10 @@ class File final : public VnodeMinfs, public fbl::Recyclable<File> {
   // are expected to have been allocated previously.
   zx_status_t BlocksSwap(Transaction* state, blk_t start, blk_t count, blk_t* bno);
 
+  // Moves the blocks reserved by |transaction| for the leaves which may be needed to map the
+  // blocks pending allocation of an extent-mapped file to |allocation_state_|.
+  void ReserveExtentLeaves(Transaction* transaction);
+
   // Describes pending allocation data for the vnode. This should only be accessed while a valid
   // Transaction object is held, as it may be modified asynchronously by the DataBlockAssigner
   // thread.
@@ -11,6 +11,7 @@
 #include <unistd.h>
 #include <utility>
 
+#include <memory>
 #include <utility>
 
 #include <fs/journal/format.h>
@@ -28,6 +29,34 @@ using RawBitmap = bitmap::RawBitmapGeneric<bitmap::VmoStorage>;
 using RawBitmap = bitmap::RawBitmapGeneric<bitmap::DefaultStorage>;
 #endif
 
+// Reads the leaves of an extent-mapped file, which fsck never modifies.
+class CheckerLeafStorage final : public ExtentLeafStorage {
+ public:
+  explicit CheckerLeafStorage(Minfs* fs) : fs_(fs) {}
+
+  zx_status_t ReadLeaf(uint32_t slot, blk_t bno, MinfsExtent* extents) final {
+    if (bno >= fs_->Info().block_count) {
+      return ZX_ERR_IO_DATA_INTEGRITY;
+    }
+    uint8_t data[kMinfsBlockSize];
+    zx_status_t status;
+    if ((status = fs_->ReadDat(bno, data)) != ZX_OK) {
+      return status;
+    }
+    memcpy(extents, data, kMinfsExtentsPerLeaf * sizeof(MinfsExtent));
+    return ZX_OK;
+  }
+
+  blk_t AllocateLeaf() final { ZX_PANIC("fsck does not modify extents\n"); }
+  void FreeLeaf(blk_t bno) final { ZX_PANIC("fsck does not modify extents\n"); }
+  void WriteLeaf(uint32_t slot, blk_t bno, const MinfsExtent* extents) final {
+    ZX_PANIC("fsck does not modify extents\n");
+  }
+
+ private:
+  Minfs* fs_;
+};
+
 }  // namespace
 
 class MinfsChecker {
@@ -59,8 +88,11 @@ class MinfsChecker {
   // bno unallocated.
   zx_status_t GetInodeNthBno(Inode* inode, blk_t n, blk_t* next_n, blk_t* bno_out);
   zx_status_t CheckDirectory(Inode* inode, ino_t ino, ino_t parent, uint32_t flags);
+  // Reads and checks the index of an indexed directory.
+  zx_status_t CheckDirectoryIndex(Inode* inode, ino_t ino, VnodeMinfs* vn, DirectoryIndex* index);
   const char* CheckDataBlock(blk_t bno);
   zx_status_t CheckFile(Inode* inode, ino_t ino);
+  zx_status_t CheckExtentFile(Inode* inode, ino_t ino);
 
   fbl::unique_ptr<Minfs> fs_;
   RawBitmap checked_inodes_;
@@ -175,6 +207,57 @@ zx_status_t MinfsChecker::GetInodeNthBno(Inode* inode, blk_t n, blk_t* next_n, b
   return ZX_ERR_OUT_OF_RANGE;
 }
 
+zx_status_t MinfsChecker::CheckDirectoryIndex(Inode* inode, ino_t ino, VnodeMinfs* vn,
+                                              DirectoryIndex* index) {
+  const size_t block_count = inode->size / kMinfsBlockSize;
+  if ((inode->size % kMinfsBlockSize) || (block_count < 2) ||
+      (block_count > kMinfsMaxIndexedDirectoryBlocks)) {
+    FS_TRACE_ERROR("check: ino#%u: bad indexed directory size %u\n", ino, inode->size);
+    return ZX_ERR_IO_DATA_INTEGRITY;
+  }
+  size_t actual;
+  zx_status_t status = vn->ReadInternal(nullptr, index, sizeof(*index),
+                                        kMinfsDirectoryIndexOffset, &actual);
+  if (status != ZX_OK || actual != sizeof(*index)) {
+    FS_TRACE_ERROR("check: ino#%u: Could not read directory index\n", ino);
+    return status != ZX_OK ? status : ZX_ERR_IO;
+  }
+  if (index->magic != kMinfsDirectoryIndexMagic || index->depth > kMinfsMaxDirectoryIndexDepth) {
+    FS_TRACE_ERROR("check: ino#%u: bad directory index (magic %#x, depth %u)\n", ino,
+                   index->magic, index->depth);
+    return ZX_ERR_IO_DATA_INTEGRITY;
+  }
+
+  // Every bucket must be reached through exactly the slots which share its depth's worth of low
+  // bits with the first slot that reaches it.
+  fbl::Array<uint32_t> first_slot(new uint32_t[block_count]{0}, block_count);
+  fbl::Array<uint32_t> slot_count(new uint32_t[block_count]{0}, block_count);
+  for (uint32_t slot = 0; slot < (1u << index->depth); slot++) {
+    uint16_t bucket = index->buckets[slot];
+    if (bucket == 0 || bucket >= block_count || index->bucket_depth[bucket] > index->depth) {
+      FS_TRACE_ERROR("check: ino#%u: bad directory index slot %u -> bucket %u\n", ino, slot,
+                     bucket);
+      return ZX_ERR_IO_DATA_INTEGRITY;
+    }
+    uint32_t mask = (1u << index->bucket_depth[bucket]) - 1;
+    if (slot_count[bucket]++ == 0) {
+      first_slot[bucket] = slot;
+    } else if ((slot & mask) != (first_slot[bucket] & mask)) {
+      FS_TRACE_ERROR("check: ino#%u: directory index slot %u does not belong to bucket %u\n",
+                     ino, slot, bucket);
+      return ZX_ERR_IO_DATA_INTEGRITY;
+    }
+  }
+  for (size_t bucket = 1; bucket < block_count; bucket++) {
+    if (slot_count[bucket] != (1u << (index->depth - index->bucket_depth[bucket]))) {
+      FS_TRACE_ERROR("check: ino#%u: directory bucket %zu has %u index slots\n", ino, bucket,
+                     slot_count[bucket]);
+      return ZX_ERR_IO_DATA_INTEGRITY;
+    }
+  }
+  return ZX_OK;
+}
+
 zx_status_t MinfsChecker::CheckDirectory(Inode* inode, ino_t ino, ino_t parent, uint32_t flags) {
   unsigned eno = 0;
   bool dot = false;
@@ -187,6 +270,15 @@ zx_status_t MinfsChecker::CheckDirectory(Inode* inode, ino_t ino, ino_t parent,
     return status;
   }
 
+  const bool indexed = inode->flags & kMinfsDirFlagIndexed;
+  std::unique_ptr<DirectoryIndex> index;
+  if (indexed) {
+    index = std::make_unique<DirectoryIndex>();
+    if ((status = CheckDirectoryIndex(inode, ino, vn.get(), index.get())) != ZX_OK) {
+      return status;
+    }
+  }
+
   size_t off = 0;
   while (true) {
     uint32_t data[MINFS_DIRENT_SIZE];
@@ -211,6 +303,10 @@ zx_status_t MinfsChecker::CheckDirectory(Inode* inode, ino_t ino, ino_t parent,
       FS_TRACE_ERROR("check: ino#%u: de[%u]: bad dirent reclen (%u)\n", ino, eno, rlen);
       return ZX_ERR_IO_DATA_INTEGRITY;
     }
+    if (indexed && (is_last || (off % kMinfsBlockSize) + rlen > kMinfsBlockSize)) {
+      FS_TRACE_ERROR("check: ino#%u: de[%u]: dirent spans buckets\n", ino, eno);
+      return ZX_ERR_IO_DATA_INTEGRITY;
+    }
     if (de->ino == 0) {
       if (flags & CD_DUMP) {
         FS_TRACE_DEBUG("ino#%u: de[%u]: <empty> reclen=%u\n", ino, eno, rlen);
@@ -250,6 +346,20 @@ zx_status_t MinfsChecker::CheckDirectory(Inode* inode, ino_t ino, ino_t parent,
           FS_TRACE_ERROR("check: ino#%u: de[%u]: '..' ino=%u (not parent!)\n", ino, eno, de->ino);
         }
       }
+      if (indexed) {
+        // '.' and '..' must be in the first block, and everything else in its bucket.
+        size_t bucket = off / kMinfsBlockSize;
+        size_t expected = 0;
+        if (!dot_or_dotdot) {
+          uint32_t slot = MinfsDirentHash(de->name, de->namelen) & ((1u << index->depth) - 1);
+          expected = index->buckets[slot];
+        }
+        if (bucket != expected) {
+          FS_TRACE_ERROR("check: ino#%u: de[%u]: '%.*s' in bucket %zu, expected %zu\n", ino, eno,
+                         de->namelen, de->name, bucket, expected);
+          return ZX_ERR_IO_DATA_INTEGRITY;
+        }
+      }
       // TODO: check for cycles (non-dot/dotdot dir ref already in checked bitmap)
       if (flags & CD_DUMP) {
         FS_TRACE_DEBUG("ino#%u: de[%u]: ino=%u type=%u '%.*s' %s\n", ino, eno, de->ino, de->type,
@@ -269,6 +379,10 @@ zx_status_t MinfsChecker::CheckDirectory(Inode* inode, ino_t ino, ino_t parent,
       off += rlen;
     }
     eno++;
+    if (indexed && off == inode->size) {
+      // Indexed directories end with their last block.
+      break;
+    }
   }
   if (dirent_count != inode->dirent_count) {
     FS_TRACE_ERROR("check: ino#%u: dirent_count of %u != %u (actual)\n", ino, inode->dirent_count,
@@ -400,6 +514,58 @@ zx_status_t MinfsChecker::CheckFile(Inode* inode, ino_t ino) {
   return ZX_OK;
 }
 
+zx_status_t MinfsChecker::CheckExtentFile(Inode* inode, ino_t ino) {
+  ExtentMap extents;
+  CheckerLeafStorage leaves(fs_.get());
+  zx_status_t status;
+  if ((status = extents.Load(*inode, &leaves)) != ZX_OK) {
+    FS_TRACE_ERROR("check: ino#%u: invalid extents: %d\n", ino, status);
+    return status;
+  }
+
+  uint32_t block_count = 0;
+  const char* msg;
+  for (const ExtentMap::Leaf& leaf : extents.leaves()) {
+    if (leaf.bno == 0) {
+      continue;
+    }
+    if ((msg = CheckDataBlock(leaf.bno)) != nullptr) {
+      FS_TRACE_WARN("check: ino#%u: extent leaf %u(@%u): %s\n", ino, leaf.slot, leaf.bno, msg);
+      conforming_ = false;
+    }
+    block_count++;
+  }
+  for (unsigned n = 0; n < kMinfsDoublyIndirect; n++) {
+    if (inode->dinum[n]) {
+      FS_TRACE_WARN("check: ino#%u: doubly indirect block %u(@%u) in extent-mapped file\n", ino,
+                    n, inode->dinum[n]);
+      conforming_ = false;
+    }
+  }
+
+  for (const MinfsExtent& extent : extents.extents()) {
+    for (blk_t i = 0; i < extent.length; i++) {
+      if ((msg = CheckDataBlock(extent.start + i)) != nullptr) {
+        FS_TRACE_WARN("check: ino#%u: block %u(@%u): %s\n", ino, extent.file_block + i,
+                      extent.start + i, msg);
+        conforming_ = false;
+      }
+      block_count++;
+    }
+  }
+
+  if (extents.End() > fbl::round_up(inode->size, kMinfsBlockSize) / kMinfsBlockSize) {
+    FS_TRACE_WARN("check: ino#%u: filesize too small\n", ino);
+    conforming_ = false;
+  }
+  if (block_count != inode->block_count) {
+    FS_TRACE_WARN("check: ino#%u: block count %u, actual blocks %u\n", ino, inode->block_count,
+                  block_count);
+    conforming_ = false;
+  }
+  return ZX_OK;
+}
+
 void MinfsChecker::CheckReserved() {
   // Check reserved inode '0'.
   if (fs_->GetInodeManager()->GetInodeAllocator()->CheckAllocated(0)) {
@@ -467,7 +633,12 @@ zx_status_t MinfsChecker::CheckInode(ino_t ino, ino_t parent, bool dot_or_dotdot
   } else {
     FS_TRACE_DEBUG("ino#%u: FILE blks=%u links=%u size=%u\n", ino, inode.block_count,
                    inode.link_count, inode.size);
-    if ((status = CheckFile(&inode, ino)) < 0) {
+    if (inode.flags & kMinfsFileFlagExtents) {
+      status = CheckExtentFile(&inode, ino);
+    } else {
+      status = CheckFile(&inode, ino);
+    }
+    if (status < 0) {
       return status;
     }
   }
@@ -59,6 +59,9 @@ class AllocatorPromise {
   // The swap will not be persisted until a call to SwapCommit is made.
   size_t Swap(size_t old_index);
 
+  // Identical to |Swap(old_index)|, but swaps in |hint| if it is non-zero and free.
+  size_t Swap(size_t old_index, size_t hint);
+
   // Commit any pending swaps, allocating new indices and de-allocating old indices.
   void SwapCommit(PendingWork* transaction);
 
@@ -36,11 +36,24 @@ constexpr uint64_t kMinfsMagic1         = (0x385000d3d3d3d304ULL);
 constexpr uint32_t kMinfsMajorVersionOld1  = 0x00000007;
 constexpr uint32_t kMinfsMajorVersionOld2  = 0x00000008;
 constexpr uint32_t kMinfsMajorVersion      = 0x00000009;
-constexpr uint32_t kMinfsMinorVersion      = 0x00000000;
+constexpr uint32_t kMinfsMinorVersion      = 0x00000002;
+
+// The oldest minor version, which uses none of the features below. Newly created filesystems
+// start here unless created with a feature which requires a newer minor version.
+constexpr uint32_t kMinfsMinorVersionBase = 0x00000000;
+
+// The minor version which introduced indexed directories. Filesystems with an older minor version
+// are upgraded to it when their first directory is indexed.
+constexpr uint32_t kMinfsMinorVersionDirectoryIndex = 0x00000001;
+
+// The minor version which introduced extent-mapped files. Filesystems created with
+// kMinfsFlagExtents start at this minor version.
+constexpr uint32_t kMinfsMinorVersionExtents = 0x00000002;
 
 constexpr ino_t    kMinfsRootIno        = 1;
 constexpr uint32_t kMinfsFlagClean      = 0x00000001; // Currently unused
 constexpr uint32_t kMinfsFlagFVM        = 0x00000002; // Mounted on FVM
+constexpr uint32_t kMinfsFlagExtents    = 0x00000004; // New files are extent-mapped
 constexpr uint32_t kMinfsBlockSize      = 8192;
 constexpr uint32_t kMinfsBlockBits      = (kMinfsBlockSize * 8);
 constexpr uint32_t kMinfsInodeSize      = 256;
@@ -189,7 +202,8 @@ struct Inode {
     uint32_t dirent_count;          // for directories
     ino_t last_inode;               // index to the previous unlinked inode
     ino_t next_inode;               // index to the next unlinked inode
-    uint32_t rsvd[3];
+    uint32_t flags;                 // kMinfsDirFlag* for directories, kMinfsFileFlag* for files
+    uint32_t rsvd[2];
     blk_t dnum[kMinfsDirect];    // direct blocks
     blk_t inum[kMinfsIndirect];  // indirect blocks
     blk_t dinum[kMinfsDoublyIndirect]; // doubly indirect blocks
@@ -198,6 +212,28 @@ struct Inode {
 static_assert(sizeof(Inode) == kMinfsInodeSize,
               "minfs inode size is wrong");
 
+// Extent-mapped files
+//
+// On filesystems with kMinfsFlagExtents, new files are extent-mapped (kMinfsFileFlagExtents):
+// rather than one block pointer per block, the inode maps runs of blocks of the file to runs of
+// contiguous data blocks. The extents of a file are sorted by |file_block|, do not overlap, and
+// are split into leaves, each of which holds consecutive extents:
+// - the inline leaf holds up to kMinfsInlineExtents extents in place of |dnum|.
+// - every other leaf is a block, pointed at by |inum|, which holds up to kMinfsExtentsPerLeaf
+//   extents. Leaves may be pointed at in any order. |dinum| is unused.
+// The extents of a leaf come first, and are followed by zeroes. Blocks of the file which are not
+// mapped by any extent are sparse.
+constexpr uint32_t kMinfsFileFlagExtents = 0x00000001;
+
+struct MinfsExtent {
+    blk_t file_block;               // first block of the file mapped by the extent
+    blk_t start;                    // first data block of the extent
+    uint32_t length;                // number of blocks; zero for unused entries
+};
+
+constexpr uint32_t kMinfsInlineExtents  = (kMinfsDirect * sizeof(blk_t)) / sizeof(MinfsExtent);
+constexpr uint32_t kMinfsExtentsPerLeaf = kMinfsBlockSize / sizeof(MinfsExtent);
+
 struct Dirent {
     ino_t ino;                      // inode number
     uint32_t reclen;                // Low 28 bits: Length of record
@@ -243,6 +279,53 @@ static_assert(kMinfsMaxDirectorySize <= kMinfsReclenMask,
 //   record starts. If the MAX_DIR_SIZE is increased, this 'last' record will
 //   also increase in size.
 
+// Indexed directories
+//
+// Lookups in a flat list of dirents have to scan the whole directory. Once a directory outgrows
+// its first block, it is converted into an indexed directory (kMinfsDirFlagIndexed), which
+// hashes names into buckets of one block each, using extendible hashing:
+// - block 0 holds '.' and '..', and the '..' record covers the rest of the block. Its unused
+//   space, right after the name, holds a DirectoryIndex which maps hashes to bucket blocks.
+// - every other block is a bucket, which holds the dirents whose hashes map to it.
+// - dirents never span blocks, the dirents of each block fill it exactly, and no dirent has
+//   the kMinfsReclenLast flag set: the directory ends at the end of its last block.
+// The dirents of an indexed directory still form a valid flat list, up to the directory's size.
+// Indexed directories never shrink.
+constexpr uint32_t kMinfsDirFlagIndexed = 0x00000001;
+
+constexpr uint32_t kMinfsDirectoryIndexMagic = 0x78646e49; // "Indx"
+constexpr uint32_t kMinfsMaxIndexedDirectoryBlocks = 1024;
+constexpr uint32_t kMinfsMaxIndexedDirectorySize =
+        kMinfsMaxIndexedDirectoryBlocks * kMinfsBlockSize;
+// The largest number of hash bits used to select a bucket.
+constexpr uint32_t kMinfsMaxDirectoryIndexDepth = 11;
+
+struct DirectoryIndex {
+    uint32_t magic;
+    uint32_t depth;                 // number of hash bits used to index |buckets|
+    // The number of hash bits shared by all dirents of each bucket block.
+    uint8_t bucket_depth[kMinfsMaxIndexedDirectoryBlocks];
+    // The bucket block of each value of the low |depth| bits of a hash.
+    uint16_t buckets[1 << kMinfsMaxDirectoryIndexDepth];
+};
+
+// Offset of the DirectoryIndex within the first block of an indexed directory.
+constexpr uint32_t kMinfsDirectoryIndexOffset = DirentSize(1) + DirentSize(2);
+
+static_assert(kMinfsDirectoryIndexOffset + sizeof(DirectoryIndex) <= kMinfsBlockSize,
+              "minfs directory index does not fit in the first block");
+static_assert(kMinfsMaxIndexedDirectorySize <= kMinfsReclenMask,
+              "MinFS directory size must be smaller than reclen mask");
+
+// Hashes a name to find its bucket in an indexed directory (32-bit FNV-1a).
+constexpr uint32_t MinfsDirentHash(const char* name, size_t len) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ static_cast<uint8_t>(name[i])) * 16777619u;
+    }
+    return hash;
+}
+
 // blocksize   8K    16K    32K
 // 16 dir =  128K   256K   512K
 // 32 ind =  512M  1024M  2048M
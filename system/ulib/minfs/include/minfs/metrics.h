@@ -33,6 +33,9 @@ class MinfsMetrics : public FsMetrics {
   std::atomic<uint64_t> init_user_data_size;
   std::atomic<uint64_t> init_user_data_ticks;
   std::atomic<uint64_t> vnodes_opened_cache_hit;
+  std::atomic<uint64_t> readahead_blocks;
+  std::atomic<uint64_t> readahead_hit_blocks;
+  std::atomic<uint64_t> readahead_wasted_blocks;
 };
 }  // namespace minfs
 #endif  // ZIRCON_SYSTEM_ULIB_MINFS_METRICS_H_
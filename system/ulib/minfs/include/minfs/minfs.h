@@ -54,6 +54,9 @@ struct MountOptions {
 
   // Number of slices to preallocate for data when the filesystem is created.
   uint32_t fvm_data_slices = 1;
+
+  // Whether the files of the filesystem are extent-mapped, when it is created.
+  bool extents = false;
 };
 
 // Format the partition backed by |bc| as MinFS.
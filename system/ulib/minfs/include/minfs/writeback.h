@@ -88,11 +88,15 @@ class Transaction final : public PendingWork {
     return data_operations_.TakeOperations();
   }
 
-  size_t SwapBlock(size_t old_bno) {
+  // Swaps |old_bno| for a new block, which is |hint| if it is non-zero and free.
+  size_t SwapBlock(size_t old_bno, size_t hint) {
     ZX_DEBUG_ASSERT(block_promise_.IsInitialized());
-    return block_promise_.Swap(old_bno);
+    return block_promise_.Swap(old_bno, hint);
   }
 
+  // Returns the number of blocks reserved by the transaction which have not been used yet.
+  size_t GetReservedBlocks() const { return block_promise_.GetReserved(); }
+
   void Resolve() {
     if (block_promise_.IsInitialized()) {
       block_promise_.SwapCommit(this);
@@ -30,7 +30,7 @@ constexpr uint32_t kSuperblockNumElements = 28;
 constexpr char kSuperBlockName[] = "superblock";
 
 // Total number of fields in the on-disk inode structure.
-constexpr uint32_t kInodeNumElements = 15;
+constexpr uint32_t kInodeNumElements = 16;
 constexpr char kInodeName[] = "inode";
 
 constexpr char kInodeTableName[] = "inode table";
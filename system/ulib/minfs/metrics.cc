@@ -24,6 +24,9 @@ MinfsMetrics::MinfsMetrics(const fuchsia_minfs_Metrics* metrics)
   init_user_data_size = metrics->init_user_data_size;
   init_user_data_ticks = metrics->init_user_data_ticks;
   vnodes_opened_cache_hit = metrics->vnodes_opened_cache_hit;
+  readahead_blocks = metrics->readahead_blocks;
+  readahead_hit_blocks = metrics->readahead_hit_blocks;
+  readahead_wasted_blocks = metrics->readahead_wasted_blocks;
 }
 
 void MinfsMetrics::CopyToFidl(fuchsia_minfs_Metrics* metrics) const {
@@ -36,6 +39,9 @@ void MinfsMetrics::CopyToFidl(fuchsia_minfs_Metrics* metrics) const {
   metrics->init_user_data_size = init_user_data_size.load();
   metrics->init_user_data_ticks = init_user_data_ticks.load();
   metrics->vnodes_opened_cache_hit = vnodes_opened_cache_hit.load();
+  metrics->readahead_blocks = readahead_blocks.load();
+  metrics->readahead_hit_blocks = readahead_hit_blocks.load();
+  metrics->readahead_wasted_blocks = readahead_wasted_blocks.load();
 }
 
 void MinfsMetrics::Dump(FILE* stream, std::optional<bool> success) const {
@@ -48,6 +54,9 @@ void MinfsMetrics::Dump(FILE* stream, std::optional<bool> success) const {
   fprintf(stream, "bytes of files initialized:         %lu\n", init_user_data_size.load());
   fprintf(stream, "ticks during initialization:        %lu\n", init_user_data_ticks.load());
   fprintf(stream, "vnodes open cache hits:             %lu\n", vnodes_opened_cache_hit.load());
+  fprintf(stream, "blocks read ahead:                  %lu\n", readahead_blocks.load());
+  fprintf(stream, "readahead blocks accessed:          %lu\n", readahead_hit_blocks.load());
+  fprintf(stream, "readahead blocks wasted:            %lu\n", readahead_wasted_blocks.load());
 }
 #endif  // FS_WITH_METRICS
 
@@ -65,6 +74,17 @@ void Minfs::UpdateInitMetrics(uint32_t dnum_count, uint32_t inum_count, uint32_t
 #endif
 }
 
+void Minfs::UpdateReadaheadMetrics(uint64_t read_blocks, uint64_t hit_blocks,
+                                   uint64_t wasted_blocks) {
+#ifdef FS_WITH_METRICS
+  if (metrics_.Enabled()) {
+    metrics_.readahead_blocks += read_blocks;
+    metrics_.readahead_hit_blocks += hit_blocks;
+    metrics_.readahead_wasted_blocks += wasted_blocks;
+  }
+#endif
+}
+
 void Minfs::UpdateLookupMetrics(bool success, const fs::Duration& duration) {
 #ifdef FS_WITH_METRICS
   metrics_.UpdateLookupStat(success, duration.get(), uint64_t(0));
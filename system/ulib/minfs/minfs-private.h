@@ -228,9 +228,16 @@ class Minfs :
   // Set/Unset the flags.
   void UpdateFlags(PendingWork* transaction, uint32_t flags, bool set);
 
-  // Mark |in_bno| for de-allocation (if it is > 0), and return a new block |*out_bno|.
+  // Raises the minor version of the filesystem to |version_minor|, if it is older.
+  void UpdateMinorVersion(PendingWork* transaction, uint32_t version_minor);
+
+  // Mark |in_bno| for de-allocation (if it is > 0), and return a new block |*out_bno|, which is
+  // |hint| if it is non-zero and free.
   // The swap will not be persisted until the transaction is commited.
-  void BlockSwap(Transaction* transaction, blk_t in_bno, blk_t* out_bno);
+  void BlockSwap(Transaction* transaction, blk_t in_bno, blk_t hint, blk_t* out_bno);
+
+  // Returns the first block of a free run of up to |count| blocks, or zero if none is found.
+  blk_t FindBlockRun(blk_t count) const;
 
   // Free a data block.
   void BlockFree(PendingWork* transaction, blk_t bno);
@@ -322,6 +329,9 @@ class Minfs :
   // Update aggregate information about VMO initialization.
   void UpdateInitMetrics(uint32_t dnum_count, uint32_t inum_count, uint32_t dinum_count,
                          uint64_t user_data_size, const fs::Duration& duration);
+  // Update aggregate information about readahead: the number of blocks read ahead of readers,
+  // accessed after being read ahead, and discarded without being accessed.
+  void UpdateReadaheadMetrics(uint64_t read_blocks, uint64_t hit_blocks, uint64_t wasted_blocks);
   // Update aggregate information about looking up vnodes by name.
   void UpdateLookupMetrics(bool success, const fs::Duration& duration);
   // Update aggregate information about looking up vnodes by inode.
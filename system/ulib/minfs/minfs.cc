@@ -334,7 +334,8 @@ zx_status_t CheckSuperblock(const Superblock* info, uint32_t max_blocks) {
                    info->version_major, kMinfsMajorVersion);
     return ZX_ERR_NOT_SUPPORTED;
   }
-  if (info->version_minor != kMinfsMinorVersion) {
+  // Older minor versions are compatible, and are upgraded as newer features are used.
+  if (info->version_minor > kMinfsMinorVersion) {
     FS_TRACE_ERROR("minfs: FS minor version: %08x. Driver minor version: %08x\n",
                    info->version_minor, kMinfsMinorVersion);
     return ZX_ERR_NOT_SUPPORTED;
@@ -537,6 +538,34 @@ zx_status_t Minfs::InoFree(PendingWork* transaction, VnodeMinfs* vn) {
   vn->CancelPendingWriteback();
 #endif
 
+  if (vn->IsExtentMapped()) {
+    // Release the blocks of all extents, and the leaves holding them.
+    const ExtentMap* extents;
+    zx_status_t status;
+    if ((status = vn->GetExtents(&extents)) != ZX_OK) {
+      return status;
+    }
+    inodes_->Free(transaction, vn->GetIno());
+    uint32_t block_count = vn->GetInode()->block_count;
+    for (const MinfsExtent& extent : extents->extents()) {
+      for (blk_t i = 0; i < extent.length; i++) {
+        ValidateBno(extent.start + i);
+        block_count--;
+        block_allocator_->Free(transaction, extent.start + i);
+      }
+    }
+    for (const ExtentMap::Leaf& leaf : extents->leaves()) {
+      if (leaf.bno != 0) {
+        ValidateBno(leaf.bno);
+        block_count--;
+        block_allocator_->Free(transaction, leaf.bno);
+      }
+    }
+    ZX_DEBUG_ASSERT(block_count == 0);
+    ZX_DEBUG_ASSERT(vn->IsUnlinked());
+    return ZX_OK;
+  }
+
   inodes_->Free(transaction, vn->GetIno());
   uint32_t block_count = vn->GetInode()->block_count;
 
@@ -907,16 +936,29 @@ void Minfs::UpdateFlags(PendingWork* transaction, uint32_t flags, bool set) {
   sb_->Write(transaction, UpdateBackupSuperblock::kUpdate);
 }
 
+void Minfs::UpdateMinorVersion(PendingWork* transaction, uint32_t version_minor) {
+  if (Info().version_minor >= version_minor) {
+    return;
+  }
+  FS_TRACE_INFO("minfs: Upgrading to minor version %u\n", version_minor);
+  sb_->MutableInfo()->version_minor = version_minor;
+  sb_->Write(transaction, UpdateBackupSuperblock::kUpdate);
+}
+
 #ifdef __Fuchsia__
-void Minfs::BlockSwap(Transaction* transaction, blk_t in_bno, blk_t* out_bno) {
+void Minfs::BlockSwap(Transaction* transaction, blk_t in_bno, blk_t hint, blk_t* out_bno) {
   if (in_bno > 0) {
     ValidateBno(in_bno);
   }
 
-  size_t allocated_bno = transaction->SwapBlock(in_bno);
+  size_t allocated_bno = transaction->SwapBlock(in_bno, hint);
   *out_bno = static_cast<blk_t>(allocated_bno);
   ValidateBno(*out_bno);
 }
+
+blk_t Minfs::FindBlockRun(blk_t count) const {
+  return static_cast<blk_t>(block_allocator_->FindRun(count));
+}
 #endif
 
 void Minfs::BlockFree(PendingWork* transaction, blk_t bno) {
@@ -1028,6 +1070,11 @@ zx_status_t Minfs::Create(fbl::unique_ptr<Bcache> bc, const Superblock* info, In
     return status;
   }
 
+  if ((status = block_allocator->SummarizeMap()) != ZX_OK) {
+    FS_TRACE_ERROR("Minfs::Create failed to summarize block allocation map: %d\n", status);
+    return status;
+  }
+
 #ifdef __Fuchsia__
   uint64_t id;
   status = Minfs::CreateFsId(&id);
@@ -1086,9 +1133,13 @@ zx_status_t Minfs::InitializeJournal(fs::JournalSuperblock journal_superblock) {
     return status;
   }
 
+  // Coalesce metadata transactions which queue up while earlier ones are being written into
+  // shared journal entries, without delaying any of them.
+  fs::JournalOptions journal_options;
+  journal_options.max_group_blocks = fs::kMaxBlockDescriptors - 1;
   journal_ = std::make_unique<fs::Journal>(GetMutableBcache(), std::move(journal_superblock),
                                            std::move(journal_buffer), std::move(writeback_buffer),
-                                           JournalStartBlock(sb_->Info()));
+                                           JournalStartBlock(sb_->Info()), journal_options);
   return ZX_OK;
 }
 
@@ -1235,7 +1286,7 @@ zx_status_t UpgradeSuperblock(fs::TransactionHandler* transaction_handler, void*
 
   // Upgrade to newer version.
   new_info.version_major = kMinfsMajorVersionOld2;
-  new_info.version_minor = kMinfsMinorVersion;
+  new_info.version_minor = kMinfsMinorVersionBase;
 
   UpdateChecksum(&new_info);
 
@@ -1569,8 +1620,17 @@ zx_status_t Mkfs(const MountOptions& options, fbl::unique_ptr<Bcache> bc) {
   info.magic0 = kMinfsMagic0;
   info.magic1 = kMinfsMagic1;
   info.version_major = kMinfsMajorVersion;
-  info.version_minor = kMinfsMinorVersion;
+  // Only claim the minor version the new image actually needs, so that older drivers can still
+  // mount it. Later features (such as directory indexes) upgrade it with UpdateMinorVersion when
+  // they are first used.
+  info.version_minor = kMinfsMinorVersionBase;
   info.flags = kMinfsFlagClean;
+  if (options.extents) {
+    // Drivers older than kMinfsMinorVersionExtents refuse to mount the filesystem, since its
+    // minor version is newer than theirs.
+    info.version_minor = kMinfsMinorVersionExtents;
+    info.flags |= kMinfsFlagExtents;
+  }
   info.block_size = kMinfsBlockSize;
   info.inode_size = kMinfsInodeSize;
 
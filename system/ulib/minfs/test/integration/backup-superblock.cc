@@ -197,7 +197,7 @@ TEST_F(FvmBackupSuperblockTest, FvmUpgradeSuperblockV7) {
 
   // Verify that the superblock was upgraded from version 7 to version 9.
   ASSERT_EQ(info.version_major, minfs::kMinfsMajorVersion);
-  ASSERT_EQ(info.version_minor, minfs::kMinfsMinorVersion);
+  ASSERT_EQ(info.version_minor, minfs::kMinfsMinorVersionBase);
 }
 
 // TODO(36164): Remove this test after migration to major version 9.
@@ -237,7 +237,7 @@ TEST_F(FvmBackupSuperblockTest, FvmUpgradeSuperblockV8) {
 
   // Verify that the superblock was upgraded from version 8 to version 9.
   ASSERT_EQ(info.version_major, minfs::kMinfsMajorVersion);
-  ASSERT_EQ(info.version_minor, minfs::kMinfsMinorVersion);
+  ASSERT_EQ(info.version_minor, minfs::kMinfsMinorVersionBase);
 }
 
 }  // namespace
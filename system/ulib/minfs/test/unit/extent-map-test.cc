@@ -0,0 +1,237 @@
+// Copyright 2019 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Tests ExtentMap behavior.
+
+#include <string.h>
+
+#include <map>
+
+#include <zxtest/zxtest.h>
+
+#include "extent-map.h"
+
+namespace minfs {
+namespace {
+
+// Holds leaves in memory, handing out leaf blocks from 1000000 onwards.
+class FakeLeafStorage : public ExtentLeafStorage {
+ public:
+  zx_status_t ReadLeaf(uint32_t slot, blk_t bno, MinfsExtent* extents) final {
+    auto leaf = leaves_.find(bno);
+    if (leaf == leaves_.end()) {
+      return ZX_ERR_IO;
+    }
+    memcpy(extents, leaf->second.extents, sizeof(leaf->second.extents));
+    return ZX_OK;
+  }
+
+  blk_t AllocateLeaf() final {
+    blk_t bno = next_bno_++;
+    leaves_[bno] = {};
+    return bno;
+  }
+
+  void FreeLeaf(blk_t bno) final {
+    EXPECT_EQ(1u, leaves_.erase(bno));
+  }
+
+  void WriteLeaf(uint32_t slot, blk_t bno, const MinfsExtent* extents) final {
+    ASSERT_EQ(1u, leaves_.count(bno));
+    memcpy(leaves_[bno].extents, extents, sizeof(leaves_[bno].extents));
+    writes_++;
+  }
+
+  size_t leaf_count() const { return leaves_.size(); }
+  size_t writes() const { return writes_; }
+
+ private:
+  struct LeafBlock {
+    MinfsExtent extents[kMinfsExtentsPerLeaf];
+  };
+
+  std::map<blk_t, LeafBlock> leaves_;
+  blk_t next_bno_ = 1000000;
+  size_t writes_ = 0;
+};
+
+// Maps |count| blocks starting at |file_block| to every other block from |start|, so that none
+// of them are contiguous.
+zx_status_t MapSparse(ExtentMap* map, blk_t file_block, blk_t count, blk_t start) {
+  for (blk_t i = 0; i < count; i++) {
+    blk_t bno = start + 2 * i;
+    zx_status_t status = map->Map(file_block + i, 1, &bno);
+    if (status != ZX_OK) {
+      return status;
+    }
+  }
+  return ZX_OK;
+}
+
+void ExpectLeavesFit(const ExtentMap& map) {
+  size_t extents = 0;
+  for (const ExtentMap::Leaf& leaf : map.leaves()) {
+    EXPECT_FALSE(leaf.dirty);
+    EXPECT_LE(leaf.count, leaf.slot == ExtentMap::kInlineSlot ? kMinfsInlineExtents
+                                                              : kMinfsExtentsPerLeaf);
+    extents += leaf.count;
+  }
+  EXPECT_EQ(map.extents().size(), extents);
+}
+
+TEST(ExtentMapTest, MapMergesContiguousBlocks) {
+  ExtentMap map;
+  blk_t bnos[] = {100, 101, 102, 103};
+  ASSERT_OK(map.Map(0, 4, bnos));
+  ASSERT_EQ(1, map.extents().size());
+  EXPECT_EQ(4u, map.End());
+
+  // Appending contiguous blocks extends the last extent.
+  blk_t next[] = {104, 105};
+  ASSERT_OK(map.Map(4, 2, next));
+  ASSERT_EQ(1, map.extents().size());
+  EXPECT_EQ(6u, map.extents()[0].length);
+
+  // Remapping a block in the middle splits the extent in three.
+  blk_t remap = 500;
+  ASSERT_OK(map.Map(2, 1, &remap));
+  ASSERT_EQ(3, map.extents().size());
+  EXPECT_EQ(101u, map.Lookup(1));
+  EXPECT_EQ(500u, map.Lookup(2));
+  EXPECT_EQ(103u, map.Lookup(3));
+  EXPECT_EQ(0u, map.Lookup(6));
+
+  // Remapping it back merges them again.
+  blk_t restore = 102;
+  ASSERT_OK(map.Map(2, 1, &restore));
+  ASSERT_EQ(1, map.extents().size());
+  EXPECT_EQ(6u, map.extents()[0].length);
+}
+
+TEST(ExtentMapTest, SparseBlocksAreUnmapped) {
+  ExtentMap map;
+  blk_t bno = 10;
+  ASSERT_OK(map.Map(100, 1, &bno));
+  EXPECT_EQ(0u, map.Lookup(0));
+  EXPECT_EQ(0u, map.Lookup(99));
+  EXPECT_EQ(10u, map.Lookup(100));
+  EXPECT_EQ(0u, map.Lookup(101));
+  EXPECT_EQ(101u, map.End());
+}
+
+TEST(ExtentMapTest, TruncateSplitsExtent) {
+  ExtentMap map;
+  blk_t bnos[] = {100, 101, 102, 103};
+  ASSERT_OK(map.Map(0, 4, bnos));
+  blk_t bno = 200;
+  ASSERT_OK(map.Map(10, 1, &bno));
+
+  ASSERT_OK(map.Truncate(2));
+  ASSERT_EQ(1, map.extents().size());
+  EXPECT_EQ(2u, map.End());
+  EXPECT_EQ(101u, map.Lookup(1));
+  EXPECT_EQ(0u, map.Lookup(2));
+
+  ASSERT_OK(map.Truncate(0));
+  EXPECT_EQ(0, map.extents().size());
+  EXPECT_EQ(0u, map.End());
+}
+
+TEST(ExtentMapTest, InlineExtentsNeedNoLeaves) {
+  ExtentMap map;
+  FakeLeafStorage storage;
+  Inode inode = {};
+  ASSERT_OK(MapSparse(&map, 0, kMinfsInlineExtents, 100));
+  map.Sync(&inode, &storage);
+  EXPECT_EQ(0, storage.leaf_count());
+  EXPECT_EQ(kMinfsIndirect, map.FreeLeafSlots());
+
+  ExtentMap loaded;
+  ASSERT_OK(loaded.Load(inode, &storage));
+  ASSERT_EQ(kMinfsInlineExtents, loaded.extents().size());
+  EXPECT_EQ(108u, loaded.Lookup(4));
+}
+
+TEST(ExtentMapTest, SyncSplitsAndMergesLeaves) {
+  ExtentMap map;
+  FakeLeafStorage storage;
+  Inode inode = {};
+
+  // Mapping many blocks at once splits the leaves as often as needed.
+  const blk_t kBlocks = 3 * kMinfsExtentsPerLeaf;
+  ASSERT_OK(MapSparse(&map, 0, kBlocks, 100));
+  map.Sync(&inode, &storage);
+  ExpectLeavesFit(map);
+  EXPECT_EQ(map.leaves().size() - 1, storage.leaf_count());
+  EXPECT_EQ(kMinfsIndirect - storage.leaf_count(), map.FreeLeafSlots());
+
+  // The leaves are read back in the order of their extents.
+  ExtentMap loaded;
+  ASSERT_OK(loaded.Load(inode, &storage));
+  ASSERT_EQ(kBlocks, loaded.extents().size());
+  for (blk_t i = 0; i < kBlocks; i++) {
+    ASSERT_EQ(100 + 2 * i, loaded.Lookup(i));
+  }
+
+  // Mapping a few blocks only rewrites the leaves which hold them.
+  const size_t writes = storage.writes();
+  ASSERT_OK(MapSparse(&loaded, kMinfsExtentsPerLeaf, 4, 10000));
+  loaded.Sync(&inode, &storage);
+  ExpectLeavesFit(loaded);
+  EXPECT_LE(storage.writes() - writes, 2);
+
+  // Leaves which become nearly empty are merged into their neighbours, and the leaves left
+  // empty are freed.
+  ASSERT_OK(loaded.Truncate(kMinfsExtentsPerLeaf / 2));
+  loaded.Sync(&inode, &storage);
+  ExpectLeavesFit(loaded);
+  EXPECT_LE(storage.leaf_count(), 1);
+  EXPECT_EQ(kMinfsExtentsPerLeaf / 2, loaded.End());
+
+  ASSERT_OK(loaded.Truncate(0));
+  loaded.Sync(&inode, &storage);
+  EXPECT_EQ(0, storage.leaf_count());
+  EXPECT_EQ(kMinfsIndirect, loaded.FreeLeafSlots());
+  for (uint32_t i = 0; i < kMinfsIndirect; i++) {
+    EXPECT_EQ(0u, inode.inum[i]);
+  }
+}
+
+TEST(ExtentMapTest, RequiredLeavesCoverMaps) {
+  // Mapping up to kMaxMapBlocks sparse blocks at a time never allocates more leaves than
+  // RequiredLeaves promises.
+  ExtentMap map;
+  FakeLeafStorage storage;
+  Inode inode = {};
+  const blk_t kBlocks = 4 * ExtentMap::kMaxMapBlocks;
+  for (blk_t i = 0; i < kBlocks; i += ExtentMap::kMaxMapBlocks) {
+    ASSERT_OK(MapSparse(&map, i, ExtentMap::kMaxMapBlocks, 100 + 2 * i));
+    map.Sync(&inode, &storage);
+    ExpectLeavesFit(map);
+  }
+  EXPECT_LE(storage.leaf_count(), ExtentMap::RequiredLeaves(kBlocks));
+}
+
+TEST(ExtentMapTest, LoadRejectsOverlappingExtents) {
+  FakeLeafStorage storage;
+  Inode inode = {};
+  MinfsExtent extents[kMinfsInlineExtents] = {{0, 100, 4}, {2, 200, 1}};
+  memcpy(inode.dnum, extents, sizeof(extents));
+
+  ExtentMap map;
+  EXPECT_EQ(ZX_ERR_IO_DATA_INTEGRITY, map.Load(inode, &storage));
+
+  // Extents must not point at block zero.
+  extents[1] = {4, 0, 1};
+  memcpy(inode.dnum, extents, sizeof(extents));
+  EXPECT_EQ(ZX_ERR_IO_DATA_INTEGRITY, map.Load(inode, &storage));
+
+  extents[1] = {4, 200, 1};
+  memcpy(inode.dnum, extents, sizeof(extents));
+  ASSERT_OK(map.Load(inode, &storage));
+  EXPECT_EQ(200u, map.Lookup(4));
+}
+
+}  // namespace
+}  // namespace minfs
@@ -79,5 +79,22 @@ TEST(MinfsFormat, MinfsSuperblockOnFvm) {
                                  + InodeBlocks(info) + JournalBlocks(info));
 }
 
+TEST(MinfsFormat, DirectoryIndexFitsBetweenDirents) {
+  // The index lives in the slack of the '..' dirent, which follows the '.' dirent.
+  ASSERT_EQ(kMinfsDirectoryIndexOffset, DirentSize(1) + DirentSize(2));
+  ASSERT_LE(kMinfsDirectoryIndexOffset + sizeof(DirectoryIndex), kMinfsBlockSize);
+
+  // Every slot of a full-depth index must be able to name any bucket block.
+  ASSERT_LE(kMinfsMaxIndexedDirectoryBlocks, 1u << kMinfsMaxDirectoryIndexDepth);
+}
+
+TEST(MinfsFormat, DirentHashIsStable) {
+  // The hash is part of the on-disk format, so it must never change.
+  ASSERT_EQ(MinfsDirentHash("", 0), 2166136261u);
+  ASSERT_EQ(MinfsDirentHash("a", 1), 0xe40c292cu);
+  ASSERT_EQ(MinfsDirentHash("foobar", 6), 0xbf9cf968u);
+  ASSERT_NE(MinfsDirentHash("file-1", 6), MinfsDirentHash("file-2", 6));
+}
+
 }  // namespace
 }  // namespace minfs
@@ -0,0 +1,92 @@
+// Copyright 2019 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Tests ReadaheadState behavior.
+
+#include <zxtest/zxtest.h>
+
+#include "vnode-readahead.h"
+
+namespace minfs {
+namespace {
+
+TEST(ReadaheadTest, WindowGrowsWhileSequential) {
+  ReadaheadState state;
+  ASSERT_OK(state.Resize(1024));
+
+  // The first read of a file starts a stream.
+  EXPECT_EQ(1 + kMinReadaheadBlocks, state.NextReadaheadEnd(0, 1));
+  EXPECT_EQ(2 + 2 * kMinReadaheadBlocks, state.NextReadaheadEnd(1, 1));
+
+  // Reads which are not block-aligned may start in the block where the previous read ended.
+  EXPECT_EQ(4 + 4 * kMinReadaheadBlocks, state.NextReadaheadEnd(1, 3));
+
+  blk_t block = 4;
+  for (int i = 0; i < 16; i++, block++) {
+    state.NextReadaheadEnd(block, 1);
+  }
+  EXPECT_EQ(block + 1 + kMaxReadaheadBlocks, state.NextReadaheadEnd(block, 1));
+}
+
+TEST(ReadaheadTest, RandomReadsDisableReadahead) {
+  ReadaheadState state;
+  ASSERT_OK(state.Resize(1024));
+
+  state.NextReadaheadEnd(0, 1);
+  state.NextReadaheadEnd(1, 1);
+  EXPECT_EQ(501u, state.NextReadaheadEnd(500, 1));
+  EXPECT_EQ(101u, state.NextReadaheadEnd(100, 1));
+
+  // A stream may start again anywhere.
+  EXPECT_EQ(102 + kMinReadaheadBlocks, state.NextReadaheadEnd(101, 1));
+}
+
+TEST(ReadaheadTest, HitsAndWaste) {
+  ReadaheadState state;
+  ASSERT_OK(state.Resize(64));
+
+  EXPECT_EQ(0u, state.SetLoaded(0, 2, false));
+  EXPECT_EQ(0u, state.SetLoaded(2, 8, true));
+  EXPECT_TRUE(state.IsLoaded(9));
+  EXPECT_FALSE(state.IsLoaded(10));
+
+  // Only the first access to a block read ahead is a hit.
+  EXPECT_EQ(3u, state.Access(0, 5));
+  EXPECT_EQ(0u, state.Access(0, 5));
+
+  // Overwriting a block read ahead wastes it.
+  EXPECT_EQ(1u, state.SetLoaded(5, 1, false));
+
+  // Discarding the blocks read ahead wastes the rest.
+  EXPECT_EQ(2u, state.Discard(8));
+  EXPECT_FALSE(state.IsLoaded(8));
+  EXPECT_TRUE(state.IsLoaded(7));
+  EXPECT_EQ(2u, state.Access(6, 10));
+}
+
+TEST(ReadaheadTest, ResizePreservesState) {
+  ReadaheadState state;
+  EXPECT_EQ(0u, state.size());
+  EXPECT_FALSE(state.IsLoaded(0));
+
+  ASSERT_OK(state.Resize(10));
+  state.SetLoaded(3, 2, false);
+  state.SetLoaded(8, 2, true);
+
+  ASSERT_OK(state.Resize(100000));
+  EXPECT_EQ(100000u, state.size());
+  EXPECT_TRUE(state.IsLoaded(3));
+  EXPECT_TRUE(state.IsLoaded(4));
+  EXPECT_FALSE(state.IsLoaded(5));
+  EXPECT_TRUE(state.IsLoaded(9));
+  EXPECT_FALSE(state.IsLoaded(10));
+
+  ASSERT_OK(state.Resize(9));
+  EXPECT_TRUE(state.IsLoaded(8));
+  EXPECT_FALSE(state.IsLoaded(9));
+  EXPECT_EQ(1u, state.Access(0, 9));
+}
+
+}  // namespace
+}  // namespace minfs
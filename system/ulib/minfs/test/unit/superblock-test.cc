@@ -243,7 +243,7 @@ TEST(SuperblockTest, TestUpgradeSuperblockV8) {
 
   // Confirm that the superblock is upgraded to newer version.
   ASSERT_EQ(kMinfsMajorVersionOld2, upgraded_info.version_major);
-  ASSERT_EQ(kMinfsMinorVersion, upgraded_info.version_minor);
+  ASSERT_EQ(kMinfsMinorVersionBase, upgraded_info.version_minor);
 
   // Confirm that the backup superblock is updated.
   ASSERT_BYTES_EQ(&upgraded_info, &backup_info, sizeof(upgraded_info));
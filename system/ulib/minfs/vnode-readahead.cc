@@ -0,0 +1,118 @@
+// Copyright 2019 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "vnode-readahead.h"
+
+#include <utility>
+
+#include <fbl/algorithm.h>
+#include <fbl/alloc_checker.h>
+
+namespace minfs {
+namespace {
+
+using RawBitmap = bitmap::RawBitmapGeneric<bitmap::DefaultStorage>;
+
+// Sets the bits of |to| which are set in |from| within [0, end).
+void CopyBits(const RawBitmap& from, RawBitmap* to, blk_t end) {
+  size_t start = 0;
+  while (start < end && from.Find(true, start, end, 1, &start) == ZX_OK) {
+    size_t run_end;
+    from.Get(start, end, &run_end);
+    ZX_ASSERT(to->Set(start, run_end) == ZX_OK);
+    start = run_end;
+  }
+}
+
+// Returns the number of bits set in |bitmap| within [start, end).
+blk_t CountSet(const RawBitmap& bitmap, blk_t start, blk_t end) {
+  blk_t count = 0;
+  size_t bit = start;
+  while (bit < end && bitmap.Find(true, bit, end, 1, &bit) == ZX_OK) {
+    size_t run_end;
+    bitmap.Get(bit, end, &run_end);
+    count += static_cast<blk_t>(run_end - bit);
+    bit = run_end;
+  }
+  return count;
+}
+
+}  // namespace
+
+zx_status_t ReadaheadState::Resize(blk_t blocks) {
+  if (blocks == size()) {
+    return ZX_OK;
+  }
+  // The bitmaps cannot be resized in place without losing their contents, so the state is copied
+  // into new bitmaps, which replace the old ones only once they have been allocated.
+  fbl::AllocChecker ac;
+  fbl::unique_ptr<Maps> maps(new (&ac) Maps);
+  if (!ac.check()) {
+    return ZX_ERR_NO_MEMORY;
+  }
+  zx_status_t status;
+  if ((status = maps->loaded.Reset(blocks)) != ZX_OK ||
+      (status = maps->speculative.Reset(blocks)) != ZX_OK) {
+    return status;
+  }
+  if (maps_ != nullptr) {
+    const blk_t end = fbl::min(blocks, size());
+    CopyBits(maps_->loaded, &maps->loaded, end);
+    CopyBits(maps_->speculative, &maps->speculative, end);
+  }
+  maps_ = std::move(maps);
+  return ZX_OK;
+}
+
+blk_t ReadaheadState::SetLoaded(blk_t start, blk_t count, bool speculative) {
+  ZX_DEBUG_ASSERT(start + count <= size());
+  if (count == 0) {
+    return 0;
+  }
+  ZX_ASSERT(maps_->loaded.Set(start, start + count) == ZX_OK);
+  if (speculative) {
+    ZX_ASSERT(maps_->speculative.Set(start, start + count) == ZX_OK);
+    return 0;
+  }
+  blk_t wasted = CountSet(maps_->speculative, start, start + count);
+  ZX_ASSERT(maps_->speculative.Clear(start, start + count) == ZX_OK);
+  return wasted;
+}
+
+blk_t ReadaheadState::Access(blk_t start, blk_t count) {
+  const blk_t end = fbl::min(start + count, size());
+  if (start >= end) {
+    return 0;
+  }
+  blk_t hits = CountSet(maps_->speculative, start, end);
+  ZX_ASSERT(maps_->speculative.Clear(start, end) == ZX_OK);
+  return hits;
+}
+
+blk_t ReadaheadState::NextReadaheadEnd(blk_t start, blk_t count) {
+  // A read which starts in the block where the previous one ended continues the same stream, since
+  // reads need not be block-aligned.
+  bool sequential = (start == next_block_) || (next_block_ > 0 && start == next_block_ - 1);
+  if (!sequential) {
+    window_ = 0;
+  } else if (window_ == 0) {
+    window_ = kMinReadaheadBlocks;
+  } else {
+    window_ = fbl::min(window_ * 2, kMaxReadaheadBlocks);
+  }
+  next_block_ = start + count;
+  return next_block_ + window_;
+}
+
+blk_t ReadaheadState::Discard(blk_t start) {
+  if (start >= size()) {
+    return 0;
+  }
+  blk_t wasted = CountSet(maps_->speculative, start, size());
+  ZX_ASSERT(maps_->loaded.Clear(start, size()) == ZX_OK);
+  ZX_ASSERT(maps_->speculative.Clear(start, size()) == ZX_OK);
+  return wasted;
+}
+
+}  // namespace minfs
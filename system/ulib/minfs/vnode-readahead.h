@@ -0,0 +1,80 @@
+// Copyright 2019 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// This file describes a utility for tracking which blocks of a Minfs vnode's VMO have been read
+// from disk, and for sizing readahead.
+
+#ifndef ZIRCON_SYSTEM_ULIB_MINFS_VNODE_READAHEAD_H_
+#define ZIRCON_SYSTEM_ULIB_MINFS_VNODE_READAHEAD_H_
+
+#ifndef __Fuchsia__
+#error Fuchsia-only Header
+#endif
+
+#include <bitmap/raw-bitmap.h>
+#include <fbl/unique_ptr.h>
+#include <minfs/format.h>
+
+namespace minfs {
+
+// The readahead window of a sequential reader starts at |kMinReadaheadBlocks| blocks, and doubles
+// on each sequential read up to |kMaxReadaheadBlocks| blocks.
+constexpr blk_t kMinReadaheadBlocks = 4;
+constexpr blk_t kMaxReadaheadBlocks = 128;
+
+// ReadaheadState tracks which blocks of a vnode's VMO hold the contents of the file, and which of
+// those were read speculatively and have not been accessed yet. It also detects sequential access,
+// and sizes the readahead window accordingly.
+class ReadaheadState {
+ public:
+  ReadaheadState() = default;
+
+  // Returns the number of blocks covered by the state.
+  blk_t size() const { return maps_ == nullptr ? 0 : static_cast<blk_t>(maps_->loaded.size()); }
+
+  // Resizes the state to cover |blocks| blocks. The state of the blocks which remain covered is
+  // preserved; new blocks are not loaded.
+  zx_status_t Resize(blk_t blocks);
+
+  // Returns true if block |n| of the VMO holds the contents of the file.
+  bool IsLoaded(blk_t n) const { return n < size() && maps_->loaded.GetOne(n); }
+
+  // Marks [start, start + count) as holding the contents of the file. Blocks marked
+  // |speculative| were read ahead of an access. Returns the number of speculative blocks which
+  // were overwritten by non-speculative contents before being accessed.
+  blk_t SetLoaded(blk_t start, blk_t count, bool speculative);
+
+  // Records an access to [start, start + count). Returns the number of blocks which had been read
+  // ahead, and are now accessed for the first time.
+  blk_t Access(blk_t start, blk_t count);
+
+  // Records a read of [start, start + count), and returns the block at which the readahead window
+  // following it ends. Returns |start + count| if the read is not part of a sequential stream.
+  blk_t NextReadaheadEnd(blk_t start, blk_t count);
+
+  // Forgets the contents of all blocks at and after |start|. Returns the number of speculative
+  // blocks discarded without ever being accessed.
+  blk_t Discard(blk_t start);
+
+ private:
+  using RawBitmap = bitmap::RawBitmapGeneric<bitmap::DefaultStorage>;
+
+  struct Maps {
+    // Blocks which hold the contents of the file.
+    RawBitmap loaded;
+    // Blocks which were read ahead, and have not been accessed since.
+    RawBitmap speculative;
+  };
+
+  // Null until the state covers any blocks.
+  fbl::unique_ptr<Maps> maps_;
+
+  // The block following the last read, and the current readahead window, in blocks.
+  blk_t next_block_ = 0;
+  blk_t window_ = 0;
+};
+
+}  // namespace minfs
+
+#endif  // ZIRCON_SYSTEM_ULIB_MINFS_VNODE_READAHEAD_H_
@@ -220,12 +220,11 @@ zx_status_t VnodeMinfs::InitIndirectVmo() {
 }
 
 // Since we cannot yet register the filesystem as a paging service (and cleanly
-// fault on pages when they are actually needed), we currently read an entire
-// file to a VMO when a file's data block are accessed.
+// fault on pages when they are actually needed), the contents of a file are
+// read into a VMO when they are accessed through the vnode.
 //
-// TODO(smklein): Even this hack can be optimized; a bitmap could be used to
-// track all 'empty/read/dirty' blocks for each vnode, rather than reading
-// the entire file.
+// Initializing the VMO loads the indirect blocks mapping the file, but none of
+// its data blocks; those are read by ReadBlocks on first access.
 zx_status_t VnodeMinfs::InitVmo(PendingWork* transaction) {
   if (vmo_.is_valid()) {
     return ZX_OK;
@@ -241,11 +240,15 @@ zx_status_t VnodeMinfs::InitVmo(PendingWork* transaction) {
 
   zx_object_set_property(vmo_.get(), ZX_PROP_NAME, "minfs-inode", 11);
 
+  if ((status = readahead_.Resize(static_cast<blk_t>(vmo_size / kMinfsBlockSize))) != ZX_OK) {
+    vmo_.reset();
+    return status;
+  }
+
   if ((status = fs_->bc_->device()->BlockAttachVmo(vmo_, &vmoid_)) != ZX_OK) {
     vmo_.reset();
     return status;
   }
-  fs::ReadTxn read_transaction(fs_->bc_.get());
   uint32_t dnum_count = 0;
   uint32_t inum_count = 0;
   uint32_t dinum_count = 0;
@@ -254,13 +257,23 @@ zx_status_t VnodeMinfs::InitVmo(PendingWork* transaction) {
     fs_->UpdateInitMetrics(dnum_count, inum_count, dinum_count, vmo_size, ticker.End());
   });
 
-  // Initialize all direct blocks
-  blk_t bno;
+  if (IsExtentMapped()) {
+    // Loading the extents loads the leaves holding them.
+    const ExtentMap* extents;
+    if ((status = GetExtents(&extents)) != ZX_OK) {
+      vmo_.reset();
+      return status;
+    }
+    inum_count = static_cast<uint32_t>(extents->leaves().size()) - 1;
+    ValidateVmoTail(GetSize());
+    return ZX_OK;
+  }
+
+  // Count all direct blocks
   for (uint32_t d = 0; d < kMinfsDirect; d++) {
-    if ((bno = inode_.dnum[d]) != 0) {
-      fs_->ValidateBno(bno);
+    if (inode_.dnum[d] != 0) {
+      fs_->ValidateBno(inode_.dnum[d]);
       dnum_count++;
-      read_transaction.Enqueue(vmoid_.id, d, bno + fs_->Info().dat_block, 1);
     }
   }
 
@@ -276,21 +289,10 @@ zx_status_t VnodeMinfs::InitVmo(PendingWork* transaction) {
         vmo_.reset();
         return status;
       }
-
-      uint32_t* ientry;
-      ReadIndirectVmoBlock(i, &ientry);
-
-      for (uint32_t j = 0; j < kMinfsDirectPerIndirect; j++) {
-        if ((bno = ientry[j]) != 0) {
-          fs_->ValidateBno(bno);
-          uint32_t n = kMinfsDirect + i * kMinfsDirectPerIndirect + j;
-          read_transaction.Enqueue(vmoid_.id, n, bno + fs_->Info().dat_block, 1);
-        }
-      }
     }
   }
 
-  // Initialize all doubly indirect blocks
+  // Initialize all doubly indirect blocks, and the indirect blocks they point to
   for (uint32_t i = 0; i < kMinfsDoublyIndirect; i++) {
     blk_t dibno;
 
@@ -304,39 +306,90 @@ zx_status_t VnodeMinfs::InitVmo(PendingWork* transaction) {
         return status;
       }
 
-      uint32_t* dientry;
-      ReadIndirectVmoBlock(GetVmoOffsetForDoublyIndirect(i), &dientry);
-
-      for (uint32_t j = 0; j < kMinfsDirectPerIndirect; j++) {
-        blk_t ibno;
-        if ((ibno = dientry[j]) != 0) {
-          fs_->ValidateBno(ibno);
-
-          // Only initialize the indirect vmo if it is being used.
-          if ((status = LoadIndirectWithinDoublyIndirect(i)) != ZX_OK) {
-            vmo_.reset();
-            return status;
-          }
-
-          uint32_t* ientry;
-          ReadIndirectVmoBlock(GetVmoOffsetForIndirect(i) + j, &ientry);
-
-          for (uint32_t k = 0; k < kMinfsDirectPerIndirect; k++) {
-            if ((bno = ientry[k]) != 0) {
-              fs_->ValidateBno(bno);
-              uint32_t n = kMinfsDirect + kMinfsIndirect * kMinfsDirectPerIndirect +
-                           j * kMinfsDirectPerIndirect + k;
-              read_transaction.Enqueue(vmoid_.id, n, bno + fs_->Info().dat_block, 1);
-            }
-          }
-        }
+      if ((status = LoadIndirectWithinDoublyIndirect(i)) != ZX_OK) {
+        vmo_.reset();
+        return status;
       }
     }
   }
 
-  status = read_transaction.Transact();
   ValidateVmoTail(GetSize());
-  return status;
+  return ZX_OK;
+}
+
+zx_status_t VnodeMinfs::ReadBlocks(blk_t start, blk_t end, blk_t readahead_end) {
+  end = fbl::min(end, readahead_.size());
+  readahead_end = fbl::max(end, fbl::min(readahead_end, readahead_.size()));
+
+  // Readahead is only issued once fewer than half of the window's blocks remain loaded ahead of
+  // the reader, so that it is issued in batches of at least half a window.
+  blk_t limit = end;
+  for (blk_t n = end; n < end + (readahead_end - end + 1) / 2; n++) {
+    if (!readahead_.IsLoaded(n)) {
+      limit = readahead_end;
+      break;
+    }
+  }
+  while (start < limit && readahead_.IsLoaded(start)) {
+    start++;
+  }
+  while (limit > start && readahead_.IsLoaded(limit - 1)) {
+    limit--;
+  }
+
+  // Blocks are mapped, read and marked as loaded in batches, each of which is read with a single
+  // transaction. Contiguous blocks of a batch are merged into a single request by the transaction.
+  blk_t bnos[kMaxReadaheadBlocks];
+  for (blk_t batch = start; batch < limit; batch += kMaxReadaheadBlocks) {
+    const blk_t count = fbl::min(limit - batch, kMaxReadaheadBlocks);
+    zx_status_t status;
+    if ((status = EnsureIndirectVmoSize(batch + count - 1)) != ZX_OK) {
+      return status;
+    }
+    auto block_callback = [](blk_t local_bno, blk_t old_bno, blk_t* out_bno) {};
+    BlockOpArgs op_args(nullptr, BlockOp::kRead, std::move(block_callback), batch, count, bnos);
+    if ((status = ApplyOperation(&op_args)) != ZX_OK) {
+      return status;
+    }
+
+    fs::ReadTxn read_transaction(fs_->bc_.get());
+    bool reads = false;
+    for (blk_t i = 0; i < count; i++) {
+      if (bnos[i] != 0 && !readahead_.IsLoaded(batch + i)) {
+        fs_->ValidateBno(bnos[i]);
+        read_transaction.Enqueue(vmoid_.id, batch + i, bnos[i] + fs_->Info().dat_block, 1);
+        reads = true;
+      }
+    }
+    if (reads && (status = read_transaction.Transact()) != ZX_OK) {
+      return status;
+    }
+
+    // Blocks which are not allocated read as zeroes, which the VMO already holds.
+    blk_t speculative = 0;
+    for (blk_t i = 0; i < count; i++) {
+      const blk_t n = batch + i;
+      if (!readahead_.IsLoaded(n)) {
+        readahead_.SetLoaded(n, 1, n >= end);
+        speculative += (n >= end) ? 1 : 0;
+      }
+    }
+    fs_->UpdateReadaheadMetrics(speculative, 0, 0);
+  }
+  return ZX_OK;
+}
+
+zx_status_t VnodeMinfs::ResizeVmo(uint64_t size) {
+  zx_status_t status;
+  if ((status = readahead_.Resize(static_cast<blk_t>(size / kMinfsBlockSize))) != ZX_OK) {
+    return status;
+  }
+  if ((status = vmo_.set_size(size)) != ZX_OK) {
+    readahead_.Resize(static_cast<blk_t>(vmo_size_ / kMinfsBlockSize));
+    return status;
+  }
+  vmo_size_ = size;
+  return ZX_OK;
 }
 #endif
 
@@ -540,6 +593,10 @@ void VnodeMinfs::ClearIndirectBlock(blk_t bno) {
 #endif
 
 zx_status_t VnodeMinfs::ApplyOperation(BlockOpArgs* op_args) {
+  if (IsExtentMapped()) {
+    return ApplyExtentOperation(op_args);
+  }
+
   blk_t start = op_args->start;
   blk_t found = 0;
   bool dirty = false;
@@ -644,9 +701,172 @@ zx_status_t VnodeMinfs::ApplyOperation(BlockOpArgs* op_args) {
   return found == op_args->count ? ZX_OK : ZX_ERR_OUT_OF_RANGE;
 }
 
+class VnodeMinfs::ExtentLeaves final : public ExtentLeafStorage {
+ public:
+  // Leaves are only allocated, freed and written within |transaction|, which may be null if the
+  // leaves are only read.
+  ExtentLeaves(VnodeMinfs* vnode, Transaction* transaction)
+      : vnode_(vnode), transaction_(transaction) {}
+
+  zx_status_t ReadLeaf(uint32_t slot, blk_t bno, MinfsExtent* extents) final {
+    vnode_->fs_->ValidateBno(bno);
+#ifdef __Fuchsia__
+    // The leaves are loaded into the indirect VMO along with the rest of |inum|.
+    uint32_t* entry;
+    vnode_->ReadIndirectVmoBlock(slot, &entry);
+#else
+    uint32_t entry[kMinfsDirectPerIndirect];
+    vnode_->ReadIndirectBlock(bno, entry);
+#endif
+    memcpy(extents, entry, kMinfsExtentsPerLeaf * sizeof(MinfsExtent));
+    return ZX_OK;
+  }
+
+  blk_t AllocateLeaf() final {
+    ZX_DEBUG_ASSERT(transaction_ != nullptr);
+    blk_t bno;
+    vnode_->fs_->BlockNew(transaction_, &bno);
+    vnode_->inode_.block_count++;
+    return bno;
+  }
+
+  void FreeLeaf(blk_t bno) final {
+    ZX_DEBUG_ASSERT(transaction_ != nullptr);
+    vnode_->fs_->BlockFree(transaction_, bno);
+    vnode_->inode_.block_count--;
+  }
+
+  void WriteLeaf(uint32_t slot, blk_t bno, const MinfsExtent* extents) final {
+    ZX_DEBUG_ASSERT(transaction_ != nullptr);
+#ifdef __Fuchsia__
+    uint32_t* entry;
+    vnode_->ReadIndirectVmoBlock(slot, &entry);
+    memset(entry, 0, kMinfsBlockSize);
+    memcpy(entry, extents, kMinfsExtentsPerLeaf * sizeof(MinfsExtent));
+    fs::Operation op = {
+      .type = fs::OperationType::kWrite,
+      .vmo_offset = slot,
+      .dev_offset = bno + vnode_->fs_->Info().dat_block,
+      .length = 1,
+    };
+    transaction_->EnqueueMetadata(vnode_->vmo_indirect_->vmo().get(), std::move(op));
+#else
+    uint32_t entry[kMinfsDirectPerIndirect] = {};
+    memcpy(entry, extents, kMinfsExtentsPerLeaf * sizeof(MinfsExtent));
+    vnode_->fs_->bc_->Writeblk(bno + vnode_->fs_->Info().dat_block, entry);
+#endif
+  }
+
+ private:
+  VnodeMinfs* vnode_;
+  Transaction* transaction_;
+};
+
+zx_status_t VnodeMinfs::GetExtents(const ExtentMap** out) {
+  ZX_DEBUG_ASSERT(IsExtentMapped());
+  if (extent_map_ == nullptr) {
+    zx_status_t status;
+#ifdef __Fuchsia__
+    for (uint32_t slot = 0; slot < kMinfsIndirect; slot++) {
+      if (inode_.inum[slot] != 0) {
+        if ((status = InitIndirectVmo()) != ZX_OK) {
+          return status;
+        }
+        break;
+      }
+    }
+#endif
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<ExtentMap> extent_map(new (&ac) ExtentMap());
+    if (!ac.check()) {
+      return ZX_ERR_NO_MEMORY;
+    }
+    ExtentLeaves leaves(this, nullptr);
+    if ((status = extent_map->Load(inode_, &leaves)) != ZX_OK) {
+      FS_TRACE_ERROR("minfs: Failed to load extents of ino %u: %d\n", ino_, status);
+      return status;
+    }
+    extent_map_ = std::move(extent_map);
+  }
+  *out = extent_map_.get();
+  return ZX_OK;
+}
+
+zx_status_t VnodeMinfs::ApplyExtentOperation(BlockOpArgs* op_args) {
+  const ExtentMap* extents;
+  zx_status_t status;
+  if ((status = GetExtents(&extents)) != ZX_OK) {
+    return status;
+  }
+
+  bool dirty = false;
+  if (op_args->op == BlockOp::kDelete) {
+    // Blocks past the last extent may still be pending allocation, so the callback is invoked
+    // up to the end of the file.
+    const blk_t file_end =
+        static_cast<blk_t>(fbl::round_up(GetSize(), kMinfsBlockSize) / kMinfsBlockSize);
+    const blk_t end = fbl::min(op_args->start + op_args->count, fbl::max(extents->End(), file_end));
+    for (blk_t n = op_args->start; n < end; n++) {
+      blk_t bno = extents->Lookup(n);
+      op_args->callback(n, bno, &bno);
+    }
+    dirty = extents->End() > op_args->start;
+    if (dirty && (status = extent_map_->Truncate(op_args->start)) != ZX_OK) {
+      return status;
+    }
+  } else {
+    ZX_DEBUG_ASSERT(op_args->op == BlockOp::kRead || op_args->bnos != nullptr);
+#ifdef __Fuchsia__
+    // Leaves are written through the indirect VMO, which is needed as soon as the extents may no
+    // longer fit inline.
+    if (op_args->op != BlockOp::kRead &&
+        extents->extents().size() + op_args->count + 2 > kMinfsInlineExtents &&
+        (status = InitIndirectVmo()) != ZX_OK) {
+      return status;
+    }
+#endif
+    // Blocks moved to a new location are remapped in runs, each of which also spans the blocks
+    // left in place between them.
+    blk_t remap_start = 0;
+    blk_t remap_end = 0;
+    for (blk_t i = 0; i < op_args->count; i++) {
+      const blk_t n = op_args->start + i;
+      const blk_t old_bno = extents->Lookup(n);
+      blk_t bno = old_bno;
+      op_args->callback(n, old_bno, &bno);
+      if (op_args->bnos != nullptr) {
+        op_args->bnos[i] = bno;
+      }
+      if (bno != old_bno) {
+        ZX_DEBUG_ASSERT(op_args->op != BlockOp::kRead && bno != 0);
+        if (remap_end == 0) {
+          remap_start = i;
+        }
+        remap_end = i + 1;
+      }
+    }
+    if (remap_end != 0) {
+      if ((status = extent_map_->Map(op_args->start + remap_start, remap_end - remap_start,
+                                     &op_args->bnos[remap_start])) != ZX_OK) {
+        return status;
+      }
+      dirty = true;
+    }
+  }
+
+  if (dirty) {
+    ZX_DEBUG_ASSERT(op_args->transaction != nullptr);
+    ExtentLeaves leaves(this, op_args->transaction);
+    extent_map_->Sync(&inode_, &leaves);
+    InodeSync(op_args->transaction, kMxFsSyncDefault);
+  }
+  return ZX_OK;
+}
+
 zx_status_t VnodeMinfs::EnsureIndirectVmoSize(blk_t n) {
 #ifdef __Fuchsia__
-  if (n >= kMinfsDirect) {
+  // Extent-mapped vnodes manage the indirect VMO themselves.
+  if (n >= kMinfsDirect && !IsExtentMapped()) {
     zx_status_t status;
     // If the vmo_indirect_ vmo has not been created, make it now.
     if ((status = InitIndirectVmo()) != ZX_OK) {
@@ -780,6 +1000,9 @@ void VnodeMinfs::fbl_recycle() {
 
 VnodeMinfs::~VnodeMinfs() {
 #ifdef __Fuchsia__
+  // Blocks which were read ahead but never accessed were wasted.
+  fs_->UpdateReadaheadMetrics(0, 0, readahead_.Discard(0));
+
   // Detach the vmoids from the underlying block device,
   // so the underlying VMO may be released.
   size_t request_count = 0;
@@ -863,11 +1086,19 @@ zx_status_t VnodeMinfs::ReadInternal(PendingWork* transaction, void* data, size_
 #ifdef __Fuchsia__
   if ((status = InitVmo(transaction)) != ZX_OK) {
     return status;
-  } else if ((status = vmo_.read(data, off, len)) != ZX_OK) {
+  }
+  const blk_t start = static_cast<blk_t>(off / kMinfsBlockSize);
+  const blk_t end =
+      static_cast<blk_t>(fbl::round_up(off + len, kMinfsBlockSize) / kMinfsBlockSize);
+  if ((status = ReadBlocks(start, end, readahead_.NextReadaheadEnd(start, end - start))) !=
+      ZX_OK) {
+    return status;
+  }
+  fs_->UpdateReadaheadMetrics(0, readahead_.Access(start, end - start), 0);
+  if ((status = vmo_.read(data, off, len)) != ZX_OK) {
     return status;
-  } else {
-    *actual = len;
   }
+  *actual = len;
 #else
   void* start = data;
   uint32_t n = static_cast<uint32_t>(off / kMinfsBlockSize);
@@ -943,16 +1174,23 @@ zx_status_t VnodeMinfs::WriteInternal(Transaction* transaction, const void* data
     if ((xfer_off + xfer) > vmo_size_) {
       size_t new_size = fbl::round_up(xfer_off + xfer, kMinfsBlockSize);
       ZX_DEBUG_ASSERT(new_size >= GetSize());  // Overflow.
-      if ((status = vmo_.set_size(new_size)) != ZX_OK) {
+      if ((status = ResizeVmo(new_size)) != ZX_OK) {
+        break;
+      }
+    }
+
+    // A partial write of a block within the file must preserve the rest of its contents.
+    if (xfer < kMinfsBlockSize && n * kMinfsBlockSize < GetSize() && !readahead_.IsLoaded(n)) {
+      if ((status = ReadBlocks(n, n + 1, n + 1)) != ZX_OK) {
         break;
       }
-      vmo_size_ = new_size;
     }
 
     // Update this block of the in-memory VMO
     if ((status = vmo_.write(data, xfer_off, xfer)) != ZX_OK) {
       break;
     }
+    fs_->UpdateReadaheadMetrics(0, 0, readahead_.SetLoaded(n, 1, false));
 
     // Update this block on-disk
     blk_t bno;
@@ -1079,6 +1317,9 @@ void VnodeMinfs::Allocate(Minfs* fs, uint32_t type, fbl::RefPtr<VnodeMinfs>* out
     (*out)->inode_.dirent_count = 2;
   } else {
     (*out)->inode_.link_count = 1;
+    if (fs->Info().flags & kMinfsFlagExtents) {
+      (*out)->inode_.flags = kMinfsFileFlagExtents;
+    }
   }
 }
 
@@ -1164,8 +1405,6 @@ zx_status_t VnodeMinfs::GetAllocatedRegions(fidl_txn_t* transaction) const {
 zx_status_t VnodeMinfs::TruncateInternal(Transaction* transaction, size_t len) {
   zx_status_t status = ZX_OK;
 #ifdef __Fuchsia__
-  // TODO(smklein): We should only init up to 'len'; no need
-  // to read in the portion of a large file we plan on deleting.
   if ((status = InitVmo(transaction)) != ZX_OK) {
     FS_TRACE_ERROR("minfs: Truncate failed to initialize VMO: %d\n", status);
     return ZX_ERR_IO;
@@ -1187,6 +1426,7 @@ zx_status_t VnodeMinfs::TruncateInternal(Transaction* transaction, size_t len) {
     }
 
 #ifdef __Fuchsia__
+    fs_->UpdateReadaheadMetrics(0, 0, readahead_.Discard(start_bno));
     uint64_t decommit_offset = fbl::round_up(len, kMinfsBlockSize);
     uint64_t decommit_length = fbl::round_up(inode_size, kMinfsBlockSize) - decommit_offset;
     if (decommit_length > 0) {
@@ -1222,6 +1462,10 @@ zx_status_t VnodeMinfs::TruncateInternal(Transaction* transaction, size_t len) {
 #ifdef __Fuchsia__
       bool allocated = (bno != 0);
       if (allocated || HasPendingAllocation(rel_bno)) {
+        if ((status = ReadBlocks(rel_bno, rel_bno + 1, rel_bno + 1)) != ZX_OK) {
+          FS_TRACE_ERROR("minfs: Truncate failed to load last block: %d\n", status);
+          return ZX_ERR_IO;
+        }
         if ((status = vmo_.read(bdata, len - adjust, adjust)) != ZX_OK) {
           FS_TRACE_ERROR("minfs: Truncate failed to read last block: %d\n", status);
           return ZX_ERR_IO;
@@ -1232,6 +1476,7 @@ zx_status_t VnodeMinfs::TruncateInternal(Transaction* transaction, size_t len) {
           FS_TRACE_ERROR("minfs: Truncate failed to write last block: %d\n", status);
           return ZX_ERR_IO;
         }
+        fs_->UpdateReadaheadMetrics(0, 0, readahead_.SetLoaded(rel_bno, 1, false));
 
         if ((status = BlockGetWritable(transaction, rel_bno, &bno)) != ZX_OK) {
           FS_TRACE_ERROR("minfs: Truncate failed to get block %u of file: %d\n", rel_bno, status);
@@ -1257,11 +1502,9 @@ zx_status_t VnodeMinfs::TruncateInternal(Transaction* transaction, size_t len) {
       return ZX_ERR_INVALID_ARGS;
     }
 #ifdef __Fuchsia__
-    uint64_t new_size = fbl::round_up(len, kMinfsBlockSize);
-    if ((status = vmo_.set_size(new_size)) != ZX_OK) {
+    if ((status = ResizeVmo(fbl::round_up(len, kMinfsBlockSize))) != ZX_OK) {
       return status;
     }
-    vmo_size_ = new_size;
 #endif
   } else {
     return ZX_OK;
@@ -20,6 +20,7 @@
 #include <fs/watcher.h>
 
 #include "vnode-allocation.h"
+#include "vnode-readahead.h"
 #endif
 
 #include <lib/zircon-internal/fnv1hash.h>
@@ -39,6 +40,8 @@
 #include <minfs/transaction-limits.h>
 #include <minfs/writeback.h>
 
+#include "extent-map.h"
+
 namespace minfs {
 
 // Used by fsck
@@ -183,6 +186,15 @@ class VnodeMinfs : public fs::Vnode,
   // Update the vnode's inode and write it to disk.
   void InodeSync(PendingWork* transaction, uint32_t flags);
 
+  // Returns true if the vnode maps its data with extents (see |kMinfsFileFlagExtents|).
+  bool IsExtentMapped() const {
+    return inode_.magic == kMinfsMagicFile && (inode_.flags & kMinfsFileFlagExtents) != 0;
+  }
+
+  // Loads the extents of an extent-mapped vnode if they have not been loaded yet, and returns
+  // them in |out|.
+  zx_status_t GetExtents(const ExtentMap** out);
+
   // Decrements the inode link count to a vnode.
   // Writes the inode back to |transaction|.
   //
@@ -374,6 +386,12 @@ class VnodeMinfs : public fs::Vnode,
   zx_status_t BlockOpIndirect(BlockOpArgs* op_args, IndirectArgs* params);
   zx_status_t BlockOpDindirect(BlockOpArgs* op_args, DindirectArgs* params);
 
+  // Performs |op_args| on an extent-mapped vnode, on behalf of |ApplyOperation|.
+  zx_status_t ApplyExtentOperation(BlockOpArgs* op_args);
+
+  // Gives |extent_map_| access to the leaf blocks of the vnode.
+  class ExtentLeaves;
+
   // Ensures that the indirect vmo is large enough to reference a block at
   // relative block address |n| within the file.
   zx_status_t EnsureIndirectVmoSize(blk_t n);
@@ -410,6 +428,14 @@ class VnodeMinfs : public fs::Vnode,
   zx_status_t AttachRemote(fs::MountChannel h) final;
   zx_status_t InitVmo(PendingWork* transaction);
 
+  // Reads the blocks within [start, end) of the file which have not been read yet into the VMO.
+  // If the blocks up to |readahead_end| are about to run out, the unread blocks within
+  // [end, readahead_end) are read speculatively along with them.
+  zx_status_t ReadBlocks(blk_t start, blk_t end, blk_t readahead_end);
+
+  // Resizes the VMO, and the readahead state which covers it, to |size| bytes.
+  zx_status_t ResizeVmo(uint64_t size);
+
   // Initializes the indirect VMO, grows it to |size| bytes, and reads |count| indirect
   // blocks from |iarray| into the indirect VMO, starting at block offset |offset|.
   zx_status_t LoadIndirectBlocks(blk_t* iarray, uint32_t count, uint32_t offset, uint64_t size);
@@ -431,11 +457,13 @@ class VnodeMinfs : public fs::Vnode,
   Minfs* const fs_;
 #ifdef __Fuchsia__
   // TODO(smklein): When we have can register MinFS as a pager service, and
-  // it can properly handle pages faults on a vnode's contents, then we can
-  // avoid reading the entire file up-front. Until then, read the contents of
-  // a VMO into memory when it is read/written.
+  // it can properly handle pages faults on a vnode's contents, then the VMO
+  // can be populated by page faults. Until then, blocks of the VMO are read
+  // into memory when they are first read/written; readahead_ tracks which
+  // blocks have been read, and reads ahead of sequential readers.
   zx::vmo vmo_{};
   uint64_t vmo_size_ = 0;
+  ReadaheadState readahead_;
 
   // vmo_indirect_ contains all indirect and doubly indirect blocks in the following order:
   // First kMinfsIndirect blocks                                - initial set of indirect blocks
@@ -458,6 +486,10 @@ class VnodeMinfs : public fs::Vnode,
   // be held before accessing it.
   Inode inode_{};
 
+  // The extents of an extent-mapped vnode, loaded on first use. As with |inode_|, a valid
+  // Transaction object must be held before modifying it.
+  fbl::unique_ptr<ExtentMap> extent_map_;
+
   // This field tracks the current number of file descriptors with
   // an open reference to this Vnode. Notably, this is distinct from the
   // VnodeMinfs's own refcount, since there may still be filesystem
@@ -0,0 +1,75 @@
+// Copyright 2019 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <lib/zx/clock.h>
+#include <lib/zx/time.h>
+#include <threads.h>
+#include <zircon/types.h>
+
+#include <atomic>
+#include <vector>
+
+namespace start_together {
+
+// Runs |body(index)| for each |index| in [0, |num_threads|) on its own thread. The threads are all
+// created first and then released together, so |body| only measures contention between them, not
+// thread start-up. The threads are not pinned to cpus, so which cpus they run on is up to the
+// scheduler; pass zx_system_get_num_cpus() to give it one thread per cpu.
+//
+// |body| must return a zx_status_t. Returns ZX_OK if every call did, otherwise the last failure
+// seen. If |elapsed| is not null, it gets the time from the release to the last join.
+template <typename Body>
+zx_status_t RunTogether(uint32_t num_threads, const Body& body, zx::duration* elapsed = nullptr) {
+  struct State {
+    const Body* body;
+    std::atomic<bool> go{false};
+    std::atomic<zx_status_t> status{ZX_OK};
+  } state;
+  state.body = &body;
+
+  struct Thread {
+    State* state;
+    uint32_t index;
+    thrd_t thrd;
+  };
+
+  auto entry = [](void* arg) -> int {
+    auto* thread = static_cast<Thread*>(arg);
+    while (!thread->state->go.load()) {
+      thrd_yield();
+    }
+    zx_status_t status = (*thread->state->body)(thread->index);
+    if (status != ZX_OK) {
+      thread->state->status.store(status);
+    }
+    return 0;
+  };
+
+  std::vector<Thread> threads(num_threads);
+  uint32_t started = 0;
+  for (; started < num_threads; started++) {
+    threads[started] = {&state, started, {}};
+    if (thrd_create_with_name(&threads[started].thrd, entry, &threads[started], "start-together") !=
+        thrd_success) {
+      state.status.store(ZX_ERR_NO_RESOURCES);
+      break;
+    }
+  }
+
+  // If a thread could not be created, the ones that were still have to be released and joined;
+  // their results are not reported.
+  const zx::time start = zx::clock::get_monotonic();
+  state.go.store(true);
+  for (uint32_t i = 0; i < started; i++) {
+    thrd_join(threads[i].thrd, nullptr);
+  }
+  if (elapsed != nullptr) {
+    *elapsed = zx::clock::get_monotonic() - start;
+  }
+  return state.status.load();
+}
+
+}  // namespace start_together
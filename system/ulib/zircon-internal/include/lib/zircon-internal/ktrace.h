@@ -121,6 +121,18 @@ enum {
 #define KTRACE_ACTION_STOP      2 // options ignored
 #define KTRACE_ACTION_REWIND    3 // options ignored
 #define KTRACE_ACTION_NEW_PROBE 4 // options ignored, ptr = name
+#define KTRACE_ACTION_SET_MODE  5 // options = KTRACE_MODE_*, tracing must be stopped
+
+// Modes for ktrace buffers
+//
+// Each cpu records events into its own buffer, and reads return the names and
+// other metadata followed by the records of each cpu in turn, each cpu's records
+// preceded by a TAG_CPU_BUFFER record. Readers wanting a single timeline merge
+// the cpus' records by timestamp.
+#define KTRACE_MODE_ONESHOT     0 // stop tracing once any cpu's buffer is full
+#define KTRACE_MODE_CIRCULAR    1 // overwrite the oldest records of a full buffer
+#define KTRACE_MODE_STREAMING   2 // reads drain the buffers, records that do not
+                                  // fit until then are dropped
 
 // Flags defined for the INHERIT_PRIORITY ktrace event.  See ktrace-def.h for details.
 #define KTRACE_FLAGS_INHERIT_PRIORITY_CPUID_MASK ((uint32_t)0xFF)
@@ -7,6 +7,10 @@
 #include <stdint.h>
 #include <sys/stat.h>
 
+#include <blobfs/compression/blob-compressor.h>
+#include <blobfs/compression/chunked.h>
+#include <blobfs/compression/lz4.h>
+#include <blobfs/compression/zstd.h>
 #include <blobfs/format.h>
 #include <digest/digest.h>
 #include <digest/merkle-tree.h>
@@ -22,10 +26,16 @@
 #include <perftest/perftest.h>
 #include <unittest/unittest.h>
 
+#include <memory>
+#include <optional>
 #include <utility>
 
 namespace {
 
+using blobfs::BlobCompressor;
+using blobfs::ChunkedDecompressor;
+using blobfs::ChunkedRange;
+using blobfs::CompressionAlgorithm;
 using digest::Digest;
 using digest::MerkleTree;
 using fs_test_utils::Fixture;
@@ -115,6 +125,19 @@ fbl::String GetNameForOrder(ReadOrder order) {
   return "";
 }
 
+fbl::String GetNameForAlgorithm(CompressionAlgorithm algorithm) {
+  switch (algorithm) {
+    case CompressionAlgorithm::LZ4:
+      return "LZ4";
+    case CompressionAlgorithm::ZSTD:
+      return "ZSTD";
+    case CompressionAlgorithm::CHUNKED:
+      return "Chunked";
+  }
+
+  return "";
+}
+
 // Creates a an in memory blob.
 bool MakeBlob(fbl::String fs_path, size_t blob_size, unsigned int* seed,
               fbl::unique_ptr<BlobInfo>* out) {
@@ -309,6 +332,183 @@ class BlobfsTest {
   BlobfsInfo info_;
 };
 
+// Measures how long each compression format takes to produce one block of a blob, which is what
+// serving a page fault on a compressed blob costs. LZ4 and ZSTD blobs are single streams, so the
+// whole blob must be decompressed; chunked blobs only decompress the frame holding the block.
+class DecompressionTest {
+ public:
+  DecompressionTest(CompressionAlgorithm algorithm, size_t blob_size)
+      : algorithm_(algorithm), blob_size_(blob_size) {}
+
+  // Time to the first byte of the blob.
+  bool FirstBlockTest(perftest::RepeatState* state, Fixture* fixture) {
+    BEGIN_HELPER;
+    ASSERT_TRUE(Init(fixture->mutable_seed()));
+    while (state->KeepRunning()) {
+      ASSERT_TRUE(ReadBlock(0));
+    }
+    END_HELPER;
+  }
+
+  // Time to a block at a random offset in the blob.
+  bool RandomBlockTest(perftest::RepeatState* state, Fixture* fixture) {
+    BEGIN_HELPER;
+    ASSERT_TRUE(Init(fixture->mutable_seed()));
+    while (state->KeepRunning()) {
+      ASSERT_TRUE(ReadBlock(rand_r(fixture->mutable_seed()) % blob_size_));
+    }
+    END_HELPER;
+  }
+
+ private:
+  // Compresses a blob of moderately compressible data.
+  bool Init(unsigned int* seed) {
+    BEGIN_HELPER;
+    if (compressor_) {
+      return true;
+    }
+    data_.reset(new char[blob_size_]);
+    for (size_t i = 0; i < blob_size_; i++) {
+      data_[i] = static_cast<char>(rand_r(seed) % 16);
+    }
+    compressor_ = BlobCompressor::Create(algorithm_, blob_size_);
+    ASSERT_TRUE(compressor_);
+    ASSERT_EQ(compressor_->Update(data_.get(), blob_size_), ZX_OK);
+    ASSERT_EQ(compressor_->End(), ZX_OK);
+    output_.reset(new char[blob_size_]);
+
+    // Like blobfs, the seek table is only parsed once, when the blob is opened.
+    if (algorithm_ == CompressionAlgorithm::CHUNKED) {
+      ASSERT_EQ(ChunkedDecompressor::Create(compressor_->Data(), compressor_->Size(), blob_size_,
+                                            compressor_->Size(), &decompressor_),
+                ZX_OK);
+    }
+    END_HELPER;
+  }
+
+  // Decompresses at least the block holding |offset|, and checks it.
+  bool ReadBlock(uint64_t offset) {
+    BEGIN_HELPER;
+    const uint64_t start = fbl::round_down(offset, blobfs::kBlobfsBlockSize);
+    const uint64_t length = fbl::min<uint64_t>(blobfs::kBlobfsBlockSize, blob_size_ - start);
+    size_t target_size = blob_size_;
+    size_t src_size = compressor_->Size();
+    switch (algorithm_) {
+      case CompressionAlgorithm::LZ4:
+        ASSERT_EQ(blobfs::LZ4Decompress(output_.get(), &target_size, compressor_->Data(),
+                                        &src_size),
+                  ZX_OK);
+        break;
+      case CompressionAlgorithm::ZSTD:
+        ASSERT_EQ(blobfs::ZSTDDecompress(output_.get(), &target_size, compressor_->Data(),
+                                         &src_size),
+                  ZX_OK);
+        break;
+      case CompressionAlgorithm::CHUNKED: {
+        ChunkedRange range;
+        ASSERT_EQ(decompressor_->MapRange(start, length, &range), ZX_OK);
+        ASSERT_EQ(decompressor_->DecompressRange(
+                      range, &output_[range.data_offset],
+                      static_cast<const char*>(compressor_->Data()) + range.compressed_offset),
+                  ZX_OK);
+        break;
+      }
+    }
+    ASSERT_EQ(memcmp(&output_[start], &data_[start], length), 0);
+    END_HELPER;
+  }
+
+  const CompressionAlgorithm algorithm_;
+  const size_t blob_size_;
+  fbl::unique_ptr<char[]> data_;
+  fbl::unique_ptr<char[]> output_;
+  std::optional<BlobCompressor> compressor_;
+  fbl::unique_ptr<ChunkedDecompressor> decompressor_;
+};
+
+// Measures how the whole-blob operations blobfs performs when a blob is written or opened scale
+// with the number of threads they are split between: building and verifying the Merkle tree, and
+// decompressing a chunked blob.
+class ParallelTest {
+ public:
+  ParallelTest(size_t blob_size, size_t num_threads)
+      : blob_size_(blob_size), num_threads_(num_threads) {}
+
+  bool CreateMerkleTest(perftest::RepeatState* state, Fixture* fixture) {
+    BEGIN_HELPER;
+    ASSERT_TRUE(Init(fixture->mutable_seed()));
+    state->SetBytesProcessedPerRun(blob_size_);
+    Digest digest;
+    while (state->KeepRunning()) {
+      ASSERT_EQ(MerkleTree::CreateParallel(data_.get(), blob_size_, tree_.get(), tree_size_,
+                                           &digest, num_threads_),
+                ZX_OK);
+    }
+    ASSERT_TRUE(digest == digest_);
+    END_HELPER;
+  }
+
+  bool VerifyMerkleTest(perftest::RepeatState* state, Fixture* fixture) {
+    BEGIN_HELPER;
+    ASSERT_TRUE(Init(fixture->mutable_seed()));
+    state->SetBytesProcessedPerRun(blob_size_);
+    while (state->KeepRunning()) {
+      ASSERT_EQ(MerkleTree::VerifyParallel(data_.get(), blob_size_, tree_.get(), tree_size_, 0,
+                                           blob_size_, digest_, num_threads_),
+                ZX_OK);
+    }
+    END_HELPER;
+  }
+
+  bool DecompressTest(perftest::RepeatState* state, Fixture* fixture) {
+    BEGIN_HELPER;
+    ASSERT_TRUE(Init(fixture->mutable_seed()));
+    state->SetBytesProcessedPerRun(blob_size_);
+    while (state->KeepRunning()) {
+      size_t target_size = blob_size_;
+      size_t src_size = compressor_->Size();
+      ASSERT_EQ(blobfs::ChunkedDecompressParallel(output_.get(), &target_size,
+                                                  compressor_->Data(), &src_size, num_threads_),
+                ZX_OK);
+      ASSERT_EQ(target_size, blob_size_);
+    }
+    ASSERT_EQ(memcmp(output_.get(), data_.get(), blob_size_), 0);
+    END_HELPER;
+  }
+
+ private:
+  // Creates a blob of moderately compressible data, its Merkle tree, and its chunked form.
+  bool Init(unsigned int* seed) {
+    BEGIN_HELPER;
+    if (compressor_) {
+      return true;
+    }
+    data_.reset(new char[blob_size_]);
+    for (size_t i = 0; i < blob_size_; i++) {
+      data_[i] = static_cast<char>(rand_r(seed) % 16);
+    }
+    tree_size_ = MerkleTree::GetTreeLength(blob_size_);
+    tree_.reset(new uint8_t[tree_size_]);
+    ASSERT_EQ(MerkleTree::Create(data_.get(), blob_size_, tree_.get(), tree_size_, &digest_),
+              ZX_OK);
+    compressor_ = BlobCompressor::Create(CompressionAlgorithm::CHUNKED, blob_size_);
+    ASSERT_TRUE(compressor_);
+    ASSERT_EQ(compressor_->Update(data_.get(), blob_size_), ZX_OK);
+    ASSERT_EQ(compressor_->End(), ZX_OK);
+    output_.reset(new char[blob_size_]);
+    END_HELPER;
+  }
+
+  const size_t blob_size_;
+  const size_t num_threads_;
+  fbl::unique_ptr<char[]> data_;
+  fbl::unique_ptr<uint8_t[]> tree_;
+  size_t tree_size_ = 0;
+  Digest digest_;
+  fbl::unique_ptr<char[]> output_;
+  std::optional<BlobCompressor> compressor_;
+};
+
 bool RunBenchmark(int argc, char** argv) {
   FixtureOptions f_opts = FixtureOptions::Default(DISK_FORMAT_BLOBFS);
   PerformanceTestOptions p_opts;
@@ -387,6 +587,87 @@ bool RunBenchmark(int argc, char** argv) {
     }
   }
 
+  // The decompression tests don't use the filesystem, only the compression formats it uses.
+  const size_t decompression_sizes[] = {
+      128 * 1024,       // 128 Kb
+      1024 * 1024,      // 1 MB
+      8 * 1024 * 1024,  // 8 MB
+  };
+  const CompressionAlgorithm algorithms[] = {
+      CompressionAlgorithm::LZ4,
+      CompressionAlgorithm::ZSTD,
+      CompressionAlgorithm::CHUNKED,
+  };
+  fbl::Vector<fbl::unique_ptr<DecompressionTest>> decompression_tests;
+  for (auto algorithm : algorithms) {
+    TestCaseInfo testcase;
+    testcase.teardown = false;
+    testcase.sample_count = kSampleCount;
+    for (auto blob_size : decompression_sizes) {
+      decompression_tests.push_back(std::make_unique<DecompressionTest>(algorithm, blob_size));
+      DecompressionTest* test = decompression_tests[decompression_tests.size() - 1].get();
+      fbl::String name = fbl::StringPrintf("Decompress/%s/%s",
+                                           GetNameForAlgorithm(algorithm).c_str(),
+                                           GetNameForSize(blob_size).c_str());
+
+      TestInfo first_block_test;
+      first_block_test.name = fbl::StringPrintf("%s/FirstBlock", name.c_str());
+      first_block_test.test_fn = [test](perftest::RepeatState* state, Fixture* fixture) {
+        return test->FirstBlockTest(state, fixture);
+      };
+      testcase.tests.push_back(std::move(first_block_test));
+
+      TestInfo random_block_test;
+      random_block_test.name = fbl::StringPrintf("%s/RandomBlock", name.c_str());
+      random_block_test.test_fn = [test](perftest::RepeatState* state, Fixture* fixture) {
+        return test->RandomBlockTest(state, fixture);
+      };
+      testcase.tests.push_back(std::move(random_block_test));
+    }
+    testcases.push_back(std::move(testcase));
+  }
+
+  // The parallel tests show throughput against thread count, and don't use the filesystem either.
+  const size_t parallel_sizes[] = {
+      1024 * 1024,       // 1 MB
+      16 * 1024 * 1024,  // 16 MB
+  };
+  const size_t thread_counts[] = {1, 2, 4, 8};
+  fbl::Vector<fbl::unique_ptr<ParallelTest>> parallel_tests;
+  for (auto blob_size : parallel_sizes) {
+    TestCaseInfo testcase;
+    testcase.teardown = false;
+    testcase.sample_count = kSampleCount;
+    for (auto num_threads : thread_counts) {
+      parallel_tests.push_back(std::make_unique<ParallelTest>(blob_size, num_threads));
+      ParallelTest* test = parallel_tests[parallel_tests.size() - 1].get();
+      fbl::String name = fbl::StringPrintf("Parallel/%s/%zuThreads",
+                                           GetNameForSize(blob_size).c_str(), num_threads);
+
+      TestInfo create_test;
+      create_test.name = fbl::StringPrintf("%s/CreateMerkle", name.c_str());
+      create_test.test_fn = [test](perftest::RepeatState* state, Fixture* fixture) {
+        return test->CreateMerkleTest(state, fixture);
+      };
+      testcase.tests.push_back(std::move(create_test));
+
+      TestInfo verify_test;
+      verify_test.name = fbl::StringPrintf("%s/VerifyMerkle", name.c_str());
+      verify_test.test_fn = [test](perftest::RepeatState* state, Fixture* fixture) {
+        return test->VerifyMerkleTest(state, fixture);
+      };
+      testcase.tests.push_back(std::move(verify_test));
+
+      TestInfo decompress_test;
+      decompress_test.name = fbl::StringPrintf("%s/DecompressChunked", name.c_str());
+      decompress_test.test_fn = [test](perftest::RepeatState* state, Fixture* fixture) {
+        return test->DecompressTest(state, fixture);
+      };
+      testcase.tests.push_back(std::move(decompress_test));
+    }
+    testcases.push_back(std::move(testcase));
+  }
+
   return fs_test_utils::RunTestCases(f_opts, p_opts, testcases);
 }
 
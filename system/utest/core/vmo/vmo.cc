@@ -872,6 +872,58 @@ TEST(VmoTestCase, ZeroPage) {
   EXPECT_OK(zx_handle_close(vmo), "handle_close");
 }
 
+TEST(VmoTestCase, LargePages) {
+  // Large pages are 2MiB where the kernel supports them; on other configurations the vmo simply
+  // behaves like any other one, which is what this test checks.
+  constexpr size_t kLargePageSize = 2 * 1024 * 1024;
+  const size_t size = kLargePageSize * 2;
+
+  zx_handle_t vmo;
+  ASSERT_OK(zx_vmo_create(size, ZX_VMO_LARGE_PAGES, &vmo));
+
+  // A commit either commits the whole range or fails and leaves it alone.
+  zx_status_t status = zx_vmo_op_range(vmo, ZX_VMO_OP_COMMIT, 0, size, nullptr, 0);
+  zx_info_vmo_t info;
+  ASSERT_OK(zx_object_get_info(vmo, ZX_INFO_VMO, &info, sizeof(info), nullptr, nullptr));
+  if (status == ZX_OK) {
+    EXPECT_EQ(size, info.committed_bytes);
+  } else {
+    EXPECT_EQ(ZX_ERR_NO_MEMORY, status);
+    EXPECT_EQ(0u, info.committed_bytes);
+  }
+  ASSERT_OK(zx_vmo_op_range(vmo, ZX_VMO_OP_DECOMMIT, 0, size, nullptr, 0));
+
+  uintptr_t ptr[2];
+  for (auto &p : ptr) {
+    ASSERT_OK(
+        zx_vmar_map(zx_vmar_root_self(), ZX_VM_PERM_READ | ZX_VM_PERM_WRITE, 0, vmo, 0, size, &p));
+  }
+  volatile uint32_t *val = (volatile uint32_t *)ptr[0];
+  volatile uint32_t *val2 = (volatile uint32_t *)ptr[1];
+
+  // read fault the zero page into the first mapping
+  EXPECT_EQ(0u, val[0], "read zero");
+
+  // write fault a neighbour through the second mapping, which may commit the whole large page
+  val2[PAGE_SIZE / sizeof(uint32_t)] = 99;
+  EXPECT_EQ(99u, val[PAGE_SIZE / sizeof(uint32_t)], "neighbour visible in first mapping");
+
+  // the first page must no longer be the zero page in either mapping
+  uint32_t v = 100;
+  ASSERT_OK(zx_vmo_write(vmo, &v, 0, sizeof(v)));
+  EXPECT_EQ(100u, val[0], "vmo write visible in first mapping");
+  EXPECT_EQ(100u, val2[0], "vmo write visible in second mapping");
+
+  // and writes through one mapping show through the other
+  val[1] = 101;
+  EXPECT_EQ(101u, val2[1], "write visible in second mapping");
+
+  for (auto p : ptr) {
+    EXPECT_OK(zx_vmar_unmap(zx_vmar_root_self(), p, size), "unmap");
+  }
+  EXPECT_OK(zx_handle_close(vmo), "handle_close");
+}
+
 TEST(VmoTestCase, Cache) {
   zx_handle_t vmo;
   const size_t size = PAGE_SIZE;
@@ -7,6 +7,7 @@
 #include <stdlib.h>
 #include <sys/stat.h>
 
+#include <fbl/array.h>
 #include <fbl/function.h>
 #include <fbl/string.h>
 #include <fbl/string_buffer.h>
@@ -42,12 +43,13 @@ bool WriteBigFile(ssize_t data_size, perftest::RepeatState* state, Fixture* fixt
   fbl::unique_fd fd(open(GetBigFilePath(*fixture).c_str(), O_CREAT | O_WRONLY));
   ASSERT_TRUE(fd);
   state->DeclareStep("write");
-  uint8_t data[data_size];
+  // Large operations do not fit on the stack.
+  fbl::Array<uint8_t> data(new uint8_t[data_size], data_size);
   uint8_t pattern = static_cast<uint8_t>(rand_r(fixture->mutable_seed()) % (1 << 8));
-  memset(data, pattern, data_size);
+  memset(data.get(), pattern, data_size);
 
   while (state->KeepRunning()) {
-    ASSERT_EQ(write(fd.get(), data, data_size), data_size);
+    ASSERT_EQ(write(fd.get(), data.get(), data_size), data_size);
   }
 
   END_HELPER;
@@ -60,10 +62,10 @@ bool ReadBigFile(ssize_t data_size, perftest::RepeatState* state, Fixture* fixtu
   uint8_t pattern = static_cast<uint8_t>(rand_r(fixture->mutable_seed()) % (1 << 8));
   ASSERT_TRUE(fd);
   state->DeclareStep("read");
-  uint8_t data[data_size];
+  fbl::Array<uint8_t> data(new uint8_t[data_size], data_size);
 
   while (state->KeepRunning()) {
-    ASSERT_EQ(read(fd.get(), data, data_size), data_size);
+    ASSERT_EQ(read(fd.get(), data.get(), data_size), data_size);
     ASSERT_EQ(data[0], pattern);
   }
 
@@ -159,6 +161,72 @@ class PathWalkOp {
   fbl::StringBuffer<fs_test_utils::kPathSize> path_;
 };
 
+// Wrapper so state can be shared across calls.
+//
+// Creates, stats and unlinks a file per iteration, all in the same directory, so that the cost of
+// each operation is dominated by the directory lookup once the directory is large.
+class LargeDirectoryOp {
+ public:
+  LargeDirectoryOp() = default;
+  LargeDirectoryOp(const LargeDirectoryOp&) = delete;
+  LargeDirectoryOp(LargeDirectoryOp&&) = delete;
+  LargeDirectoryOp& operator=(const LargeDirectoryOp&) = delete;
+  LargeDirectoryOp& operator=(LargeDirectoryOp&&) = delete;
+  ~LargeDirectoryOp() = default;
+
+  // Will create entries until |state::KeepGoing| returns false.
+  bool Create(perftest::RepeatState* state, Fixture* fixture) {
+    BEGIN_HELPER;
+    fbl::String dir = GetDirPath(*fixture);
+    ASSERT_EQ(mkdir(dir.c_str(), 0666), 0);
+    count_ = 0;
+    while (state->KeepRunning()) {
+      fbl::unique_fd fd(open(GetEntryPath(*fixture, count_).c_str(), O_CREAT | O_EXCL | O_RDWR));
+      ASSERT_TRUE(fd);
+      count_++;
+    }
+    END_HELPER;
+  }
+
+  // Will stat the created entries until |state::KeepGoing| returns false.
+  bool Stat(perftest::RepeatState* state, Fixture* fixture) {
+    BEGIN_HELPER;
+    uint32_t entry = 0;
+    while (state->KeepRunning()) {
+      struct stat buff;
+      ASSERT_EQ(stat(GetEntryPath(*fixture, entry).c_str(), &buff), 0);
+      entry = (entry + 1) % count_;
+    }
+    END_HELPER;
+  }
+
+  // Will unlink the created entries until |state::KeepGoing| returns false.
+  bool Unlink(perftest::RepeatState* state, Fixture* fixture) {
+    BEGIN_HELPER;
+    uint32_t entry = 0;
+    while (state->KeepRunning() && entry < count_) {
+      ASSERT_EQ(unlink(GetEntryPath(*fixture, entry).c_str()), 0);
+      entry++;
+    }
+    for (; entry < count_; entry++) {
+      ASSERT_EQ(unlink(GetEntryPath(*fixture, entry).c_str()), 0);
+    }
+    ASSERT_EQ(rmdir(GetDirPath(*fixture).c_str()), 0);
+    END_HELPER;
+  }
+
+ private:
+  static fbl::String GetDirPath(const Fixture& fixture) {
+    return fbl::StringPrintf("%s/large-dir", fixture.fs_path().c_str());
+  }
+
+  static fbl::String GetEntryPath(const Fixture& fixture, uint32_t entry) {
+    return fbl::StringPrintf("%s/large-dir/file-%08u", fixture.fs_path().c_str(), entry);
+  }
+
+  uint32_t count_ = 0;
+};
+
 }  // namespace
 
 bool RunBenchmark(int argc, char** argv) {
@@ -201,6 +269,35 @@ bool RunBenchmark(int argc, char** argv) {
     testcases.push_back(std::move(testcase));
   }
 
+  // Large sequential Read Write tests, which write files of up to 256 MiB.
+  const int large_rw_test_sample_counts[] = {
+      64,
+      256,
+  };
+  for (int test_sample_count : large_rw_test_sample_counts) {
+    TestCaseInfo testcase;
+    testcase.sample_count = test_sample_count;
+    testcase.name = fbl::StringPrintf("%s/Bigfile/1Mbytes/%d-Ops",
+                                      disk_format_string_[f_opts.fs_type], test_sample_count);
+    testcase.teardown = false;
+
+    TestInfo write_test, read_test;
+    write_test.name = fbl::StringPrintf("%s/Write", testcase.name.c_str());
+    write_test.test_fn = [](perftest::RepeatState* state, Fixture* fixture) {
+      return WriteBigFile(1 << 20, state, fixture);
+    };
+    write_test.required_disk_space = test_sample_count * (1 << 20);
+    testcase.tests.push_back(std::move(write_test));
+
+    read_test.name = fbl::StringPrintf("%s/Read", testcase.name.c_str());
+    read_test.test_fn = [](perftest::RepeatState* state, Fixture* fixture) {
+      return ReadBigFile(1 << 20, state, fixture);
+    };
+    read_test.required_disk_space = test_sample_count * (1 << 20);
+    testcase.tests.push_back(std::move(read_test));
+    testcases.push_back(std::move(testcase));
+  }
+
   // Path walk tests.
   const int path_walk_sample_counts[] = {
       125,
@@ -234,6 +331,39 @@ bool RunBenchmark(int argc, char** argv) {
     testcases.push_back(std::move(testcase));
   }
 
+  // Large directory tests. The largest count stays below the default inode count of minfs.
+  const int large_dir_sample_counts[] = {
+      1000,
+      10000,
+      30000,
+  };
+
+  LargeDirectoryOp ld_op;
+  for (int test_sample_count : large_dir_sample_counts) {
+    TestCaseInfo testcase;
+    testcase.name = fbl::StringPrintf("%s/LargeDirectory/%d-Entries",
+                                      disk_format_string_[f_opts.fs_type], test_sample_count);
+    testcase.sample_count = test_sample_count;
+    testcase.teardown = false;
+
+    TestInfo create_test;
+    create_test.name = fbl::StringPrintf("%s/Create", testcase.name.c_str());
+    create_test.test_fn = fbl::BindMember(&ld_op, &LargeDirectoryOp::Create);
+    testcase.tests.push_back(std::move(create_test));
+
+    TestInfo stat_test;
+    stat_test.name = fbl::StringPrintf("%s/Stat", testcase.name.c_str());
+    stat_test.test_fn = fbl::BindMember(&ld_op, &LargeDirectoryOp::Stat);
+    testcase.tests.push_back(std::move(stat_test));
+
+    TestInfo unlink_test;
+    unlink_test.name = fbl::StringPrintf("%s/Unlink", testcase.name.c_str());
+    unlink_test.test_fn = fbl::BindMember(&ld_op, &LargeDirectoryOp::Unlink);
+    testcase.tests.push_back(std::move(unlink_test));
+
+    testcases.push_back(std::move(testcase));
+  }
+
   return fs_test_utils::RunTestCases(f_opts, p_opts, testcases);
 }
 }  // namespace fs_bench
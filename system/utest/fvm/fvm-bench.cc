@@ -0,0 +1,185 @@
+// Copyright 2019 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Measures concurrent random I/O to a partition of a ramdisk-backed FVM, whose slices are either
+// physically contiguous or interleaved so that most requests spanning a slice boundary must be
+// split.
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <thread>
+#include <utility>
+
+#include <fbl/array.h>
+#include <fbl/string_printf.h>
+#include <fbl/unique_fd.h>
+#include <fbl/vector.h>
+#include <fs-test-utils/fixture.h>
+#include <fs-test-utils/perftest.h>
+#include <fuchsia/hardware/block/c/fidl.h>
+#include <fuchsia/hardware/block/volume/c/fidl.h>
+#include <lib/fzl/fdio.h>
+#include <perftest/perftest.h>
+#include <unittest/unittest.h>
+
+namespace {
+
+using fs_test_utils::Fixture;
+using fs_test_utils::FixtureOptions;
+using fs_test_utils::PerformanceTestOptions;
+using fs_test_utils::TestCaseInfo;
+using fs_test_utils::TestInfo;
+
+constexpr size_t kSliceSize = fs_test_utils::kFvmBlockSize * 16;
+// Number of slices used by the benchmark, besides the first slice allocated by the fixture.
+constexpr uint64_t kSliceCount = 256;
+constexpr size_t kOpsPerThread = 64;
+
+enum class Layout {
+  // Consecutive virtual slices map to consecutive physical slices.
+  kContiguous,
+  // Consecutive virtual slices map to physical slices which are not consecutive.
+  kInterleaved,
+};
+
+// Extends the partition to |kSliceCount| slices after the first, laid out as |layout|. Does
+// nothing if the partition was already extended.
+bool ExtendPartition(Layout layout, Fixture* fixture) {
+  BEGIN_HELPER;
+  fbl::unique_fd fd(open(fixture->partition_path().c_str(), O_RDWR));
+  ASSERT_TRUE(fd);
+  fzl::UnownedFdioCaller caller(fd.get());
+
+  zx_status_t status;
+  fuchsia_hardware_block_BlockInfo info;
+  ASSERT_EQ(fuchsia_hardware_block_BlockGetInfo(caller.borrow_channel(), &status, &info), ZX_OK);
+  ASSERT_EQ(status, ZX_OK);
+  if (info.block_count * info.block_size > kSliceSize) {
+    return true;
+  }
+
+  auto extend = [&](uint64_t vslice, uint64_t count) {
+    return fuchsia_hardware_block_volume_VolumeExtend(caller.borrow_channel(), vslice, count,
+                                                      &status) == ZX_OK &&
+           status == ZX_OK;
+  };
+  if (layout == Layout::kContiguous) {
+    ASSERT_TRUE(extend(1, kSliceCount));
+  } else {
+    // Allocating the odd slices before the even ones maps neighbouring slices to physical slices
+    // which are far apart.
+    for (uint64_t first = 1; first <= 2; first++) {
+      for (uint64_t vslice = first; vslice <= kSliceCount; vslice += 2) {
+        ASSERT_TRUE(extend(vslice, 1));
+      }
+    }
+  }
+  END_HELPER;
+}
+
+// Issues |kOpsPerThread| reads or writes of |op_size| bytes at random offsets from each of
+// |thread_count| threads.
+bool RandomIo(Layout layout, bool write, size_t op_size, size_t thread_count,
+              perftest::RepeatState* state, Fixture* fixture) {
+  BEGIN_HELPER;
+  ASSERT_TRUE(ExtendPartition(layout, fixture));
+
+  fbl::Vector<fbl::unique_fd> fds;
+  for (size_t i = 0; i < thread_count; i++) {
+    fbl::unique_fd fd(open(fixture->partition_path().c_str(), O_RDWR));
+    ASSERT_TRUE(fd);
+    fds.push_back(std::move(fd));
+  }
+  const off_t op_count = static_cast<off_t>(kSliceCount * kSliceSize / op_size);
+
+  state->DeclareStep(write ? "write" : "read");
+  while (state->KeepRunning()) {
+    std::atomic<size_t> failures = 0;
+    fbl::Vector<std::thread> threads;
+    for (size_t i = 0; i < thread_count; i++) {
+      unsigned int seed = rand_r(fixture->mutable_seed());
+      int fd = fds[i].get();
+      threads.push_back(std::thread([&failures, seed, fd, write, op_size, op_count]() mutable {
+        fbl::Array<uint8_t> data(new uint8_t[op_size], op_size);
+        memset(data.get(), static_cast<uint8_t>(seed), op_size);
+        for (size_t op = 0; op < kOpsPerThread; op++) {
+          // Offsets are aligned to half of the operation size, so that some operations span
+          // two slices.
+          off_t offset = kSliceSize + (rand_r(&seed) % (2 * op_count - 1)) * (op_size / 2);
+          ssize_t result = write ? pwrite(fd, data.get(), op_size, offset)
+                                 : pread(fd, data.get(), op_size, offset);
+          if (result != static_cast<ssize_t>(op_size)) {
+            failures++;
+          }
+        }
+      }));
+    }
+    for (std::thread& thread : threads) {
+      thread.join();
+    }
+    ASSERT_EQ(failures.load(), 0);
+  }
+  END_HELPER;
+}
+
+bool RunBenchmark(int argc, char** argv) {
+  FixtureOptions f_opts = FixtureOptions::Default(DISK_FORMAT_MINFS);
+  f_opts.use_fvm = true;
+  f_opts.fvm_slice_size = kSliceSize;
+  f_opts.ramdisk_block_count = 2 * (kSliceCount + 1) * kSliceSize / f_opts.ramdisk_block_size;
+  f_opts.fs_format = false;
+  f_opts.fs_mount = false;
+  PerformanceTestOptions p_opts;
+  constexpr uint32_t kSampleCount = 100;
+  const size_t op_sizes[] = {
+      8 * 1024,
+      64 * 1024,
+  };
+  const size_t thread_counts[] = {
+      1,
+      4,
+      8,
+  };
+
+  if (!fs_test_utils::ParseCommandLineArgs(argc, argv, &f_opts, &p_opts)) {
+    return false;
+  }
+
+  fbl::Vector<TestCaseInfo> testcases;
+  for (Layout layout : {Layout::kContiguous, Layout::kInterleaved}) {
+    TestCaseInfo testcase;
+    testcase.name = fbl::StringPrintf(
+        "Fvm/RandomIo/%s", (layout == Layout::kContiguous) ? "Contiguous" : "Interleaved");
+    testcase.teardown = false;
+    testcase.sample_count = kSampleCount;
+    for (size_t op_size : op_sizes) {
+      for (size_t thread_count : thread_counts) {
+        for (bool write : {false, true}) {
+          TestInfo test;
+          test.name = fbl::StringPrintf("%s/%zuKbytes/%zuThreads/%s", testcase.name.c_str(),
+                                        op_size / 1024, thread_count, write ? "Write" : "Read");
+          test.test_fn = [layout, write, op_size, thread_count](perftest::RepeatState* state,
+                                                                Fixture* fixture) {
+            return RandomIo(layout, write, op_size, thread_count, state, fixture);
+          };
+          testcase.tests.push_back(std::move(test));
+        }
+      }
+    }
+    testcases.push_back(std::move(testcase));
+  }
+
+  return fs_test_utils::RunTestCases(f_opts, p_opts, testcases);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  return fs_test_utils::RunWithMemFs([argc, argv]() { return RunBenchmark(argc, argv) ? 0 : -1; });
+}
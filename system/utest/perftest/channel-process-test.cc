@@ -0,0 +1,90 @@
+// Copyright 2019 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <lib/zx/channel.h>
+#include <lib/zx/event.h>
+#include <lib/zx/job.h>
+#include <lib/zx/process.h>
+#include <lib/zx/thread.h>
+#include <lib/zx/vmar.h>
+#include <mini-process/mini-process.h>
+#include <zircon/assert.h>
+#include <zircon/syscalls.h>
+
+#include <thread>
+
+#include <perftest/perftest.h>
+
+namespace {
+
+// Measure the time taken to send a message on a channel to a thread in this process and receive
+// its reply. The thread runs in the same address space, so switching to it does not switch
+// page tables.
+bool ChannelRoundTripThreadTest(perftest::RepeatState* state) {
+  zx::channel local, remote;
+  ZX_ASSERT(zx::channel::create(0, &local, &remote) == ZX_OK);
+
+  std::thread echo([&remote] {
+    for (;;) {
+      zx_signals_t observed;
+      ZX_ASSERT(remote.wait_one(ZX_CHANNEL_READABLE | ZX_CHANNEL_PEER_CLOSED,
+                                zx::time::infinite(), &observed) == ZX_OK);
+      if (!(observed & ZX_CHANNEL_READABLE)) {
+        return;
+      }
+      uint32_t message;
+      ZX_ASSERT(remote.read(0, &message, sizeof(message), nullptr, nullptr, 0, nullptr) ==
+                ZX_OK);
+      ZX_ASSERT(remote.write(0, &message, sizeof(message), nullptr, 0) == ZX_OK);
+    }
+  });
+
+  uint32_t message = 0;
+  while (state->KeepRunning()) {
+    ZX_ASSERT(local.write(0, &message, sizeof(message), nullptr, 0) == ZX_OK);
+    ZX_ASSERT(local.wait_one(ZX_CHANNEL_READABLE, zx::time::infinite(), nullptr) == ZX_OK);
+    ZX_ASSERT(local.read(0, &message, sizeof(message), nullptr, nullptr, 0, nullptr) == ZX_OK);
+  }
+
+  local.reset();
+  echo.join();
+  return true;
+}
+
+// Measure the time taken to send a message on a channel to another process and receive its
+// reply. Every round trip switches between the address spaces of the two processes, so
+// comparing with ChannelRoundTripThreadTest shows the cost of those switches, including TLB
+// misses after them.
+bool ChannelRoundTripProcessTest(perftest::RepeatState* state) {
+  zx::process process;
+  zx::vmar vmar;
+  static const char kName[] = "perftest-echo";
+  ZX_ASSERT(zx::process::create(*zx::job::default_job(), kName, sizeof(kName) - 1, 0, &process,
+                                &vmar) == ZX_OK);
+  zx::thread thread;
+  ZX_ASSERT(zx::thread::create(process, kName, sizeof(kName) - 1, 0, &thread) == ZX_OK);
+  zx::event event;
+  ZX_ASSERT(zx::event::create(0, &event) == ZX_OK);
+
+  // The mini-process replies to each command on its control channel.
+  zx_handle_t control;
+  ZX_ASSERT(start_mini_process_etc(process.get(), thread.release(), vmar.get(), event.release(),
+                                   true, &control) == ZX_OK);
+
+  while (state->KeepRunning()) {
+    ZX_ASSERT(mini_process_cmd(control, MINIP_CMD_ECHO_MSG, nullptr) == ZX_OK);
+  }
+
+  zx_handle_close(control);
+  ZX_ASSERT(process.kill() == ZX_OK);
+  return true;
+}
+
+void RegisterTests() {
+  perftest::RegisterTest("Channel/RoundTrip/Thread", ChannelRoundTripThreadTest);
+  perftest::RegisterTest("Channel/RoundTrip/Process", ChannelRoundTripProcessTest);
+}
+PERFTEST_CTOR(RegisterTests)
+
+}  // namespace
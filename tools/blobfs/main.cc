@@ -156,7 +156,12 @@ zx_status_t BlobfsCreator::CalculateRequiredSize(off_t* out) {
         blobfs::MerkleInfo info;
         fbl::unique_fd data_fd(open(path, O_RDONLY, 0644));
 
-        if ((res = blobfs::blobfs_preprocess(data_fd.get(), ShouldCompress(), &info)) != ZX_OK) {
+        // Once there are fewer blobs left than threads, the idle threads' share goes to hashing
+        // the remaining blobs, so a few large blobs at the end don't run on a single core each.
+        size_t remaining = blob_list_.size() - i;
+        size_t hash_threads = remaining < n_threads ? n_threads / remaining : 1;
+        if ((res = blobfs::blobfs_preprocess(data_fd.get(), ShouldCompress(), &info,
+                                             hash_threads)) != ZX_OK) {
           mtx.lock();
           status = res;
           mtx.unlock();
@@ -11,6 +11,9 @@
 #include <string.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <vector>
+
 #include <fbl/unique_fd.h>
 
 constexpr uint32_t kChunkSize = 65536;
@@ -35,70 +38,58 @@ Usage: ktrace-pretty-print <path>\n\
        ktrace-pretty-print --help\n\
 ";
 
-static uint8_t buffer[kChunkSize];
-
-// Where to read from next.
-static uint8_t* current = buffer;
-
-// Limit of data read into |buffer|.
-static uint8_t* marker = buffer;
-
-static uint8_t* const end = buffer + kChunkSize;
-
 static size_t number_records_read = 0;
 static size_t number_bytes_read = 0;
 
-static inline size_t AvailableBytes() {
-  assert(marker >= current);
-  return marker - current;
-}
-
 static void PrintUsage(FILE* f) { fputs(kUsage, f); }
 
-static void ReadMoreData(int fd) {
-  memcpy(buffer, current, AvailableBytes());
-  marker = buffer + AvailableBytes();
-
-  while (marker < end) {
-    ssize_t bytes_read = read(fd, marker, end - marker);
-    if (bytes_read <= 0)
-      break;
-
-    marker += bytes_read;
+static bool ReadTrace(int fd, std::vector<uint8_t>* trace) {
+  uint8_t buffer[kChunkSize];
+  ssize_t bytes_read;
+  while ((bytes_read = read(fd, buffer, sizeof(buffer))) > 0) {
+    trace->insert(trace->end(), buffer, buffer + bytes_read);
   }
-
-  current = buffer;
+  return bytes_read == 0;
 }
 
-// no-inline for easier debugging in gdb
-__NO_INLINE static ktrace_header_t* ReadNextRecord(int fd) {
-  if (AvailableBytes() < sizeof(ktrace_header_t))
-    ReadMoreData(fd);
-
-  if (AvailableBytes() < sizeof(ktrace_header_t))
-    return nullptr;
-
-  ktrace_header_t* record = (ktrace_header_t*)current;
-
-  if (AvailableBytes() < KTRACE_LEN(record->tag))
-    ReadMoreData(fd);
-
-  if (AvailableBytes() < KTRACE_LEN(record->tag))
-    return nullptr;
+// A trace holds the metadata followed by the records of each cpu in turn, or
+// several such chunks when streamed. Split out the metadata, in the order read,
+// and merge the records of all cpus by timestamp. The padding at the end of each
+// cpu's buffer is dropped.
+static void SplitRecords(const std::vector<uint8_t>& trace,
+                         std::vector<const ktrace_header_t*>* metadata,
+                         std::vector<const ktrace_header_t*>* records) {
+  size_t offset = 0;
+  while (offset + sizeof(ktrace_header_t) <= trace.size()) {
+    auto record = reinterpret_cast<const ktrace_header_t*>(&trace[offset]);
+
+    // If the record has zero length we're hosed.
+    if (KTRACE_LEN(record->tag) == 0) {
+      printf("Zero length tag, done.\n");
+      break;
+    }
+    if (offset + KTRACE_LEN(record->tag) > trace.size()) {
+      break;
+    }
+    offset += KTRACE_LEN(record->tag);
 
-  record = (ktrace_header_t*)current;
+    number_bytes_read += KTRACE_LEN(record->tag);
+    number_records_read += 1;
 
-  // If the record has zero length we're hosed.
-  if (KTRACE_LEN(record->tag) == 0) {
-    printf("Zero length tag, done.\n");
-    return nullptr;
+    if (KTRACE_EVENT(record->tag) == KTRACE_EVENT(TAG_PAD)) {
+      continue;
+    }
+    if (KTRACE_GROUP(record->tag) & KTRACE_GRP_META) {
+      metadata->push_back(record);
+    } else {
+      records->push_back(record);
+    }
   }
 
-  current += KTRACE_LEN(record->tag);
-
-  number_bytes_read += KTRACE_LEN(record->tag);
-  number_records_read += 1;
-  return record;
+  // Records from each cpu are already nearly in order; a stable sort keeps
+  // records with equal timestamps in the order they were recorded.
+  std::stable_sort(records->begin(), records->end(),
+                   [](const ktrace_header_t* a, const ktrace_header_t* b) { return a->ts < b->ts; });
 }
 
 static void PrintTag(uint32_t tag) {
@@ -112,53 +103,67 @@ static void PrintTag(uint32_t tag) {
   }
 }
 
-static void Dump16B(const TagInfo* info, ktrace_header_t* r) {
+static void Dump16B(const TagInfo* info, const ktrace_header_t* r) {
   printf("%" PRIu64 ": ", r->ts);
   PrintTag(r->tag);
   // TODO(dje): Further decode args.
   printf(", arg 0x%x\n", r->tid);
 }
 
-static void Dump32B(const TagInfo* info, ktrace_rec_32b_t* r) {
+static void Dump32B(const TagInfo* info, const ktrace_rec_32b_t* r) {
   printf("%" PRIu64 ": ", r->ts);
   PrintTag(r->tag);
   // TODO(dje): Further decode args.
   printf(", tid 0x%x, a 0x%x, b 0x%x, c 0x%x, d 0x%x\n", r->tid, r->a, r->b, r->c, r->d);
 }
 
-static void DumpName(const TagInfo* info, ktrace_rec_name_t* r) {
+static void DumpName(const TagInfo* info, const ktrace_rec_name_t* r) {
   PrintTag(r->tag);
   printf(", id 0x%x, arg 0x%x, %s\n", r->id, r->arg, r->name);
 }
 
+static void DumpRecord(const ktrace_header_t* record) {
+  uint32_t event = KTRACE_EVENT(record->tag);
+  if (event >= countof(g_tags)) {
+    printf("Unexpected event: 0x%x\n", event);
+    return;
+  }
+  const TagInfo* info = &g_tags[event];
+  if (info->name == nullptr) {
+    printf("Unexpected event: 0x%x\n", event);
+    return;
+  }
+  switch (info->type) {
+    case Tag16B:
+      Dump16B(info, record);
+      break;
+    case Tag32B:
+      Dump32B(info, (const ktrace_rec_32b_t*)record);
+      break;
+    case TagNAME:
+      DumpName(info, (const ktrace_rec_name_t*)record);
+      break;
+    default:
+      printf("Unexpected tag type: 0x%x\n", info->type);
+      break;
+  }
+}
+
 static int DoDump(const fbl::unique_fd& fd) {
-  ktrace_header_t* record;
+  std::vector<uint8_t> trace;
+  if (!ReadTrace(fd.get(), &trace)) {
+    fprintf(stderr, "I/O error reading trace\n");
+    return EXIT_FAILURE;
+  }
 
-  while ((record = ReadNextRecord(fd.get())) != nullptr) {
-    uint32_t event = KTRACE_EVENT(record->tag);
-    if (event >= countof(g_tags)) {
-      printf("Unexpected event: 0x%x\n", event);
-      continue;
-    }
-    const TagInfo* info = &g_tags[event];
-    if (info->name == nullptr) {
-      printf("Unexpected event: 0x%x\n", event);
-      continue;
-    }
-    switch (info->type) {
-      case Tag16B:
-        Dump16B(info, record);
-        break;
-      case Tag32B:
-        Dump32B(info, (ktrace_rec_32b_t*)record);
-        break;
-      case TagNAME:
-        DumpName(info, (ktrace_rec_name_t*)record);
-        break;
-      default:
-        printf("Unexpected tag type: 0x%x\n", info->type);
-        break;
-    }
+  std::vector<const ktrace_header_t*> metadata;
+  std::vector<const ktrace_header_t*> records;
+  SplitRecords(trace, &metadata, &records);
+  for (const ktrace_header_t* record : metadata) {
+    DumpRecord(record);
+  }
+  for (const ktrace_header_t* record : records) {
+    DumpRecord(record);
   }
 
   printf("%zu records, %zu bytes\n", number_records_read, number_bytes_read);
@@ -69,7 +69,8 @@ int handle_argument(char** argv, const char* arg, std::vector<FileEntry>* entrie
   }
 }
 
-void handle_entry(FileEntry* entry) {
+// Hashes the file named by |entry| on up to |num_threads| threads.
+void handle_entry(FileEntry* entry, size_t num_threads) {
   fbl::unique_fd fd{open(entry->filename.c_str(), O_RDONLY)};
   if (!fd) {
     perror(entry->filename.c_str());
@@ -103,7 +104,8 @@ void handle_entry(FileEntry* entry) {
     perror("mmap");
     exit(1);
   }
-  zx_status_t rc = MerkleTree::Create(data, info.st_size, tree.get(), len, &digest);
+  zx_status_t rc =
+      MerkleTree::CreateParallel(data, info.st_size, tree.get(), len, &digest, num_threads);
   if (info.st_size != 0 && munmap(data, info.st_size) != 0) {
     perror("munmap");
     exit(1);
@@ -154,6 +156,7 @@ int main(int argc, char** argv) {
   if (!n_threads) {
     n_threads = 4;
   }
+  const size_t n_cpus = n_threads;
   if (n_threads > entries.size()) {
     n_threads = entries.size();
   }
@@ -166,7 +169,10 @@ int main(int argc, char** argv) {
         if (j >= entries.size()) {
           return;
         }
-        handle_entry(&entries[j]);
+        // Once there are fewer files left than CPUs, the idle CPUs are used to hash the
+        // remaining files.
+        size_t remaining = entries.size() - j;
+        handle_entry(&entries[j], remaining < n_cpus ? n_cpus / remaining : 1);
       }
     }));
   }
@@ -177,6 +177,7 @@ bool MinfsCreator::IsOptionValid(Option option) {
     case Option::kReadonly:
     case Option::kOffset:
     case Option::kLength:
+    case Option::kExtents:
     case Option::kHelp:
       return true;
     default:
@@ -323,8 +324,10 @@ zx_status_t MinfsCreator::CalculateRequiredSize(off_t* out) {
 
   // This is a rough estimate of how many directory data blocks will be needed.
   // This is not super robust and will not hold up if directories start requiring indirect blocks,
-  // but for our current purposes it should be sufficient.
-  uint32_t dir_blocks = ToU32(dir_count + (dir_bytes_ / minfs::kMinfsBlockSize));
+  // but for our current purposes it should be sufficient. Directories which outgrow a single block
+  // are indexed, and the buckets of an indexed directory may be as little as half full, so the
+  // directory entries are counted twice.
+  uint32_t dir_blocks = ToU32(dir_count + (2 * dir_bytes_ / minfs::kMinfsBlockSize));
 
   minfs::Superblock info;
   info.flags = 0;
@@ -360,7 +363,9 @@ zx_status_t MinfsCreator::Mkfs() {
   }
 
   // Consume the bcache to mkfs.
-  if ((status = minfs::Mkfs(std::move(bc))) != ZX_OK) {
+  minfs::MountOptions options = {};
+  options.extents = ShouldUseExtents();
+  if ((status = minfs::Mkfs(options, std::move(bc))) != ZX_OK) {
     return status;
   }
 